@@ -28,8 +28,13 @@
 #endif
 
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/can_dcmd.h>
 
+#include <dev-can-linux/shmring.h>
+#include <dev-can-linux/trace.h>
+
 #if DEVCANLINUX_SYSLOG == 1
 # define SYSLOG_ERR(fmt, arg...) syslog(LOG_ERR, fmt, ##arg)
 #else
@@ -53,6 +58,276 @@
  */
 #define EXT_CAN_CMD_CODE                    0x54
 #define EXT_CAN_DEVCTL_SET_LATENCY_LIMIT_MS __DIOT(_DCMD_MISC, EXT_CAN_CMD_CODE + 0,  uint32_t)
+#define EXT_CAN_DEVCTL_RX_FRAME_TS_NOBLOCK  __DIOF(_DCMD_MISC, EXT_CAN_CMD_CODE + 1,  struct can_msg_ts)
+#define EXT_CAN_DEVCTL_RX_FRAME_TS_BLOCK    __DIOF(_DCMD_MISC, EXT_CAN_CMD_CODE + 2,  struct can_msg_ts)
+#define EXT_CAN_DEVCTL_GET_TIMESTAMP_NS     __DIOF(_DCMD_MISC, EXT_CAN_CMD_CODE + 3,  uint64_t)
+#define EXT_CAN_DEVCTL_SET_RECORD_MODE      __DIOT(_DCMD_MISC, EXT_CAN_CMD_CODE + 4,  uint32_t)
+#define EXT_CAN_DEVCTL_SHM_ATTACH           __DIOTF(_DCMD_MISC, EXT_CAN_CMD_CODE + 5, struct can_shm_attach)
+#define EXT_CAN_DEVCTL_SHM_TX_KICK          __DION(_DCMD_MISC, EXT_CAN_CMD_CODE + 6)
+#define EXT_CAN_DEVCTL_GET_POOL_STATS       __DIOF(_DCMD_MISC, EXT_CAN_CMD_CODE + 7,  struct can_pool_stats)
+#define EXT_CAN_DEVCTL_GW_ADD_RULE          __DIOTF(_DCMD_MISC, EXT_CAN_CMD_CODE + 8, struct can_gw_rule)
+#define EXT_CAN_DEVCTL_GW_GET_STATS         __DIOTF(_DCMD_MISC, EXT_CAN_CMD_CODE + 9, struct can_gw_stats)
+#define EXT_CAN_DEVCTL_GW_FLUSH             __DIOT(_DCMD_MISC, EXT_CAN_CMD_CODE + 10, uint32_t)
+#define EXT_CAN_DEVCTL_GET_EXT_STATS        __DIOF(_DCMD_MISC, EXT_CAN_CMD_CODE + 11, struct can_ext_stats)
+#define EXT_CAN_DEVCTL_GET_BUSLOAD          __DIOF(_DCMD_MISC, EXT_CAN_CMD_CODE + 12, struct can_busload)
+#define EXT_CAN_DEVCTL_GET_BUSLOAD_IDS      __DIOTF(_DCMD_MISC, EXT_CAN_CMD_CODE + 13, struct can_busload_ids)
+#define EXT_CAN_DEVCTL_GET_LATENCY          __DIOTF(_DCMD_MISC, EXT_CAN_CMD_CODE + 14, struct can_latency)
+#define EXT_CAN_DEVCTL_GET_TRACE            __DIOTF(_DCMD_MISC, EXT_CAN_CMD_CODE + 15, struct can_trace)
+
+/*
+ * Extended frame record; the standard CAN message together with its 64-bit
+ * receive timestamp in nanoseconds. The timestamp is taken when the IRQ pulse
+ * of the frame is received by the driver and shares its time base with
+ * EXT_CAN_DEVCTL_GET_TIMESTAMP_NS. The legacy millisecond timestamp
+ * canmsg.ext.timestamp is still set as before.
+ */
+struct can_msg_ts {
+    struct can_msg canmsg;
+    uint64_t timestamp_ns;
+};
+
+/*
+ * Shared memory ring attach request and reply. The ring carries struct
+ * can_msg_ts records; from the driver to the client on RX channels and from
+ * the client to the driver on TX channels. The driver delivers event, which
+ * must be registered with MsgRegisterEvent(), when the RX ring goes from empty
+ * to non-empty while the client waits on it; SIGEV_NONE disables this.
+ */
+struct can_shm_attach {
+    struct sigevent event;  /* in: RX doorbell */
+    uint32_t slots;         /* in: power of two, 0 for the default of 1024 */
+    uint32_t size;          /* out: size of the shared memory object */
+    shm_handle_t handle;    /* out: for shm_open_handle() */
+};
+
+/*
+ * Frame buffer pool occupancy; one entry per buffer cache of the driver. The
+ * pools are shared by all devices and sized with driver option -M. A non-zero
+ * failures count means frames were dropped for want of a buffer.
+ */
+#define CAN_POOL_STATS_MAX      4
+#define CAN_POOL_NAME_MAX       16
+
+struct can_pool_stats {
+    uint32_t num_pools;
+    uint32_t reserved;
+
+    struct {
+        char name[CAN_POOL_NAME_MAX];
+        uint32_t objects;       /* pool size */
+        uint32_t in_use;        /* buffers currently allocated */
+        uint32_t high_water;    /* maximum of in_use since driver start */
+        uint32_t failures;      /* allocations failed on an empty pool */
+    } pool[CAN_POOL_STATS_MAX];
+};
+
+/*
+ * Gateway routing rule; frames received on device src whose id matches id
+ * under mask are queued straight to the transmit queue of device dst, after
+ * the optional id rewrite and payload modification. Device numbers are those
+ * of the /dev/canN/ paths. Ids are Linux style CAN ids, i.e. the standard
+ * 11-bit id is not shifted up as it is in a MID, with CAN_GW_EFF set for
+ * extended 29-bit ids; a rule only matches frames of its own id type.
+ *
+ * Frames forwarded by a rule are not forwarded again, and neither are the TX
+ * echoes of a device. The rules are shared by all devices and can be added
+ * through any of their file descriptors, or with driver option -g.
+ * EXT_CAN_DEVCTL_GW_FLUSH removes the rules from the given index on; 0 removes
+ * them all.
+ */
+#define CAN_GW_MAX_RULES        64
+
+#define CAN_GW_EFF              0x80000000U /* id, new_id: extended 29-bit id */
+
+#define CAN_GW_SET_ID           0x00000001U /* flags: rewrite the id to new_id */
+#define CAN_GW_MOD_DATA         0x00000002U /* flags: data AND, OR then XOR */
+
+struct can_gw_rule {
+    uint32_t src;               /* source device */
+    uint32_t dst;               /* destination device */
+    uint32_t id;                /* match */
+    uint32_t mask;              /* id bits compared */
+    uint32_t flags;
+    uint32_t new_id;            /* CAN_GW_SET_ID */
+    uint8_t and_data[8];        /* CAN_GW_MOD_DATA */
+    uint8_t or_data[8];
+    uint8_t xor_data[8];
+    uint32_t rate;              /* frames per second forwarded, 0 no limit */
+    uint32_t index;             /* out: rule index */
+};
+
+/*
+ * Gateway rule counters; hits counts the frames matched, drops those of them
+ * not queued, either over the rule's rate or for a full or absent destination
+ * transmit queue. rate_drops counts the former alone.
+ */
+struct can_gw_stats {
+    uint32_t index;             /* in: rule index */
+    uint32_t reserved;
+    uint64_t hits;
+    uint64_t drops;
+    uint64_t rate_drops;
+};
+
+/*
+ * Extended device statistics; every counter the driver keeps for the device of
+ * the file descriptor, counted since the driver started. rx_dropped and
+ * tx_dropped are the totals; the drop counters further down break them down
+ * by cause. Counters a device can't tell stay 0, e.g. rx_crc_errors and the
+ * interrupt counts of vcan devices.
+ */
+struct can_ext_stats {
+    /* frames */
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_errors;
+    uint64_t tx_errors;
+    uint64_t rx_dropped;
+    uint64_t tx_dropped;
+    uint64_t rx_length_errors;
+    uint64_t rx_over_errors;        /* controller receive overruns */
+    uint64_t rx_crc_errors;
+    uint64_t rx_frame_errors;
+    uint64_t rx_fifo_errors;
+    uint64_t rx_missed_errors;
+    uint64_t tx_aborted_errors;     /* pending frames aborted, e.g. bus-off */
+    uint64_t tx_carrier_errors;
+    uint64_t tx_fifo_errors;
+    uint64_t tx_heartbeat_errors;
+    uint64_t tx_window_errors;
+
+    /* controller */
+    uint64_t bus_error;
+    uint64_t error_warning;         /* changes to error warning state */
+    uint64_t error_passive;         /* changes to error passive state */
+    uint64_t bus_off;               /* changes to bus off state */
+    uint64_t arbitration_lost;
+    uint64_t restarts;
+
+    /* driver */
+    uint64_t interrupts;            /* interrupt sources serviced */
+    uint64_t rx_interrupts;
+    uint64_t tx_interrupts;
+    uint64_t error_interrupts;
+    uint64_t rx_queue_drops;        /* client receive queue or ring full */
+    uint64_t rx_stage_drops;        /* RX staging ring full */
+    uint64_t rx_latency_drops;      /* older than the client latency limit */
+    uint64_t tx_queue_drops;        /* device transmit queue full */
+    uint64_t alloc_failures;        /* frame buffer pools (-M) empty */
+};
+
+/*
+ * Bus load of the bus of a device; all frames seen on it, received and
+ * transmitted, over sliding windows of 100 ms, 1 s and 10 s. load is the
+ * share of the bus time the frames took at the device bitrate, in parts per
+ * million, counting the frame bits without dynamic bit stuffing but with the
+ * intermission; it is 0 when the bitrate is not known.
+ */
+#define CAN_BUSLOAD_WINDOWS     3
+
+struct can_busload {
+    uint32_t bitrate;           /* bit/s; 0 if unknown */
+    uint32_t reserved;
+    uint64_t frames;            /* since driver start */
+    uint64_t bits;
+
+    struct {
+        uint32_t window_ms;
+        uint32_t load;          /* ppm of the bus time */
+        uint64_t frames;
+        uint64_t bits;
+    } window[CAN_BUSLOAD_WINDOWS];
+};
+
+/*
+ * Per CAN id rates of a device's bus, CAN_BUSLOAD_IDS_MAX ids per call from
+ * index first on; num_ids is the number of ids known, count those returned.
+ * interval and jitter are moving averages of an id's inter-arrival time and
+ * of its deviation from that. Ids are Linux style with CAN_GW_EFF set for
+ * extended ids, as in struct can_gw_rule. Setting reset clears the ids once
+ * they are copied.
+ */
+#define CAN_BUSLOAD_IDS_MAX     32
+
+struct can_busload_ids {
+    uint32_t first;             /* in */
+    uint32_t reset;             /* in */
+    uint32_t num_ids;
+    uint32_t count;
+    uint64_t other_frames;      /* frames of ids beyond the table size */
+
+    struct {
+        uint32_t id;
+        uint32_t rate;          /* frames per 1000 s, from interval */
+        uint64_t frames;
+        uint64_t interval_ns;
+        uint64_t jitter_ns;
+        uint64_t age_ns;        /* since the id's latest frame */
+    } ids[CAN_BUSLOAD_IDS_MAX];
+};
+
+/*
+ * Latency histograms of the driver's frame pipeline stages. Each stage is
+ * timed from the end of the one before it; bucket b of a stage counts the
+ * times of [2^b, 2^(b+1)) ns, bucket 0 those under 2 ns and the last bucket
+ * all longer ones. scope selects the device's histograms, which take in the
+ * receive stages of all its client sessions, or those of the calling file
+ * descriptor's own session, which only has the receive stages. Setting reset
+ * clears the histograms once they are copied.
+ */
+#define CAN_LATENCY_BUCKETS     32
+
+#define CAN_LATENCY_DEVICE      0
+#define CAN_LATENCY_SESSION     1
+
+enum can_latency_stage {
+    CAN_LATENCY_RX_IRQ,         /* IRQ pulse receipt to frame read out */
+    CAN_LATENCY_RX_QUEUE,       /* read out to stored in the client queues */
+    CAN_LATENCY_RX_WAKE,        /* stored to taken by the client */
+    CAN_LATENCY_RX_REPLY,       /* first frame taken to the reply; per reply */
+    CAN_LATENCY_TX_QUEUE,       /* client write or devctl to dequeued */
+    CAN_LATENCY_TX_XMIT,        /* dequeued to handed to the controller */
+    CAN_LATENCY_TX_DONE,        /* handed to the controller to TX complete */
+    CAN_LATENCY_STAGES
+};
+
+struct can_latency {
+    uint32_t scope;             /* in */
+    uint32_t reset;             /* in */
+
+    struct {
+        uint64_t count[CAN_LATENCY_BUCKETS];
+        uint64_t sum_ns;
+        uint64_t max_ns;
+    } stage[CAN_LATENCY_STAGES];
+};
+
+/*
+ * Trace records of the driver's trace points, see dev-can-linux/trace.h. The
+ * driver keeps num_rings rings of the latest records, each written by one or
+ * more of its threads; up to CAN_TRACE_RECORDS_MAX records of ring ring are
+ * returned per call from position first on, oldest first, and next is the
+ * position to ask for in the following call. Records overwritten before they
+ * were read are skipped; lost counts them. Fails with ENOSYS when the driver
+ * is built without trace points (CONFIG_TRACE 0). The rings are shared by all
+ * devices and can be read through any of their file descriptors.
+ */
+#define CAN_TRACE_RECORDS_MAX   32
+
+struct can_trace {
+    uint32_t ring;              /* in */
+    uint32_t num_rings;
+    uint64_t first;             /* in */
+    uint64_t next;
+    uint64_t head;              /* records ever written to the ring */
+    uint64_t lost;
+    uint32_t count;
+    uint32_t reserved;
+
+    struct can_trace_record records[CAN_TRACE_RECORDS_MAX];
+};
 
 /**
  * Special Note
@@ -139,6 +414,333 @@ static inline int read_frame_raw_noblock (int filedes, struct can_msg* canmsg) {
     return EOK;
 }
 
+static inline int read_frame_ts_block (int filedes,
+        struct can_msg_ts* record)
+{
+    int ret;
+    struct can_msg_ts record_temp;
+    struct can_msg_ts* _record = &record_temp;
+
+    if (record) {
+        _record = record;
+    }
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_RX_FRAME_TS_BLOCK,
+            _record, sizeof(struct can_msg_ts), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_RX_FRAME_TS_BLOCK: %s\n",
+                strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int read_frame_ts_noblock (int filedes,
+        struct can_msg_ts* record)
+{
+    int ret;
+    struct can_msg_ts record_temp;
+    struct can_msg_ts* _record = &record_temp;
+
+    if (record) {
+        _record = record;
+    }
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_RX_FRAME_TS_NOBLOCK,
+            _record, sizeof(struct can_msg_ts), NULL )))
+    {
+        if (ret != EAGAIN) {
+            log_error("devctl EXT_CAN_DEVCTL_RX_FRAME_TS_NOBLOCK: %s\n",
+                    strerror(ret));
+        }
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int get_timestamp_ns (int filedes, uint64_t* value) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_GET_TIMESTAMP_NS,
+            value, sizeof(uint64_t), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_GET_TIMESTAMP_NS: %s\n",
+                strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int get_pool_stats (int filedes, struct can_pool_stats* stats) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_GET_POOL_STATS,
+            stats, sizeof(struct can_pool_stats), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_GET_POOL_STATS: %s\n",
+                strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int gw_add_rule (int filedes, struct can_gw_rule* rule) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_GW_ADD_RULE,
+            rule, sizeof(struct can_gw_rule), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_GW_ADD_RULE: %s\n", strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int gw_get_stats (int filedes, struct can_gw_stats* stats) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_GW_GET_STATS,
+            stats, sizeof(struct can_gw_stats), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_GW_GET_STATS: %s\n", strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int gw_flush (int filedes, uint32_t first) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_GW_FLUSH,
+            &first, sizeof(uint32_t), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_GW_FLUSH: %s\n", strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int get_ext_stats (int filedes, struct can_ext_stats* stats) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_GET_EXT_STATS,
+            stats, sizeof(struct can_ext_stats), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_GET_EXT_STATS: %s\n", strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int get_busload (int filedes, struct can_busload* load) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_GET_BUSLOAD,
+            load, sizeof(struct can_busload), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_GET_BUSLOAD: %s\n", strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int get_busload_ids (int filedes, struct can_busload_ids* ids) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_GET_BUSLOAD_IDS,
+            ids, sizeof(struct can_busload_ids), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_GET_BUSLOAD_IDS: %s\n",
+                strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int get_latency (int filedes, struct can_latency* latency) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_GET_LATENCY,
+            latency, sizeof(struct can_latency), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_GET_LATENCY: %s\n", strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int get_trace (int filedes, struct can_trace* trace) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_GET_TRACE,
+            trace, sizeof(struct can_trace), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_GET_TRACE: %s\n", strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+/*
+ * Binary record mode of a file descriptor; when enabled read() returns as many
+ * whole struct can_msg records as fit the buffer and write() takes an array of
+ * struct can_msg records. When disabled (default) read() and write() transfer
+ * message payload bytes only.
+ */
+static inline int set_record_mode (int filedes, uint32_t enable) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_SET_RECORD_MODE,
+            &enable, sizeof(uint32_t), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_SET_RECORD_MODE: %s\n",
+                strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+/**
+ * Switch the session over to a shared memory ring and map it into port. From
+ * then on received frames, or frames to write, go through the ring only; see
+ * read_frame_shm() and write_frame_shm(). To block on an empty RX ring call
+ * shmring_prepare_wait() and wait for event only when it returns 1.
+ */
+static inline int attach_shm_ring (int filedes, const struct sigevent* event,
+        uint32_t slots, shmring_port_t* port)
+{
+    int ret;
+    struct can_shm_attach attach = { .slots = slots };
+
+    if (event) {
+        attach.event = *event;
+    }
+    else {
+        SIGEV_NONE_INIT(&attach.event);
+    }
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_SHM_ATTACH,
+            &attach, sizeof(struct can_shm_attach), NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_SHM_ATTACH: %s\n", strerror(ret));
+
+        return ret;
+    }
+
+    int fd;
+
+    if ((fd = shm_open_handle(attach.handle, O_RDWR)) == -1) {
+        ret = errno;
+
+        log_error("shm_open_handle: %s\n", strerror(ret));
+
+        return ret;
+    }
+
+    void* mem = mmap(NULL, attach.size,
+            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    ret = errno;
+    close(fd);
+
+    if (mem == MAP_FAILED) {
+        log_error("mmap: %s\n", strerror(ret));
+
+        return ret;
+    }
+
+    if (EOK != (ret = shmring_attach(port,
+            mem, attach.size, sizeof(struct can_msg_ts))))
+    {
+        log_error("shmring_attach: %s\n", strerror(ret));
+
+        munmap(mem, attach.size);
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+static inline int kick_shm_tx (int filedes) {
+    int ret;
+
+    if (EOK != (ret = devctl(
+            filedes, EXT_CAN_DEVCTL_SHM_TX_KICK, NULL, 0, NULL )))
+    {
+        log_error("devctl EXT_CAN_DEVCTL_SHM_TX_KICK: %s\n", strerror(ret));
+
+        return ret;
+    }
+
+    return EOK;
+}
+
+/* Returns EAGAIN when the ring is full */
+static inline int write_frame_shm (int filedes, shmring_port_t* port,
+        const struct can_msg* canmsg)
+{
+    struct can_msg_ts record = { .canmsg = *canmsg };
+
+    if (shmring_push(port, &record) != EOK) {
+        return EAGAIN;
+    }
+
+    // Only a driver sleeping on the empty ring needs to be told
+    if (shmring_need_wakeup(port)) {
+        return kick_shm_tx(filedes);
+    }
+
+    return EOK;
+}
+
+/* Returns EAGAIN when the ring is empty */
+static inline int read_frame_shm (shmring_port_t* port,
+        struct can_msg_ts* record)
+{
+    return shmring_pop(port, record);
+}
+
 static inline int set_latency_limit_ms (int filedes, uint32_t value) {
     int ret;
 
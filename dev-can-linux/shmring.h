@@ -0,0 +1,271 @@
+/*
+ * \file    shmring.h
+ * \brief   Shared memory ring used to pass frames between driver and clients
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef DEV_CAN_LINUX_SHMRING_H_
+#define DEV_CAN_LINUX_SHMRING_H_
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef EOK
+#define EOK 0
+#endif
+
+/*
+ * Single producer, single consumer ring of fixed size records placed in a
+ * shared memory object. Only plain C and the GCC/Clang __atomic builtins are
+ * used so that the same code runs in the driver, in QNX clients and on a
+ * Linux host with POSIX shm for testing and benchmarking.
+ *
+ * Head and tail are free running 32-bit counters, each written by one side
+ * only and kept on its own cache line. Each side works through a private
+ * shmring_port_t which holds the ring geometry and a cached copy of the other
+ * side's counter; nothing the peer can write is trusted for addressing.
+ *
+ * The consumer never polls: when it finds the ring empty it calls
+ * shmring_prepare_wait() and only sleeps if that returns 1. The producer
+ * calls shmring_need_wakeup() after each push and rings the doorbell (a
+ * pulse, or a devctl towards the driver) only if it returns 1, i.e. when the
+ * ring went from empty to non-empty under a sleeping consumer.
+ */
+
+#define SHMRING_MAGIC       0x524e4143  /* "CANR" */
+#define SHMRING_VERSION     1
+#define SHMRING_CACHE_LINE  64
+#define SHMRING_MAX_SLOTS   (1u << 16)
+
+typedef struct shmring {
+    /* set once by shmring_init() */
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;         /* power of two */
+    uint32_t record_size;
+    uint8_t  _pad0[SHMRING_CACHE_LINE - 4*sizeof(uint32_t)];
+
+    uint32_t head;          /* written by the producer only */
+    uint8_t  _pad1[SHMRING_CACHE_LINE - sizeof(uint32_t)];
+
+    uint32_t tail;          /* written by the consumer only */
+    uint8_t  _pad2[SHMRING_CACHE_LINE - sizeof(uint32_t)];
+
+    uint32_t waiting;       /* set by a consumer about to sleep */
+    uint8_t  _pad3[SHMRING_CACHE_LINE - sizeof(uint32_t)];
+
+    /* slots*record_size bytes of records follow */
+} shmring_t;
+
+typedef struct shmring_port {
+    shmring_t* ring;
+    uint8_t* data;
+    uint32_t mask;
+    uint32_t record_size;
+    uint32_t cached;        /* last seen counter of the other side; the tail
+                               is a safe start value for either side */
+} shmring_port_t;
+
+
+/* Bytes of shared memory needed for a ring; 0 for an invalid geometry */
+static inline size_t shmring_size (uint32_t slots, uint32_t record_size) {
+    if (slots == 0 || slots > SHMRING_MAX_SLOTS || (slots & (slots - 1))
+            || record_size == 0)
+    {
+        return 0;
+    }
+
+    return sizeof(shmring_t) + (size_t)slots*record_size;
+}
+
+/* Format size bytes at mem as an empty ring; done by the creator only */
+static inline int shmring_init (void* mem, size_t size,
+        uint32_t slots, uint32_t record_size)
+{
+    size_t need = shmring_size(slots, record_size);
+
+    if (mem == NULL || need == 0 || size < need) {
+        return EINVAL;
+    }
+
+    shmring_t* ring = (shmring_t*)mem;
+
+    memset(ring, 0, sizeof(shmring_t));
+
+    ring->version = SHMRING_VERSION;
+    ring->slots = slots;
+    ring->record_size = record_size;
+
+    __atomic_store_n(&ring->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+    return EOK;
+}
+
+/*
+ * Attach a port to a ring mapped at mem. Clients let the driver's geometry be
+ * adopted by passing expect_record_size 0; the driver passes the values it
+ * created the ring with.
+ */
+static inline int shmring_attach (shmring_port_t* port, void* mem, size_t size,
+        uint32_t expect_record_size)
+{
+    shmring_t* ring = (shmring_t*)mem;
+
+    if (port == NULL || ring == NULL || size < sizeof(shmring_t)) {
+        return EINVAL;
+    }
+
+    if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != SHMRING_MAGIC
+            || ring->version != SHMRING_VERSION)
+    {
+        return EINVAL;
+    }
+
+    uint32_t slots = ring->slots;
+    uint32_t record_size = ring->record_size;
+    size_t need = shmring_size(slots, record_size);
+
+    if (need == 0 || size < need) {
+        return EINVAL;
+    }
+
+    if (expect_record_size && record_size != expect_record_size) {
+        return EINVAL;
+    }
+
+    port->ring = ring;
+    port->data = (uint8_t*)mem + sizeof(shmring_t);
+    port->mask = slots - 1;
+    port->record_size = record_size;
+    port->cached = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    return EOK;
+}
+
+/* Number of records waiting; exact for the consumer, a lower bound else */
+static inline uint32_t shmring_count (const shmring_port_t* port) {
+    uint32_t head = __atomic_load_n(&port->ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&port->ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t count = head - tail;
+
+    return (count > port->mask + 1) ? port->mask + 1 : count;
+}
+
+/* Producer side; returns EAGAIN when the ring is full */
+static inline int shmring_push (shmring_port_t* port, const void* record) {
+    shmring_t* ring = port->ring;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    if (head - port->cached > port->mask) {
+        port->cached = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+        if (head - port->cached > port->mask) {
+            return EAGAIN;
+        }
+    }
+
+    memcpy(port->data + (size_t)(head & port->mask)*port->record_size,
+            record, port->record_size);
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return EOK;
+}
+
+/*
+ * Producer side; called after one or more pushes. Returns 1 when the consumer
+ * went to sleep on an empty ring and must be woken by the doorbell.
+ */
+static inline int shmring_need_wakeup (shmring_port_t* port) {
+    shmring_t* ring = port->ring;
+
+    /* order the head store above against the waiting load below */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&ring->waiting, __ATOMIC_RELAXED) == 0) {
+        return 0;
+    }
+
+    return __atomic_exchange_n(&ring->waiting, 0, __ATOMIC_ACQ_REL) != 0;
+}
+
+/* Consumer side; oldest record in place, or NULL when empty */
+static inline void* shmring_peek (shmring_port_t* port) {
+    shmring_t* ring = port->ring;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    if (port->cached == tail) {
+        port->cached = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        if (port->cached == tail) {
+            return NULL;
+        }
+    }
+
+    return port->data + (size_t)(tail & port->mask)*port->record_size;
+}
+
+/* Consumer side; release the record returned by shmring_peek() */
+static inline void shmring_consume (shmring_port_t* port) {
+    shmring_t* ring = port->ring;
+
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Consumer side; returns EAGAIN when the ring is empty */
+static inline int shmring_pop (shmring_port_t* port, void* record) {
+    void* slot = shmring_peek(port);
+
+    if (slot == NULL) {
+        return EAGAIN;
+    }
+
+    memcpy(record, slot, port->record_size);
+    shmring_consume(port);
+
+    return EOK;
+}
+
+/*
+ * Consumer side; announce that the consumer is about to sleep. Returns 1 if it
+ * may sleep until the doorbell, or 0 if records arrived meanwhile.
+ */
+static inline int shmring_prepare_wait (shmring_port_t* port) {
+    shmring_t* ring = port->ring;
+
+    __atomic_store_n(&ring->waiting, 1, __ATOMIC_RELAXED);
+
+    /* order the waiting store above against the head load below */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    port->cached = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if (port->cached != __atomic_load_n(&ring->tail, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+
+        return 0;
+    }
+
+    return 1;
+}
+
+#endif /* DEV_CAN_LINUX_SHMRING_H_ */
@@ -0,0 +1,107 @@
+/*
+ * \file    trace.h
+ * \brief   Binary trace records written by the driver's trace points
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef DEV_CAN_LINUX_TRACE_H_
+#define DEV_CAN_LINUX_TRACE_H_
+
+#include <stdint.h>
+
+/*
+ * Trace records are fixed size and binary; the driver stores the event id,
+ * the time and up to CAN_TRACE_ARGS raw arguments and leaves all formatting
+ * to the reader. The same event table is used by the driver and by the
+ * decoder so that record files can be formatted offline.
+ *
+ * Events of kind CAN_TRACE_KIND_FRAME carry a frame: arg[0] holds the device
+ * number and the frame length, see CAN_TRACE_UNIT() and CAN_TRACE_LEN(),
+ * arg[1] the id and arg[2], arg[3] data bytes 0-3 and 4-7, first byte in the
+ * most significant bits; their format string names the form of the id, a
+ * Linux style CAN id or a QNX MID. Events of kind CAN_TRACE_KIND_ARGS are
+ * printed with their format string, which is given all four arguments.
+ */
+
+#define CAN_TRACE_ARGS          4
+
+#define CAN_TRACE_KIND_ARGS     0
+#define CAN_TRACE_KIND_FRAME    1
+
+/* X(event, kind, name, format) */
+#define CAN_TRACE_EVENTS(X) \
+    X(CAN_TRACE_NONE, CAN_TRACE_KIND_ARGS, "none", "") \
+    X(CAN_TRACE_RX_FRAME, CAN_TRACE_KIND_FRAME, "netif_rx", \
+            "Linux id") \
+    X(CAN_TRACE_RX_TAKEN, CAN_TRACE_KIND_FRAME, "rx devctl", \
+            "MID") \
+    X(CAN_TRACE_TX_WRITE, CAN_TRACE_KIND_FRAME, "io_write", \
+            "MID") \
+    X(CAN_TRACE_TX_DEVCTL, CAN_TRACE_KIND_FRAME, "tx devctl", \
+            "MID") \
+    X(CAN_TRACE_IO_READ, CAN_TRACE_KIND_ARGS, "io_read", \
+            "id: %u, rcvid: %u") \
+    X(CAN_TRACE_IO_WRITE, CAN_TRACE_KIND_ARGS, "io_write", \
+            "id: %u, rcvid: %u, nbytes: %u") \
+    X(CAN_TRACE_IO_WRITE_RECORDS, CAN_TRACE_KIND_ARGS, "io_write", \
+            "can%u queued %u records") \
+    X(CAN_TRACE_IO_DEVCTL, CAN_TRACE_KIND_ARGS, "io_devctl", \
+            "id: %u, dcmd: %X")
+
+#define CAN_TRACE_ENUM(event, kind, name, format) event,
+
+enum can_trace_event {
+    CAN_TRACE_EVENTS(CAN_TRACE_ENUM)
+    CAN_TRACE_NUM_EVENTS
+};
+
+#undef CAN_TRACE_ENUM
+
+struct can_trace_record {
+    uint64_t tstamp;            /* ns, as EXT_CAN_DEVCTL_GET_TIMESTAMP_NS */
+    uint32_t seq;               /* position in the ring, plus 1 */
+    uint16_t event;             /* enum can_trace_event */
+    uint16_t thread;            /* thread id of the writer */
+    uint32_t arg[CAN_TRACE_ARGS];
+};
+
+#define CAN_TRACE_FRAME_ARG0(unit, len) \
+    ((uint32_t)(unit) << 8 | ((uint32_t)(len) & 0xff))
+
+#define CAN_TRACE_UNIT(arg0)    ((arg0) >> 8)
+#define CAN_TRACE_LEN(arg0)     ((arg0) & 0xff)
+
+#define CAN_TRACE_DATA(dat, i) \
+    ((uint32_t)(dat)[i] << 24 | (uint32_t)(dat)[(i) + 1] << 16 | \
+     (uint32_t)(dat)[(i) + 2] << 8 | (uint32_t)(dat)[(i) + 3])
+
+/*
+ * Trace record file, as written by the cantrace tool: this header followed by
+ * count records in time order
+ */
+#define CAN_TRACE_FILE_MAGIC    0x54524143  /* "CART" */
+#define CAN_TRACE_FILE_VERSION  1
+
+struct can_trace_file {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t count;
+};
+
+#endif /* DEV_CAN_LINUX_TRACE_H_ */
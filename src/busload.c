@@ -0,0 +1,179 @@
+/*
+ * \file    busload.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include <linux/can/dev.h>
+
+#include "frame.h"
+#include "busload.h"
+
+
+void busload_init (busload_t* bl) {
+    memset(bl, 0, sizeof(busload_t));
+
+    pthread_mutex_init(&bl->mutex, NULL);
+
+    /* UINT64_MAX matches no bucket number, not even bucket 0's */
+    int i;
+    for (i = 0; i < BUSLOAD_BUCKETS; ++i) {
+        bl->bucket[i] = UINT64_MAX;
+    }
+}
+
+void busload_destroy (busload_t* bl) {
+    pthread_mutex_destroy(&bl->mutex);
+}
+
+static busload_id_t* busload_id (busload_t* bl, uint32_t key) {
+    uint32_t i = ((key & ~BUSLOAD_KEY_USED) * 2654435761U)
+            & (BUSLOAD_MAX_IDS - 1);
+    int probes;
+
+    for (probes = 0; probes < BUSLOAD_MAX_PROBES; ++probes) {
+        busload_id_t* entry = &bl->ids[i];
+
+        if (entry->key == key) {
+            return entry;
+        }
+
+        if (entry->key == 0) {
+            entry->key = key;
+            ++bl->num_ids;
+
+            return entry;
+        }
+
+        i = (i + 1) & (BUSLOAD_MAX_IDS - 1);
+    }
+
+    return NULL;
+}
+
+void busload_frame (busload_t* bl, uint32_t id, uint8_t len, bool rtr,
+        uint64_t tstamp)
+{
+    bool eff = (id & FRAME_EFF) != 0;
+    uint32_t bits = can_frame_bits(false, eff, false, true, rtr ? 0 : len);
+    uint64_t n = tstamp / BUSLOAD_BUCKET_NS;
+    int b = (int)(n % BUSLOAD_BUCKETS);
+
+    pthread_mutex_lock(&bl->mutex);
+
+    bl->frames++;
+    bl->bits += bits;
+
+    if (bl->bucket[b] != n) {
+        bl->bucket[b] = n;
+        bl->bucket_bits[b] = 0;
+        bl->bucket_frames[b] = 0;
+    }
+
+    bl->bucket_bits[b] += bits;
+    bl->bucket_frames[b]++;
+
+    busload_id_t* entry = busload_id(bl,
+            (id & (FRAME_EFF | FRAME_ID_MASK)) | BUSLOAD_KEY_USED);
+
+    if (entry == NULL) {
+        bl->other_frames++;
+    }
+    else {
+        if (entry->frames && tstamp > entry->last) {
+            uint64_t d = tstamp - entry->last;
+
+            if (entry->frames == 1) {
+                entry->interval = d;
+            }
+            else {
+                uint64_t dev = (d > entry->interval)
+                    ? d - entry->interval : entry->interval - d;
+
+                entry->jitter = entry->jitter - entry->jitter/16 + dev/16;
+                entry->interval = entry->interval - entry->interval/16 + d/16;
+            }
+        }
+
+        entry->frames++;
+        entry->last = tstamp;
+    }
+
+    pthread_mutex_unlock(&bl->mutex);
+}
+
+void busload_window (busload_t* bl, uint64_t window_ns, uint64_t now,
+        busload_window_t* window)
+{
+    uint64_t current = now / BUSLOAD_BUCKET_NS;
+    uint64_t count = window_ns / BUSLOAD_BUCKET_NS;
+    uint64_t k;
+
+    if (count > BUSLOAD_BUCKETS - 1) {
+        count = BUSLOAD_BUCKETS - 1; // the current bucket is still filling
+    }
+
+    window->frames = 0;
+    window->bits = 0;
+
+    pthread_mutex_lock(&bl->mutex);
+
+    for (k = 1; k <= count && k <= current; ++k) {
+        uint64_t n = current - k;
+        int b = (int)(n % BUSLOAD_BUCKETS);
+
+        if (bl->bucket[b] == n) {
+            window->frames += bl->bucket_frames[b];
+            window->bits += bl->bucket_bits[b];
+        }
+    }
+
+    pthread_mutex_unlock(&bl->mutex);
+}
+
+int busload_ids (busload_t* bl, int first, busload_id_t* ids, int max) {
+    int used = 0, n = 0;
+    int i;
+
+    pthread_mutex_lock(&bl->mutex);
+
+    for (i = 0; i < BUSLOAD_MAX_IDS && n < max; ++i) {
+        if (bl->ids[i].key == 0) {
+            continue;
+        }
+
+        if (used++ >= first) {
+            ids[n++] = bl->ids[i];
+        }
+    }
+
+    pthread_mutex_unlock(&bl->mutex);
+
+    return n;
+}
+
+void busload_reset_ids (busload_t* bl) {
+    pthread_mutex_lock(&bl->mutex);
+
+    memset(bl->ids, 0, sizeof(bl->ids));
+    bl->num_ids = 0;
+    bl->other_frames = 0;
+
+    pthread_mutex_unlock(&bl->mutex);
+}
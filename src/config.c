@@ -18,7 +18,12 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <config.h>
+#include <slab.h>
 
 /*
  * Check configuration macros are valid
@@ -62,8 +67,15 @@ int opts = 0;
 int optt = 0;
 int optu = 0;
 int optb = 0;
+int optp = 0;
+int optI = 0;
+int optT = 0;
 int optL = 0;
 int optL_num = 0;
+int optS = 0;
+int optS_num = 0;
+int optM = 0;
+int optM_num = SLAB_DEFAULT_OBJECTS;
 int optm = 0;
 int optx = 0;
 int optE = 0;
@@ -74,6 +86,306 @@ channel_config_t* optu_config = NULL;
 size_t num_optb_configs = 0;
 bitrate_config_t* optb_config = NULL;
 
+size_t num_optp_configs = 0;
+poll_config_t* optp_config = NULL;
+
+size_t num_optI_configs = 0;
+irq_config_t* optI_config = NULL;
+
+thread_config_t optT_default = {
+    .id = -1,
+    .classes = 0,
+    .sched = {
+        [0 ... NUM_THREAD_CLASSES-1] = { .policy = -1 }
+    }
+};
+size_t num_optT_configs = 0;
+thread_config_t* optT_config = NULL;
+
+/*
+ * -p and -I options
+ */
+
+static char* const poll_sub_opts[] = {
+#define POLL_OPT_ID         0
+    "id",
+#define POLL_OPT_FRAMES     1
+    "frames",
+#define POLL_OPT_WINDOW     2
+    "window",
+#define POLL_OPT_BUDGET     3
+    "budget",
+#define POLL_OPT_IDLE       4
+    "idle",
+#define POLL_OPT_PERIOD     5
+    "period",
+    NULL
+};
+
+static char* const irq_sub_opts[] = {
+#define IRQ_OPT_ID          0
+    "id",
+#define IRQ_OPT_PRIORITY    1
+    "prio",
+#define IRQ_OPT_RUNMASK     2
+    "cpus",
+#define IRQ_OPT_PER_ATTACH  3
+    "attach",
+    NULL
+};
+
+static const poll_config_t default_poll_config = {
+    .id = -1,
+    .frames = DEFAULT_POLL_FRAMES,
+    .window_us = DEFAULT_POLL_WINDOW_US,
+    .budget = DEFAULT_POLL_BUDGET,
+    .idle = DEFAULT_POLL_IDLE,
+    .period_us = DEFAULT_POLL_PERIOD_US
+};
+
+static const irq_config_t default_irq_config = {
+    .id = -1,
+    .per_attach = 0,
+    .priority = 0,
+    .runmask = 0
+};
+
+int poll_config_option (const char* option) {
+    char *copy, *options, *value;
+    int result = EOK;
+
+    if ((copy = strdup(option)) == NULL) {
+        printf("strdup failure\n");
+
+        return EINVAL;
+    }
+
+    poll_config_t new_poll_config = default_poll_config;
+
+    options = copy;
+    while (result == EOK && *options != '\0') {
+        int subopt = getsubopt(&options, poll_sub_opts, &value);
+
+        if (subopt == -1) {
+            /* process unknown token */
+            printf("error: Unknown suboption for -p\n");
+            continue;
+        }
+
+        if (value == NULL) {
+            printf("error with %s sub-option\n", poll_sub_opts[subopt]);
+
+            result = EINVAL;
+            break;
+        }
+
+        int n = atoi(value);
+
+        if (n < 0 || (n == 0 && subopt == POLL_OPT_BUDGET)) {
+            printf("invalid -p %s value: %d\n", poll_sub_opts[subopt], n);
+
+            result = EINVAL;
+            break;
+        }
+
+        switch (subopt) {
+        case POLL_OPT_ID:       /* process id option */
+            new_poll_config.id = n;
+            break;
+
+        case POLL_OPT_FRAMES:   /* process frames option */
+            new_poll_config.frames = n;
+            break;
+
+        case POLL_OPT_WINDOW:   /* process window option */
+            new_poll_config.window_us = n;
+            break;
+
+        case POLL_OPT_BUDGET:   /* process budget option */
+            new_poll_config.budget = n;
+            break;
+
+        case POLL_OPT_IDLE:     /* process idle option */
+            new_poll_config.idle = n;
+            break;
+
+        case POLL_OPT_PERIOD:   /* process period option */
+            new_poll_config.period_us = n;
+            break;
+        }
+    }
+
+    free(copy);
+
+    if (result != EOK) {
+        return result;
+    }
+
+    int id = new_poll_config.id;
+
+    if (id < 0) {
+        printf("channel id (%d) invalid\n", id);
+
+        return EINVAL;
+    }
+
+    if (num_optp_configs < id + 1) {
+        poll_config_t* new_optp_config;
+
+        int new_num_optp_configs = id + 1;
+        new_optp_config =
+            malloc(new_num_optp_configs*sizeof(poll_config_t));
+
+        if (new_optp_config == NULL) {
+            printf("malloc failure\n");
+
+            return EINVAL;
+        }
+
+        /* Fill all newly created configs with default settings */
+        int i;
+        for (i = num_optp_configs; i < new_num_optp_configs; ++i) {
+            new_optp_config[i] = default_poll_config;
+        }
+
+        /* Copy previous configs to the new configs */
+        if (optp_config != NULL) {
+            memcpy( new_optp_config, optp_config,
+                    num_optp_configs*sizeof(poll_config_t) );
+
+            free(optp_config);
+        }
+
+        /* Set the configs to the new configs */
+        num_optp_configs = new_num_optp_configs;
+        optp_config = new_optp_config;
+    }
+
+    optp_config[id] = new_poll_config;
+
+    return EOK;
+}
+
+int irq_config_option (const char* option) {
+    char *copy, *options, *value;
+    int result = EOK;
+
+    if ((copy = strdup(option)) == NULL) {
+        printf("strdup failure\n");
+
+        return EINVAL;
+    }
+
+    irq_config_t new_irq_config = default_irq_config;
+
+    options = copy;
+    while (result == EOK && *options != '\0') {
+        int subopt = getsubopt(&options, irq_sub_opts, &value);
+
+        if (subopt == IRQ_OPT_PER_ATTACH) {
+            new_irq_config.per_attach = 1;
+            continue;
+        }
+
+        if (subopt == -1) {
+            /* process unknown token */
+            printf("error: Unknown suboption for -I\n");
+            continue;
+        }
+
+        if (value == NULL) {
+            printf("error with %s sub-option\n", irq_sub_opts[subopt]);
+
+            result = EINVAL;
+            break;
+        }
+
+        if (subopt == IRQ_OPT_RUNMASK) {  /* process cpus option */
+            char* end;
+            unsigned long mask = strtoul(value, &end, 0);
+
+            if (*end != '\0' || mask > UINT32_MAX) {
+                printf("invalid -I cpus value: %s\n", value);
+
+                result = EINVAL;
+                break;
+            }
+
+            new_irq_config.runmask = (uint32_t)mask;
+            continue;
+        }
+
+        int n = atoi(value);
+
+        if (n < 0) {
+            printf("invalid -I %s value: %d\n", irq_sub_opts[subopt], n);
+
+            result = EINVAL;
+            break;
+        }
+
+        switch (subopt) {
+        case IRQ_OPT_ID:        /* process id option */
+            new_irq_config.id = n;
+            break;
+
+        case IRQ_OPT_PRIORITY:  /* process prio option */
+            new_irq_config.priority = n;
+            break;
+        }
+    }
+
+    free(copy);
+
+    if (result != EOK) {
+        return result;
+    }
+
+    int id = new_irq_config.id;
+
+    if (id < 0) {
+        printf("channel id (%d) invalid\n", id);
+
+        return EINVAL;
+    }
+
+    if (num_optI_configs < id + 1) {
+        irq_config_t* new_optI_config;
+
+        int new_num_optI_configs = id + 1;
+        new_optI_config =
+            malloc(new_num_optI_configs*sizeof(irq_config_t));
+
+        if (new_optI_config == NULL) {
+            printf("malloc failure\n");
+
+            return EINVAL;
+        }
+
+        /* Fill all newly created configs with default settings */
+        int i;
+        for (i = num_optI_configs; i < new_num_optI_configs; ++i) {
+            new_optI_config[i] = default_irq_config;
+        }
+
+        /* Copy previous configs to the new configs */
+        if (optI_config != NULL) {
+            memcpy( new_optI_config, optI_config,
+                    num_optI_configs*sizeof(irq_config_t) );
+
+            free(optI_config);
+        }
+
+        /* Set the configs to the new configs */
+        num_optI_configs = new_num_optI_configs;
+        optI_config = new_optI_config;
+    }
+
+    optI_config[id] = new_irq_config;
+
+    return EOK;
+}
+
 size_t num_disable_device_configs;
 device_config_t* disable_device_config;
 size_t num_enable_device_cap_configs;
@@ -83,15 +395,17 @@ device_config_t* enable_device_cap_config;
  * IRQ Management
  */
 
-irq_group_t*    irq_group = NULL;
+irq_group_t**   irq_group = NULL;
 size_t          irq_group_size = 0;
 irq_group_t**   irq_to_group_map = NULL;
 size_t          irq_to_group_map_size = 0;
-irq_attach_t    irq_attach[MAX_IRQ_ATTACH_COUNT];
+irq_attach_t*   irq_attach[MAX_IRQ_ATTACH_COUNT];
 size_t          irq_attach_size = 0;
 
-static inline void irq_to_group_add (
-        pci_irq_t* irq, size_t nirq, size_t group_id)
+static size_t   irq_group_max = 0;
+
+static inline int irq_to_group_add (
+        pci_irq_t* irq, size_t nirq, irq_group_t* group)
 {
     uint_t i;
 
@@ -104,73 +418,85 @@ static inline void irq_to_group_add (
     }
 
     if (irq_to_group_map_size < new_irq_to_group_map_size) {
-        irq_group_t** new_irq_to_group_map =
-            malloc(new_irq_to_group_map_size*sizeof(irq_group_t*));
-
-        memset( new_irq_to_group_map, 0,
+        irq_group_t** new_irq_to_group_map = realloc( irq_to_group_map,
                 new_irq_to_group_map_size*sizeof(irq_group_t*) );
 
-        for (i = 0; i < irq_to_group_map_size; ++i) {
-            new_irq_to_group_map[i] = irq_to_group_map[i];
-        }
+        if (new_irq_to_group_map == NULL) {
+            log_err("error irq_group_add out of memory\n");
 
-        if (irq_to_group_map) {
-            free(irq_to_group_map);
+            return -1;
         }
 
+        memset( &new_irq_to_group_map[irq_to_group_map_size], 0,
+                (new_irq_to_group_map_size - irq_to_group_map_size)
+                    *sizeof(irq_group_t*) );
+
         irq_to_group_map = new_irq_to_group_map;
         irq_to_group_map_size = new_irq_to_group_map_size;
     }
 
     for (i = 0; i < nirq; ++i) {
-        irq_to_group_map[irq[i]] = &irq_group[group_id];
+        irq_to_group_map[irq[i]] = group;
     }
+
+    return 0;
 }
 
-void irq_group_add (pci_irq_t* irq, size_t nirq,
+int irq_group_add (pci_irq_t* irq, size_t nirq,
         pci_devhdl_t hdl, pci_cap_t msi_cap, bool is_msi, bool is_msix)
 {
     uint_t i;
 
-    size_t new_irq_group_size = irq_group_size + 1;
+    /* groups are allocated one by one so irq_to_group_map never needs
+     * redirecting; only the array of pointers to them grows */
+    if (irq_group_size == irq_group_max) {
+        size_t max = irq_group_max ? 2*irq_group_max : 8;
+        irq_group_t** grown = realloc(irq_group, max*sizeof(irq_group_t*));
 
-    irq_group_t* new_irq_group = malloc(new_irq_group_size*sizeof(irq_group_t));
+        if (grown == NULL) {
+            log_err("error irq_group_add out of memory\n");
 
-    for (i = 0; i < irq_group_size; ++i) {
-        new_irq_group[i] = irq_group[i];
+            return -1;
+        }
+
+        irq_group = grown;
+        irq_group_max = max;
     }
 
-    new_irq_group[irq_group_size].num_irq = nirq;
-    new_irq_group[irq_group_size].irq = malloc(nirq*sizeof(pci_irq_t));
-    new_irq_group[irq_group_size].hdl = hdl;
-    new_irq_group[irq_group_size].msi_cap = msi_cap;
-    new_irq_group[irq_group_size].is_msi = is_msi;
-    new_irq_group[irq_group_size].is_msix = is_msix;
+    irq_group_t* group = malloc(sizeof(irq_group_t));
 
-    for (i = 0; i < nirq; ++i) {
-        new_irq_group[irq_group_size].irq[i] = irq[i];
+    if (group == NULL) {
+        log_err("error irq_group_add out of memory\n");
+
+        return -1;
     }
 
-    /* Redirect irq_to_group_map pointers */
-    for (i = 0; i < irq_to_group_map_size; ++i) {
-        if (irq_to_group_map[i]) {
-            for (uint_t j = 0; j < irq_group_size; ++j) {
-                if (irq_to_group_map[i] == &irq_group[j]) {
-                    irq_to_group_map[i] = &new_irq_group[j];
-                    break;
-                }
-            }
-        }
+    if ((group->irq = malloc(nirq*sizeof(pci_irq_t))) == NULL) {
+        log_err("error irq_group_add out of memory\n");
+
+        free(group);
+        return -1;
     }
 
-    if (irq_group) {
-        free(irq_group);
+    group->num_irq = nirq;
+    group->hdl = hdl;
+    group->msi_cap = msi_cap;
+    group->is_msi = is_msi;
+    group->is_msix = is_msix;
+
+    for (i = 0; i < nirq; ++i) {
+        group->irq[i] = irq[i];
     }
 
-    irq_group = new_irq_group;
-    irq_group_size = new_irq_group_size;
+    if (irq_to_group_add(irq, nirq, group)) {
+        free(group->irq);
+        free(group);
+        return -1;
+    }
+
+    irq_group[irq_group_size++] = group;
 
-    irq_to_group_add(irq, nirq, irq_group_size-1);
+    return 0;
 }
 
 void irq_group_cleanup (void) {
@@ -184,13 +510,14 @@ void irq_group_cleanup (void) {
 
     if (irq_group) {
         for (i = 0; i < irq_group_size; ++i) {
-            free(irq_group[i].irq);
-
-            irq_group[i].irq = NULL;
+            free(irq_group[i]->irq);
+            free(irq_group[i]);
         }
 
         free(irq_group);
 
         irq_group = NULL;
+        irq_group_size = 0;
+        irq_group_max = 0;
     }
 }
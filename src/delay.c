@@ -0,0 +1,97 @@
+/*
+ * \file    delay.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <time.h>
+#include <errno.h>
+#include <sys/neutrino.h>
+#include <sys/syspage.h>
+
+#include "delay.h"
+
+
+static uint64_t cycles_per_sec = 0;
+static uint64_t tick_ns = 0;
+
+static void calibrate (void) {
+    struct timespec res;
+
+    if (clock_getres(CLOCK_MONOTONIC, &res) == 0) {
+        tick_ns = res.tv_sec*1000000000ULL + res.tv_nsec;
+    }
+
+    if (tick_ns == 0) {
+        tick_ns = 1000000; /* the QNX default of 1 ms */
+    }
+
+    cycles_per_sec = SYSPAGE_ENTRY(qtime)->cycles_per_sec;
+}
+
+static void sleep_ns (uint64_t ns) {
+    struct timespec ts = {
+        .tv_sec = ns / 1000000000ULL,
+        .tv_nsec = ns % 1000000000ULL
+    };
+
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+        continue;
+    }
+}
+
+/* Wait ns, of which slack may be overshot */
+static void wait_ns (uint64_t ns, uint64_t slack) {
+    if (ns == 0) {
+        return;
+    }
+
+    if (cycles_per_sec == 0) {
+        calibrate();
+    }
+
+    uint64_t start = ClockCycles();
+
+    /* a sleep is rounded up to the tick and runs up to another past it */
+    if (ns > 2*tick_ns) {
+        if (slack >= 2*tick_ns) {
+            sleep_ns(ns);
+
+            return;
+        }
+
+        sleep_ns(ns - 2*tick_ns);
+    }
+
+    /* split to avoid overflowing the 64-bit intermediate product */
+    uint64_t cycles = (ns / 1000000000ULL) * cycles_per_sec
+        + ((ns % 1000000000ULL) * cycles_per_sec) / 1000000000ULL + 1;
+
+    while (ClockCycles() - start < cycles) {
+        __asm__ __volatile__("" ::: "memory");
+    }
+}
+
+void delay_ns (uint64_t ns) {
+    wait_ns(ns, 0);
+}
+
+void delay_range_us (unsigned long min_us, unsigned long max_us) {
+    uint64_t slack = (max_us > min_us) ? (max_us - min_us)*1000ULL : 0;
+
+    wait_ns(min_us*1000ULL, slack);
+}
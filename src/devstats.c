@@ -0,0 +1,65 @@
+/*
+ * \file    devstats.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "devstats.h"
+
+
+__thread int devstats_slot = -1;
+
+static unsigned devstats_next_slot = 0;
+
+int devstats_slot_take (void) {
+    devstats_slot = (int)(__atomic_fetch_add(
+            &devstats_next_slot, 1, __ATOMIC_RELAXED) % DEVSTATS_SLOTS);
+
+    return devstats_slot;
+}
+
+uint64_t devstats_read_counter (const devstats_t* slots, size_t offset) {
+    uint64_t sum = 0;
+    int slot;
+
+    for (slot = 0; slot < DEVSTATS_SLOTS; ++slot) {
+        const uint64_t* counter =
+            (const uint64_t*)((const uint8_t*)&slots[slot] + offset);
+
+        sum += __atomic_load_n(counter, __ATOMIC_RELAXED);
+    }
+
+    return sum;
+}
+
+void devstats_read (const devstats_t* slots, devstats_t* sum) {
+    uint64_t* out = (uint64_t*)sum;
+    int slot;
+    size_t i;
+
+    memset(sum, 0, sizeof(devstats_t));
+
+    for (slot = 0; slot < DEVSTATS_SLOTS; ++slot) {
+        const uint64_t* in = (const uint64_t*)&slots[slot];
+
+        for (i = 0; i < DEVSTATS_COUNTERS; ++i) {
+            out[i] += __atomic_load_n(&in[i], __ATOMIC_RELAXED);
+        }
+    }
+}
@@ -0,0 +1,448 @@
+/*
+ * \file    gateway.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include <dev-can-linux/commands.h>
+
+#include "gateway.h"
+
+static_assert( CAN_GW_EFF == FRAME_EFF, "CAN_GW_EFF must match FRAME_EFF" );
+
+#define GATEWAY_SFF_MASK    0x7FFU
+
+typedef struct gateway_rule {
+    struct can_gw_rule rule;
+
+    queue_t* dst;           /* transmit queue of rule.dst, or NULL */
+
+    /* rule.id, rule.mask and rule.new_id in the frame record id layout; the
+     * mask always compares the id type */
+    uint32_t id, mask;
+    uint32_t new_id;
+
+    uint64_t and_data, or_data, xor_data;
+
+    /* rate limit as a virtual scheduler; a frame is let through if it is
+     * no more than tolerance early for tat, which then moves on by interval */
+    uint64_t interval;      /* ns between frames, 0 for no limit */
+    uint64_t tolerance;
+    uint64_t tat;
+
+    uint64_t hits, drops, rate_drops;
+} gateway_rule_t;
+
+static gateway_rule_t gateway_rules[CAN_GW_MAX_RULES];
+int gateway_num_rules = 0;
+
+static struct {
+    int id;
+    queue_t* tx_queue;
+} gateway_devices[GATEWAY_MAX_DEVICES];
+
+static int gateway_num_devices = 0;
+
+static pthread_rwlock_t gateway_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+enum {
+    GATEWAY_OPT_SRC = 0,
+    GATEWAY_OPT_DST,
+    GATEWAY_OPT_ID,
+    GATEWAY_OPT_MASK,
+    GATEWAY_OPT_EXT,
+    GATEWAY_OPT_SET_ID,
+    GATEWAY_OPT_AND,
+    GATEWAY_OPT_OR,
+    GATEWAY_OPT_XOR,
+    GATEWAY_OPT_RATE
+};
+
+static char* const gateway_sub_opts[] = {
+    [GATEWAY_OPT_SRC]       = "src",
+    [GATEWAY_OPT_DST]       = "dst",
+    [GATEWAY_OPT_ID]        = "id",
+    [GATEWAY_OPT_MASK]      = "mask",
+    [GATEWAY_OPT_EXT]       = "ext",
+    [GATEWAY_OPT_SET_ID]    = "setid",
+    [GATEWAY_OPT_AND]       = "and",
+    [GATEWAY_OPT_OR]        = "or",
+    [GATEWAY_OPT_XOR]       = "xor",
+    [GATEWAY_OPT_RATE]      = "rate",
+    NULL
+};
+
+static queue_t* gateway_device_queue (int id) {
+    int i;
+
+    for (i = 0; i < gateway_num_devices; ++i) {
+        if (gateway_devices[i].id == id) {
+            return gateway_devices[i].tx_queue;
+        }
+    }
+
+    return NULL;
+}
+
+static uint32_t gateway_id_bits (uint32_t id) {
+    return (id & CAN_GW_EFF) ? FRAME_ID_MASK : GATEWAY_SFF_MASK;
+}
+
+int gateway_add_rule (struct can_gw_rule* rule) {
+    uint32_t id_bits = gateway_id_bits(rule->id);
+
+    if ((rule->id & ~(CAN_GW_EFF | id_bits)) != 0) {
+        return EINVAL;
+    }
+
+    if ((rule->flags & ~(CAN_GW_SET_ID | CAN_GW_MOD_DATA)) != 0) {
+        return EINVAL;
+    }
+
+    if ((rule->flags & CAN_GW_SET_ID) && (rule->new_id
+                & ~(CAN_GW_EFF | gateway_id_bits(rule->new_id))) != 0)
+    {
+        return EINVAL;
+    }
+
+    pthread_rwlock_wrlock(&gateway_lock);
+
+    if (gateway_num_rules == CAN_GW_MAX_RULES) {
+        pthread_rwlock_unlock(&gateway_lock);
+
+        return ENOSPC;
+    }
+
+    rule->index = gateway_num_rules;
+
+    gateway_rule_t* r = &gateway_rules[gateway_num_rules];
+
+    memset(r, 0, sizeof(gateway_rule_t));
+    r->rule = *rule;
+    r->dst = gateway_device_queue(rule->dst);
+
+    r->id = rule->id & (CAN_GW_EFF | id_bits);
+    r->mask = (rule->mask & id_bits) | FRAME_EFF;
+    r->new_id = rule->new_id;
+
+    r->and_data = ~0ULL;
+
+    if (rule->flags & CAN_GW_MOD_DATA) {
+        memcpy(&r->and_data, rule->and_data, sizeof(r->and_data));
+        memcpy(&r->or_data, rule->or_data, sizeof(r->or_data));
+        memcpy(&r->xor_data, rule->xor_data, sizeof(r->xor_data));
+    }
+
+    if (rule->rate) {
+        /* allow bursts of up to a tenth of a second's frames */
+        r->interval = 1000000000ULL / rule->rate;
+        r->tolerance = r->interval * (rule->rate / 10);
+    }
+
+    __atomic_store_n(&gateway_num_rules, gateway_num_rules + 1,
+            __ATOMIC_RELEASE);
+
+    pthread_rwlock_unlock(&gateway_lock);
+
+    return EOK;
+}
+
+int gateway_get_stats (struct can_gw_stats* stats) {
+    int result = EOK;
+
+    pthread_rwlock_rdlock(&gateway_lock);
+
+    if (stats->index < gateway_num_rules) {
+        gateway_rule_t* r = &gateway_rules[stats->index];
+
+        stats->reserved = 0;
+        stats->hits = __atomic_load_n(&r->hits, __ATOMIC_RELAXED);
+        stats->drops = __atomic_load_n(&r->drops, __ATOMIC_RELAXED);
+        stats->rate_drops = __atomic_load_n(&r->rate_drops, __ATOMIC_RELAXED);
+    }
+    else {
+        result = EINVAL;
+    }
+
+    pthread_rwlock_unlock(&gateway_lock);
+
+    return result;
+}
+
+void gateway_flush (uint32_t first) {
+    pthread_rwlock_wrlock(&gateway_lock);
+
+    if (first < gateway_num_rules) {
+        __atomic_store_n(&gateway_num_rules, first, __ATOMIC_RELEASE);
+    }
+
+    pthread_rwlock_unlock(&gateway_lock);
+}
+
+void gateway_attach (int id, queue_t* tx_queue) {
+    int i;
+
+    pthread_rwlock_wrlock(&gateway_lock);
+
+    for (i = 0; i < gateway_num_devices; ++i) {
+        if (gateway_devices[i].id == id) {
+            break;
+        }
+    }
+
+    if (i == gateway_num_devices) {
+        if (tx_queue == NULL || i == GATEWAY_MAX_DEVICES) {
+            pthread_rwlock_unlock(&gateway_lock);
+
+            return;
+        }
+
+        gateway_devices[gateway_num_devices++].id = id;
+    }
+
+    gateway_devices[i].tx_queue = tx_queue;
+
+    for (i = 0; i < gateway_num_rules; ++i) {
+        if (gateway_rules[i].rule.dst == id) {
+            gateway_rules[i].dst = tx_queue;
+        }
+    }
+
+    pthread_rwlock_unlock(&gateway_lock);
+}
+
+void gateway_route_frame (int src, const frame_t* frame, uint64_t tstamp) {
+    if (frame->hops != 0 || (frame->id & FRAME_ECHO)) {
+        return; // forwarded once already, or our own transmission
+    }
+
+    uint32_t key = frame->id & (FRAME_EFF | FRAME_ID_MASK);
+    int i, n;
+
+    pthread_rwlock_rdlock(&gateway_lock);
+
+    n = __atomic_load_n(&gateway_num_rules, __ATOMIC_ACQUIRE);
+
+    for (i = 0; i < n; ++i) {
+        gateway_rule_t* r = &gateway_rules[i];
+
+        if (r->rule.src != (uint32_t)src || ((key ^ r->id) & r->mask) != 0) {
+            continue;
+        }
+
+        __atomic_fetch_add(&r->hits, 1, __ATOMIC_RELAXED);
+
+        if (r->interval) {
+            if (tstamp + r->tolerance < r->tat) {
+                __atomic_fetch_add(&r->rate_drops, 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&r->drops, 1, __ATOMIC_RELAXED);
+
+                continue;
+            }
+
+            r->tat = ((r->tat > tstamp) ? r->tat : tstamp) + r->interval;
+        }
+
+        if (r->dst == NULL || !queue_has_space(r->dst)) {
+            __atomic_fetch_add(&r->drops, 1, __ATOMIC_RELAXED);
+
+            continue;
+        }
+
+        frame_t out = *frame;
+
+        out.hops = frame->hops + 1;
+
+        if (r->rule.flags & CAN_GW_SET_ID) {
+            out.id = r->new_id;
+        }
+
+        if (r->rule.flags & CAN_GW_MOD_DATA) {
+            uint64_t data;
+
+            memcpy(&data, out.data, sizeof(data));
+            data = ((data & r->and_data) | r->or_data) ^ r->xor_data;
+            memcpy(out.data, &data, sizeof(data));
+        }
+
+        if (enqueue_tstamp(r->dst, &out, tstamp) != EOK) {
+            __atomic_fetch_add(&r->drops, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    pthread_rwlock_unlock(&gateway_lock);
+}
+
+/* Payload bytes as hex digits, data[0] first, e.g. FF00FFFFFFFFFFFF */
+static int gateway_parse_data (const char* value, uint8_t data[8]) {
+    int i;
+
+    if (strlen(value) != 16) {
+        return EINVAL;
+    }
+
+    for (i = 0; i < 8; ++i) {
+        char byte[3] = { value[2*i], value[2*i + 1], '\0' };
+        char* end;
+
+        data[i] = (uint8_t)strtoul(byte, &end, 16);
+
+        if (*end != '\0') {
+            return EINVAL;
+        }
+    }
+
+    return EOK;
+}
+
+static int gateway_parse_uint (const char* value, uint32_t* result) {
+    char* end;
+    unsigned long n = strtoul(value, &end, 0);
+
+    if (end == value || *end != '\0' || n > UINT32_MAX) {
+        return EINVAL;
+    }
+
+    *result = (uint32_t)n;
+
+    return EOK;
+}
+
+int gateway_option (const char* option) {
+    char *copy, *options, *value;
+    struct can_gw_rule rule;
+    uint32_t ext = 0;
+    int have_src = 0, have_dst = 0, have_id = 0, have_mask = 0;
+    int result = EOK;
+
+    memset(&rule, 0, sizeof(rule));
+    memset(rule.and_data, 0xFF, sizeof(rule.and_data));
+
+    if ((copy = strdup(option)) == NULL) {
+        printf("strdup failure\n");
+
+        return EINVAL;
+    }
+
+    options = copy;
+    while (result == EOK && *options != '\0') {
+        int subopt = getsubopt(&options, gateway_sub_opts, &value);
+
+        if (subopt == -1) {
+            printf("error: Unknown suboption for -g\n");
+
+            result = EINVAL;
+            break;
+        }
+
+        if (value == NULL) {
+            printf("error with %s sub-option\n", gateway_sub_opts[subopt]);
+
+            result = EINVAL;
+            break;
+        }
+
+        switch (subopt) {
+        case GATEWAY_OPT_SRC:
+            result = gateway_parse_uint(value, &rule.src);
+            have_src = 1;
+            break;
+
+        case GATEWAY_OPT_DST:
+            result = gateway_parse_uint(value, &rule.dst);
+            have_dst = 1;
+            break;
+
+        case GATEWAY_OPT_ID:
+            result = gateway_parse_uint(value, &rule.id);
+            have_id = 1;
+            break;
+
+        case GATEWAY_OPT_MASK:
+            result = gateway_parse_uint(value, &rule.mask);
+            have_mask = 1;
+            break;
+
+        case GATEWAY_OPT_EXT:
+            result = gateway_parse_uint(value, &ext);
+            break;
+
+        case GATEWAY_OPT_SET_ID:
+            result = gateway_parse_uint(value, &rule.new_id);
+            rule.flags |= CAN_GW_SET_ID;
+            break;
+
+        case GATEWAY_OPT_AND:
+            result = gateway_parse_data(value, rule.and_data);
+            rule.flags |= CAN_GW_MOD_DATA;
+            break;
+
+        case GATEWAY_OPT_OR:
+            result = gateway_parse_data(value, rule.or_data);
+            rule.flags |= CAN_GW_MOD_DATA;
+            break;
+
+        case GATEWAY_OPT_XOR:
+            result = gateway_parse_data(value, rule.xor_data);
+            rule.flags |= CAN_GW_MOD_DATA;
+            break;
+
+        case GATEWAY_OPT_RATE:
+            result = gateway_parse_uint(value, &rule.rate);
+            break;
+        }
+
+        if (result != EOK) {
+            printf("invalid -g %s value: %s\n",
+                    gateway_sub_opts[subopt], value);
+        }
+    }
+
+    free(copy);
+
+    if (result != EOK) {
+        return result;
+    }
+
+    if (!have_src || !have_dst) {
+        printf("error: -g requires src and dst\n");
+
+        return EINVAL;
+    }
+
+    if (ext) {
+        rule.id |= CAN_GW_EFF;
+        rule.new_id |= CAN_GW_EFF;
+    }
+
+    if (!have_mask) {
+        /* a given id is matched exactly, otherwise all frames are */
+        rule.mask = have_id ? ~0U : 0;
+    }
+
+    if ((result = gateway_add_rule(&rule)) != EOK) {
+        printf("error: -g rule invalid (%s)\n", strerror(result));
+    }
+
+    return result;
+}
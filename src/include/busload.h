@@ -0,0 +1,105 @@
+/*
+ * \file    busload.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_BUSLOAD_H_
+#define SRC_BUSLOAD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/*
+ * Bus load measurement
+ *
+ * Every frame a device sees on its bus, received or transmitted, adds its
+ * time on the wire to a ring of BUSLOAD_BUCKET_NS wide buckets indexed by the
+ * frame timestamp. The load over a window is the bus time of the complete
+ * buckets it spans over the window length; the ring holds the longest
+ * window plus the bucket still filling, BUSLOAD_BUCKETS buckets. Frame bits are counted with
+ * can_frame_bits() without dynamic bit stuffing and with the intermission,
+ * the way Linux counts them for byte queue limits, so the real load is up to
+ * about a fifth higher for worst case payloads.
+ *
+ * Alongside, each CAN id gets an entry with its frame count and the moving
+ * averages of its inter-arrival time and of the deviation from it, the
+ * jitter; both are exponential with a 1/16 weight like RFC 3550 jitter.
+ * Frames of ids beyond BUSLOAD_MAX_IDS, or whose entry isn't found within
+ * BUSLOAD_MAX_PROBES slots, are only counted in other_frames.
+ *
+ * Frames are counted by the device's delivery thread, not on the IRQ path.
+ */
+
+#define BUSLOAD_BUCKET_NS   10000000ULL     /* 10 ms */
+#define BUSLOAD_BUCKETS     1001            /* 10 s and the current one */
+#define BUSLOAD_MAX_IDS     256             /* power of 2 */
+#define BUSLOAD_MAX_PROBES  8               /* id table slots tried */
+
+#define BUSLOAD_KEY_USED    0x40000000U     /* marks a used id entry */
+
+typedef struct busload_id {
+    uint32_t key;               /* frame id | BUSLOAD_KEY_USED; 0 unused */
+    uint32_t reserved;
+    uint64_t frames;
+    uint64_t last;              /* timestamp of the latest frame, ns */
+    uint64_t interval;          /* mean inter-arrival time, ns */
+    uint64_t jitter;            /* mean deviation from interval, ns */
+} busload_id_t;
+
+typedef struct busload {
+    pthread_mutex_t mutex;
+
+    uint64_t frames;            /* totals */
+    uint64_t bits;
+
+    uint64_t bucket[BUSLOAD_BUCKETS];       /* bucket number held */
+    uint32_t bucket_bits[BUSLOAD_BUCKETS];
+    uint32_t bucket_frames[BUSLOAD_BUCKETS];
+
+    busload_id_t ids[BUSLOAD_MAX_IDS];      /* open addressing on the id */
+    int num_ids;
+    uint64_t other_frames;      /* frames of ids left out of ids[] */
+} busload_t;
+
+typedef struct busload_window {
+    uint64_t frames;
+    uint64_t bits;
+} busload_window_t;
+
+extern void busload_init (busload_t* bl);
+extern void busload_destroy (busload_t* bl);
+
+/* Count a frame; id is a frame_t id (FRAME_EFF flag, no FRAME_ECHO) */
+extern void busload_frame (busload_t* bl, uint32_t id, uint8_t len, bool rtr,
+        uint64_t tstamp);
+
+/* Frames and bits of the complete buckets of the window_ns up to now */
+extern void busload_window (busload_t* bl, uint64_t window_ns, uint64_t now,
+        busload_window_t* window);
+
+/*
+ * Copy up to max id entries, from the first'th used entry on, in table order;
+ * returns the number copied
+ */
+extern int busload_ids (busload_t* bl, int first, busload_id_t* ids, int max);
+
+/* Forget the id entries */
+extern void busload_reset_ids (busload_t* bl);
+
+#endif /* SRC_BUSLOAD_H_ */
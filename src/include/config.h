@@ -26,6 +26,7 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <linux/irqreturn.h>
 
@@ -38,7 +39,15 @@
 #define DEFAULT_NUM_TX_CHANNELS 1
 #define DEFAULT_RESTART_MS      50 // Default bus-off restart delay
 #define DEFAULT_ERROR_COUNT     0  // default error state recovery count
+
+/* Adaptive polling defaults; see option -p */
+#define DEFAULT_POLL_FRAMES     32  // frames within the window to start polling
+#define DEFAULT_POLL_WINDOW_US  1000
+#define DEFAULT_POLL_BUDGET     64  // max frames handled per poll round
+#define DEFAULT_POLL_IDLE       8   // empty rounds before returning to IRQs
+#define DEFAULT_POLL_PERIOD_US  100 // time between poll rounds
 #define MAX_NO_OF_VCAN_CHANNELS 16 // maximum number of vcan devices allowed
+#define MAX_NO_OF_SIM_CHANNELS  16 // maximum number of sja1000sim devices
 
 /*
  * Program options
@@ -60,8 +69,15 @@ extern int opts;
 extern int optt;
 extern int optu;
 extern int optb;
+extern int optp;
+extern int optI;
+extern int optT;
 extern int optL;
 extern int optL_num;
+extern int optS;
+extern int optS_num;
+extern int optM;
+extern int optM_num;
 extern int optm;
 extern int optx;
 extern int optE;
@@ -71,6 +87,7 @@ typedef struct {
     int num_rx_channels;
     int num_tx_channels;
     int is_extended_mid;
+    int record_mode;    /* read()/write() whole struct can_msg records */
 } channel_config_t;
 
 extern size_t num_optu_configs;
@@ -90,6 +107,63 @@ typedef struct {
 extern size_t num_optb_configs;
 extern bitrate_config_t* optb_config;
 
+typedef struct poll_config {
+    int id;
+    int frames;             /* frames within window_us that start polling */
+    int window_us;
+    int budget;             /* max frames handled per poll round */
+    int idle;               /* empty poll rounds before returning to IRQs */
+    int period_us;          /* time between poll rounds */
+} poll_config_t;
+
+extern size_t num_optp_configs;
+extern poll_config_t* optp_config;
+
+/* Parse a -p option into optp_config; returns EOK, or EINVAL after printing
+ * the error */
+extern int poll_config_option (const char* option);
+
+typedef struct irq_config {
+    int id;
+    int per_attach;         /* one worker per IRQ attach instead of device */
+    int priority;           /* worker priority; 0 for the default */
+    uint32_t runmask;       /* CPUs the worker may run on; 0 for any */
+} irq_config_t;
+
+extern size_t num_optI_configs;
+extern irq_config_t* optI_config;
+
+/* Parse a -I option into optI_config; returns EOK, or EINVAL after printing
+ * the error */
+extern int irq_config_option (const char* option);
+
+/* Driver thread classes scheduled with -T */
+typedef enum thread_class {
+    THREAD_IRQ = 0,         /* IRQ workers servicing interrupt pulses */
+    THREAD_TX,              /* netif_tx() device transmit thread */
+    THREAD_RX,              /* reactor resuming blocked receive clients */
+    THREAD_RESMGR,          /* resource manager dispatch threads */
+    THREAD_TIMER,           /* bus-off recovery timer thread */
+    NUM_THREAD_CLASSES
+} thread_class_t;
+
+typedef struct thread_sched {
+    int policy;             /* SCHED_FIFO, SCHED_RR or SCHED_OTHER; -1 keeps
+                               the creating thread's policy */
+    int priority;           /* 0 for the default */
+    uint32_t runmask;       /* CPUs the thread may run on; 0 for any */
+} thread_sched_t;
+
+typedef struct thread_config {
+    int id;
+    unsigned classes;       /* bit per thread class given explicitly */
+    thread_sched_t sched[NUM_THREAD_CLASSES];
+} thread_config_t;
+
+extern thread_config_t optT_default;   /* -T without id; all devices */
+extern size_t num_optT_configs;
+extern thread_config_t* optT_config;
+
 typedef struct {
     int vid;
     int did;
@@ -183,6 +257,23 @@ typedef __u64       u64;
 #define MAX_IRQ_ATTACH_COUNT    (127)
 #define MAX_HANDLERS_PER_IRQ    (256)
 
+/* IRQ_ACTIONS_MIN
+ * Handlers an attach has room for at first; the array doubles when a further
+ * device shares the IRQ. */
+#define IRQ_ACTIONS_MIN         (4)
+
+/* MAX_IRQ_WORKERS
+ * Threads servicing IRQ pulses; worker 0 is the shared irq_loop() started by
+ * main(), further workers are created for devices configured with -I. */
+#define MAX_IRQ_WORKERS         (32)
+
+/* SOFT_IRQ_BASE
+ * IRQ numbers from SOFT_IRQ_BASE on are software IRQs of simulated devices;
+ * they are raised with soft_irq_raise() instead of by an interrupt
+ * controller. */
+#define SOFT_IRQ_BASE           (0x10000)
+#define MAX_SOFT_IRQS           MAX_IRQ_ATTACH_COUNT
+
 typedef struct {
     pci_irq_t*          irq;
     size_t              num_irq;
@@ -192,32 +283,69 @@ typedef struct {
     bool                is_msix;
 } irq_group_t;
 
+/* Handler of one device sharing an IRQ, as struct irqaction of Linux */
 typedef struct {
-    struct sigevent     event;
-    int                 id;
-    pci_irq_t           irq;
-    struct net_device*  dev[MAX_HANDLERS_PER_IRQ];
-    irqreturn_t         (*handler[MAX_HANDLERS_PER_IRQ])(int, void*);
-    irqreturn_t         (*reset_interrupt[MAX_HANDLERS_PER_IRQ])(int, void*);
+    irqreturn_t         (*handler)(int, void*);
+    irqreturn_t         (*thread_fn)(int, void*);
+    struct net_device*  dev;
+} irq_action_t;
+
+/*
+ * Handlers of an attach; an outgrown array is kept on the retired list of
+ * its successor, as a worker may still be walking it, and freed with the
+ * attach.
+ */
+typedef struct irq_actions {
+    struct irq_actions* retired;
+    size_t              max;
+    irq_action_t        action[];
+} irq_actions_t;
+
+/*
+ * Attaches are allocated as IRQs are requested and are never moved, as the
+ * kernel holds a pointer to them for the ISR; the fields irq_loop() reads
+ * for every pulse come first.
+ */
+typedef struct {
+    irq_actions_t*      actions;
     size_t              num_handlers;
+    pci_irq_t           irq;
+    int                 id;
+    bool                dead;       /* freed by free_irq(); never reused */
+
+    void                (*unmask)(uint_t);
+    void                (*mask)(uint_t);
+
+    int                 worker;     /* irq_worker[] servicing the pulses */
+
+    /* adaptive interrupt-to-polling mode; see irq_loop() */
+    const poll_config_t* poll;
+    bool                polling;
+    uint64_t            poll_window_start;
+    unsigned            poll_window_frames;
+    unsigned            poll_idle;
+
+    unsigned            soft_state; /* SOFT_IRQ_* of a software IRQ */
+
+    /* held by the worker while the handlers run and by free_irq() */
+    pthread_mutex_t     lock;
+
+    struct sigevent     event;
     pci_devhdl_t        hdl;
     pci_cap_t           msi_cap;
     uint_t              irq_entry;
     bool                is_msi;
     bool                is_msix;
-
-    void                (*unmask)(uint_t);
-    void                (*mask)(uint_t);
 } irq_attach_t;
 
-extern irq_group_t*     irq_group;
+extern irq_group_t**    irq_group;
 extern size_t           irq_group_size;
 extern irq_group_t**    irq_to_group_map;
 extern size_t           irq_to_group_map_size;
-extern irq_attach_t     irq_attach[MAX_IRQ_ATTACH_COUNT];
+extern irq_attach_t*    irq_attach[MAX_IRQ_ATTACH_COUNT];
 extern size_t           irq_attach_size;
 
-void irq_group_add (pci_irq_t* irq, size_t nirq,
+int irq_group_add (pci_irq_t* irq, size_t nirq,
         pci_devhdl_t hdl, pci_cap_t msi_cap, bool is_msi, bool is_msix);
 
 void irq_group_cleanup (void);
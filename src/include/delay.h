@@ -0,0 +1,48 @@
+/*
+ * \file    delay.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_DELAY_H_
+#define SRC_DELAY_H_
+
+#include <stdint.h>
+
+/*
+ * Short delays
+ *
+ * A sleep on QNX is rounded up to the clock tick and may run up to a tick
+ * past it, so sleeping is no good for the microsecond waits the Linux
+ * drivers make while switching the controller's mode. Delays of up to two
+ * ticks busy-wait on ClockCycles() instead; longer ones sleep until two
+ * ticks short of the deadline and busy-wait the rest. The spin compares against
+ * the free-running counter rather than counting loops, so being preempted
+ * in it doesn't stretch it. The counter rate and the tick are read once, on
+ * first use.
+ */
+
+/* Wait ns nanoseconds; never returns early */
+extern void delay_ns (uint64_t ns);
+
+/*
+ * Wait between min_us and max_us microseconds; a plain sleep when the range
+ * is wide enough to absorb the tick rounding, otherwise as delay_ns()
+ */
+extern void delay_range_us (unsigned long min_us, unsigned long max_us);
+
+#endif /* SRC_DELAY_H_ */
@@ -0,0 +1,120 @@
+/*
+ * \file    devstats.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_DEVSTATS_H_
+#define SRC_DEVSTATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Device statistics
+ *
+ * The counters of a device are split over DEVSTATS_SLOTS slots, each on cache
+ * lines of its own. A thread takes a slot the first time it counts anything
+ * and keeps it for good, so the IRQ, transmit, delivery and resmgr threads of
+ * a device each count into their own slot and never bounce a cache line
+ * between them. Threads are handed the slots in turn; once there are more
+ * threads than slots some share one, which is why the counting is still an
+ * atomic add, uncontended in the common case. Readers add up the slots.
+ *
+ * Counters only ever go up; a reader racing the counting threads sees each
+ * counter at some value it had, not a snapshot of all of them at one instant.
+ */
+
+#define DEVSTATS_SLOTS          16
+#define DEVSTATS_ALIGN          64
+
+typedef struct devstats {
+    /* struct net_device_stats counterparts */
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_errors;
+    uint64_t tx_errors;
+    uint64_t rx_dropped;            /* all receive drops, see below */
+    uint64_t tx_dropped;            /* all transmit drops, see below */
+    uint64_t rx_length_errors;
+    uint64_t rx_over_errors;        /* controller receive overruns */
+    uint64_t rx_crc_errors;
+    uint64_t rx_frame_errors;
+    uint64_t rx_fifo_errors;
+    uint64_t rx_missed_errors;
+    uint64_t tx_aborted_errors;     /* echo frames flushed, e.g. on bus-off */
+    uint64_t tx_carrier_errors;
+    uint64_t tx_fifo_errors;
+    uint64_t tx_heartbeat_errors;
+    uint64_t tx_window_errors;
+
+    /* struct can_device_stats counterparts */
+    uint64_t bus_error;
+    uint64_t error_warning;
+    uint64_t error_passive;
+    uint64_t bus_off;
+    uint64_t arbitration_lost;
+    uint64_t restarts;
+
+    /* driver */
+    uint64_t interrupts;            /* interrupt sources serviced */
+    uint64_t rx_interrupts;
+    uint64_t tx_interrupts;
+    uint64_t error_interrupts;
+    uint64_t rx_queue_drops;        /* client receive queue or ring full */
+    uint64_t rx_stage_drops;        /* RX staging ring full */
+    uint64_t rx_latency_drops;      /* older than the client latency limit */
+    uint64_t tx_queue_drops;        /* device transmit queue full */
+    uint64_t alloc_failures;        /* frame buffer pools empty */
+} __attribute__((aligned(DEVSTATS_ALIGN))) devstats_t;
+
+#define DEVSTATS_COUNTERS       (offsetof(devstats_t, alloc_failures) \
+                                    / sizeof(uint64_t) + 1)
+
+/* Slot of the calling thread; -1 until its first count */
+extern __thread int devstats_slot;
+
+extern int devstats_slot_take (void);
+
+/* The calling thread's slot of the counters of a device */
+static inline devstats_t* devstats_local (devstats_t* slots) {
+    int slot = devstats_slot;
+
+    if (slot < 0) {
+        slot = devstats_slot_take();
+    }
+
+    return &slots[slot];
+}
+
+#define DEVSTATS_ADD(slots, field, n) \
+    __atomic_fetch_add(&devstats_local(slots)->field, (n), __ATOMIC_RELAXED)
+
+#define DEVSTATS_INC(slots, field)  DEVSTATS_ADD(slots, field, 1)
+
+/* Sum of the slots of one counter, e.g. DEVSTATS_READ(slots, rx_packets) */
+#define DEVSTATS_READ(slots, field) \
+    devstats_read_counter(slots, offsetof(devstats_t, field))
+
+extern uint64_t devstats_read_counter (const devstats_t* slots, size_t offset);
+
+/* Sum of the slots of every counter */
+extern void devstats_read (const devstats_t* slots, devstats_t* sum);
+
+#endif /* SRC_DEVSTATS_H_ */
@@ -0,0 +1,111 @@
+/*
+ * \file    frame.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_FRAME_H_
+#define SRC_FRAME_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/can_dcmd.h>
+
+/*
+ * Internal frame record
+ *
+ * Frames travel through the driver's queues as 16 byte records, four to a
+ * cache line, with their receive timestamps kept in a separate lane (see
+ * queue_tstamp()). The QNX struct can_msg is only built from or taken apart
+ * into a frame record where frames cross to or from a client; the resmgr
+ * read/write/devctl handlers and the shared memory channels.
+ *
+ * The id holds the Linux style CAN id, i.e. the standard 11-bit id is not
+ * shifted up as it is in a QNX MID, together with the FRAME_* flags.
+ */
+
+#define FRAME_EFF       0x80000000U /* extended 29-bit id */
+#define FRAME_ECHO      0x40000000U /* loop-back of a transmitted frame */
+#define FRAME_ID_MASK   0x1FFFFFFFU
+
+/* QNX standard 11-bit MIDs are in bits 18-28 */
+#define FRAME_SFF_SHIFT 18
+
+typedef struct frame {
+    uint32_t id;                /* CAN id and FRAME_* flags */
+    uint8_t len;
+    uint8_t hops;               /* gateway forwards (-g) so far */
+    uint8_t _pad[2];
+    uint8_t data[CAN_MSG_DATA_MAX];
+} frame_t;
+
+static_assert( sizeof(frame_t) == 16, "frame_t must be 16 bytes" );
+
+/*
+ * Message IDs or MIDs are slightly different on QNX compared to Linux. The
+ * form of the ID depends on whether or not the driver is using extended MIDs:
+ *
+ *      - In standard 11-bit MIDs, bits 18–28 define the MID.
+ *      - In extended 29-bit MIDs, bits 0–28 define the MID.
+ */
+static inline uint32_t frame_mid (const frame_t* frame) {
+    if (frame->id & FRAME_EFF) {
+        return frame->id & FRAME_ID_MASK;
+    }
+
+    return (frame->id & FRAME_ID_MASK) << FRAME_SFF_SHIFT;
+}
+
+/* Client message to frame record; the length is limited to CAN_MSG_DATA_MAX */
+static inline void frame_from_canmsg (frame_t* frame,
+        const struct can_msg* canmsg)
+{
+    if (canmsg->ext.is_extended_mid) {
+        frame->id = (canmsg->mid & FRAME_ID_MASK) | FRAME_EFF;
+    }
+    else {
+        frame->id = (canmsg->mid >> FRAME_SFF_SHIFT) & FRAME_ID_MASK;
+    }
+
+    frame->len = (canmsg->len > CAN_MSG_DATA_MAX)
+        ? CAN_MSG_DATA_MAX : canmsg->len;
+    frame->hops = 0;
+    frame->_pad[0] = frame->_pad[1] = 0;
+
+    memcpy(frame->data, canmsg->dat, CAN_MSG_DATA_MAX);
+}
+
+/*
+ * Frame record to client message; timestamp is the legacy millisecond
+ * timestamp of the frame, see user_timestamp_ms().
+ */
+static inline void frame_to_canmsg (const frame_t* frame, uint32_t timestamp,
+        struct can_msg* canmsg)
+{
+    memset(canmsg, 0, sizeof(*canmsg));
+
+    canmsg->mid = frame_mid(frame);
+    canmsg->len = frame->len;
+    canmsg->ext.timestamp = timestamp;
+    canmsg->ext.is_extended_mid = (frame->id & FRAME_EFF) ? 1 : 0;
+    canmsg->ext.is_remote_frame = (frame->id & FRAME_ECHO) ? 0 : 1;
+
+    memcpy(canmsg->dat, frame->data, CAN_MSG_DATA_MAX);
+}
+
+#endif /* SRC_FRAME_H_ */
@@ -0,0 +1,78 @@
+/*
+ * \file    gateway.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_GATEWAY_H_
+#define SRC_GATEWAY_H_
+
+#include <stdint.h>
+
+#include <queue.h>
+
+struct can_gw_rule;
+struct can_gw_stats;
+
+/*
+ * In-driver CAN gateway
+ *
+ * Routes frames received on one device to the transmit queue of another
+ * without a client in between; see struct can_gw_rule. Rules come from -g
+ * options and EXT_CAN_DEVCTL_GW_* devctls. The receive paths hand each frame
+ * to gateway_route() before delivering it to the clients.
+ *
+ * The rule table is read locked while routing and write locked to change it.
+ * A rule's rate limiter state is only touched by the receive path of its
+ * source device.
+ */
+
+#define GATEWAY_MAX_DEVICES     64
+
+/* Process one -g option string; returns EOK or EINVAL after printing why */
+extern int gateway_option (const char* option);
+
+/* Add a rule; the index of the rule is returned in rule->index */
+extern int gateway_add_rule (struct can_gw_rule* rule);
+
+/* Counters of rule stats->index */
+extern int gateway_get_stats (struct can_gw_stats* stats);
+
+/* Remove the rules from index first on */
+extern void gateway_flush (uint32_t first);
+
+/* Device id now takes forwarded frames into tx_queue; NULL to detach */
+extern void gateway_attach (int id, queue_t* tx_queue);
+
+/* Number of rules; routing is skipped altogether while there are none */
+extern int gateway_num_rules;
+
+extern void gateway_route_frame (int src, const frame_t* frame,
+        uint64_t tstamp);
+
+/* Route a frame received on device src at tstamp (ns) */
+static inline void gateway_route (int src, const frame_t* frame,
+        uint64_t tstamp)
+{
+    if (__atomic_load_n(&gateway_num_rules, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    gateway_route_frame(src, frame, tstamp);
+}
+
+#endif /* SRC_GATEWAY_H_ */
@@ -21,6 +21,8 @@
 #ifndef SRC_INTERRUPT_H_
 #define SRC_INTERRUPT_H_
 
+#include <errno.h>
+#include <string.h>
 #include <pci/cap_msi.h>
 #include <pci/cap_msix.h>
 
@@ -31,7 +33,31 @@
 /* shutdown check */
 extern volatile unsigned shutdown_program; // 0x0 = running, 0x1 = shutdown
 
-extern void* irq_loop (void*);
+/*
+ * IRQ worker; a channel receiving the IRQ pulses of its attaches and the
+ * irq_loop() thread servicing them
+ */
+typedef struct irq_worker {
+    int chid;
+    struct sigevent terminate_event;
+    pthread_t thread;
+
+    struct net_device* owner;   /* device of a dedicated worker, or NULL */
+    bool per_attach;            /* dedicated to a single IRQ attach */
+    thread_sched_t sched;       /* irq thread class */
+    int priority;               /* effective priority; also of its pulses */
+
+    int polling;                /* attaches in polling mode */
+} irq_worker_t;
+
+extern irq_worker_t irq_worker[MAX_IRQ_WORKERS];
+extern size_t irq_worker_size;
+
+/* Free the IRQ attaches once the IRQ workers have stopped */
+extern void irq_attach_cleanup (void);
+
+/* arg is the irq_worker_t to run, or NULL for the shared worker 0 */
+extern void* irq_loop (void* arg);
 extern void terminate_irq_loop();
 
 
@@ -42,7 +68,7 @@ static inline void mask_irq_debug (uint_t attach_index) {
         return;
     }
 
-    irq_attach_t* attach = &irq_attach[attach_index];
+    irq_attach_t* attach = irq_attach[attach_index];
 
     if (attach->msi_cap
         && pci_device_cfg_cap_isenabled(attach->hdl, attach->msi_cap))
@@ -108,7 +134,7 @@ static inline void unmask_irq_debug (uint_t attach_index) {
         return;
     }
 
-    irq_attach_t* attach = &irq_attach[attach_index];
+    irq_attach_t* attach = irq_attach[attach_index];
 
     if (attach->msi_cap
         && pci_device_cfg_cap_isenabled(
@@ -184,7 +210,7 @@ static inline void mask_irq_msix (uint_t attach_index) {
         return;
     }
 
-    irq_attach_t* attach = &irq_attach[attach_index];
+    irq_attach_t* attach = irq_attach[attach_index];
 
     if (attach->msi_cap == NULL) {
         return;
@@ -214,7 +240,7 @@ static inline void unmask_irq_msix (uint_t attach_index) {
         return;
     }
 
-    irq_attach_t* attach = &irq_attach[attach_index];
+    irq_attach_t* attach = irq_attach[attach_index];
 
     if (attach->msi_cap == NULL) {
         return;
@@ -245,7 +271,7 @@ static inline void mask_irq_msi (uint_t attach_index) {
         return;
     }
 
-    irq_attach_t* attach = &irq_attach[attach_index];
+    irq_attach_t* attach = irq_attach[attach_index];
 
     if (attach->msi_cap == NULL) {
         return;
@@ -277,7 +303,7 @@ static inline void unmask_irq_msi (uint_t attach_index) {
         return;
     }
 
-    irq_attach_t* attach = &irq_attach[attach_index];
+    irq_attach_t* attach = irq_attach[attach_index];
 
     if (attach->msi_cap == NULL) {
         return;
@@ -309,7 +335,7 @@ static inline void mask_irq_regular (uint_t attach_index) {
         return;
     }
 
-    irq_attach_t* attach = &irq_attach[attach_index];
+    irq_attach_t* attach = irq_attach[attach_index];
 
     InterruptMask(attach->irq, attach->id);
 }
@@ -319,13 +345,13 @@ static inline void unmask_irq_regular (uint_t attach_index) {
         return;
     }
 
-    irq_attach_t* attach = &irq_attach[attach_index];
+    irq_attach_t* attach = irq_attach[attach_index];
 
     InterruptUnmask(attach->irq, attach->id);
 }
 
 static inline void mask_irq_msi_legacy (uint_t attach_index) {
-    irq_attach_t* attach = &irq_attach[attach_index];
+    irq_attach_t* attach = irq_attach[attach_index];
 
     if (attach->msi_cap == NULL) {
         return;
@@ -347,7 +373,7 @@ static inline void mask_irq_msi_legacy (uint_t attach_index) {
 }
 
 static inline void unmask_irq_msi_legacy (uint_t attach_index) {
-    irq_attach_t* attach = &irq_attach[attach_index];
+    irq_attach_t* attach = irq_attach[attach_index];
 
     if (attach->msi_cap == NULL) {
         return;
@@ -368,4 +394,56 @@ static inline void unmask_irq_msi_legacy (uint_t attach_index) {
     unmask_irq_regular(attach_index);
 }
 
+/*
+ * Software IRQs
+ *
+ * Raising a software IRQ masks it and delivers its pulse, like
+ * InterruptAttachEvent() does for a regular IRQ. Raised while masked it is
+ * left pending and delivered when unmasked.
+ */
+#define SOFT_IRQ_MASKED     0x1
+#define SOFT_IRQ_PENDING    0x2
+
+extern void soft_irq_raise (unsigned int irq);
+
+static inline void soft_irq_deliver (irq_attach_t* attach) {
+    if (MsgDeliverEvent(0, &attach->event) == -1) {
+        log_err("soft IRQ %d MsgDeliverEvent error; %s\n",
+                attach->irq, strerror(errno));
+    }
+}
+
+static inline void mask_irq_soft (uint_t attach_index) {
+    if (attach_index >= irq_attach_size) {
+        return;
+    }
+
+    __atomic_fetch_or( &irq_attach[attach_index]->soft_state,
+            SOFT_IRQ_MASKED, __ATOMIC_ACQ_REL );
+}
+
+static inline void unmask_irq_soft (uint_t attach_index) {
+    if (attach_index >= irq_attach_size) {
+        return;
+    }
+
+    irq_attach_t* attach = irq_attach[attach_index];
+    unsigned state = __atomic_load_n(&attach->soft_state, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        /* a pending IRQ is delivered at once and stays masked */
+        unsigned next = (state & SOFT_IRQ_PENDING) ? SOFT_IRQ_MASKED : 0;
+
+        if (__atomic_compare_exchange_n( &attach->soft_state, &state, next,
+                    false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ))
+        {
+            if (next) {
+                soft_irq_deliver(attach);
+            }
+
+            return;
+        }
+    }
+}
+
 #endif /* SRC_INTERRUPT_H_ */
@@ -0,0 +1,99 @@
+/*
+ * \file    latency.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_LATENCY_H_
+#define SRC_LATENCY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Frame pipeline latency histograms
+ *
+ * Each stage a frame passes through in the driver is timed from the end of
+ * the stage before it, on the get_clock_time_ns() time base, and the time is
+ * counted into a log2 histogram of the stage: bucket b holds the times of
+ * [2^b, 2^(b+1)) ns, bucket 0 those under 2 ns and the last bucket everything
+ * from 2^(LATENCY_BUCKETS-1) ns on. Histograms are kept per device and per
+ * client session; a session only sees the receive stages it takes part in.
+ *
+ * Samples are added with relaxed atomics by whichever thread runs a stage,
+ * so a reader racing them may see a sample's bucket before its sum.
+ */
+
+#define LATENCY_BUCKETS     32
+
+typedef enum latency_stage {
+    /* receive */
+    LATENCY_RX_IRQ,         /* IRQ pulse receipt to its first frame read */
+    LATENCY_RX_QUEUE,       /* read out to stored in the client queues */
+    LATENCY_RX_WAKE,        /* stored to taken by the client */
+    LATENCY_RX_REPLY,       /* first frame taken to the reply; per reply */
+
+    /* transmit */
+    LATENCY_TX_QUEUE,       /* client write or devctl to taken off tx_queue */
+    LATENCY_TX_XMIT,        /* taken off tx_queue to handed to the controller */
+    LATENCY_TX_DONE,        /* handed to the controller to TX complete IRQ */
+
+    LATENCY_STAGES
+} latency_stage_t;
+
+typedef struct latency_hist {
+    uint64_t count[LATENCY_BUCKETS];
+    uint64_t sum;           /* ns */
+    uint64_t max;           /* ns */
+} latency_hist_t;
+
+typedef struct latency {
+    latency_hist_t stage[LATENCY_STAGES];
+} latency_t;
+
+static inline int latency_bucket (uint64_t ns) {
+    int b = (ns > 1) ? 63 - __builtin_clzll(ns) : 0;
+
+    return (b < LATENCY_BUCKETS) ? b : LATENCY_BUCKETS - 1;
+}
+
+/* Count a time of ns in stage */
+static inline void latency_add (latency_t* lat, latency_stage_t stage,
+        uint64_t ns)
+{
+    latency_hist_t* hist = &lat->stage[stage];
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&hist->count[latency_bucket(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum, ns, __ATOMIC_RELAXED);
+
+    while (ns > max && !__atomic_compare_exchange_n(&hist->max, &max, ns,
+                true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {}
+}
+
+/* Time from since to now (ns), 0 if the clock reads went out of order */
+static inline uint64_t latency_since (uint64_t since, uint64_t now) {
+    return (now > since) ? now - since : 0;
+}
+
+extern void latency_init (latency_t* lat);
+
+/* Copy the histograms, optionally clearing them */
+extern void latency_read (latency_t* lat, latency_t* out, int reset);
+
+#endif /* SRC_LATENCY_H_ */
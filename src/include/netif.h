@@ -21,6 +21,18 @@
 #ifndef SRC_NETIF_H_
 #define SRC_NETIF_H_
 
+#include <session.h>
+#include <vbus.h>
+
 extern void* netif_tx (void* arg);
 
+extern void netif_rx_deliver (device_session_t* ds,
+        const rx_stage_frame_t* frames, int n);
+
+/* Virtual bus (-B) callbacks of the vcan devices; arg is the net_device */
+extern void netif_vbus_deliver (void* arg, const frame_t* frame,
+        uint64_t tstamp);
+extern void netif_vbus_event (void* arg, vbus_event_t event,
+        unsigned tec, unsigned rec);
+
 #endif /* SRC_NETIF_H_ */
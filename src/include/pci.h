@@ -42,6 +42,7 @@ extern struct pci_driver peak_pci_driver;
 extern struct pci_driver plx_pci_driver;
 extern struct pci_driver f81601_pci_driver;
 extern struct pci_driver vcan_driver;
+extern struct pci_driver sim_pci_driver;
 
 extern int process_driver_selection();
 extern void print_driver_selection_results();
@@ -281,7 +282,8 @@ static inline void remove_all_driver_selections() {
             driver_selection_root->driver->remove(pdev);
 
             if (pdev->vendor && pdev->device) {
-                // Only Virtual CAN (vcan) driver can have vendor=0 or device=0
+                // Only the virtual vcan and sja1000sim drivers can have
+                // vendor=0 or device=0
 
                 for (int_t i = 0; i < pdev->nba; ++i) {
                     ioblock_t* block = NULL;
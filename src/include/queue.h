@@ -1,7 +1,7 @@
 /*
  * \file    queue.h
  *
- * \details Circular queue for handling CAN messages of QNX type can_msg.
+ * \details Circular queue for handling CAN frames as internal frame records.
  *          Multi-thread safe, blocks on dequeue and implements nice shutdown on
  *          destroy_queue() call.
  *
@@ -26,7 +26,8 @@
 #define SRC_QUEUE_H_
 
 #include <pthread.h>
-#include <sys/can_dcmd.h>
+
+#include "frame.h"
 
 
 typedef struct queue_attr {
@@ -36,19 +37,37 @@ typedef struct queue_attr {
 typedef struct queue {
     queue_attr_t attr;
 
-    struct can_msg* data;
+    frame_t* data;
+    uint64_t* tstamp;   /* receive time lane (ns), one per data slot */
+    uint64_t* queued;   /* time stored lane (ns), for latency measurement */
     int begin, end;
+    int reserved;       /* messages from begin held by dequeue_reserve() */
+    uint64_t removed;   /* messages taken off the front, read or lost */
 
     pthread_cond_t cond;
+    pthread_cond_t space;   /* signalled when messages are removed or a
+                             * reservation is released */
     pthread_mutex_t mutex;
 
     volatile int session_up;
     volatile int dequeue_waiting;
+    volatile int space_waiting; /* callers waiting on space */
     volatile int stopped;
     volatile int wake_pending;
+    volatile int kicked;    /* makes dequeue() return NULL once when empty */
 
     void* dropped_packet_arg;
     void (*dropped_packet)(void*);
+
+    void* expired_arg;
+    void (*expired)(void*);     /* called for each message dropped for being
+                                 * older than the dequeue latency limit */
+
+    void* enqueued_arg;
+    void (*enqueued)(void*);    /* called after a message has been stored */
+
+    void* dequeued_arg;
+    void (*dequeued)(void*);    /* called after a message has been removed */
 } queue_t;
 
 
@@ -58,6 +77,7 @@ static inline void queue_shutdown_signal (queue_t* Q) {
     Q->session_up = 0;
 
     pthread_cond_signal(&Q->cond);
+    pthread_cond_broadcast(&Q->space);
     pthread_mutex_unlock(&Q->mutex);
 }
 
@@ -91,6 +111,28 @@ static inline void queue_start (queue_t* Q) {
     Q->stopped = 0;
 }
 
+/* unlocked estimate; used for readiness reporting only */
+static inline int queue_has_space (queue_t* Q) {
+    int count = (Q->end >= Q->begin)
+        ? Q->end - Q->begin
+        : Q->attr.size - Q->begin + Q->end;
+
+    return count < Q->attr.size - 1;
+}
+
+/*
+ * Wake a consumer blocked in dequeue() without a message, e.g. to look at
+ * other sources of work; dequeue() then returns NULL with session_up still set
+ */
+static inline void queue_kick (queue_t* Q) {
+    pthread_mutex_lock(&Q->mutex);
+
+    Q->kicked = 1;
+
+    pthread_cond_signal(&Q->cond);
+    pthread_mutex_unlock(&Q->mutex);
+}
+
 static inline int queue_wake_pending (queue_t* Q) {
     return Q->wake_pending;
 }
@@ -103,13 +145,59 @@ static inline void queue_awake (queue_t* Q) {
     Q->wake_pending = 0;
 }
 
+/*
+ * Timestamp (ns) of a message returned by any of the dequeue functions; only
+ * valid while the message pointer itself is valid.
+ */
+static inline uint64_t queue_tstamp (queue_t* Q, const frame_t* msg) {
+    return Q->tstamp[msg - Q->data];
+}
+
+/*
+ * Count of messages taken off the front of the queue so far, read or lost to
+ * a full queue; tells whether the oldest message is still the one seen before
+ */
+static inline uint64_t queue_removed (queue_t* Q) {
+    return Q->removed;
+}
+
+/* Time (ns) a message returned by any of the dequeue functions was stored */
+static inline uint64_t queue_queued (queue_t* Q, const frame_t* msg) {
+    return Q->queued[msg - Q->data];
+}
+
 extern int create_queue (queue_t* Q, const queue_attr_t* attr);
 extern void destroy_queue (queue_t* Q);
-extern int enqueue (queue_t* Q, struct can_msg* msg);
-extern struct can_msg* dequeue (queue_t* Q, uint32_t latency_limit_ms);
-extern struct can_msg* dequeue_noblock (queue_t* Q, uint32_t latency_limit_ms);
-extern struct can_msg* dequeue_peek (queue_t* Q);
-extern struct can_msg* dequeue_peek_noblock (queue_t* Q);
+extern int enqueue (queue_t* Q, const frame_t* msg);
+extern int enqueue_tstamp (queue_t* Q, const frame_t* msg, uint64_t tstamp);
+
+/* As enqueue_tstamp() for a caller that read the clock already; queued (ns) */
+extern int enqueue_at (queue_t* Q, const frame_t* msg, uint64_t tstamp,
+        uint64_t queued);
+
+/*
+ * Store a message without losing any queued ones; while the queue is full it
+ * waits for messages to be removed, or returns EAGAIN straight away if
+ * noblock is set. Returns EPIPE once the queue is shut down.
+ */
+extern int enqueue_wait (queue_t* Q, const frame_t* msg, int noblock);
+extern frame_t* dequeue (queue_t* Q, uint32_t latency_limit_ms);
+extern frame_t* dequeue_noblock (queue_t* Q, uint32_t latency_limit_ms);
+extern frame_t* dequeue_peek (queue_t* Q);
+extern frame_t* dequeue_peek_noblock (queue_t* Q);
+
+/*
+ * Zero-copy access to up to max of the oldest messages, returned as at most
+ * two contiguous segments (the second one when the messages wrap around the
+ * end of the ring). The slots stay valid until dequeue_release(), which
+ * consumes the first count of them and gives up the rest; meanwhile a full
+ * queue drops new messages instead of the oldest ones. A reservation held by
+ * another caller is waited for, so concurrent readers never get the same
+ * messages. Returns the number of messages reserved.
+ */
+extern int dequeue_reserve (queue_t* Q, int max,
+        frame_t* seg[2], int seg_len[2]);
+extern void dequeue_release (queue_t* Q, int count);
 
 
 #endif /* SRC_QUEUE_H_ */
@@ -0,0 +1,69 @@
+/*
+ * \file    reactor.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_REACTOR_H_
+#define SRC_REACTOR_H_
+
+#include <pthread.h>
+
+struct can_ocb;
+struct can_resmgr;
+struct thread_sched;
+
+/*
+ * Per-device reactor
+ *
+ * A single thread per device resumes clients blocked in io_read() or one of
+ * the blocking receive devctls. RX sessions queue their OCB on the reactor
+ * when a frame is enqueued while a client is blocked, and the reactor replays
+ * the blocked message with resmgr_msg_again() on the resmgr context reserved
+ * for it.
+ */
+typedef struct reactor {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;        /* signalled when an OCB becomes ready */
+    pthread_cond_t idle;        /* signalled when active returns to NULL */
+
+    struct can_ocb* ready_head; /* OCBs with blocked clients and new data */
+    struct can_ocb* ready_tail;
+
+    struct can_resmgr* active;  /* resmgr whose context is in use, or NULL */
+    struct can_ocb* active_ocb; /* OCB being resumed; cleared by cancel */
+
+    const struct thread_sched* sched;   /* rx thread class */
+
+    int refs;                   /* number of attached resmgrs */
+    int shutdown;
+} reactor_t;
+
+extern reactor_t* create_reactor (const struct thread_sched* sched);
+
+/* Attach/detach a resmgr; the last detach stops and frees the reactor */
+extern void reactor_attach (reactor_t* r, struct can_resmgr* resmgr);
+extern void reactor_detach (reactor_t* r, struct can_resmgr* resmgr);
+
+/* Schedule a resume of the OCB's blocked clients */
+extern void reactor_signal (reactor_t* r, struct can_ocb* ocb);
+
+/* Remove the OCB and refuse further signals; called before it is freed */
+extern void reactor_cancel (reactor_t* r, struct can_ocb* ocb);
+
+#endif /* SRC_REACTOR_H_ */
@@ -23,6 +23,8 @@
 
 #include <pci/pci.h>
 #include <session.h>
+#include <reactor.h>
+#include <waitq.h>
 
 #include <drivers/net/can/sja1000/sja1000.h>
 
@@ -48,6 +50,7 @@ struct can_ocb;
 #include <sys/neutrino.h>
 
 #define MAX_NAME_SIZE (IFNAMSIZ*2) // e.g. /dev/can1/rx0
+#define READ_IOV_MAX 32 // frames per MsgWritev()/MsgReplyv() in io_read()
 
 
 /*
@@ -95,12 +98,6 @@ struct resmgr_ops {
     int     (*fill_xstats)(struct sk_buff* skb, const struct net_device* dev);
 };
 
-typedef struct blocked_client {
-    struct blocked_client *prev, *next;
-
-    int rcvid; // resmgr_msg_again() entry; -1 when no blocking client
-} blocked_client_t;
-
 /*
  * Extended OCB structure
  */
@@ -112,19 +109,32 @@ typedef struct can_ocb {
     int session_index;
     client_session_t *session;
 
+    /* When set read() and write() transfer whole struct can_msg records rather
+     * than payload bytes only */
+    int record_mode;
+
     struct rx_t {
-        pthread_t thread;
         pthread_mutex_t mutex;
-        pthread_cond_t cond;
 
-        blocked_client_t* blocked_clients;
+        waitq_t blocked_clients; // rcvids for resmgr_msg_again()
+
+        /* reactor ready list linkage; protected by the reactor mutex */
+        struct can_ocb* ready_next;
+        int ready_queued;
 
         queue_t* queue;
 
-        char* read_buffer;
-        size_t read_size;
-        size_t nbytes, offset;
+        size_t offset; // payload bytes of the oldest frame already read
+        uint64_t head; // queue_removed() count while that frame was oldest
     } rx;
+
+    /* ionotify()/select()/poll() support */
+    struct notify_t {
+        pthread_mutex_t mutex;
+        volatile int armed;
+
+        iofunc_notify_t list[3]; // IOFUNC_NOTIFY_INPUT, _OUTPUT and _OBAND
+    } notify;
 } can_ocb_t;
 
 typedef enum channel_type {
@@ -139,6 +149,7 @@ typedef struct can_resmgr {
     struct driver_selection* driver_selection;
     int is_extended_mid; // Only applicable for read and write functions not
                          // used for direct devctl send/receive functionality.
+    int record_mode;     // Initial record_mode of OCBs opened on this resmgr
 
     char name[MAX_NAME_SIZE];
     channel_type_t channel_type;
@@ -149,6 +160,7 @@ typedef struct can_resmgr {
 
 #if CONFIG_QNX_RESMGR_THREAD_POOL == 1
     thread_pool_attr_t thread_pool_attr;
+    pthread_attr_t thread_attr;
     thread_pool_t* thread_pool;
 #elif CONFIG_QNX_RESMGR_SINGLE_THREAD == 1
     dispatch_context_t* dispatch_context;
@@ -158,6 +170,10 @@ typedef struct can_resmgr {
 
     int id;
 
+    /* RX channels only; resumes blocked clients of this resmgr */
+    reactor_t* reactor;
+    dispatch_context_t* reactor_context;
+
     iofunc_mount_t mount;
     iofunc_funcs_t mount_funcs;
 
@@ -212,85 +228,4 @@ static inline void free_all_resmgrs (can_resmgr_t** root) {
     }
 }
 
-static inline void store_blocked_client (
-        blocked_client_t** root, blocked_client_t* r)
-{
-    if (*root == NULL) {
-        *root = r;
-        r->prev = r->next = NULL;
-        return;
-    }
-
-    blocked_client_t* last = *root;
-
-    while (last->next != NULL) {
-        last = last->next;
-    }
-
-    last->next = r;
-    r->prev = last;
-    r->next = NULL;
-}
-
-static inline blocked_client_t* get_blocked_client (
-        blocked_client_t** root, int rcvid)
-{
-    blocked_client_t* location = *root;
-
-    while (location != NULL) {
-        if (location->rcvid == rcvid) {
-            return location;
-        }
-
-        location = location->next;
-    }
-
-    return NULL;
-}
-
-static inline void remove_blocked_client (blocked_client_t** root, int rcvid) {
-    blocked_client_t* location = *root;
-
-    while (location != NULL) {
-        if (location->rcvid == rcvid) {
-            if (location->prev == NULL) {
-                *root = location->next;
-                if (*root != NULL) {
-                    (*root)->prev = NULL;
-                }
-            }
-            else {
-                location->prev->next = location->next;
-
-                if (location->next) {
-                    location->next->prev = location->prev;
-                }
-            }
-
-            blocked_client_t* next = NULL;
-
-            if (location != NULL) {
-                next = location->next;
-            }
-
-            free(location);
-
-            location = next;
-        }
-        else {
-            location = location->next;
-        }
-    }
-}
-
-static inline void free_all_blocked_clients (blocked_client_t** root) {
-    while (*root != NULL) {
-        blocked_client_t* next = (*root)->next;
-
-        free(*root);
-
-        *root = next;
-    }
-}
-
 #endif /* SRC_RESMGR_H_ */
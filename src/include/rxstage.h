@@ -0,0 +1,90 @@
+/*
+ * \file    rxstage.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_RXSTAGE_H_
+#define SRC_RXSTAGE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/can_dcmd.h>
+
+#include <dev-can-linux/shmring.h>
+
+#define RX_STAGE_SLOTS          256     /* power of two */
+#define RX_STAGE_BATCH          32      /* frames fanned out per lock */
+
+struct device_session;
+struct thread_sched;
+
+/* Raw received frame as drained from the hardware */
+typedef struct rx_stage_frame {
+    uint64_t tstamp;            /* receive time (ns) */
+    uint64_t read;              /* read out of the controller (ns) */
+    uint32_t can_id;            /* Linux can_id with EFF/RTR flags */
+    uint8_t len;
+    uint8_t is_echo;            /* loop-back of a transmitted frame */
+    uint8_t pulse;              /* tstamp is the IRQ pulse receipt time */
+    uint8_t _pad;
+    uint8_t data[CAN_MSG_DATA_MAX];
+} rx_stage_frame_t;
+
+/*
+ * Per-device receive staging ring
+ *
+ * The IRQ path only copies each frame drained from the hardware into this
+ * lock-free ring and returns, so the interrupt is unmasked again right away.
+ * A delivery thread per device converts the frames and fans them out to the
+ * client sessions, taking the session lock once per batch. The ring is a
+ * private shmring; the IRQ path rings the delivery thread's doorbell, a pulse,
+ * only when the thread went to sleep on an empty ring, so a busy device or one
+ * in polling mode (-p) wakes it at most once per batch.
+ */
+typedef struct rx_stage {
+    shmring_port_t producer;    /* IRQ path side */
+    shmring_port_t consumer;    /* delivery thread side */
+    void* mem;
+
+    int chid;                   /* delivery thread doorbell */
+    int coid;
+    int priority;               /* of the doorbell pulse */
+
+    const struct thread_sched* sched;   /* rx thread class */
+    pthread_attr_t thread_attr;
+    pthread_t thread;
+    int running;
+
+    struct device_session* device_session;
+    void (*deliver)(struct device_session*, const rx_stage_frame_t*, int);
+} rx_stage_t;
+
+/*
+ * Start the delivery thread of a device; deliver() is called with batches of
+ * up to RX_STAGE_BATCH frames.
+ */
+extern int create_rx_stage (rx_stage_t* stage, struct device_session* ds,
+        void (*deliver)(struct device_session*, const rx_stage_frame_t*, int),
+        const struct thread_sched* sched, int default_priority);
+
+extern void destroy_rx_stage (rx_stage_t* stage);
+
+/* IRQ path; stage a received frame, EAGAIN if the ring is full */
+extern int rx_stage_push (rx_stage_t* stage, const rx_stage_frame_t* frame);
+
+#endif /* SRC_RXSTAGE_H_ */
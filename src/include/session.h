@@ -23,6 +23,10 @@
 
 #include <config.h>
 #include <queue.h>
+#include <shmchan.h>
+#include <rxstage.h>
+#include <busload.h>
+#include <latency.h>
 
 /* must ensure session create, destroy and handling are atomic */
 extern pthread_mutex_t device_session_create_mutex;
@@ -36,6 +40,15 @@ typedef struct client_session {
     uint32_t* prio;      /* CAN priority - not used */
 
     queue_t rx_queue;
+
+    /* called when the device tx_queue has been drained by one message */
+    void* tx_ready_arg;
+    void (*tx_ready)(void*);
+
+    /* shared memory ring replacing rx_queue or the write path, or NULL */
+    shm_channel_t* shm;
+
+    latency_t latency;      /* receive stages of this session's frames */
 } client_session_t;
 
 typedef struct device_session {
@@ -43,12 +56,28 @@ typedef struct device_session {
     struct net_device* device;
     struct client_session* root_client_session;
 
+    int id;                 /* device id, e.g. 0 for /dev/can0; -1 until set */
+
     pthread_attr_t tx_thread_attr;
     pthread_t tx_thread;
 
     queue_t tx_queue;
 
+    /* frames staged by the IRQ path for the delivery thread */
+    rx_stage_t rx_stage;
+
     int queue_stopped;
+
+    /* shared memory TX rings of the client sessions, drained by netif_tx */
+    pthread_mutex_t shm_tx_mutex;
+    shm_channel_t* shm_tx_list;
+    int shm_tx_channels;    /* client sessions with a shared memory TX ring */
+    int shm_tx_turn;        /* round robin position among those rings */
+
+    int tx_notify_armed;    /* TX OCBs with armed notification entries */
+
+    busload_t busload;      /* frames seen on the device's bus */
+    latency_t latency;      /* frame pipeline stages, all sessions */
 } device_session_t;
 
 extern device_session_t* root_device_session;
@@ -64,6 +93,9 @@ extern client_session_t* create_client_session (
 
 extern void destroy_client_session (client_session_t* S);
 
+/* Add a client session's shared memory TX ring to those drained by netif_tx */
+extern void attach_shm_tx_channel (device_session_t* D, shm_channel_t* ch);
+
 static inline device_session_t* get_last_device_session() {
     device_session_t* last = root_device_session;
 
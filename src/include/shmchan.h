@@ -0,0 +1,81 @@
+/*
+ * \file    shmchan.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_SHMCHAN_H_
+#define SRC_SHMCHAN_H_
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/neutrino.h>
+#include <sys/can_dcmd.h>
+
+#include <dev-can-linux/shmring.h>
+
+#include "frame.h"
+
+#define SHM_CHANNEL_DEFAULT_SLOTS   1024
+
+typedef enum shm_channel_dir {
+    SHM_CHANNEL_RX,         /* driver produces, client consumes */
+    SHM_CHANNEL_TX          /* client produces, driver consumes */
+} shm_channel_dir_t;
+
+/*
+ * Shared memory channel of a client session
+ *
+ * An anonymous shared memory object holding one shmring of struct can_msg_ts
+ * records, handed to the client with shm_create_handle(). For RX channels the
+ * client's registered event is delivered as the doorbell; for TX channels the
+ * client rings the driver with EXT_CAN_DEVCTL_SHM_TX_KICK.
+ */
+typedef struct shm_channel {
+    shm_channel_dir_t dir;
+    shmring_port_t port;    /* driver side of the ring */
+
+    int fd;
+    void* mem;
+    size_t size;
+
+    int rcvid;              /* client to deliver the RX doorbell to */
+    struct sigevent event;
+    int event_valid;
+
+    struct shm_channel* next;   /* device's TX channel list */
+} shm_channel_t;
+
+extern shm_channel_t* create_shm_channel (shm_channel_dir_t dir,
+        uint32_t slots);
+extern void destroy_shm_channel (shm_channel_t* ch);
+
+/* Give process pid a one time handle to map the channel */
+extern int shm_channel_handle (shm_channel_t* ch, pid_t pid,
+        shm_handle_t* handle);
+
+/*
+ * Push a received frame into an RX channel and ring the client's doorbell if
+ * it is sleeping on the empty ring. Returns EAGAIN when the ring is full.
+ */
+extern int shm_channel_rx (shm_channel_t* ch,
+        const frame_t* frame, uint64_t tstamp);
+
+/* Take the next frame written by the client to a TX channel; EAGAIN if none */
+extern int shm_channel_tx (shm_channel_t* ch, frame_t* frame);
+
+#endif /* SRC_SHMCHAN_H_ */
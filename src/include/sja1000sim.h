@@ -0,0 +1,131 @@
+/*
+ * \file    sja1000sim.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_SJA1000SIM_H_
+#define SRC_SJA1000SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/*
+ * Register level SJA1000 simulator
+ *
+ * Models a PeliCAN mode SJA1000 as seen through its register file: the mode,
+ * command, status and interrupt registers, the 64 byte receive FIFO with its
+ * message counter and start address, the transmit buffer, the acceptance
+ * filters (single and dual filter mode) and the error counters with their
+ * warning, passive and bus-off transitions.
+ *
+ * Controllers are attached to a simulated bus; a transmission request puts
+ * the frame on the bus at once and every other operating controller whose
+ * acceptance filter passes it receives it. Frames no controller acknowledges
+ * raise ACK errors on the transmitter, which keeps retrying until it becomes
+ * error passive, and then until a controller joins or the request is aborted.
+ * Bit timing, arbitration and BasicCAN mode are not modelled.
+ *
+ * The module has no QNX dependencies so that the full driver receive,
+ * transmit and interrupt paths can also be run in a host test harness.
+ */
+
+#define SJA1000_SIM_REGS        128 // register address space
+#define SJA1000_SIM_RX_FIFO     64  // receive FIFO size in bytes
+#define SJA1000_SIM_TX_BUF      13  // frame information, id and data bytes
+#define SJA1000_SIM_MAX_NODES   16  // controllers per bus
+
+typedef struct sja1000_sim_frame {
+    uint32_t id;
+    bool eff;                   /* extended 29-bit id */
+    bool rtr;
+    uint8_t len;                /* DLC, 0-15 */
+    uint8_t data[8];
+} sja1000_sim_frame_t;
+
+typedef struct sja1000_sim sja1000_sim_t;
+
+typedef struct sja1000_sim_bus {
+    pthread_mutex_t mutex;
+    sja1000_sim_t* node[SJA1000_SIM_MAX_NODES];
+    int num_nodes;
+
+    /* acknowledge every frame, as if a further node were listening */
+    bool ack;
+
+    /* observer of every frame put on the bus; called with the bus locked */
+    void (*tx)(void* arg, const sja1000_sim_frame_t* frame);
+    void* tx_arg;
+
+    uint64_t frames;            /* frames put on the bus */
+    uint64_t ack_errors;        /* transmissions nobody acknowledged */
+} sja1000_sim_bus_t;
+
+struct sja1000_sim {
+    sja1000_sim_bus_t* bus;
+
+    /* raised when the interrupt output becomes active; bus not locked */
+    void (*irq)(void* arg);
+    void* irq_arg;
+
+    uint8_t mod, ier, ir, sr;
+    uint8_t btr0, btr1, ocr, cdr;
+    uint8_t alc, ecc, ewl;
+    uint8_t acr[4], amr[4];
+
+    unsigned txerr, rxerr;
+
+    uint8_t tx_buf[SJA1000_SIM_TX_BUF];
+    bool tx_pending;            /* request waiting for an acknowledgement */
+    bool tx_single_shot;
+    bool tx_self;               /* self reception request */
+
+    uint8_t fifo[SJA1000_SIM_RX_FIFO];
+    uint8_t rbsa;               /* start of the current message */
+    uint8_t fifo_used;          /* bytes held */
+    uint8_t rmc;                /* messages held */
+
+    bool irq_line;              /* interrupt output active */
+    bool irq_raise;             /* irq() is due once the bus is unlocked */
+
+    uint64_t rx_overruns;
+};
+
+extern int sja1000_sim_bus_init (sja1000_sim_bus_t* bus);
+extern void sja1000_sim_bus_destroy (sja1000_sim_bus_t* bus);
+
+/* Attach sim to bus in its hardware reset state */
+extern int sja1000_sim_init (sja1000_sim_t* sim, sja1000_sim_bus_t* bus,
+        void (*irq)(void* arg), void* irq_arg);
+extern void sja1000_sim_destroy (sja1000_sim_t* sim);
+
+/* Register file access, as from the host bus */
+extern uint8_t sja1000_sim_read (sja1000_sim_t* sim, int reg);
+extern void sja1000_sim_write (sja1000_sim_t* sim, int reg, uint8_t val);
+
+/* Whether the interrupt output is active */
+extern bool sja1000_sim_irq_active (sja1000_sim_t* sim);
+
+/* Put a frame on the bus from a node outside the simulation */
+extern int sja1000_sim_bus_inject (sja1000_sim_bus_t* bus,
+        const sja1000_sim_frame_t* frame);
+
+/* Bit error detected by sim while transmitting (tx) or receiving */
+extern void sja1000_sim_inject_error (sja1000_sim_t* sim, bool tx);
+
+#endif /* SRC_SJA1000SIM_H_ */
@@ -0,0 +1,103 @@
+/*
+ * \file    slab.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_SLAB_H_
+#define SRC_SLAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Slab object caches
+ *
+ * Each cache hands out fixed size objects of one type from a single block of
+ * memory reserved at startup, so the receive and transmit paths never call
+ * malloc(). Free objects are kept on a lock-free global depot, a stack of
+ * object indices with a tagged head against ABA, and each thread keeps a small
+ * magazine of objects per cache in front of it. Allocations and frees mostly
+ * hit the magazine; only a full or empty magazine exchanges half its objects
+ * with the depot. Objects are not cleared on allocation.
+ *
+ * Objects held in the magazines of other threads can't be allocated, so a
+ * cache can report exhaustion up to SLAB_MAGAZINE_SIZE objects per thread
+ * early; the default cache size leaves room for that. A thread's magazines
+ * are returned to the depots when it exits.
+ */
+
+#define SLAB_MAX_CACHES         4
+#define SLAB_MAGAZINE_SIZE      16
+#define SLAB_ALIGN              16
+#define SLAB_DEFAULT_OBJECTS    1024    /* per cache; see option -M */
+#define SLAB_NIL                UINT32_MAX
+
+typedef struct slab_cache {
+    const char* name;
+    size_t object_size;         /* rounded up to SLAB_ALIGN */
+    uint32_t objects;
+
+    uint8_t* mem;               /* objects*object_size bytes */
+    uint32_t* next;             /* depot links by object index */
+    uint64_t depot;             /* tag << 32 | index of the top object */
+
+    int slot;                   /* registry slot; index of thread magazines */
+    uint32_t generation;        /* invalidates magazines of an older cache */
+
+    /* counters */
+    uint32_t in_use;            /* objects allocated and not freed */
+    uint32_t high_water;        /* maximum of in_use */
+    uint32_t failures;          /* allocations failed on exhaustion */
+} slab_cache_t;
+
+typedef struct slab_stats {
+    uint32_t objects;
+    uint32_t in_use;
+    uint32_t high_water;
+    uint32_t failures;
+} slab_stats_t;
+
+/* Reserve memory for a cache of objects; returns EOK, EINVAL or ENOMEM */
+extern int slab_cache_init (slab_cache_t* cache, const char* name,
+        size_t object_size, uint32_t objects);
+
+/* Release a cache; all of its objects must have been freed */
+extern void slab_cache_destroy (slab_cache_t* cache);
+
+/* Returns NULL when the cache is exhausted */
+extern void* slab_alloc (slab_cache_t* cache);
+
+/* Return an object to the cache it was allocated from */
+extern void slab_free (void* ptr);
+
+extern void slab_cache_stats (const slab_cache_t* cache, slab_stats_t* stats);
+
+/*
+ * Driver caches
+ */
+extern slab_cache_t skb_cache;          /* struct sk_buff */
+extern slab_cache_t skb_priv_cache;     /* struct can_skb_priv */
+extern slab_cache_t echo_cache;         /* transmitted skbs kept for echo */
+
+/*
+ * Must be called once before any skb is allocated; objects is the number of
+ * objects of each driver cache.
+ */
+extern int slab_memory_init (uint32_t objects);
+
+#endif /* SRC_SLAB_H_ */
@@ -0,0 +1,72 @@
+/*
+ * \file    threads.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_THREADS_H_
+#define SRC_THREADS_H_
+
+#include <pthread.h>
+
+#include <config.h>
+
+struct net_device;
+
+/*
+ * Driver thread scheduling
+ *
+ * Each driver thread belongs to a thread class; option -T assigns a policy,
+ * priority and CPU runmask to a class, either for one device (id=#) or for all
+ * devices. Classes a device entry leaves out fall back to the driver wide
+ * entry, and anything not configured keeps the driver's built-in defaults.
+ */
+
+/*
+ * Process one -T option string, e.g. "id=0,irq=40:0x2,tx=30:0x2:rr"; a
+ * "file=path" suboption reads further -T option strings from path, one per
+ * line. Returns EOK, or EINVAL after printing the error.
+ */
+extern int thread_config_option (const char* option);
+
+/* Fill the classes of the device entries left out with the driver wide ones */
+extern void thread_config_finalize (void);
+
+/* Scheduling of a thread class for device dev, or the driver wide one */
+extern const thread_sched_t* thread_sched (
+        const struct net_device* dev, thread_class_t cls );
+
+/* Priority to use for a thread class given its built-in default */
+extern int thread_sched_priority (const thread_sched_t* sched,
+        int default_priority);
+
+/*
+ * Set up attr so that a thread created with it runs with sched's policy and
+ * priority; default_priority applies when sched has none, and 0 leaves the
+ * thread to inherit the creating thread's scheduling.
+ */
+extern void thread_sched_attr (pthread_attr_t* attr,
+        const thread_sched_t* sched, int default_priority);
+
+/*
+ * Apply sched to the calling thread; called first thing by each driver thread
+ * since the runmask can't be given at creation, and for threads created by
+ * others (e.g. the resmgr thread pool) to also set the policy and priority.
+ */
+extern void thread_sched_apply (const thread_sched_t* sched);
+
+#endif /* SRC_THREADS_H_ */
@@ -24,10 +24,11 @@
 #include <sys/syspage.h>
 #include <linux/types.h>
 
+#include <timerwheel.h>
 
-/* Timer shutdown pulse */
-#define _PULSE_CODE_SHUTDOWN_TIMER  (_PULSE_CODE_MINAVAIL+0)
-#define _PULSE_CODE_TIMER_TRIGGER   (_PULSE_CODE_MINAVAIL+1)
+
+/* Timer service pulse */
+#define _PULSE_CODE_TIMER_TRIGGER   (_PULSE_CODE_MINAVAIL+0)
 
 /* some scaling factors */
 #define MILLION	1e6 
@@ -40,32 +41,51 @@
 #define TIMER_INTERVAL_NS   ((BILLION) / (HZ)) // Timer interval nanoseconds
 #define jiffies             0
 
-typedef struct timer_record {
-    timer_t id;
+struct thread_sched;
 
-    int created, chid, started;
+/*
+ * All timers are kept on one timer wheel, in ticks of TIMER_INTERVAL_NS, and
+ * run by one timer service thread woken by a single one-shot OS timer set
+ * for the wheel's next expiry. The service is started by the first
+ * setup_timer(). Callbacks run on the service thread one at a time, so they
+ * should be short.
+ */
+typedef struct timer_record {
+    timer_entry_t entry;    /* first; the service casts entries back */
 
     void (*callback)(void*);
     void *data;
 
-    struct sigevent event;
-
-    pthread_attr_t attr;
+    const struct thread_sched* sched;   /* timer thread class, or NULL */
 } timer_record_t;
 
 /*
  * Functions needed by the Linux Kernel source "drivers/net/can/dev.c" to
- * implement Bus-off recovery timer functionality.
+ * implement Bus-off recovery timer functionality. setup_timer() must not be
+ * given a pending timer.
  */
 extern void setup_timer (timer_record_t* timer, void (*callback)(void*),
         void *priv);
 
+/*
+ * Run the timer's callback at the priority of the given scheduling; the
+ * service thread itself runs with the driver wide timer thread class.
+ */
+extern void set_timer_sched (timer_record_t* timer,
+        const struct thread_sched* sched);
+
+/* Cancel the timer and wait for its callback if running on another thread */
 extern void cancel_delayed_work_sync (timer_record_t* timer);
+
+/* Arm the timer to fire in ticks; re-arming a pending timer moves it */
 extern void schedule_delayed_work (timer_record_t* timer, int ticks);
 
 /* accurate relative time function in us */
 extern uint64_t get_clock_time_us();
 
+/* accurate relative time function in ns; same time base as get_clock_time_us */
+extern uint64_t get_clock_time_ns();
+
 /*
  * Behaviour of these two variables depends on the option '-t' (optt).
  * IF '-t' enabled, then user_timestamp supplied by the user via the devctl
@@ -80,4 +100,7 @@ extern uint64_t get_clock_time_us();
 extern uint32_t user_timestamp;
 extern uint32_t user_timestamp_time;
 
+/* Millisecond timestamp reported to clients for time tstamp (ns) */
+extern uint32_t user_timestamp_ms (uint64_t tstamp);
+
 #endif /* SRC_TIMER_H_ */
@@ -0,0 +1,99 @@
+/*
+ * \file    timerwheel.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_TIMERWHEEL_H_
+#define SRC_TIMERWHEEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hierarchical timer wheel
+ *
+ * Time is counted in ticks. Level 0 has a slot per tick for the next
+ * TIMER_WHEEL_SLOTS ticks, each higher level a slot per TIMER_WHEEL_SLOTS
+ * slots of the level below. A timer goes into the lowest level its expiry
+ * fits in, and whenever the wheel's time crosses the boundary of a slot of a
+ * higher level the timers of that slot are cascaded down; each timer is
+ * moved at most TIMER_WHEEL_LEVELS-1 times. Adding and deleting a timer take
+ * constant time. Expiries further out than TIMER_WHEEL_MAX_TICKS are
+ * clamped to it.
+ *
+ * The wheel does no locking and knows nothing of clocks; its user keeps it
+ * under a lock and passes in the current tick.
+ */
+
+#define TIMER_WHEEL_BITS        6
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS      4
+#define TIMER_WHEEL_MAX_TICKS \
+    ((1ULL << (TIMER_WHEEL_BITS*TIMER_WHEEL_LEVELS)) - 1)
+
+#define TIMER_WHEEL_NEVER       UINT64_MAX
+
+typedef struct timer_entry {
+    struct timer_entry *prev, *next;    /* NULL when not pending */
+    uint64_t expires;                   /* tick */
+    uint8_t level, slot;
+} timer_entry_t;
+
+typedef struct timer_wheel {
+    uint64_t now;           /* next tick to expire; those before are done */
+    unsigned pending;
+    uint64_t occupied[TIMER_WHEEL_LEVELS];  /* bit per non-empty slot */
+
+    /* list heads */
+    timer_entry_t slot[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel_t;
+
+extern void timer_wheel_init (timer_wheel_t* w, uint64_t now);
+
+/* Move the time of an empty wheel up to now; no-op while timers are pending */
+extern void timer_wheel_sync (timer_wheel_t* w, uint64_t now);
+
+static inline void timer_entry_init (timer_entry_t* e) {
+    e->prev = e->next = NULL;
+}
+
+static inline int timer_entry_pending (const timer_entry_t* e) {
+    return e->next != NULL;
+}
+
+/* Add e to expire at tick expires, deleting it first if pending */
+extern void timer_wheel_add (timer_wheel_t* w, timer_entry_t* e,
+        uint64_t expires);
+
+extern void timer_wheel_del (timer_wheel_t* w, timer_entry_t* e);
+
+/*
+ * Take the next timer expired by tick now off the wheel, or advance the
+ * wheel's time past now and return NULL. Called in a loop; timers may be
+ * added and deleted between the calls.
+ */
+extern timer_entry_t* timer_wheel_expire (timer_wheel_t* w, uint64_t now);
+
+/*
+ * Tick at which timer_wheel_expire() is next due to be called: the earliest
+ * level 0 expiry, or the earliest cascade of an occupied higher level slot
+ * before it; TIMER_WHEEL_NEVER if the wheel is empty
+ */
+extern uint64_t timer_wheel_next (const timer_wheel_t* w);
+
+#endif /* SRC_TIMERWHEEL_H_ */
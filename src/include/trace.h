@@ -0,0 +1,113 @@
+/*
+ * \file    trace.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_TRACE_H_
+#define SRC_TRACE_H_
+
+#include <stdint.h>
+
+#include <dev-can-linux/trace.h>
+
+#include "timer.h"
+
+/*
+ * Trace points
+ *
+ * trace(event, args...) stores a struct can_trace_record of the event with
+ * up to CAN_TRACE_ARGS arguments, missing ones 0, into the trace ring of the
+ * calling thread; no formatting, no locks and no system calls. The rings are
+ * read out with EXT_CAN_DEVCTL_GET_TRACE and formatted by the cantrace tool.
+ * When built with CONFIG_TRACE 0 a trace point compiles to nothing and its
+ * arguments are not evaluated.
+ *
+ * Threads are handed the TRACE_RINGS rings in turn, as with the devstats
+ * slots, so that once there are more threads than rings some share one. A
+ * record's position is therefore taken with an atomic add and the record is
+ * published through its seq member, seqlock style: seq is cleared, the record
+ * written, then seq set to the position plus 1. A reader keeps a copied
+ * record only if it found the same, expected seq before and after the copy.
+ */
+
+#define TRACE_RINGS             16
+#define TRACE_RING_RECORDS      1024    /* power of two */
+
+#if CONFIG_TRACE == 1
+
+typedef struct trace_ring {
+    uint64_t head;          /* records ever written */
+    struct can_trace_record record[TRACE_RING_RECORDS];
+} __attribute__((aligned(64))) trace_ring_t;
+
+extern trace_ring_t trace_rings[TRACE_RINGS];
+
+/* Ring and thread id of the calling thread; -1 until its first record */
+extern __thread int trace_ring;
+extern __thread uint16_t trace_thread;
+
+extern int trace_ring_take (void);
+
+static inline void trace_write (uint16_t event,
+        uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+    int r = trace_ring;
+
+    if (r < 0) {
+        r = trace_ring_take();
+    }
+
+    trace_ring_t* ring = &trace_rings[r];
+    uint64_t pos = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    struct can_trace_record* rec = &ring->record[pos & (TRACE_RING_RECORDS-1)];
+
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    rec->tstamp = get_clock_time_ns();
+    rec->event = event;
+    rec->thread = trace_thread;
+    rec->arg[0] = arg0;
+    rec->arg[1] = arg1;
+    rec->arg[2] = arg2;
+    rec->arg[3] = arg3;
+
+    __atomic_store_n(&rec->seq, (uint32_t)(pos + 1), __ATOMIC_RELEASE);
+}
+
+#define trace_args(event, a0, a1, a2, a3, ...) \
+    trace_write(event, (a0), (a1), (a2), (a3))
+
+#define trace(...)  trace_args(__VA_ARGS__, 0, 0, 0, 0)
+
+#else
+
+#define trace(...)  ((void)0)
+
+#endif
+
+/*
+ * Copy up to max records of ring r from position first on into out, skipping
+ * those already overwritten. Sets *count to the number copied, *next to the
+ * position to continue from and *head to the ring's head. Returns ENOSYS when
+ * built without trace points.
+ */
+extern int trace_read (int r, uint64_t first, struct can_trace_record* out,
+        int max, int* count, uint64_t* next, uint64_t* head);
+
+#endif /* SRC_TRACE_H_ */
@@ -0,0 +1,163 @@
+/*
+ * \file    vbus.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_VBUS_H_
+#define SRC_VBUS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <frame.h>
+
+/*
+ * Timed virtual CAN bus
+ *
+ * vcan devices attached to a virtual bus (option -B) no longer loop frames
+ * back to their clients at once. Each device holds one frame in transmission
+ * at a time, like a controller's TX buffer; the bus thread arbitrates the
+ * held frames by identifier, as the bus would at start of frame, and keeps
+ * the bus busy for the winner's time on the wire at the bus bitrate, given by
+ * can_frame_bits() including the intermission and, by default, worst case bit
+ * stuffing. The frame is then received by every device on the bus, its sender
+ * included as the echo.
+ *
+ * Error frames and bus-off can be injected at rates given in events per
+ * million frames. An error frame aborts the frame at a random bit, adds the
+ * error flag, delimiter and intermission to the bus time and counts against
+ * the error counters; the sender retransmits the frame. A device going
+ * bus-off drops its frame and stays off the bus for the 128 x 11 recessive
+ * bits of its recovery.
+ */
+
+#define VBUS_MAX_BUSES          8
+#define VBUS_MAX_NODES          16
+
+/* error counter thresholds */
+#define VBUS_ERROR_WARNING      96
+#define VBUS_ERROR_PASSIVE      128
+#define VBUS_BUS_OFF            256
+
+typedef enum vbus_event {
+    VBUS_EVENT_TX_ERROR,        /* error frame during own transmission */
+    VBUS_EVENT_RX_ERROR,        /* error frame during reception */
+    VBUS_EVENT_BUS_OFF,
+    VBUS_EVENT_BUS_ON,          /* bus-off recovery complete */
+    VBUS_EVENT_STATE            /* counters fell below a threshold */
+} vbus_event_t;
+
+struct vbus;
+
+typedef struct vbus_node {
+    struct vbus* bus;
+    int id;                     /* device id */
+
+    /* frame received off the bus, own frames included flagged FRAME_ECHO;
+     * bus not locked */
+    void (*deliver)(void* arg, const frame_t* frame, uint64_t tstamp);
+
+    /* error counters changed; bus locked */
+    void (*event)(void* arg, vbus_event_t event, unsigned tec, unsigned rec);
+
+    void* arg;
+
+    frame_t frame;              /* frame in transmission */
+    bool pending;
+
+    unsigned tec, rec;          /* transmit and receive error counters */
+    bool bus_off;
+    uint64_t bus_off_until;     /* end of bus-off recovery, ns */
+
+    /* statistics */
+    uint64_t tx_frames;
+    uint64_t arbitration_lost;
+    uint64_t error_frames;
+    uint64_t bus_offs;
+} vbus_node_t;
+
+typedef struct vbus {
+    int index;
+
+    /* configuration (-B) */
+    int ids[VBUS_MAX_NODES];    /* device ids to attach */
+    int num_ids;
+    uint32_t bitrate;           /* 0 is the first attached device's */
+    bool stuffing;              /* worst case bit stuffing */
+    uint32_t error_ppm;         /* error frames per million frames */
+    uint32_t bus_off_ppm;       /* bus-off events per million frames */
+    uint64_t seed;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;        /* frame to transmit, or stop */
+    pthread_cond_t done;        /* frame off the bus */
+    pthread_t thread;
+    bool running;
+    bool stop;
+
+    vbus_node_t* node[VBUS_MAX_NODES];
+    int num_nodes;
+
+    uint64_t idle_at;           /* end of the bus' current activity, ns */
+    uint64_t rng;
+
+    /* statistics */
+    uint64_t frames;
+    uint64_t bits;              /* bit times the bus was busy */
+    uint64_t error_frames;
+    uint64_t bus_offs;
+} vbus_t;
+
+extern vbus_t vbus[VBUS_MAX_BUSES];
+extern int num_vbus;
+
+/*
+ * Process one -B option string, e.g. "ids=0:1,bitrate=500k,errors=100";
+ * returns EOK, or EINVAL after printing the error.
+ */
+extern int vbus_option (const char* option);
+
+/*
+ * Attach device id to the bus configured for it, if any; bitrate is the
+ * device's, used if the bus has none configured. Returns the device's node,
+ * or NULL if it is not on a virtual bus.
+ */
+extern vbus_node_t* vbus_attach (int id, uint32_t bitrate,
+        void (*deliver)(void* arg, const frame_t* frame, uint64_t tstamp),
+        void (*event)(void* arg, vbus_event_t event,
+                unsigned tec, unsigned rec),
+        void* arg);
+
+/*
+ * Transmit frame on node's bus; blocks until the frame is off the bus,
+ * including any retransmissions, or dropped by a bus-off.
+ */
+extern int vbus_xmit (vbus_node_t* node, const frame_t* frame);
+
+/* Stop the bus threads and release the buses */
+extern void vbus_cleanup (void);
+
+/*
+ * Bus time of frame in ns at bitrate; can_frame_bits() including the
+ * intermission, with worst case bit stuffing if stuffing is set.
+ */
+extern uint64_t vbus_frame_ns (const frame_t* frame, uint32_t bitrate,
+        bool stuffing);
+
+#endif /* SRC_VBUS_H_ */
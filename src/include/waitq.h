@@ -0,0 +1,250 @@
+/*
+ * \file    waitq.h
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SRC_WAITQ_H_
+#define SRC_WAITQ_H_
+
+#include <errno.h>
+#include <stdint.h>
+
+/*
+ * Blocked client wait queue
+ *
+ * Fixed capacity set of rcvids kept in blocking order (FIFO), embedded in the
+ * OCB so that blocking and resuming a client never touches the heap. Entries
+ * are linked through their slot indices; an open addressed hash table of slot
+ * indices gives O(1) lookup and removal by rcvid. Removed hash buckets are
+ * marked as tombstones and are reclaimed by an in place rehash once they
+ * crowd the table.
+ *
+ * The caller provides locking.
+ */
+
+#define WAITQ_HASH_BITS     7
+#define WAITQ_BUCKETS       (1 << WAITQ_HASH_BITS)
+#define WAITQ_MAX_CLIENTS   (WAITQ_BUCKETS / 2) /* blocked clients per OCB */
+
+#define WAITQ_NIL           (-1)    /* empty bucket / end of list */
+#define WAITQ_TOMBSTONE     (-2)    /* removed bucket; probing continues */
+
+typedef struct waitq_entry {
+    int rcvid;
+    int16_t prev, next;         /* FIFO links, or free list through next */
+} waitq_entry_t;
+
+typedef struct waitq {
+    waitq_entry_t entry[WAITQ_MAX_CLIENTS];
+    int16_t bucket[WAITQ_BUCKETS];  /* entry index, WAITQ_NIL or _TOMBSTONE */
+
+    int16_t head, tail;         /* oldest and newest blocked client */
+    int16_t free;               /* first unused entry */
+
+    volatile int count;         /* may be read without the lock as a hint */
+    int tombstones;
+} waitq_t;
+
+
+static inline void waitq_init (waitq_t* W) {
+    int i;
+
+    for (i = 0; i < WAITQ_BUCKETS; ++i) {
+        W->bucket[i] = WAITQ_NIL;
+    }
+
+    for (i = 0; i < WAITQ_MAX_CLIENTS; ++i) {
+        W->entry[i].rcvid = -1;
+        W->entry[i].prev = WAITQ_NIL;
+        W->entry[i].next = (i + 1 < WAITQ_MAX_CLIENTS) ? i + 1 : WAITQ_NIL;
+    }
+
+    W->head = W->tail = WAITQ_NIL;
+    W->free = 0;
+    W->count = 0;
+    W->tombstones = 0;
+}
+
+static inline unsigned waitq_hash (int rcvid) {
+    /* Fibonacci hashing; rcvids differ mostly in their low bits */
+    return ((uint32_t)rcvid * 2654435761u) >> (32 - WAITQ_HASH_BITS);
+}
+
+/* Bucket holding rcvid, or WAITQ_NIL */
+static inline int waitq_lookup (waitq_t* W, int rcvid) {
+    unsigned b = waitq_hash(rcvid);
+    int n;
+
+    for (n = 0; n < WAITQ_BUCKETS; ++n, b = (b + 1) & (WAITQ_BUCKETS - 1)) {
+        int16_t e = W->bucket[b];
+
+        if (e == WAITQ_NIL) {
+            break;
+        }
+
+        if (e != WAITQ_TOMBSTONE && W->entry[e].rcvid == rcvid) {
+            return b;
+        }
+    }
+
+    return WAITQ_NIL;
+}
+
+static inline void waitq_hash_insert (waitq_t* W, int16_t e) {
+    unsigned b = waitq_hash(W->entry[e].rcvid);
+
+    while (W->bucket[b] != WAITQ_NIL && W->bucket[b] != WAITQ_TOMBSTONE) {
+        b = (b + 1) & (WAITQ_BUCKETS - 1);
+    }
+
+    if (W->bucket[b] == WAITQ_TOMBSTONE) {
+        --W->tombstones;
+    }
+
+    W->bucket[b] = e;
+}
+
+/* Drop all tombstones by rebuilding the hash table from the FIFO */
+static inline void waitq_rehash (waitq_t* W) {
+    int i;
+
+    for (i = 0; i < WAITQ_BUCKETS; ++i) {
+        W->bucket[i] = WAITQ_NIL;
+    }
+
+    W->tombstones = 0;
+
+    int16_t e;
+    for (e = W->head; e != WAITQ_NIL; e = W->entry[e].next) {
+        waitq_hash_insert(W, e);
+    }
+}
+
+static inline int waitq_empty (waitq_t* W) {
+    return W->count == 0;
+}
+
+static inline int waitq_contains (waitq_t* W, int rcvid) {
+    return waitq_lookup(W, rcvid) != WAITQ_NIL;
+}
+
+/* Oldest blocked rcvid, or -1 when empty */
+static inline int waitq_first (waitq_t* W) {
+    return (W->head == WAITQ_NIL) ? -1 : W->entry[W->head].rcvid;
+}
+
+/*
+ * Append rcvid to the back of the queue; a no-op if it is already queued.
+ * Returns EAGAIN when all WAITQ_MAX_CLIENTS entries are in use.
+ */
+static inline int waitq_insert (waitq_t* W, int rcvid) {
+    if (waitq_lookup(W, rcvid) != WAITQ_NIL) {
+        return EOK;
+    }
+
+    if (W->free == WAITQ_NIL) {
+        return EAGAIN;
+    }
+
+    // Keep at least a quarter of the buckets empty so probes terminate early
+    if (W->count + W->tombstones + 1 > WAITQ_BUCKETS * 3 / 4) {
+        waitq_rehash(W);
+    }
+
+    int16_t e = W->free;
+    W->free = W->entry[e].next;
+
+    W->entry[e].rcvid = rcvid;
+    W->entry[e].prev = W->tail;
+    W->entry[e].next = WAITQ_NIL;
+
+    if (W->tail != WAITQ_NIL) {
+        W->entry[W->tail].next = e;
+    }
+    else {
+        W->head = e;
+    }
+
+    W->tail = e;
+
+    waitq_hash_insert(W, e);
+    ++W->count;
+
+    return EOK;
+}
+
+static inline void waitq_unlink (waitq_t* W, int16_t e) {
+    waitq_entry_t* entry = &W->entry[e];
+
+    if (entry->prev != WAITQ_NIL) {
+        W->entry[entry->prev].next = entry->next;
+    }
+    else {
+        W->head = entry->next;
+    }
+
+    if (entry->next != WAITQ_NIL) {
+        W->entry[entry->next].prev = entry->prev;
+    }
+    else {
+        W->tail = entry->prev;
+    }
+}
+
+/* Returns ENOENT if rcvid isn't queued */
+static inline int waitq_remove (waitq_t* W, int rcvid) {
+    int b = waitq_lookup(W, rcvid);
+
+    if (b == WAITQ_NIL) {
+        return ENOENT;
+    }
+
+    int16_t e = W->bucket[b];
+
+    W->bucket[b] = WAITQ_TOMBSTONE;
+    ++W->tombstones;
+
+    waitq_unlink(W, e);
+
+    W->entry[e].rcvid = -1;
+    W->entry[e].prev = WAITQ_NIL;
+    W->entry[e].next = W->free;
+    W->free = e;
+
+    --W->count;
+
+    return EOK;
+}
+
+/* Move the oldest client to the back of the queue */
+static inline void waitq_rotate (waitq_t* W) {
+    int16_t e = W->head;
+
+    if (e == WAITQ_NIL || e == W->tail) {
+        return;
+    }
+
+    waitq_unlink(W, e);
+
+    W->entry[e].prev = W->tail;
+    W->entry[e].next = WAITQ_NIL;
+    W->entry[W->tail].next = e;
+    W->tail = e;
+}
+
+#endif /* SRC_WAITQ_H_ */
@@ -26,11 +26,23 @@
 
 #include "interrupt.h"
 #include "session.h"
+#include "timer.h"
+#include "threads.h"
 
 
 int irq_chid = -1;
 struct sigevent terminate_event;
 
+irq_worker_t irq_worker[MAX_IRQ_WORKERS] = {
+    [0] = { .chid = -1, .sched = { .policy = -1 } }
+};
+size_t irq_worker_size = 0;
+
+/* attach index of each software IRQ, or -1 */
+static int soft_irq_attach[MAX_SOFT_IRQS] = {
+    [0 ... MAX_SOFT_IRQS-1] = -1
+};
+
 /* atomic shutdown check */
 volatile unsigned shutdown_program = 0x0; // 0x0 = running, 0x1 = shutdown
 
@@ -40,6 +52,296 @@ void terminate_irq_loop () {
     if (MsgDeliverEvent(0, &terminate_event) == -1) {
         log_err("irq_trigger_event error; %s\n", strerror(errno));
     }
+
+    size_t w;
+    for (w = 1; w < irq_worker_size; ++w) {
+        if (MsgDeliverEvent(0, &irq_worker[w].terminate_event) == -1) {
+            log_err("irq_trigger_event error; %s\n", strerror(errno));
+        }
+    }
+}
+
+/*
+ * Create a dedicated IRQ worker with its own channel and thread; returns its
+ * index, or 0 to fall back to the shared worker.
+ */
+static int irq_worker_create (struct net_device* owner, bool per_attach,
+        const thread_sched_t* sched, int default_priority)
+{
+    if (irq_worker_size == MAX_IRQ_WORKERS) {
+        log_warn("reached max IRQ worker count: %d; using shared worker\n",
+                MAX_IRQ_WORKERS);
+
+        return 0;
+    }
+
+    int w = irq_worker_size;
+    irq_worker_t* worker = &irq_worker[w];
+
+    if ((worker->chid = ChannelCreate(_NTO_CHF_PRIVATE)) == -1) {
+        log_err("irq worker ChannelCreate error; %s\n", strerror(errno));
+
+        return 0;
+    }
+
+    int coid =
+        ConnectAttach(ND_LOCAL_NODE, 0, worker->chid, _NTO_SIDE_CHANNEL, 0);
+
+    worker->owner = owner;
+    worker->per_attach = per_attach;
+    worker->sched = *sched;
+    worker->priority = thread_sched_priority(sched, default_priority);
+    worker->polling = 0;
+
+    SIGEV_SET_TYPE(&worker->terminate_event, SIGEV_PULSE);
+    worker->terminate_event.sigev_coid = coid;
+    worker->terminate_event.sigev_code = 0; // not needed for termination
+    worker->terminate_event.sigev_priority = worker->priority;
+
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    thread_sched_attr(&attr, sched, worker->priority);
+
+    int err;
+    if ((err = pthread_create(&worker->thread, &attr, &irq_loop, worker))
+            != EOK)
+    {
+        log_err("irq worker pthread_create error; %s\n", strerror(err));
+
+        ConnectDetach(coid);
+        ChannelDestroy(worker->chid);
+
+        return 0;
+    }
+
+    ++irq_worker_size;
+
+    log_dbg("IRQ worker %d: %s, priority %d, runmask 0x%x\n",
+            w, owner->name, worker->priority, worker->sched.runmask);
+
+    return w;
+}
+
+/*
+ * Worker to service a new IRQ attach of device dev; devices configured with
+ * -I, or with an irq thread class of their own (-T id=#,irq=...), get
+ * dedicated workers.
+ */
+static int irq_worker_select (struct net_device* dev, int default_priority) {
+    const irq_config_t* config = dev->irq_config;
+    const thread_config_t* threads = dev->thread_config;
+
+    bool own_sched =
+        (threads != NULL && (threads->classes & (1u << THREAD_IRQ)));
+
+    if (config == NULL && !own_sched) {
+        return 0;
+    }
+
+    bool per_attach = (config != NULL && config->per_attach);
+
+    if (!per_attach) {
+        size_t w;
+        for (w = 1; w < irq_worker_size; ++w) {
+            if (irq_worker[w].owner == dev && !irq_worker[w].per_attach) {
+                return w;
+            }
+        }
+    }
+
+    /* -I prio and cpus take precedence over the irq thread class */
+    thread_sched_t sched = *thread_sched(dev, THREAD_IRQ);
+
+    if (config != NULL && config->priority) {
+        sched.priority = config->priority;
+    }
+
+    if (config != NULL && config->runmask) {
+        sched.runmask = config->runmask;
+    }
+
+    return irq_worker_create(dev, per_attach, &sched, default_priority);
+}
+
+/*
+ * New zeroed attach, published at the end of irq_attach[] with its index in
+ * *k; NULL when the table is full
+ */
+static irq_attach_t* irq_attach_new (int* k) {
+    if (irq_attach_size == MAX_IRQ_ATTACH_COUNT) {
+        log_err( "error request_irq reached max IRQ attach count: %d\n",
+                (int)irq_attach_size );
+
+        return NULL;
+    }
+
+    irq_attach_t* attach = calloc(1, sizeof(irq_attach_t));
+
+    if (attach == NULL) {
+        log_err("error request_irq out of memory\n");
+
+        return NULL;
+    }
+
+    pthread_mutex_init(&attach->lock, NULL);
+
+    *k = irq_attach_size;
+    irq_attach[*k] = attach;
+
+    __atomic_store_n(&irq_attach_size, *k + 1, __ATOMIC_RELEASE);
+
+    return attach;
+}
+
+/* Add the handlers of device dev to attach; returns -1 on failure */
+static int irq_action_add (irq_attach_t* attach, irq_handler_t handler,
+        irq_handler_t thread_fn, struct net_device* dev)
+{
+    irq_actions_t* actions = attach->actions;
+    size_t n = attach->num_handlers;
+
+    if (n == MAX_HANDLERS_PER_IRQ) {
+        log_err( "error reached max handlers per IRQ count: %d\n",
+                MAX_HANDLERS_PER_IRQ );
+
+        return -1;
+    }
+
+    if (actions == NULL || n == actions->max) {
+        size_t max = actions ? 2*actions->max : IRQ_ACTIONS_MIN;
+        irq_actions_t* grown =
+            malloc(sizeof(irq_actions_t) + max*sizeof(irq_action_t));
+
+        if (grown == NULL) {
+            log_err("error request_irq out of memory\n");
+
+            return -1;
+        }
+
+        grown->retired = actions;
+        grown->max = max;
+
+        if (n) {
+            memcpy(grown->action, actions->action, n*sizeof(irq_action_t));
+        }
+
+        __atomic_store_n(&attach->actions, grown, __ATOMIC_RELEASE);
+        actions = grown;
+    }
+
+    actions->action[n].handler = handler;
+    actions->action[n].thread_fn = thread_fn;
+    actions->action[n].dev = dev;
+
+    /* a worker handling the IRQ meanwhile sees the new handler complete */
+    __atomic_store_n(&attach->num_handlers, n + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void irq_attach_cleanup (void) {
+    size_t k;
+
+    for (k = 0; k < irq_attach_size; ++k) {
+        irq_actions_t* actions = irq_attach[k]->actions;
+
+        while (actions != NULL) {
+            irq_actions_t* retired = actions->retired;
+
+            free(actions);
+            actions = retired;
+        }
+
+        pthread_mutex_destroy(&irq_attach[k]->lock);
+        free(irq_attach[k]);
+        irq_attach[k] = NULL;
+    }
+
+    irq_attach_size = 0;
+}
+
+static inline bool is_soft_irq (unsigned int irq) {
+    return (irq >= SOFT_IRQ_BASE && irq < SOFT_IRQ_BASE + MAX_SOFT_IRQS);
+}
+
+/*
+ * Attach for a software IRQ; no interrupt is attached in the kernel, the
+ * device raises the pulse itself through soft_irq_raise(). Software IRQs are
+ * not shared.
+ */
+static int request_soft_irq (unsigned int irq, irq_handler_t handler,
+        irq_handler_t thread_fn, struct net_device* ndev, int default_priority)
+{
+    if (soft_irq_attach[irq - SOFT_IRQ_BASE] != -1) {
+        log_err("error request_irq soft IRQ %d already attached\n", irq);
+
+        return -1;
+    }
+
+    int k;
+    irq_attach_t* attach = irq_attach_new(&k);
+
+    if (attach == NULL || irq_action_add(attach, handler, thread_fn, ndev)) {
+        return -1;
+    }
+
+    int w = irq_worker_select(ndev, default_priority);
+
+    SIGEV_SET_TYPE(&attach->event, SIGEV_PULSE);
+
+    attach->event.sigev_coid = ConnectAttach( ND_LOCAL_NODE, 0,
+            irq_worker[w].chid, _NTO_SIDE_CHANNEL, 0 );
+    attach->event.sigev_code = k;
+    attach->event.sigev_priority = irq_worker[w].priority;
+    attach->worker = w;
+
+    attach->id = 0;
+    attach->irq = irq;
+    attach->mask = mask_irq_soft;
+    attach->unmask = unmask_irq_soft;
+    attach->poll = ndev->poll;
+
+    soft_irq_attach[irq - SOFT_IRQ_BASE] = k;
+
+    log_trace("attached soft IRQ %d\n", irq);
+
+    return 0;
+}
+
+void soft_irq_raise (unsigned int irq) {
+    if (!is_soft_irq(irq)) {
+        return;
+    }
+
+    int k = soft_irq_attach[irq - SOFT_IRQ_BASE];
+
+    if (k == -1) {
+        return;
+    }
+
+    irq_attach_t* attach = irq_attach[k];
+    unsigned state = __atomic_load_n(&attach->soft_state, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        unsigned next = (state & SOFT_IRQ_MASKED)
+            ? (state | SOFT_IRQ_PENDING) : SOFT_IRQ_MASKED;
+
+        if (state == next) {
+            return; // already pending
+        }
+
+        if (__atomic_compare_exchange_n( &attach->soft_state, &state, next,
+                    false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ))
+        {
+            if (!(state & SOFT_IRQ_MASKED)) {
+                soft_irq_deliver(attach);
+            }
+
+            return;
+        }
+    }
 }
 
 /*
@@ -129,38 +431,45 @@ int request_threaded_irq(unsigned int irq, irq_handler_t handler,
         SIGEV_SET_TYPE(&terminate_event, SIGEV_PULSE);
         terminate_event.sigev_coid = coid;
         terminate_event.sigev_code = 0; // not needed for termination
-        terminate_event.sigev_priority =
-            param.sched_priority + CONFIG_IRQ_SCHED_PRIORITY_BOOST;
+        terminate_event.sigev_priority = thread_sched_priority(
+                thread_sched(NULL, THREAD_IRQ),
+                param.sched_priority + CONFIG_IRQ_SCHED_PRIORITY_BOOST );
+
+        /* Worker 0 is the shared irq_loop() thread started by main() */
+        irq_worker[0].chid = irq_chid;
+        irq_worker[0].terminate_event = terminate_event;
+        irq_worker[0].owner = NULL;
+        irq_worker[0].per_attach = false;
+        irq_worker[0].sched = *thread_sched(NULL, THREAD_IRQ);
+        irq_worker[0].priority = terminate_event.sigev_priority;
+        irq_worker[0].polling = 0;
+        irq_worker_size = 1;
+    }
+
+    if (is_soft_irq(irq)) {
+        return request_soft_irq(irq, handler, thread_fn, ndev,
+                param.sched_priority + CONFIG_IRQ_SCHED_PRIORITY_BOOST);
     }
 
     irq_group_t* group = irq_to_group_map[irq];
 
     uint_t i;
     for (i = 0; i < group->num_irq; ++i) {
-        if (irq_attach_size == MAX_IRQ_ATTACH_COUNT) {
-            log_err( "error request_irq reached max IRQ attach count: %d\n",
-                    (int)irq_attach_size );
-
-            return -1;
-        }
-
         bool create_new_attach = true;
 
         uint_t j;
         for (j = 0; j < irq_attach_size; ++j) {
-            if (irq_attach[j].irq == group->irq[i]) {
-                int h = irq_attach[j].num_handlers++;
-
-                if (irq_attach[j].num_handlers >= MAX_HANDLERS_PER_IRQ) {
-                    log_err( "error reached max handlers per IRQ count: %d\n",
-                            MAX_HANDLERS_PER_IRQ );
+            irq_attach_t* attach = irq_attach[j];
 
+            if (attach->irq == group->irq[i] && !attach->dead) {
+                if (irq_action_add(attach, handler, thread_fn, ndev)) {
                     return -1;
                 }
 
-                irq_attach[j].handler[h] = handler;
-                irq_attach[j].reset_interrupt[h] = thread_fn;
-                irq_attach[j].dev[h] = ndev;
+                // A shared IRQ polls with the first thresholds configured
+                if (attach->poll == NULL) {
+                    attach->poll = ndev->poll;
+                }
 
                 create_new_attach = false;
                 break;
@@ -171,63 +480,68 @@ int request_threaded_irq(unsigned int irq, irq_handler_t handler,
             continue;
         }
 
-        int k = irq_attach_size++;
+        int k;
+        irq_attach_t* attach = irq_attach_new(&k);
 
-        SIGEV_SET_TYPE(&irq_attach[k].event, SIGEV_PULSE);
+        /* Guaranteed to be the first handler installation */
+        if (attach == NULL
+            || irq_action_add(attach, handler, thread_fn, ndev))
+        {
+            return -1;
+        }
 
-        int coid =
-            ConnectAttach(ND_LOCAL_NODE, 0, irq_chid, _NTO_SIDE_CHANNEL, 0);
+        int w = irq_worker_select(ndev,
+                param.sched_priority + CONFIG_IRQ_SCHED_PRIORITY_BOOST);
 
-        irq_attach[k].event.sigev_coid = coid;
-        irq_attach[k].event.sigev_code = k;
-        irq_attach[k].event.sigev_priority =
-            param.sched_priority + CONFIG_IRQ_SCHED_PRIORITY_BOOST;
+        SIGEV_SET_TYPE(&attach->event, SIGEV_PULSE);
 
-        irq_attach[k].irq = group->irq[i];
-        irq_attach[k].irq_entry = i;
+        int coid = ConnectAttach( ND_LOCAL_NODE, 0,
+                irq_worker[w].chid, _NTO_SIDE_CHANNEL, 0 );
 
-        /* Guaranteed to be the first handler installation */
-        irq_attach[k].handler[0] = handler;
-        irq_attach[k].reset_interrupt[0] = thread_fn;
-        irq_attach[k].dev[0] = ndev;
-        irq_attach[k].num_handlers = 1;
-
-        irq_attach[k].hdl = group->hdl;
-        irq_attach[k].msi_cap = group->msi_cap;
-        irq_attach[k].is_msi = group->is_msi;
-        irq_attach[k].is_msix = group->is_msix;
-        irq_attach[k].mask = NULL;
-        irq_attach[k].unmask = NULL;
+        attach->event.sigev_coid = coid;
+        attach->event.sigev_code = k;
+        attach->event.sigev_priority = irq_worker[w].priority;
+        attach->worker = w;
+
+        attach->irq = group->irq[i];
+        attach->irq_entry = i;
+
+        attach->hdl = group->hdl;
+        attach->msi_cap = group->msi_cap;
+        attach->is_msi = group->is_msi;
+        attach->is_msix = group->is_msix;
+
+        attach->poll = ndev->poll;
 
 #ifdef MSI_DEBUG
-        irq_attach[k].mask = mask_irq_debug;
-        irq_attach[k].unmask = unmask_irq_debug;
+        attach->mask = mask_irq_debug;
+        attach->unmask = unmask_irq_debug;
 #else
         if (group->msi_cap
             && pci_device_cfg_cap_isenabled(group->hdl, group->msi_cap))
         {
             if (group->is_msix) { // MSI-X Support
-                irq_attach[k].mask = mask_irq_msix;
-                irq_attach[k].unmask = unmask_irq_msix;
+                attach->mask = mask_irq_msix;
+                attach->unmask = unmask_irq_msix;
 
                 log_trace("attached MSI-X IRQ %d\n", group->irq[i]);
             }
             else if (group->is_msi) { // MSI Support (with PVM)
-                irq_attach[k].mask = mask_irq_msi;
-                irq_attach[k].unmask = unmask_irq_msi;
+                attach->mask = mask_irq_msi;
+                attach->unmask = unmask_irq_msi;
 
                 log_trace("attached MSI IRQ %d\n", group->irq[i]);
             }
             else { // MSI Support (without PVM)
-                irq_attach[k].mask = mask_irq_msi_legacy;
-                irq_attach[k].unmask = unmask_irq_msi_legacy;
+                attach->mask = mask_irq_msi_legacy;
+                attach->unmask = unmask_irq_msi_legacy;
 
                 log_trace("attached Legacy-MSI IRQ %d\n", group->irq[i]);
             }
         }
         else { // Regular IRQ
-            irq_attach[k].mask = mask_irq_regular;
-            irq_attach[k].unmask = unmask_irq_regular;
+            attach->mask = mask_irq_regular;
+            attach->unmask = unmask_irq_regular;
 
             log_trace("attached regular IRQ %d\n", group->irq[i]);
         }
@@ -235,8 +549,8 @@ int request_threaded_irq(unsigned int irq, irq_handler_t handler,
 
         int id;
 
-        if (irq_attach[k].mask == mask_irq_msi_legacy ||
-            irq_attach[k].mask == mask_irq_regular)
+        if (attach->mask == mask_irq_msi_legacy ||
+            attach->mask == mask_irq_regular)
         {
             // When working with regular IRQ or legacy MSI devices that
             // are handled at the regular IRQ level, we use InterruptAttachEvent
@@ -246,7 +560,7 @@ int request_threaded_irq(unsigned int irq, irq_handler_t handler,
             // IRQ.
 
             if ((id = InterruptAttachEvent( group->irq[i],
-                        &irq_attach[k].event, attach_flags )) == -1)
+                        &attach->event, attach_flags )) == -1)
             {
                 log_err("internal error; interrupt attach event failure\n");
 
@@ -264,7 +578,7 @@ int request_threaded_irq(unsigned int irq, irq_handler_t handler,
             // the Kernel will call.
 
             if ((id = InterruptAttach( group->irq[i],
-                        &irq_handler, &irq_attach[k], 0, attach_flags )) == -1)
+                        &irq_handler, attach, 0, attach_flags )) == -1)
             {
                 log_err("internal error; interrupt attach failure\n");
 
@@ -272,50 +586,334 @@ int request_threaded_irq(unsigned int irq, irq_handler_t handler,
             }
         }
 
-        irq_attach[k].id = id;
+        attach->id = id;
 
-        irq_attach[k].unmask(k);
+        attach->unmask(k);
     }
 
     return 0;
 }
 
+/*
+ * Mark an attach dead; called with attach->lock held, so no worker is running
+ * its handlers, and the workers skip it from then on. A worker polling it
+ * leaves polling mode on its next round. The attach itself stays allocated,
+ * as pulses may still be queued for it, until irq_attach_cleanup().
+ */
+static void irq_attach_kill (irq_attach_t* attach) {
+    attach->dead = true;
+    attach->id = -1;
+    __atomic_store_n(&attach->num_handlers, 0, __ATOMIC_RELEASE);
+}
+
 void free_irq (unsigned int irq, void *dev) {
     log_trace("free_irq; irq: %d\n", irq);
 
+    if (is_soft_irq(irq)) {
+        int k = soft_irq_attach[irq - SOFT_IRQ_BASE];
+
+        if (k != -1) {
+            soft_irq_attach[irq - SOFT_IRQ_BASE] = -1;
+            mask_irq_soft(k);
+
+            pthread_mutex_lock(&irq_attach[k]->lock);
+            irq_attach_kill(irq_attach[k]);
+            pthread_mutex_unlock(&irq_attach[k]->lock);
+        }
+
+        return;
+    }
+
     uint_t i, k;
     for (i = 0; i < irq_to_group_map[irq]->num_irq; ++i) {
         for (k = 0; k < irq_attach_size; ++k) {
-            if (irq_attach[k].id != -1 &&
-                irq_to_group_map[irq]->irq[i] == irq_attach[k].irq &&
-                irq_attach[k].dev == dev)
+            irq_attach_t* attach = irq_attach[k];
+
+            if (attach->id == -1 || attach->dead ||
+                irq_to_group_map[irq]->irq[i] != attach->irq)
             {
-                InterruptDetach(irq_attach[k].id);
+                continue;
+            }
 
-                irq_attach[k].id = -1;
-                break;
+            pthread_mutex_lock(&attach->lock);
+
+            irq_action_t* action = attach->actions->action;
+            size_t n = attach->num_handlers;
+            size_t j = 0;
+
+            while (j < n && action[j].dev != dev) {
+                ++j;
+            }
+
+            if (j == n) {
+                pthread_mutex_unlock(&attach->lock);
+
+                continue;
+            }
+
+            if (n > 1) {
+                /* a shared IRQ stays attached for the other devices */
+                action[j] = action[n - 1];
+                __atomic_store_n(&attach->num_handlers, n - 1,
+                        __ATOMIC_RELEASE);
+            }
+            else {
+                InterruptDetach(attach->id);
+                irq_attach_kill(attach);
+            }
+
+            pthread_mutex_unlock(&attach->lock);
+
+            break;
+        }
+    }
+}
+
+/*
+ * Frames moved by all devices of an attach so far, as counted by the calling
+ * thread; the handlers count into the stats slot of the thread running them
+ */
+static inline unsigned long irq_frames (const irq_action_t* action, size_t n) {
+    unsigned long frames = 0;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        devstats_t* stats = devstats_local(action[i].dev->stats);
+
+        frames += __atomic_load_n(&stats->rx_packets, __ATOMIC_RELAXED)
+                + __atomic_load_n(&stats->tx_packets, __ATOMIC_RELAXED);
+    }
+
+    return frames;
+}
+
+/* Run the handlers of attach k once; returns the number of frames moved */
+static unsigned irq_handle (int_t k, uint64_t tstamp) {
+    irq_attach_t* attach = irq_attach[k];
+    size_t n = __atomic_load_n(&attach->num_handlers, __ATOMIC_ACQUIRE);
+    const irq_action_t* action =
+        __atomic_load_n(&attach->actions, __ATOMIC_ACQUIRE)->action;
+    unsigned long frames = irq_frames(action, n);
+    irqreturn_t err;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        struct net_device* dev = action[i].dev;
+
+        dev->irq_tstamp = tstamp;
+        dev->irq_pulse = tstamp;
+
+        err = action[i].handler(attach->irq, dev);
+
+        dev->irq_tstamp = 0;
+        dev->irq_pulse = 0;
+
+        if (err == IRQ_WAKE_THREAD && action[i].thread_fn != NULL) {
+            err = action[i].thread_fn(attach->irq, dev);
+
+            if (err != IRQ_HANDLED) {
+                log_err("reset_interrupt error: %d\n", err);
             }
         }
+        else if (err != IRQ_NONE && err != IRQ_HANDLED) {
+            log_err("IRQ handler error: %d\n", err);
+
+            continue;
+        }
+    }
+
+    return (unsigned)(irq_frames(action, n) - frames);
+}
+
+static void irq_wake_tx (int_t k) {
+    irq_attach_t* attach = irq_attach[k];
+    size_t n = __atomic_load_n(&attach->num_handlers, __ATOMIC_ACQUIRE);
+    const irq_action_t* action =
+        __atomic_load_n(&attach->actions, __ATOMIC_ACQUIRE)->action;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        device_session_t* ds = action[i].dev->device_session;
+        if (queue_wake_pending(&ds->tx_queue)) {
+            queue_start_signal(&ds->tx_queue);
+            queue_awake(&ds->tx_queue);
+        }
+    }
+}
+
+/* Whether the IRQ of attach k is already masked when its pulse arrives */
+static inline bool irq_masked_on_pulse (int_t k) {
+    irq_attach_t* attach = irq_attach[k];
+
+    if (attach->mask == mask_irq_msi_legacy ||
+        attach->mask == mask_irq_regular)
+    {
+        return true; // InterruptAttachEvent() masks the IRQ
+    }
+
+    if (attach->mask == mask_irq_soft) {
+        return true; // soft_irq_raise() masks the IRQ
+    }
+
+    return (CONFIG_QNX_INTERRUPT_MASK_ISR == 1
+            || CONFIG_QNX_INTERRUPT_MASK_PULSE == 1);
+}
+
+/*
+ * Adaptive interrupt-to-polling (NAPI-style) receive mode
+ *
+ * An attach whose devices move poll->frames frames within poll->window_us is
+ * left masked after its pulse is handled and is serviced from then on by poll
+ * rounds run every poll->period_us, each handling at most poll->budget
+ * frames. After poll->idle consecutive rounds without any frames the IRQ is
+ * unmasked again; frames that arrived meanwhile raise it straight away.
+ */
+static bool irq_poll_start (int_t k, unsigned frames, uint64_t now) {
+    irq_attach_t* attach = irq_attach[k];
+    const poll_config_t* poll = attach->poll;
+
+    if (poll == NULL || poll->frames == 0) {
+        return false;
+    }
+
+    if (now - attach->poll_window_start > poll->window_us*1000ULL) {
+        attach->poll_window_start = now;
+        attach->poll_window_frames = 0;
+    }
+
+    attach->poll_window_frames += frames;
+
+    if (attach->poll_window_frames < poll->frames) {
+        return false;
+    }
+
+    if (!irq_masked_on_pulse(k)) {
+        attach->mask(k);
+    }
+
+    attach->polling = true;
+    attach->poll_idle = 0;
+    ++irq_worker[attach->worker].polling;
+
+    log_dbg("IRQ %d: polling mode\n", attach->irq);
+
+    return true;
+}
+
+static void irq_poll_stop (int_t k) {
+    irq_attach_t* attach = irq_attach[k];
+
+    attach->polling = false;
+    attach->poll_window_start = 0;
+    attach->poll_window_frames = 0;
+    --irq_worker[attach->worker].polling;
+
+    attach->unmask(k);
+
+    log_dbg("IRQ %d: interrupt mode\n", attach->irq);
+}
+
+/*
+ * Run one poll round over the polling attaches of worker w; returns the time
+ * until the next round
+ */
+static uint64_t irq_poll (int w) {
+    uint64_t period_ns = UINT64_MAX;
+    int_t k;
+
+    for (k = 0; k < irq_attach_size; ++k) {
+        irq_attach_t* attach = irq_attach[k];
+
+        if (!attach->polling || attach->worker != w) {
+            continue;
+        }
+
+        pthread_mutex_lock(&attach->lock);
+
+        if (attach->dead) {
+            attach->polling = false;
+            --irq_worker[w].polling;
+
+            pthread_mutex_unlock(&attach->lock);
+
+            continue;
+        }
+
+        const poll_config_t* poll = attach->poll;
+        uint64_t tstamp = get_clock_time_ns();
+        unsigned frames = 0, n;
+
+        do {
+            n = irq_handle(k, tstamp);
+            frames += n;
+        } while (n && frames < poll->budget);
+
+        irq_wake_tx(k);
+
+        if (frames) {
+            attach->poll_idle = 0;
+        }
+        else if (++attach->poll_idle >= poll->idle) {
+            irq_poll_stop(k);
+
+            pthread_mutex_unlock(&attach->lock);
+
+            continue;
+        }
+
+        pthread_mutex_unlock(&attach->lock);
+
+        if (poll->period_us*1000ULL < period_ns) {
+            period_ns = poll->period_us*1000ULL;
+        }
     }
+
+    return period_ns;
 }
 
 void* irq_loop (void* arg) {
+    irq_worker_t* worker = (arg ? (irq_worker_t*)arg : &irq_worker[0]);
+    int w = worker - irq_worker;
     int rcvid;
-    irqreturn_t err;
+    uint64_t poll_period_ns = 0;
+    uint64_t poll_next = 0;
+
+    // Worker 0 may start before any IRQ is requested
+    thread_sched_apply(arg ? &worker->sched : thread_sched(NULL, THREAD_IRQ));
 
     for(;;) {
-        size_t i;
         struct _pulse pulse;
-        rcvid = MsgReceivePulse(irq_chid, &pulse, sizeof(pulse), NULL);
+
+        if (worker->polling) {
+            uint64_t now = get_clock_time_ns();
+
+            if (now >= poll_next) {
+                poll_period_ns = irq_poll(w);
+                poll_next = now + poll_period_ns;
+            }
+
+            if (worker->polling) {
+                // Wait for the next poll round, still taking pulses of the
+                // attaches in interrupt mode meanwhile
+                uint64_t timeout = (poll_next > now) ? poll_next - now : 0;
+
+                TimerTimeout( CLOCK_MONOTONIC, _NTO_TIMEOUT_RECEIVE,
+                        NULL, &timeout, NULL );
+            }
+        }
+
+        rcvid = MsgReceivePulse(worker->chid, &pulse, sizeof(pulse), NULL);
 
         if (shutdown_program) {
-            log_info("Shutdown IRQ loop\n");
+            log_info("Shutdown IRQ loop %d\n", w);
 
             return NULL;
         }
 
         if (rcvid == -1 ) {
-            log_err("MsgReceivePulse error; %s\n", strerror(errno));
+            if (errno != ETIMEDOUT) {
+                log_err("MsgReceivePulse error; %s\n", strerror(errno));
+            }
 
             continue;
         }
@@ -326,14 +924,27 @@ void* irq_loop (void* arg) {
             continue;
         }
 
-        irq_attach_t* attach = &irq_attach[k];
+        /* stamp once per pulse; frames read by the handlers inherit it */
+        uint64_t tstamp = get_clock_time_ns();
+
+        irq_attach_t* attach = irq_attach[k];
 
         if (attach->mask == NULL || attach->unmask == NULL) {
             continue;
         }
 
-        if (irq_attach[k].mask != mask_irq_msi_legacy &&
-            irq_attach[k].mask != mask_irq_regular)
+        pthread_mutex_lock(&attach->lock);
+
+        if (attach->dead || attach->polling) {
+            // freed, or raised before the IRQ was masked and the poll
+            // covers it
+            pthread_mutex_unlock(&attach->lock);
+
+            continue;
+        }
+
+        if (attach->mask != mask_irq_msi_legacy &&
+            attach->mask != mask_irq_regular)
         {
 #if CONFIG_QNX_INTERRUPT_MASK_PULSE == 1
             attach->mask(k);
@@ -341,35 +952,17 @@ void* irq_loop (void* arg) {
         }
 
         // Handle IRQ
-        for (i = 0; i < irq_attach[k].num_handlers; ++i) {
-            err = irq_attach[k].handler[i](
-                    irq_attach[k].irq, irq_attach[k].dev[i] );
-
-            if (err == IRQ_WAKE_THREAD
-                && irq_attach[k].reset_interrupt[i] != NULL)
-            {
-                err = irq_attach[k].reset_interrupt[i](
-                        irq_attach[k].irq, irq_attach[k].dev[i] );
-
-                if (err != IRQ_HANDLED) {
-                    log_err("reset_interrupt error: %d\n", err);
-                }
-            }
-            else if (err != IRQ_NONE && err != IRQ_HANDLED) {
-                log_err("IRQ handler error: %d\n", err);
+        unsigned frames = irq_handle(k, tstamp);
 
-                continue;
-            }
+        if (irq_poll_start(k, frames, tstamp)) {
+            poll_next = tstamp + attach->poll->period_us*1000ULL;
+        }
+        else {
+            attach->unmask(k);
         }
 
-        attach->unmask(k);
+        irq_wake_tx(k);
 
-        for (i = 0; i < irq_attach[k].num_handlers; ++i) {
-            device_session_t* ds = irq_attach[k].dev[i]->device_session;
-            if (queue_wake_pending(&ds->tx_queue)) {
-                queue_start_signal(&ds->tx_queue);
-                queue_awake(&ds->tx_queue);
-            }
-        }
+        pthread_mutex_unlock(&attach->lock);
     }
 }
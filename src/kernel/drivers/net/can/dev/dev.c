@@ -34,7 +34,6 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include <assert.h>
 #include <errno.h>
 #include <string.h>
 #include <linux/types.h>
@@ -49,16 +48,7 @@
 #include <linux/can/skb.h>
 #include <linux/can/netlink.h>
 #include <resmgr.h>
-
-/*
- * Check the size of sk_buff and can_frame are within the block-size limit of
- * the fixed-block allocator
- */
-static_assert( sizeof(struct sk_buff) <= FIXED_MAX_BLOCK_SIZE,
-        "sk_buff exceeds fixed block-size" );
-
-static_assert( sizeof(struct can_skb_priv) <= FIXED_MAX_BLOCK_SIZE,
-        "can_frame exceeds fixed block-size" );
+#include <threads.h>
 
 
 static void can_update_state_error_stats(struct net_device *dev,
@@ -71,13 +61,13 @@ static void can_update_state_error_stats(struct net_device *dev,
 
 	switch (new_state) {
 	case CAN_STATE_ERROR_WARNING:
-		priv->can_stats.error_warning++;
+		DEV_STATS_INC(dev, error_warning);
 		break;
 	case CAN_STATE_ERROR_PASSIVE:
-		priv->can_stats.error_passive++;
+		DEV_STATS_INC(dev, error_passive);
 		break;
 	case CAN_STATE_BUS_OFF:
-		priv->can_stats.bus_off++;
+		DEV_STATS_INC(dev, bus_off);
 		break;
 	default:
 		break;
@@ -225,7 +215,7 @@ static int can_restart(struct net_device *dev)
 		return err;
 	} else {
 		netdev_dbg(dev, "Restarted\n");
-		priv->can_stats.restarts++;
+		DEV_STATS_INC(dev, restarts);
 	}
 
 	return 0;
@@ -294,7 +284,9 @@ struct net_device *alloc_candev_mqs(int sizeof_priv, unsigned int echo_skb_max,
 	struct net_device *dev;
 	struct can_priv *priv;
 
-    dev = (struct net_device*)malloc(sizeof(struct net_device));
+    /* QNX: aligned for the cache line aligned stats slots */
+    dev = (struct net_device*)aligned_alloc(
+            _Alignof(struct net_device), sizeof(struct net_device));
 	if (!dev)
 		return NULL;
 
@@ -400,6 +392,9 @@ int open_candev(struct net_device *dev)
 	if (!netif_carrier_ok(dev))
 		netif_carrier_on(dev);
 
+	/* Run the bus-off recovery timer in the device's timer thread class */
+	set_timer_sched(&priv->restart_work, thread_sched(dev, THREAD_TIMER));
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(open_candev);
@@ -34,6 +34,8 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <string.h>
+
 #include <linux/can/dev.h>
 #include <linux/module.h>
 
@@ -55,15 +57,14 @@ MODULE_AUTHOR("Wolfgang Grandegger <wg@grandegger.com>");
 void can_flush_echo_skb(struct net_device *dev)
 {
 	struct can_priv *priv = netdev_priv(dev);
-	struct net_device_stats *stats = &dev->stats;
 	int i;
 
 	for (i = 0; i < priv->echo_skb_max; i++) {
 		if (priv->echo_skb[i]) {
 			kfree_skb(priv->echo_skb[i]);
 			priv->echo_skb[i] = NULL;
-			stats->tx_dropped++;
-			stats->tx_aborted_errors++;
+			DEV_STATS_INC(dev, tx_dropped);
+			DEV_STATS_INC(dev, tx_aborted_errors);
 		}
 	}
 }
@@ -205,32 +206,58 @@ void can_free_echo_skb(struct net_device *dev, unsigned int idx,
 }
 EXPORT_SYMBOL_GPL(can_free_echo_skb);
 
-struct sk_buff *alloc_can_skb(struct net_device *dev, struct can_frame **cf)
+static struct sk_buff *__alloc_can_skb(struct net_device *dev,
+        struct can_frame **cf, slab_cache_t *priv_cache)
 {
     struct sk_buff *skb;
     struct can_skb_priv *skb_priv;
 
-    skb = (struct sk_buff*)fixed_malloc(sizeof(struct sk_buff));
-    if (unlikely(!skb))
+    skb = (struct sk_buff*)slab_alloc(&skb_cache);
+    if (unlikely(!skb)) {
+        DEV_STATS_INC(dev, alloc_failures);
         return NULL;
+    }
 
-    skb_priv = fixed_malloc(sizeof(struct can_skb_priv));
-    if (unlikely(!skb_priv))
+    skb_priv = slab_alloc(priv_cache);
+    if (unlikely(!skb_priv)) {
+        slab_free(skb);
+        DEV_STATS_INC(dev, alloc_failures);
         return NULL;
+    }
 
     memset(skb_priv, 0, sizeof(struct can_skb_priv));
 
     *cf = skb_priv->cf;
 
+    /* slab objects are not cleared; set every field */
+    skb->len = 0;
+    skb->data_len = 0;
+    skb->is_echo = 0;
     skb->head = (unsigned char*)skb_priv;
     skb->data = (unsigned char*)(*cf);
     skb->dev = dev;
-    skb->is_echo = 0;
+    skb->tstamp = 0;
 
     return skb;
 }
+
+struct sk_buff *alloc_can_skb(struct net_device *dev, struct can_frame **cf)
+{
+    return __alloc_can_skb(dev, cf, &skb_priv_cache);
+}
 EXPORT_SYMBOL_GPL(alloc_can_skb);
 
+/*
+ * Transmitted skbs are held as echo skbs until the controller reports the
+ * transmission done; their frames come from a cache of their own so that a
+ * stalled bus can't starve reception.
+ */
+struct sk_buff *alloc_can_tx_skb(struct net_device *dev, struct can_frame **cf)
+{
+    return __alloc_can_skb(dev, cf, &echo_cache);
+}
+EXPORT_SYMBOL_GPL(alloc_can_tx_skb);
+
 struct sk_buff *alloc_can_err_skb(struct net_device *dev, struct can_frame **cf)
 {
     struct sk_buff *skb;
@@ -277,7 +304,7 @@ bool can_dropped_invalid_skb(struct net_device *dev, struct sk_buff *skb)
 
 inval_skb:
 	kfree_skb(skb);
-	dev->stats.tx_dropped++;
+	DEV_STATS_INC(dev, tx_dropped);
 	return true;
 }
 EXPORT_SYMBOL_GPL(can_dropped_invalid_skb);
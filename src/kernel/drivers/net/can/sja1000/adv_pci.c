@@ -354,6 +354,13 @@ static int adv_pci_add_chan(struct pci_dev *pdev, int channel, int bar_no)
     priv->read_reg = adv_pci_read_reg;
     priv->write_reg = adv_pci_write_reg;
 
+    if (reg_shift == 0) {
+        priv->reg_access = SJA1000_REG_ACCESS_MMIO_1;
+    }
+    else if (reg_shift == 2) {
+        priv->reg_access = SJA1000_REG_ACCESS_MMIO_4;
+    }
+
     priv->can.clock.freq = ADV_PCI_CAN_CLOCK;
 
     priv->ocr = ADV_PCI_OCR;
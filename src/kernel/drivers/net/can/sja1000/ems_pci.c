@@ -372,18 +372,21 @@ static int ems_pci_add_card(struct pci_dev *pdev,
 		if (card->version == 1) {
 			priv->read_reg  = ems_pci_v1_read_reg;
 			priv->write_reg = ems_pci_v1_write_reg;
+			priv->reg_access = SJA1000_REG_ACCESS_MMIO_4;
 			priv->post_irq  = ems_pci_v1_post_irq;
 			priv->reg_base = card->base_addr + EMS_PCI_V1_CAN_BASE_OFFSET
 					+ (i * EMS_PCI_V1_CAN_CTRL_SIZE);
 		} else if (card->version == 2) {
 			priv->read_reg  = ems_pci_v2_read_reg;
 			priv->write_reg = ems_pci_v2_write_reg;
+			priv->reg_access = SJA1000_REG_ACCESS_MMIO_1;
 			priv->post_irq  = ems_pci_v2_post_irq;
 			priv->reg_base = card->base_addr + EMS_PCI_V2_CAN_BASE_OFFSET
 					+ (i * EMS_PCI_V2_CAN_CTRL_SIZE);
 		} else {
 			priv->read_reg  = ems_pci_v3_read_reg;
 			priv->write_reg = ems_pci_v3_write_reg;
+			priv->reg_access = SJA1000_REG_ACCESS_MMIO_1;
 			priv->post_irq  = ems_pci_v3_post_irq;
 			priv->reg_base = card->base_addr + EMS_PCI_V3_CAN_BASE_OFFSET
 					+ (i * EMS_PCI_V3_CAN_CTRL_SIZE);
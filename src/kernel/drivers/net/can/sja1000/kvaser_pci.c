@@ -266,6 +266,7 @@ static int kvaser_pci_add_chan(struct pci_dev *pdev, int channel,
 
 	priv->read_reg = kvaser_pci_read_reg;
 	priv->write_reg = kvaser_pci_write_reg;
+	priv->reg_access = SJA1000_REG_ACCESS_MMIO_1;
 
 	priv->can.clock.freq = KVASER_PCI_CAN_CLOCK;
 
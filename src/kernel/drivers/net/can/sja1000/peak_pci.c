@@ -311,6 +311,7 @@ static void peak_pciec_led_work(struct work_struct *work)
 		container_of(work, struct peak_pciec_card, led_work.work);
 	struct net_device *netdev;
 	u8 new_led = card->led_cache;
+	unsigned long bytes;
 	int i, up_count = 0;
 
 	/* first check what is to do */
@@ -330,13 +331,15 @@ static void peak_pciec_led_work(struct work_struct *work)
 		new_led |= PCA9553_LED_SLOW(i);
 
 		/* if bytes counters changed, set fast blinking led */
-		if (netdev->stats.rx_bytes != card->channel[i].prev_rx_bytes) {
-			card->channel[i].prev_rx_bytes = netdev->stats.rx_bytes;
+		bytes = DEV_STATS_READ(netdev, rx_bytes);
+		if (bytes != card->channel[i].prev_rx_bytes) {
+			card->channel[i].prev_rx_bytes = bytes;
 			new_led &= ~PCA9553_LED_MASK(i);
 			new_led |= PCA9553_LED_FAST(i);
 		}
-		if (netdev->stats.tx_bytes != card->channel[i].prev_tx_bytes) {
-			card->channel[i].prev_tx_bytes = netdev->stats.tx_bytes;
+		bytes = DEV_STATS_READ(netdev, tx_bytes);
+		if (bytes != card->channel[i].prev_tx_bytes) {
+			card->channel[i].prev_tx_bytes = bytes;
 			new_led &= ~PCA9553_LED_MASK(i);
 			new_led |= PCA9553_LED_FAST(i);
 		}
@@ -508,6 +511,7 @@ static int peak_pciec_probe(struct pci_dev *pdev, struct net_device *dev)
 		INIT_DELAYED_WORK(&card->led_work, peak_pciec_led_work);
 		/* PCAN-ExpressCard needs its own callback for leds */
 		priv->write_reg = peak_pciec_write_reg;
+		priv->reg_access = SJA1000_REG_ACCESS_INDIRECT;
 	}
 
 	chan->pciec_card = card;
@@ -663,6 +667,7 @@ static int peak_pci_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 
 		priv->read_reg = peak_pci_read_reg;
 		priv->write_reg = peak_pci_write_reg;
+		priv->reg_access = SJA1000_REG_ACCESS_MMIO_4;
 		priv->post_irq = peak_pci_post_irq;
 
 		priv->can.clock.freq = PEAK_PCI_CAN_CLOCK;
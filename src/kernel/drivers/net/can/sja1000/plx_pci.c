@@ -706,6 +706,7 @@ static int plx_pci_add_card(struct pci_dev *pdev,
 		priv->reg_base = addr + cm->offset;
 		priv->read_reg = plx_pci_read_reg;
 		priv->write_reg = plx_pci_write_reg;
+		priv->reg_access = SJA1000_REG_ACCESS_MMIO_1;
 
 		/* Check if channel is present */
 		if (plx_pci_check_sja1000(priv)) {
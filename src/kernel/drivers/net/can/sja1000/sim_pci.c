@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2025 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/interrupt.h>
+#include <linux/netdevice.h>
+#include <linux/slab.h>
+#include <linux/pci.h>
+
+#include <sja1000sim.h>
+#include <interrupt.h>
+
+#include "sja1000.h"
+
+#define DRV_NAME  "sja1000sim"
+
+MODULE_AUTHOR("Deniz Eren (deniz.eren@outlook.com)");
+MODULE_DESCRIPTION("Simulated SJA1000 CAN-bus module");
+MODULE_LICENSE("GPL v2");
+
+#define SIM_PCI_CAN_CLOCK  (16000000 / 2)
+
+/*
+ * Unlike vcan, whose frames netif_tx() hands straight back to the clients,
+ * these channels are full SJA1000 devices; the register accesses of the
+ * driver go to a simulated controller (see sja1000sim.h) and its interrupts
+ * reach irq_loop() as software IRQs. All channels of the board share one
+ * simulated bus.
+ */
+struct sim_pci {
+    struct pci_dev *pci_dev;
+    struct net_device *slave_dev[MAX_NO_OF_SIM_CHANNELS];
+    sja1000_sim_t sim[MAX_NO_OF_SIM_CHANNELS];
+    int no_channels;
+    sja1000_sim_bus_t bus;
+};
+
+static const struct pci_device_id sim_pci_tbl[] = {
+    {0,}
+};
+
+MODULE_DEVICE_TABLE(pci, sim_pci_tbl);
+
+static u8 sim_pci_read_reg(const struct sja1000_priv *priv, int port)
+{
+    return sja1000_sim_read((sja1000_sim_t *)priv->priv, port);
+}
+
+static void sim_pci_write_reg(const struct sja1000_priv *priv,
+                int port, u8 val)
+{
+    sja1000_sim_write((sja1000_sim_t *)priv->priv, port, val);
+}
+
+/* Interrupt output of the simulated controller became active */
+static void sim_pci_irq(void *arg)
+{
+    struct net_device *dev = (struct net_device *)arg;
+
+    soft_irq_raise(dev->irq);
+}
+
+/*
+ * The handler stops after SJA1000_MAX_IRQ rounds; an output still active
+ * then has to be raised again, as a level triggered IRQ would be.
+ */
+static void sim_pci_post_irq(const struct sja1000_priv *priv)
+{
+    if (sja1000_sim_irq_active((sja1000_sim_t *)priv->priv))
+        soft_irq_raise(priv->dev->irq);
+}
+
+static void sim_pci_del_all_channels(struct pci_dev *pdev)
+{
+    struct net_device *dev;
+    struct sim_pci *board;
+    int i;
+
+    board = pci_get_drvdata(pdev);
+    if (!board)
+        return;
+
+    for (i = 0; i < board->no_channels; i++) {
+        dev = board->slave_dev[i];
+        if (!dev)
+            continue;
+
+        dev_info(&board->pci_dev->dev, "Removing device %s\n",
+            dev->name);
+
+        unregister_sja1000dev(dev);
+        free_sja1000dev(dev);
+        board->slave_dev[i] = NULL;
+
+        sja1000_sim_destroy(&board->sim[i]);
+    }
+}
+
+static int sim_pci_add_chan(struct pci_dev *pdev, int channel)
+{
+    struct net_device *dev;
+    struct sja1000_priv *priv;
+    struct sim_pci *board;
+    int err;
+
+    dev = alloc_sja1000dev(0);
+    if (dev == NULL)
+        return -ENOMEM;
+
+    priv = netdev_priv(dev);
+    board = pci_get_drvdata(pdev);
+
+    err = sja1000_sim_init(&board->sim[channel], &board->bus,
+            sim_pci_irq, dev);
+    if (err) {
+        free_sja1000dev(dev);
+        return -err;
+    }
+
+    priv->priv = &board->sim[channel];
+    priv->read_reg = sim_pci_read_reg;
+    priv->write_reg = sim_pci_write_reg;
+    priv->post_irq = sim_pci_post_irq;
+
+    priv->irq_flags = 0;
+
+    priv->can.clock.freq = SIM_PCI_CAN_CLOCK;
+    priv->ocr = OCR_TX0_PUSHPULL;
+    priv->cdr = CDR_CBP;
+
+    dev->irq = SOFT_IRQ_BASE + channel;
+
+    board->pci_dev = pdev;
+    board->slave_dev[channel] = dev;
+
+    dev_info(&pdev->dev, "channel %d irq=%d\n", channel, dev->irq);
+
+    SET_NETDEV_DEV(dev, &pdev->dev);
+    dev->dev_id = channel;
+
+    /* Register SJA1000 device */
+    err = register_sja1000dev(dev);
+    if (err) {
+        dev_err(&pdev->dev, "Registering device failed (err=%d)\n",
+            err);
+        goto failure;
+    }
+
+    return 0;
+
+failure:
+    sim_pci_del_all_channels(pdev);
+    return err;
+}
+
+static void sim_pci_remove_one(struct pci_dev *pdev)
+{
+    struct sim_pci *board = pci_get_drvdata(pdev);
+
+    dev_info(&pdev->dev, "Removing card\n");
+
+    sim_pci_del_all_channels(pdev);
+
+    sja1000_sim_bus_destroy(&board->bus);
+
+    kfree(board);
+
+    pci_set_drvdata(pdev, NULL);
+}
+
+static int sim_pci_init_one(struct pci_dev *pdev,
+                const struct pci_device_id *ent)
+{
+    struct sim_pci *board;
+
+    int i, err;
+
+    dev_info(&pdev->dev, "initializing sja1000sim\n");
+
+    board = kzalloc(sizeof(struct sim_pci), GFP_KERNEL);
+    if (board == NULL)
+        return -ENOMEM;
+
+    if (sja1000_sim_bus_init(&board->bus) != EOK) {
+        kfree(board);
+        return -ENOMEM;
+    }
+
+    /* a lone controller gets its frames acknowledged by the bus */
+    board->no_channels = optS_num;
+    board->bus.ack = (board->no_channels == 1);
+
+    pci_set_drvdata(pdev, board);
+
+    for (i = 0; i < board->no_channels; i++) {
+        err = sim_pci_add_chan(pdev, i);
+        if (err)
+            goto failure_cleanup;
+    }
+    return 0;
+
+failure_cleanup:
+    sim_pci_remove_one(pdev);
+
+    return err;
+}
+
+/*static */struct pci_driver sim_pci_driver = {
+    .name = DRV_NAME,
+    .id_table = sim_pci_tbl,
+    .probe = sim_pci_init_one,
+    .remove = sim_pci_remove_one
+};
+
+module_pci_driver(sim_pci_driver);
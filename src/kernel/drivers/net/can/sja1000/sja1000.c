@@ -68,11 +68,16 @@
 #include <linux/netdevice.h>
 #include <linux/skbuff.h>
 #include <linux/delay.h>
+#include <linux/io.h>
 
 #include <linux/can/dev.h>
 
 #include "sja1000.h"
 
+#ifdef __QNX__
+#include <rxstage.h>
+#endif
+
 #define DRV_NAME "sja1000"
 
 MODULE_AUTHOR("Oliver Hartkopp <oliver.hartkopp@volkswagen.de>");
@@ -91,7 +96,41 @@ static const struct can_bittiming_const sja1000_bittiming_const = {
 	.brp_inc = 1,
 };
 
-static void sja1000_write_cmdreg(struct sja1000_priv *priv, u8 val)
+/*
+ * Register access instantiated per enum sja1000_reg_access; with access a
+ * compile time constant the switch folds away and plain MMIO accesses inline.
+ */
+static __always_inline u8 sja1000_rd(const struct sja1000_priv *priv,
+				     int reg, const int access)
+{
+	switch (access) {
+	case SJA1000_REG_ACCESS_MMIO_1:
+		return readb(priv->reg_base + reg);
+	case SJA1000_REG_ACCESS_MMIO_4:
+		return readb(priv->reg_base + (reg << 2));
+	default:
+		return priv->read_reg(priv, reg);
+	}
+}
+
+static __always_inline void sja1000_wr(const struct sja1000_priv *priv,
+				       int reg, u8 val, const int access)
+{
+	switch (access) {
+	case SJA1000_REG_ACCESS_MMIO_1:
+		writeb(val, priv->reg_base + reg);
+		break;
+	case SJA1000_REG_ACCESS_MMIO_4:
+		writeb(val, priv->reg_base + (reg << 2));
+		break;
+	default:
+		priv->write_reg(priv, reg, val);
+		break;
+	}
+}
+
+static __always_inline void __sja1000_write_cmdreg(struct sja1000_priv *priv,
+						   u8 val, const int access)
 {
 #ifndef __QNX__
 	unsigned long flags;
@@ -104,13 +143,18 @@ static void sja1000_write_cmdreg(struct sja1000_priv *priv, u8 val)
 #ifndef __QNX__
 	spin_lock_irqsave(&priv->cmdreg_lock, flags);
 #endif
-	priv->write_reg(priv, SJA1000_CMR, val);
-	priv->read_reg(priv, SJA1000_SR);
+	sja1000_wr(priv, SJA1000_CMR, val, access);
+	sja1000_rd(priv, SJA1000_SR, access);
 #ifndef __QNX__
 	spin_unlock_irqrestore(&priv->cmdreg_lock, flags);
 #endif
 }
 
+static void sja1000_write_cmdreg(struct sja1000_priv *priv, u8 val)
+{
+	__sja1000_write_cmdreg(priv, val, SJA1000_REG_ACCESS_INDIRECT);
+}
+
 static int sja1000_is_absent(struct sja1000_priv *priv)
 {
 	return (priv->read_reg(priv, SJA1000_MOD) == 0xFF);
@@ -311,8 +355,8 @@ static int sja1000_get_berr_counter(const struct net_device *dev,
  * xx xx xx xx	 ff	 ll   00 11 22 33 44 55 66 77
  * [  can-id ] [flags] [len] [can data (up to 8 bytes]
  */
-static netdev_tx_t sja1000_start_xmit(struct sk_buff *skb,
-					    struct net_device *dev)
+static __always_inline netdev_tx_t __sja1000_start_xmit(struct sk_buff *skb,
+		struct net_device *dev, const int access)
 {
 	struct sja1000_priv *priv = netdev_priv(dev);
 	struct can_frame *cf = (struct can_frame *)skb->data;
@@ -336,20 +380,20 @@ static netdev_tx_t sja1000_start_xmit(struct sk_buff *skb,
 	if (id & CAN_EFF_FLAG) {
 		fi |= SJA1000_FI_FF;
 		dreg = SJA1000_EFF_BUF;
-		priv->write_reg(priv, SJA1000_FI, fi);
-		priv->write_reg(priv, SJA1000_ID1, (id & 0x1fe00000) >> 21);
-		priv->write_reg(priv, SJA1000_ID2, (id & 0x001fe000) >> 13);
-		priv->write_reg(priv, SJA1000_ID3, (id & 0x00001fe0) >> 5);
-		priv->write_reg(priv, SJA1000_ID4, (id & 0x0000001f) << 3);
+		sja1000_wr(priv, SJA1000_FI, fi, access);
+		sja1000_wr(priv, SJA1000_ID1, (id & 0x1fe00000) >> 21, access);
+		sja1000_wr(priv, SJA1000_ID2, (id & 0x001fe000) >> 13, access);
+		sja1000_wr(priv, SJA1000_ID3, (id & 0x00001fe0) >> 5, access);
+		sja1000_wr(priv, SJA1000_ID4, (id & 0x0000001f) << 3, access);
 	} else {
 		dreg = SJA1000_SFF_BUF;
-		priv->write_reg(priv, SJA1000_FI, fi);
-		priv->write_reg(priv, SJA1000_ID1, (id & 0x000007f8) >> 3);
-		priv->write_reg(priv, SJA1000_ID2, (id & 0x00000007) << 5);
+		sja1000_wr(priv, SJA1000_FI, fi, access);
+		sja1000_wr(priv, SJA1000_ID1, (id & 0x000007f8) >> 3, access);
+		sja1000_wr(priv, SJA1000_ID2, (id & 0x00000007) << 5, access);
 	}
 
 	for (i = 0; i < cf->len; i++)
-		priv->write_reg(priv, dreg++, cf->data[i]);
+		sja1000_wr(priv, dreg++, cf->data[i], access);
 
 	can_put_echo_skb(skb, dev, 0, 0);
 
@@ -361,15 +405,86 @@ static netdev_tx_t sja1000_start_xmit(struct sk_buff *skb,
 	else
 		cmd_reg_val |= CMD_TR;
 
-	sja1000_write_cmdreg(priv, cmd_reg_val);
+	__sja1000_write_cmdreg(priv, cmd_reg_val, access);
 
 	return NETDEV_TX_OK;
 }
 
-static void sja1000_rx(struct net_device *dev)
+static netdev_tx_t sja1000_start_xmit(struct sk_buff *skb,
+					    struct net_device *dev)
+{
+	switch (((struct sja1000_priv *)netdev_priv(dev))->reg_access) {
+	case SJA1000_REG_ACCESS_MMIO_1:
+		return __sja1000_start_xmit(skb, dev, SJA1000_REG_ACCESS_MMIO_1);
+	case SJA1000_REG_ACCESS_MMIO_4:
+		return __sja1000_start_xmit(skb, dev, SJA1000_REG_ACCESS_MMIO_4);
+	default:
+		return __sja1000_start_xmit(skb, dev,
+					    SJA1000_REG_ACCESS_INDIRECT);
+	}
+}
+
+#ifdef __QNX__
+/*
+ * Receive fast path; the registers are decoded straight into a frame record
+ * for the receive staging ring, so no skb is allocated for data frames. Error
+ * frames and echo still go through an skb and netif_rx().
+ */
+static __always_inline void __sja1000_rx(struct net_device *dev,
+					 const int access)
+{
+	struct sja1000_priv *priv = netdev_priv(dev);
+	struct rx_stage_frame frame;
+	uint8_t fi;
+	uint8_t dreg;
+	canid_t id;
+	int i;
+
+	frame.tstamp = netif_rx_tstamp(dev);
+	frame.is_echo = 0;
+
+	fi = sja1000_rd(priv, SJA1000_FI, access);
+
+	if (fi & SJA1000_FI_FF) {
+		/* extended frame format (EFF) */
+		dreg = SJA1000_EFF_BUF;
+		id = (sja1000_rd(priv, SJA1000_ID1, access) << 21)
+		    | (sja1000_rd(priv, SJA1000_ID2, access) << 13)
+		    | (sja1000_rd(priv, SJA1000_ID3, access) << 5)
+		    | (sja1000_rd(priv, SJA1000_ID4, access) >> 3);
+		id |= CAN_EFF_FLAG;
+	} else {
+		/* standard frame format (SFF) */
+		dreg = SJA1000_SFF_BUF;
+		id = (sja1000_rd(priv, SJA1000_ID1, access) << 3)
+		    | (sja1000_rd(priv, SJA1000_ID2, access) >> 5);
+	}
+
+	frame.len = can_cc_dlc2len(fi & 0x0F);
+	memset(frame.data, 0, sizeof(frame.data));
+
+	if (fi & SJA1000_FI_RTR) {
+		id |= CAN_RTR_FLAG;
+	} else {
+		for (i = 0; i < frame.len; i++)
+			frame.data[i] = sja1000_rd(priv, dreg++, access);
+
+		DEV_STATS_ADD(dev, rx_bytes, frame.len);
+	}
+	DEV_STATS_INC(dev, rx_packets);
+
+	frame.can_id = id;
+
+	/* release receive buffer */
+	__sja1000_write_cmdreg(priv, CMD_RRB, access);
+
+	netif_rx_frame(dev, &frame);
+}
+#else
+static __always_inline void __sja1000_rx(struct net_device *dev,
+					 const int access)
 {
 	struct sja1000_priv *priv = netdev_priv(dev);
-	struct net_device_stats *stats = &dev->stats;
 	struct can_frame *cf;
 	struct sk_buff *skb;
 	uint8_t fi;
@@ -382,21 +497,21 @@ static void sja1000_rx(struct net_device *dev)
 	if (skb == NULL)
 		return;
 
-	fi = priv->read_reg(priv, SJA1000_FI);
+	fi = sja1000_rd(priv, SJA1000_FI, access);
 
 	if (fi & SJA1000_FI_FF) {
 		/* extended frame format (EFF) */
 		dreg = SJA1000_EFF_BUF;
-		id = (priv->read_reg(priv, SJA1000_ID1) << 21)
-		    | (priv->read_reg(priv, SJA1000_ID2) << 13)
-		    | (priv->read_reg(priv, SJA1000_ID3) << 5)
-		    | (priv->read_reg(priv, SJA1000_ID4) >> 3);
+		id = (sja1000_rd(priv, SJA1000_ID1, access) << 21)
+		    | (sja1000_rd(priv, SJA1000_ID2, access) << 13)
+		    | (sja1000_rd(priv, SJA1000_ID3, access) << 5)
+		    | (sja1000_rd(priv, SJA1000_ID4, access) >> 3);
 		id |= CAN_EFF_FLAG;
 	} else {
 		/* standard frame format (SFF) */
 		dreg = SJA1000_SFF_BUF;
-		id = (priv->read_reg(priv, SJA1000_ID1) << 3)
-		    | (priv->read_reg(priv, SJA1000_ID2) >> 5);
+		id = (sja1000_rd(priv, SJA1000_ID1, access) << 3)
+		    | (sja1000_rd(priv, SJA1000_ID2, access) >> 5);
 	}
 
 	can_frame_set_cc_len(cf, fi & 0x0F, priv->can.ctrlmode);
@@ -404,19 +519,20 @@ static void sja1000_rx(struct net_device *dev)
 		id |= CAN_RTR_FLAG;
 	} else {
 		for (i = 0; i < cf->len; i++)
-			cf->data[i] = priv->read_reg(priv, dreg++);
+			cf->data[i] = sja1000_rd(priv, dreg++, access);
 
-		stats->rx_bytes += cf->len;
+		DEV_STATS_ADD(dev, rx_bytes, cf->len);
 	}
-	stats->rx_packets++;
+	DEV_STATS_INC(dev, rx_packets);
 
 	cf->can_id = id;
 
 	/* release receive buffer */
-	sja1000_write_cmdreg(priv, CMD_RRB);
+	__sja1000_write_cmdreg(priv, CMD_RRB, access);
 
 	netif_rx(skb);
 }
+#endif
 
 static irqreturn_t sja1000_reset_interrupt(int irq, void *dev_id)
 {
@@ -437,7 +553,6 @@ static irqreturn_t sja1000_reset_interrupt(int irq, void *dev_id)
 static int sja1000_err(struct net_device *dev, uint8_t isrc, uint8_t status)
 {
 	struct sja1000_priv *priv = netdev_priv(dev);
-	struct net_device_stats *stats = &dev->stats;
 	struct can_frame *cf;
 	struct sk_buff *skb;
 	enum can_state state = priv->can.state;
@@ -459,8 +574,8 @@ static int sja1000_err(struct net_device *dev, uint8_t isrc, uint8_t status)
 			cf->data[1] = CAN_ERR_CRTL_RX_OVERFLOW;
 		}
 
-		stats->rx_over_errors++;
-		stats->rx_errors++;
+		DEV_STATS_INC(dev, rx_over_errors);
+		DEV_STATS_INC(dev, rx_errors);
 		sja1000_write_cmdreg(priv, CMD_CDO);	/* clear bit */
 
 		/* Some controllers needs additional handling upon overrun
@@ -491,7 +606,7 @@ static int sja1000_err(struct net_device *dev, uint8_t isrc, uint8_t status)
 	}
 	if (isrc & IRQ_BEI) {
 		/* bus error interrupt */
-		priv->can.can_stats.bus_error++;
+		DEV_STATS_INC(dev, bus_error);
 
 		ecc = priv->read_reg(priv, SJA1000_ECC);
 		if (skb) {
@@ -518,11 +633,11 @@ static int sja1000_err(struct net_device *dev, uint8_t isrc, uint8_t status)
 
 		/* Error occurred during transmission? */
 		if ((ecc & ECC_DIR) == 0) {
-			stats->tx_errors++;
+			DEV_STATS_INC(dev, tx_errors);
 			if (skb)
 				cf->data[2] |= CAN_ERR_PROT_TX;
 		} else {
-			stats->rx_errors++;
+			DEV_STATS_INC(dev, rx_errors);
 		}
 	}
 	if (isrc & IRQ_EPI) {
@@ -538,7 +653,7 @@ static int sja1000_err(struct net_device *dev, uint8_t isrc, uint8_t status)
 		/* arbitration lost interrupt */
 		netdev_dbg(dev, "arbitration lost interrupt\n");
 		alc = priv->read_reg(priv, SJA1000_ALC);
-		priv->can.can_stats.arbitration_lost++;
+		DEV_STATS_INC(dev, arbitration_lost);
 		if (skb) {
 			cf->can_id |= CAN_ERR_LOSTARB;
 			cf->data[0] = alc & 0x1f;
@@ -563,11 +678,11 @@ static int sja1000_err(struct net_device *dev, uint8_t isrc, uint8_t status)
 	return ret;
 }
 
-irqreturn_t sja1000_interrupt(int irq, void *dev_id)
+static __always_inline irqreturn_t __sja1000_interrupt(int irq, void *dev_id,
+						       const int access)
 {
 	struct net_device *dev = (struct net_device *)dev_id;
 	struct sja1000_priv *priv = netdev_priv(dev);
-	struct net_device_stats *stats = &dev->stats;
 	uint8_t isrc, status;
 	irqreturn_t ret = 0;
 	int n = 0, err;
@@ -576,13 +691,13 @@ irqreturn_t sja1000_interrupt(int irq, void *dev_id)
 		priv->pre_irq(priv);
 
 	/* Shared interrupts and IRQ off? */
-	if (priv->read_reg(priv, SJA1000_IER) == IRQ_OFF)
+	if (sja1000_rd(priv, SJA1000_IER, access) == IRQ_OFF)
 		goto out;
 
-	while ((isrc = priv->read_reg(priv, SJA1000_IR)) &&
+	while ((isrc = sja1000_rd(priv, SJA1000_IR, access)) &&
 	       (n < SJA1000_MAX_IRQ)) {
 
-		status = priv->read_reg(priv, SJA1000_SR);
+		status = sja1000_rd(priv, SJA1000_SR, access);
 		/* check for absent controller due to hw unplug */
 		if (status == 0xFF && sja1000_is_absent(priv))
 			goto out;
@@ -590,24 +705,34 @@ irqreturn_t sja1000_interrupt(int irq, void *dev_id)
 		if (isrc & IRQ_WUI)
 			netdev_warn(dev, "wakeup interrupt\n");
 
+		/* QNX: interrupt source counts, see devstats.h */
+		DEV_STATS_INC(dev, interrupts);
+		if (isrc & IRQ_RI)
+			DEV_STATS_INC(dev, rx_interrupts);
+		if (isrc & IRQ_TI)
+			DEV_STATS_INC(dev, tx_interrupts);
+		if (isrc & (IRQ_DOI | IRQ_EI | IRQ_BEI | IRQ_EPI | IRQ_ALI))
+			DEV_STATS_INC(dev, error_interrupts);
+
 		if (isrc & IRQ_TI) {
 			/* transmission buffer released */
 			if (priv->can.ctrlmode & CAN_CTRLMODE_ONE_SHOT &&
 			    !(status & SR_TCS)) {
-				stats->tx_errors++;
+				DEV_STATS_INC(dev, tx_errors);
 				can_free_echo_skb(dev, 0, NULL);
 			} else {
 				/* transmission complete */
-				stats->tx_bytes += can_get_echo_skb(dev, 0, NULL);
-				stats->tx_packets++;
+				DEV_STATS_ADD(dev, tx_bytes,
+					      can_get_echo_skb(dev, 0, NULL));
+				DEV_STATS_INC(dev, tx_packets);
 			}
 			netif_wake_queue(dev);
 		}
 		if (isrc & IRQ_RI) {
 			/* receive interrupt */
 			while (status & SR_RBS) {
-				sja1000_rx(dev);
-				status = priv->read_reg(priv, SJA1000_SR);
+				__sja1000_rx(dev, access);
+				status = sja1000_rd(priv, SJA1000_SR, access);
 				/* check for absent controller */
 				if (status == 0xFF && sja1000_is_absent(priv))
 					goto out;
@@ -635,6 +760,24 @@ out:
 
 	return ret;
 }
+
+irqreturn_t sja1000_interrupt(int irq, void *dev_id)
+{
+	struct net_device *dev = (struct net_device *)dev_id;
+	struct sja1000_priv *priv = netdev_priv(dev);
+
+	switch (priv->reg_access) {
+	case SJA1000_REG_ACCESS_MMIO_1:
+		return __sja1000_interrupt(irq, dev_id,
+					   SJA1000_REG_ACCESS_MMIO_1);
+	case SJA1000_REG_ACCESS_MMIO_4:
+		return __sja1000_interrupt(irq, dev_id,
+					   SJA1000_REG_ACCESS_MMIO_4);
+	default:
+		return __sja1000_interrupt(irq, dev_id,
+					   SJA1000_REG_ACCESS_INDIRECT);
+	}
+}
 EXPORT_SYMBOL_GPL(sja1000_interrupt);
 
 static int sja1000_open(struct net_device *dev)
@@ -163,6 +163,18 @@
 #define SJA1000_QUIRK_NO_CDR_REG	BIT(1)
 #define SJA1000_QUIRK_RESET_ON_OVERRUN	BIT(2)
 
+/*
+ * Register access patterns for sja1000priv.reg_access. Boards whose registers
+ * are plain bytes at a fixed stride from reg_base select theirs at probe; the
+ * RX, TX and IRQ paths are instantiated for each pattern so that the register
+ * accesses are inlined. Anything else goes through read_reg()/write_reg().
+ */
+enum sja1000_reg_access {
+	SJA1000_REG_ACCESS_INDIRECT = 0,	/* read_reg()/write_reg() */
+	SJA1000_REG_ACCESS_MMIO_1,		/* reg_base + reg */
+	SJA1000_REG_ACCESS_MMIO_4,		/* reg_base + reg*4 */
+};
+
 /*
  * SJA1000 private data structure
  */
@@ -188,6 +200,7 @@ struct sja1000_priv {
 	u16 flags;		/* custom mode flags */
 	u8 ocr;			/* output control register */
 	u8 cdr;			/* clock divider register */
+	u8 reg_access;		/* enum sja1000_reg_access */
 };
 
 struct net_device *alloc_sja1000dev(int sizeof_priv);
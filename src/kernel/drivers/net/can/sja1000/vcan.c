@@ -48,12 +48,9 @@ MODULE_DEVICE_TABLE(pci, vcan_pci_tbl);
 
 // SJA1000 simuation note:
 // In netif_tx() (src/netif.c), for the vcan case, we just broadcast to all
-// client sessions to avoid deeper hardware layers of the driver. However, if
-// in the future an SJA1000 simulator is desired, then these
-// vcan_read_reg()/vcan_write_reg() functions can be utilized and the netif_tx()
-// bypass can be removed.
-// Such an implementation should be considered as an additional option rather
-// than modifying this existing vcan implementation.
+// client sessions to avoid deeper hardware layers of the driver. Devices that
+// run the full SJA1000 driver against a simulated controller are provided
+// separately by the sja1000sim driver (sim_pci.c, option -S).
 
 static u8 vcan_read_reg(const struct sja1000_priv *priv, int port)
 {
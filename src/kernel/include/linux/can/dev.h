@@ -74,7 +74,7 @@ enum can_termination_gpio {
  */
 struct can_priv {
 	struct net_device *dev;
-	struct can_device_stats can_stats;
+	/* QNX: can_stats are counted with DEV_STATS_INC(dev, ...) */
 
 	const struct can_bittiming_const *bittiming_const,
 		*data_bittiming_const;
@@ -137,7 +137,7 @@ static inline bool can_dev_dropped_skb(struct net_device *dev, struct sk_buff *s
 		netdev_info_once(dev,
 				 "interface in listen only mode, dropping skb\n");
 		kfree_skb(skb);
-		dev->stats.tx_dropped++;
+		DEV_STATS_INC(dev, tx_dropped);
 		return true;
 	}
 
@@ -5,10 +5,9 @@
  *          been modified by redefining delay functions to interface QNX delay
  *          functions instead.
  *
- * \details TODO: further investigation and testing needed regarding the
- *          accuracy of the current implementation. Currently the Linux
- *          implementations have been primarily replaced with QNX default usleep
- *          function; this may not be good enough.
+ * \details The Linux implementations are replaced by the delay functions of
+ *          src/include/delay.h, which busy-wait delays too short to sleep for
+ *          on QNX; see there.
  *
  * Delay routines, using a pre-computed "loops_per_jiffy" value.
  *
@@ -51,8 +50,10 @@
 #ifdef __QNX__
 #include <unistd.h>
 #include <linux/kernel.h>
+#include <delay.h>
 
-#define udelay(useconds) usleep(useconds)
+#define udelay(useconds) delay_ns((uint64_t)(useconds)*1000)
+#define mdelay(n) delay_ns((uint64_t)(n)*1000000)
 #else
 #include <linux/math.h>
 #include <linux/sched.h>
@@ -95,7 +96,7 @@ extern unsigned long loops_per_jiffy;
 static inline void ndelay(unsigned long x)
 {
 #ifdef __QNX__
-    udelay(x / 1000); /* TODO: check this; currently doing simple division */
+    delay_ns(x);
 #else
 	udelay(DIV_ROUND_UP(x, 1000));
 #endif
@@ -123,7 +124,7 @@ void usleep_range_state(unsigned long min, unsigned long max,
  */
 static inline void usleep_range(unsigned long min, unsigned long max) {
 #ifdef __QNX__
-    udelay(min); /* TODO: check this; currently just using udelay min */
+    delay_range_us(min, max);
 #else
 	usleep_range_state(min, max, TASK_UNINTERRUPTIBLE);
 #endif
@@ -54,6 +54,7 @@
 #include <linux/skbuff.h>
 #include <uapi/linux/if.h>
 #include <limits.h>
+#include <devstats.h>
 
 #ifdef __QNX__
 #include <../include/stdatomic.h>   // Force C inclusion instead of C++
@@ -110,6 +111,15 @@ struct net_device_stats {
 };
 #undef NET_DEV_STAT
 
+/*
+ * QNX: the counters live in per-thread slots, see devstats.h; the Linux
+ * DEV_STATS_*() accessors count into and read them. Fields of struct
+ * can_device_stats and the driver's own counters are accessed the same way.
+ */
+#define DEV_STATS_INC(DEV, FIELD) DEVSTATS_INC((DEV)->stats, FIELD)
+#define DEV_STATS_ADD(DEV, FIELD, VAL) DEVSTATS_ADD((DEV)->stats, FIELD, VAL)
+#define DEV_STATS_READ(DEV, FIELD) DEVSTATS_READ((DEV)->stats, FIELD)
+
 struct net_device;
 
 enum netdev_state_t {
@@ -811,7 +821,7 @@ struct net_device {
     char      	name[IFNAMSIZ];
     unsigned int         irq;
 	unsigned long		state;
-    struct net_device_stats stats;
+    devstats_t stats[DEVSTATS_SLOTS]; /* QNX: DEV_STATS_*() */
     unsigned int        flags;
     unsigned int        mtu;
     const struct net_device_ops *netdev_ops;
@@ -820,6 +830,16 @@ struct net_device {
     unsigned long       tx_queue_len;
     void* priv;
     struct device_session* device_session;
+    u64                 irq_tstamp; /* IRQ pulse receipt time (ns), consumed
+                                     * by the first frame read after it */
+    u64                 irq_pulse;  /* IRQ pulse receipt time (ns) while its
+                                     * handlers run; latency */
+    u64                 xmit_tstamp; /* latest frame handed to the controller
+                                      * (ns); latency */
+    const struct poll_config* poll; /* adaptive polling (-p), or NULL */
+    const struct irq_config* irq_config; /* IRQ worker (-I), or NULL */
+    const struct thread_config* thread_config; /* threads (-T), or NULL */
+    struct vbus_node* vbus; /* timed virtual bus (-B), or NULL */
 };
 
 /**
@@ -922,6 +942,11 @@ static inline void dev_consume_skb_any(struct sk_buff *skb)
 }
 
 int netif_rx(struct sk_buff *skb);
+u64 netif_rx_tstamp(struct net_device *dev);
+
+/* QNX: receive a data frame decoded without an skb, see rxstage.h */
+struct rx_stage_frame;
+int netif_rx_frame(struct net_device *dev, struct rx_stage_frame *frame);
 
 /**
  *	netif_carrier_ok - test if carrier present
@@ -38,11 +38,14 @@
  * struct sk_buff
  * @data:   Data head pointer
  * @dev:    Used to access device data and callbacks
+ * @tstamp: Time we arrived in nanoseconds; taken when the IRQ pulse was
+ *          received, see netif_rx_tstamp()
  */
 struct sk_buff {
 	unsigned int len, data_len, is_echo;
     unsigned char *head, *data;
 	struct net_device* dev;
+	u64 tstamp;
 };
 
 /**
@@ -51,8 +54,8 @@ struct sk_buff {
  */
 static inline void kfree_skb (struct sk_buff* skb) {
     // TODO: Check if any of the Linux implementation house-keeping is needed
-    fixed_free(skb->head);
-    fixed_free(skb);
+    slab_free(skb->head);
+    slab_free(skb);
 }
 
 /**
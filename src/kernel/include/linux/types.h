@@ -31,6 +31,6 @@
 // Include configurations and type mapping settings from src/include/* headers
 #include <config.h>
 #include <logs.h>
-#include <fixed.h>
+#include <slab.h>
 
 #endif /* _LINUX_TYPES_H */
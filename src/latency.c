@@ -0,0 +1,40 @@
+/*
+ * \file    latency.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "latency.h"
+
+
+void latency_init (latency_t* lat) {
+    memset(lat, 0, sizeof(latency_t));
+}
+
+void latency_read (latency_t* lat, latency_t* out, int reset) {
+    uint64_t* in = (uint64_t*)lat;
+    uint64_t* to = (uint64_t*)out;
+    size_t i;
+
+    for (i = 0; i < sizeof(latency_t)/sizeof(uint64_t); ++i) {
+        to[i] = reset
+            ? __atomic_exchange_n(&in[i], 0, __ATOMIC_RELAXED)
+            : __atomic_load_n(&in[i], __ATOMIC_RELAXED);
+    }
+}
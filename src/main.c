@@ -29,6 +29,10 @@
 #include <interrupt.h>
 #include <driver-prints.h>
 #include <session.h>
+#include <threads.h>
+#include <slab.h>
+#include <vbus.h>
+#include <gateway.h>
 
 
 int main_chid = -1;
@@ -89,6 +93,8 @@ int main (int argc, char* argv[]) {
         "btr1",
 #define F81601_EX_CLK   12
         "f81601_ex_clk",
+#define RECORD_MODE     13
+        "bin",
         NULL
     };
 
@@ -100,7 +106,7 @@ int main (int argc, char* argv[]) {
 
     // Need to parse -v and -l first so that log_*() functions work within the
     // command-line parsing loop following this one.
-    while ((opt = getopt(argc, argv, "r:R:d:e:U:u:b:L:m:viqstlVCEwcx?h")) != -1) {
+    while ((opt = getopt(argc, argv, "r:R:d:e:U:u:b:p:I:T:L:S:B:g:M:m:viqstlVCEwcx?h")) != -1) {
         switch (opt) {
         case 'v':
             optv++;
@@ -121,7 +127,7 @@ int main (int argc, char* argv[]) {
     opterr = opt_bak_opterr;
     optopt = opt_bak_optopt;
 
-    while ((opt = getopt(argc, argv, "r:R:d:e:U:u:b:L:m:viqstlVCEwcx?h")) != -1) {
+    while ((opt = getopt(argc, argv, "r:R:d:e:U:u:b:p:I:T:L:S:B:g:M:m:viqstlVCEwcx?h")) != -1) {
         switch (opt) {
         case 'r':
             optr++;
@@ -228,6 +234,7 @@ int main (int argc, char* argv[]) {
                 .num_rx_channels = DEFAULT_NUM_RX_CHANNELS,
                 .num_tx_channels = DEFAULT_NUM_TX_CHANNELS,
                 .is_extended_mid = -1,
+                .record_mode = 0,
             };
 
             channel_config_t new_channel_config = default_channel_config;
@@ -289,6 +296,10 @@ int main (int argc, char* argv[]) {
                     new_channel_config.is_extended_mid = 1;
                     break;
 
+                case RECORD_MODE:       /* process binary record mode option */
+                    new_channel_config.record_mode = 1;
+                    break;
+
                 default :
                     /* process unknown token */
                     printf("error: Unknown suboption for -u\n");
@@ -507,6 +518,34 @@ int main (int argc, char* argv[]) {
             }
             break;
         }
+        case 'p':
+            optp++;
+            if (poll_config_option(optarg) != EOK) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'I':
+            optI++;
+            if (irq_config_option(optarg) != EOK) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'T':
+            optT++;
+            if (thread_config_option(optarg) != EOK) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'B':
+            if (vbus_option(optarg) != EOK) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'g':
+            if (gateway_option(optarg) != EOK) {
+                return EXIT_FAILURE;
+            }
+            break;
         case 'L':
         {
             optL = 1;
@@ -521,6 +560,33 @@ int main (int argc, char* argv[]) {
 
             break;
         }
+        case 'S':
+        {
+            optS = 1;
+            optS_num = atoi(optarg);
+
+            if (optS_num <= 0 || optS_num > MAX_NO_OF_SIM_CHANNELS) {
+                printf( "option -S %d invalid; allowed 1 to %d\n",
+                    optS_num, MAX_NO_OF_SIM_CHANNELS );
+
+                return EXIT_FAILURE;
+            }
+
+            break;
+        }
+        case 'M':
+        {
+            optM = 1;
+            optM_num = atoi(optarg);
+
+            if (optM_num <= 0) {
+                printf("option -M %d invalid\n", optM_num);
+
+                return EXIT_FAILURE;
+            }
+
+            break;
+        }
         case 'm':
         {
             optm++;
@@ -674,14 +740,52 @@ int main (int argc, char* argv[]) {
         }
     }
 
+    // Make sure all -p id=# are greater than the -U# base index
+    for (int i = 0; i < num_optp_configs; ++i) {
+        if (optp_config[i].id != -1
+            && optp_config[i].id < next_device_id)
+        {
+            log_err("error: config -p with invalid id=%d less than -U %d\n",
+                    optp_config[i].id, next_device_id);
+
+            allow_driver_start = false;
+        }
+    }
+
+    // Make sure all -I id=# are greater than the -U# base index
+    for (int i = 0; i < num_optI_configs; ++i) {
+        if (optI_config[i].id != -1
+            && optI_config[i].id < next_device_id)
+        {
+            log_err("error: config -I with invalid id=%d less than -U %d\n",
+                    optI_config[i].id, next_device_id);
+
+            allow_driver_start = false;
+        }
+    }
+
+    // Make sure all -T id=# are greater than the -U# base index
+    for (int i = 0; i < num_optT_configs; ++i) {
+        if (optT_config[i].id != -1
+            && optT_config[i].id < next_device_id)
+        {
+            log_err("error: config -T with invalid id=%d less than -U %d\n",
+                    optT_config[i].id, next_device_id);
+
+            allow_driver_start = false;
+        }
+    }
+
+    thread_config_finalize();
+
     log_info("driver start (version: %s)\n", PROGRAM_VERSION);
 
     ThreadCtl(_NTO_TCTL_IO, 0);
 
     signal(SIGINT, sigint_signal_handler);
 
-    if (fixed_memory_init()) {
-        log_err("fixed_memory_init fail\n");
+    if (slab_memory_init(optM_num) != EOK) {
+        log_err("slab_memory_init fail\n");
 
         return EXIT_FAILURE;
     }
@@ -724,6 +828,45 @@ int main (int argc, char* argv[]) {
         }
     }
 
+    // Make sure all -p id=# are less than the maximum detected device index
+    for (int i = 0; i < num_optp_configs; ++i) {
+        if (optp_config[i].id != -1
+            && optp_config[i].id >= next_device_id)
+        {
+            log_err("error: config -p with invalid id=%d greater than maximum "
+                    "detected device id=%d\n",
+                    optp_config[i].id, next_device_id-1);
+
+            allow_driver_start = false;
+        }
+    }
+
+    // Make sure all -I id=# are less than the maximum detected device index
+    for (int i = 0; i < num_optI_configs; ++i) {
+        if (optI_config[i].id != -1
+            && optI_config[i].id >= next_device_id)
+        {
+            log_err("error: config -I with invalid id=%d greater than maximum "
+                    "detected device id=%d\n",
+                    optI_config[i].id, next_device_id-1);
+
+            allow_driver_start = false;
+        }
+    }
+
+    // Make sure all -T id=# are less than the maximum detected device index
+    for (int i = 0; i < num_optT_configs; ++i) {
+        if (optT_config[i].id != -1
+            && optT_config[i].id >= next_device_id)
+        {
+            log_err("error: config -T with invalid id=%d greater than maximum "
+                    "detected device id=%d\n",
+                    optT_config[i].id, next_device_id-1);
+
+            allow_driver_start = false;
+        }
+    }
+
     if (!allow_driver_start) {
         return EXIT_FAILURE;
     }
@@ -746,10 +889,8 @@ int main (int argc, char* argv[]) {
     pthread_attr_init(&irq_thread_attr);
     pthread_attr_setdetachstate(&irq_thread_attr, PTHREAD_CREATE_DETACHED);
 
-    pthread_attr_setinheritsched(&irq_thread_attr, PTHREAD_EXPLICIT_SCHED);
-
-    param.sched_priority += CONFIG_IRQ_SCHED_PRIORITY_BOOST;
-    pthread_attr_setschedparam(&irq_thread_attr, &param);
+    thread_sched_attr( &irq_thread_attr, thread_sched(NULL, THREAD_IRQ),
+            param.sched_priority + CONFIG_IRQ_SCHED_PRIORITY_BOOST );
 
     pthread_create(&irq_thread, &irq_thread_attr, &irq_loop, NULL);
 
@@ -773,9 +914,15 @@ int main (int argc, char* argv[]) {
      */
     remove_all_driver_selections();
 
+    vbus_cleanup();
+
+    irq_attach_cleanup();
     irq_group_cleanup();
 
     free(optu_config);
+    free(optp_config);
+    free(optI_config);
+    free(optT_config);
 
     return EXIT_SUCCESS;
 }
@@ -22,96 +22,423 @@
 
 #include <drivers/net/can/sja1000/sja1000.h>
 #include <session.h>
+#include <shmchan.h>
+#include <threads.h>
+#include <vbus.h>
+#include <gateway.h>
+#include <trace.h>
 
 #include "netif.h"
 #include "interrupt.h"
 
 
-void* netif_tx (void* arg) {
-    device_session_t* ds = (device_session_t*)arg;
-    struct net_device* dev = ds->device;
-    struct can_msg* canmsg;
+/*
+ * Hand a frame to a client, through its shared memory ring if it has one;
+ * queued is the time (ns) the frame is handed over, for the latency stages
+ */
+static void netif_deliver (client_session_t* it,
+        const frame_t* frame, uint64_t tstamp, uint64_t queued)
+{
+    if (it->shm == NULL) {
+        if (enqueue_at(&it->rx_queue, frame, tstamp, queued) != EOK) {
+        }
 
-    queue_start(&ds->tx_queue);
+        return;
+    }
 
-    while (1) {
-        if (ds->tx_queue.attr.size == 0) {
-            log_trace("netif_tx exit: %s\n", dev->name);
+    if (it->shm->dir != SHM_CHANNEL_RX) {
+        return;
+    }
 
-            return NULL;
+    if (shm_channel_rx(it->shm, frame, tstamp) != EOK) {
+        if (it->rx_queue.dropped_packet) {
+            it->rx_queue.dropped_packet(it->rx_queue.dropped_packet_arg);
         }
+    }
+}
 
-        if ((canmsg = dequeue(&ds->tx_queue, 0)) == NULL) {
-            log_trace("netif_tx exit: %s\n", dev->name);
+/* Hand a frame to every client whose filter passes it */
+static void netif_broadcast (device_session_t* ds,
+        const frame_t* frame, uint64_t tstamp)
+{
+    uint32_t mid = frame_mid(frame);
 
-            return NULL;
+    gateway_route(ds->id, frame, tstamp);
+
+    pthread_mutex_lock(&device_session_create_mutex);
+
+    client_session_t* it = ds->root_client_session;
+    while (it != NULL) {
+        if ((mid & *it->mfilter) == mid) {
+            netif_deliver(it, frame, tstamp, tstamp);
         }
 
-        if (!dev->irq) {
-            // Only Virtual CAN (vcan) driver can have irq=0
-            // For vcan, we just broadcast to all client sessions
+        it = it->next;
+    }
+
+    pthread_mutex_unlock(&device_session_create_mutex);
+}
+
+/*
+ * Virtual bus callbacks (-B); the frame is stamped on the driver's clock like
+ * those of the hardware devices rather than with the bus' own time.
+ */
+void netif_vbus_deliver (void* arg, const frame_t* frame, uint64_t tstamp) {
+    struct net_device* dev = (struct net_device*)arg;
+    device_session_t* ds = dev->device_session;
+
+    if (ds) {
+        uint64_t now = get_clock_time_ns();
+
+        // Every device on the bus sees every frame, its own included as its
+        // echo; the gateway doesn't forward those
+        busload_frame( &ds->busload, frame->id & ~FRAME_ECHO, frame->len,
+                false, now );
+        netif_broadcast(ds, frame, now);
+    }
+}
 
-            client_session_t* it = ds->root_client_session;
-            while (it != NULL) {
-                if ((canmsg->mid & *it->mfilter) == canmsg->mid) {
-                    if (enqueue(&it->rx_queue, canmsg) != EOK) {
-                    }
+void netif_vbus_event (void* arg, vbus_event_t event,
+        unsigned tec, unsigned rec)
+{
+    struct net_device* dev = (struct net_device*)arg;
+    struct can_priv* priv = netdev_priv(dev);
+    unsigned c = (tec > rec) ? tec : rec;
+    enum can_state state;
+
+    switch (event) {
+    case VBUS_EVENT_TX_ERROR:
+        DEV_STATS_INC(dev, tx_errors);
+        DEV_STATS_INC(dev, bus_error);
+        break;
+    case VBUS_EVENT_RX_ERROR:
+        DEV_STATS_INC(dev, rx_errors);
+        DEV_STATS_INC(dev, bus_error);
+        break;
+    case VBUS_EVENT_BUS_OFF:
+        DEV_STATS_INC(dev, tx_errors);
+        DEV_STATS_INC(dev, bus_off);
+        priv->state = CAN_STATE_BUS_OFF;
+        return;
+    case VBUS_EVENT_BUS_ON:
+        DEV_STATS_INC(dev, restarts);
+        break;
+    case VBUS_EVENT_STATE:
+        break;
+    }
+
+    if (c >= VBUS_ERROR_PASSIVE) {
+        state = CAN_STATE_ERROR_PASSIVE;
+    }
+    else if (c >= VBUS_ERROR_WARNING) {
+        state = CAN_STATE_ERROR_WARNING;
+    }
+    else {
+        state = CAN_STATE_ERROR_ACTIVE;
+    }
+
+    if (state > priv->state || event == VBUS_EVENT_BUS_ON
+            || event == VBUS_EVENT_STATE)
+    {
+        if (state == CAN_STATE_ERROR_WARNING
+                && priv->state < CAN_STATE_ERROR_WARNING)
+        {
+            DEV_STATS_INC(dev, error_warning);
+        }
+        else if (state == CAN_STATE_ERROR_PASSIVE
+                && priv->state < CAN_STATE_ERROR_PASSIVE)
+        {
+            DEV_STATS_INC(dev, error_passive);
+        }
+
+        priv->state = state;
+    }
+}
+
+/* Transmit a frame taken off tx_queue or a TX ring at time taken (ns) */
+static int netif_xmit (device_session_t* ds, const frame_t* frame,
+        uint64_t taken)
+{
+    struct net_device* dev = ds->device;
+
+    if (!dev->irq) {
+        // Only Virtual CAN (vcan) driver can have irq=0
+        // For vcan, we just broadcast to all client sessions, unless the
+        // device is on a timed virtual bus (-B)
+
+        if (dev->vbus) {
+            return vbus_xmit(dev->vbus, frame);
+        }
+
+        uint64_t now = get_clock_time_ns();
+
+        busload_frame(&ds->busload, frame->id, frame->len, false, now);
+        netif_broadcast(ds, frame, now);
+
+        return EOK;
+    }
+
+    struct sk_buff *skb;
+    struct can_frame *cf;
+
+    /* create zero'ed CAN frame buffer */
+    skb = alloc_can_tx_skb(dev, &cf);
+
+    if (skb == NULL) {
+        log_err("netif_tx exit: alloc_can_tx_skb error\n");
+
+        return ENOMEM;
+    }
+
+    skb->len = CAN_MTU;
+    cf->can_id = frame->id & FRAME_ID_MASK;
+    cf->len = frame->len;
+
+    if (frame->id & FRAME_EFF) { // Extended MID
+        cf->can_id |= CAN_EFF_FLAG;
+    }
+
+    memcpy(cf->data, frame->data, CAN_MSG_DATA_MAX);
+
+    dev->netdev_ops->ndo_start_xmit(skb, dev);
+
+    dev->xmit_tstamp = get_clock_time_ns();
+
+    latency_add( &ds->latency, LATENCY_TX_XMIT,
+            latency_since(taken, dev->xmit_tstamp) );
+
+    return EOK;
+}
+
+/*
+ * Take the next frame from the clients' shared memory TX rings, round robin
+ * between the rings. When all of them are empty each ring is marked as having
+ * a sleeping consumer, so that the next client write kicks tx_queue. Only the
+ * device's own list of TX rings is walked, under its own lock.
+ */
+static int netif_tx_shm (device_session_t* ds, frame_t* frame) {
+    if (ds->shm_tx_channels == 0) {
+        return EAGAIN;
+    }
+
+    int result = EAGAIN;
+    int retry;
+
+    pthread_mutex_lock(&ds->shm_tx_mutex);
+
+    do {
+        shm_channel_t* ch;
+        shm_channel_t* first = NULL;
+        int first_turn = 0;
+        int turn = 0;
+
+        retry = 0;
+
+        for (ch = ds->shm_tx_list; ch != NULL; ch = ch->next) {
+            if (shmring_peek(&ch->port) != NULL) {
+                if (turn >= ds->shm_tx_turn) {
+                    break;
                 }
 
-                it = it->next;
+                if (first == NULL) {
+                    first = ch;
+                    first_turn = turn;
+                }
             }
 
-            continue;
+            ++turn;
         }
 
-        struct sk_buff *skb;
-        struct can_frame *cf;
+        if (ch == NULL && first != NULL) { // wrap around
+            ch = first;
+            turn = first_turn;
+        }
 
-        /* create zero'ed CAN frame buffer */
-        skb = alloc_can_skb(dev, &cf);
+        if (ch != NULL) {
+            result = shm_channel_tx(ch, frame);
+            ds->shm_tx_turn = turn + 1;
 
-        if (skb == NULL) {
-            log_err("netif_tx exit: alloc_can_skb error\n");
+            break;
+        }
 
-            return NULL;
+        for (ch = ds->shm_tx_list; ch != NULL; ch = ch->next) {
+            if (!shmring_prepare_wait(&ch->port)) {
+                retry = 1;
+            }
         }
+    } while (retry);
+
+    pthread_mutex_unlock(&ds->shm_tx_mutex);
+
+    return result;
+}
+
+void* netif_tx (void* arg) {
+    device_session_t* ds = (device_session_t*)arg;
+    struct net_device* dev = ds->device;
+    frame_t* frame;
+    frame_t shm_frame;
+
+    thread_sched_apply(thread_sched(dev, THREAD_TX));
 
-        skb->len = CAN_MTU;
-        cf->can_id = canmsg->mid;
-        cf->len = canmsg->len;
+    queue_start(&ds->tx_queue);
 
-        if (canmsg->ext.is_extended_mid) { // Extended MID
-            cf->can_id |= CAN_EFF_FLAG;
+    while (1) {
+        if (ds->tx_queue.attr.size == 0) {
+            log_trace("netif_tx exit: %s\n", dev->name);
+
+            return NULL;
         }
-        else { // Standard MID
-            /**
-             * Message IDs or MIDs are slightly different on QNX compared to
-             * Linux. The form of the ID depends on whether or not the driver
-             * is using extended MIDs:
-             *
-             *      - In standard 11-bit MIDs, bits 18–28 define the MID.
-             *      - In extended 29-bit MIDs, bits 0–28 define the MID.
-             */
 
-            cf->can_id >>= 18;
+        if (ds->shm_tx_channels) {
+            if (queue_is_stopped(&ds->tx_queue)) {
+                // Come back to the rings once the device restarts
+                queue_kick(&ds->tx_queue);
+            }
+            else if (netif_tx_shm(ds, &shm_frame) == EOK) {
+                if (netif_xmit(ds, &shm_frame, get_clock_time_ns()) != EOK) {
+                    return NULL;
+                }
+
+                // More ring frames may follow; take at most one queued frame
+                // in between rather than blocking
+                queue_kick(&ds->tx_queue);
+            }
         }
 
-        int i;
-        for (i = 0; i < canmsg->len; ++i) {
-            cf->data[i] = canmsg->dat[i];
+        if ((frame = dequeue(&ds->tx_queue, 0)) == NULL) {
+            if (ds->tx_queue.session_up == 0) {
+                log_trace("netif_tx exit: %s\n", dev->name);
+
+                return NULL;
+            }
+
+            continue; // kicked
         }
 
-        dev->netdev_ops->ndo_start_xmit(skb, dev);
+        uint64_t taken = get_clock_time_ns();
+
+        latency_add( &ds->latency, LATENCY_TX_QUEUE,
+                latency_since(queue_tstamp(&ds->tx_queue, frame), taken) );
+
+        if (netif_xmit(ds, frame, taken) != EOK) {
+            return NULL;
+        }
     }
 
     return 0;
 }
 
+/* Linux can_id to frame record id; omits the RTR, ERR flags */
+static inline uint32_t netif_frame_id (canid_t can_id) {
+    uint32_t id = can_id & FRAME_ID_MASK;
+
+    if (can_id & CAN_EFF_FLAG) { // Extended MID
+        id |= FRAME_EFF;
+    }
+
+    return id;
+}
+
 /*
  * Test from Linux:
  *      cansend vcan0 1F334455#1122334455667788
  *      cansend vcan0 123#1122334455667788
  */
+/* Convert a staged Linux frame to the internal frame record */
+static inline void netif_frame (const rx_stage_frame_t* staged,
+        frame_t* frame)
+{
+    frame->id = netif_frame_id(staged->can_id);
+
+    if (staged->is_echo) {
+        frame->id |= FRAME_ECHO;
+    }
+
+    frame->len = staged->len; // set LEN
+    frame->hops = 0;
+    memcpy(frame->data, staged->data, CAN_MSG_DATA_MAX); // Set DAT
+}
+
+/*
+ * Fan received frames out to the client sessions of a device; called by the
+ * device's delivery thread with a batch of staged frames, taking the session
+ * lock once for the whole batch. The bus load and the IRQ latency are counted
+ * here too, keeping them off the IRQ path; remote frames and, without -E, echo
+ * frames are only staged for that.
+ */
+void netif_rx_deliver (device_session_t* ds,
+        const rx_stage_frame_t* frames, int n)
+{
+    frame_t frame[RX_STAGE_BATCH];
+    uint32_t mid[RX_STAGE_BATCH];
+    uint64_t tstamp[RX_STAGE_BATCH];
+    uint64_t now = get_clock_time_ns();
+    int i, m = 0;
+
+    if (n > RX_STAGE_BATCH) {
+        n = RX_STAGE_BATCH;
+    }
+
+    for (i = 0; i < n; ++i) {
+        const rx_stage_frame_t* staged = &frames[i];
+
+        busload_frame( &ds->busload, netif_frame_id(staged->can_id),
+                staged->len, (staged->can_id & CAN_RTR_FLAG) != 0,
+                staged->tstamp );
+
+        if (staged->pulse) {
+            latency_add( &ds->latency, LATENCY_RX_IRQ,
+                    latency_since(staged->tstamp, staged->read) );
+        }
+
+        if (staged->can_id & CAN_RTR_FLAG) {
+            log_trace("netif_rx; CAN_RTR_FLAG\n");
+
+            continue;
+        }
+
+        if (staged->is_echo && !optE) {
+            continue;
+        }
+
+        latency_add( &ds->latency, LATENCY_RX_QUEUE,
+                latency_since(staged->read, now) );
+
+        trace(CAN_TRACE_RX_FRAME, CAN_TRACE_FRAME_ARG0(ds->id, staged->len),
+                staged->can_id, CAN_TRACE_DATA(staged->data, 0),
+                CAN_TRACE_DATA(staged->data, 4));
+
+        netif_frame(staged, &frame[m]);
+        mid[m] = frame_mid(&frame[m]);
+        tstamp[m] = staged->tstamp;
+
+        // Forward ahead of the client delivery
+        gateway_route(ds->id, &frame[m], tstamp[m]);
+
+        ++m;
+    }
+
+    if (m == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&device_session_create_mutex);
+
+    client_session_t* it = ds->root_client_session;
+    while (it != NULL) {
+        for (i = 0; i < m; ++i) {
+            if ((mid[i] & *it->mfilter) == mid[i]) {
+                netif_deliver(it, &frame[i], tstamp[i], now);
+            }
+        }
+
+        it = it->next;
+    }
+
+    pthread_mutex_unlock(&device_session_create_mutex);
+}
+
 int netif_rx (struct sk_buff* skb) {
     struct can_frame* msg = (struct can_frame*)skb->data;
 
@@ -229,101 +556,91 @@ int netif_rx (struct sk_buff* skb) {
         return NET_RX_SUCCESS;
     }
 
-    if (msg->can_id & CAN_RTR_FLAG) {
-        log_trace("netif_rx; CAN_RTR_FLAG\n");
+    // set TIMESTAMP; echo frames are stamped by the TX complete IRQ pulse,
+    // which is left for the first frame received within the same pulse
+    uint64_t tstamp = skb->tstamp;
 
+    if (!tstamp) {
         if (!skb->is_echo) {
-            kfree_skb(skb);
+            tstamp = netif_rx_tstamp(skb->dev);
+        }
+        else if (!(tstamp = skb->dev->irq_tstamp)) {
+            tstamp = get_clock_time_ns();
         }
-
-        return NET_RX_SUCCESS;
     }
 
-    if (!optE) {
-        if (skb->is_echo) {
-            return NET_RX_SUCCESS;
-        }
+    // Transmitted frames are staged even without -E; they count towards the
+    // bus load as they complete
+    if (skb->is_echo && skb->dev->device_session) {
+        latency_add( &skb->dev->device_session->latency, LATENCY_TX_DONE,
+                latency_since(skb->dev->xmit_tstamp, tstamp) );
     }
 
-    struct can_msg canmsg;
+    rx_stage_frame_t frame = {
+        .tstamp = tstamp,
+        .can_id = msg->can_id,
+        .len = msg->len,
+        .is_echo = (skb->is_echo ? 1 : 0)
+    };
 
-    /* set MID; omit EFF, RTR, ERR flags */
-    canmsg.mid = (msg->can_id & CAN_ERR_MASK);
+    memcpy(frame.data, msg->data, CAN_MSG_DATA_MAX);
 
-    if (msg->can_id & CAN_EFF_FLAG) { // Extended MID
-        canmsg.ext.is_extended_mid = 1; // EFF
-    }
-    else { // Standard MID
-        canmsg.ext.is_extended_mid = 0; // SFF
-
-        /**
-         * Message IDs or MIDs are slightly different on QNX compared to
-         * Linux. The form of the ID depends on whether or not the driver
-         * is using extended MIDs:
-         *
-         *      - In standard 11-bit MIDs, bits 18–28 define the MID.
-         *      - In extended 29-bit MIDs, bits 0–28 define the MID.
-         */
-
-        canmsg.mid <<= 18;
-    }
+    netif_rx_frame(skb->dev, &frame);
 
-    // set TIMESTAMP
-    if (optt) {
-        canmsg.ext.timestamp = user_timestamp;
-    }
-    else if (user_timestamp_time != 0) {
-        canmsg.ext.timestamp =
-            user_timestamp + get_clock_time_us()/1000 - user_timestamp_time;
-    }
-    else {
-        canmsg.ext.timestamp = get_clock_time_us()/1000;
+    if (!skb->is_echo) {
+        kfree_skb(skb);
     }
 
-    canmsg.ext.is_remote_frame = (skb->is_echo ? 0 : 1);
-    canmsg.len = msg->len; // set LEN
+    return NET_RX_SUCCESS;
+}
+
+int netif_rx_frame (struct net_device* dev, rx_stage_frame_t* frame) {
+    device_session_t* ds = dev->device_session;
 
-    int i;
-    for (i = 0; i < CAN_MSG_DATA_MAX; ++i) {
-        canmsg.dat[i] = msg->data[i]; // Set DAT
+    if (ds == NULL) {
+        return NET_RX_DROP;
     }
 
-    pthread_mutex_lock(&device_session_create_mutex);
+    frame->read = get_clock_time_ns();
 
-    device_session_t* ds = skb->dev->device_session;
+    // The bus load and the latency are counted by the delivery thread
+    frame->pulse = (!frame->is_echo && dev->irq_pulse != 0
+            && frame->tstamp == dev->irq_pulse);
 
-    client_session_t* it = ds->root_client_session;
-    while (it != NULL) {
-        if ((canmsg.mid & *it->mfilter) == canmsg.mid) {
-            if (enqueue(&it->rx_queue, &canmsg) != EOK) {
+    if (ds->rx_stage.running) {
+        // Conversion and fan-out are left to the device's delivery thread
+        if (rx_stage_push(&ds->rx_stage, frame) != EOK) {
+            if (!frame->is_echo || optE) {
+                DEV_STATS_INC(dev, rx_dropped);
+                DEV_STATS_INC(dev, rx_stage_drops);
             }
-        }
 
-        it = it->next;
+            return NET_RX_DROP;
+        }
+    }
+    else {
+        netif_rx_deliver(ds, frame, 1);
     }
 
-    pthread_mutex_unlock(&device_session_create_mutex);
+    return NET_RX_SUCCESS;
+}
 
-    log_trace("netif_rx; %s [%s] %X [%d] %2X %2X %2X %2X %2X %2X %2X %2X\n",
-            skb->dev->name,
-            /* EFF/SFF is set in the MSB */
-            (msg->can_id & CAN_EFF_FLAG) ? "EFF" : "SFF",
-            msg->can_id & CAN_ERR_MASK, /* omit EFF, RTR, ERR flags */
-            msg->len,
-            msg->data[0],
-            msg->data[1],
-            msg->data[2],
-            msg->data[3],
-            msg->data[4],
-            msg->data[5],
-            msg->data[6],
-            msg->data[7]);
+/*
+ * Receive timestamp for the next frame read from the device. The first frame
+ * read after an IRQ pulse gets the pulse receipt time, any further frames
+ * drained within the same pulse are stamped at the time they are read. Echoes
+ * of transmitted frames don't take it.
+ */
+u64 netif_rx_tstamp (struct net_device* dev) {
+    u64 tstamp = dev->irq_tstamp;
 
-    if (!skb->is_echo) {
-        kfree_skb(skb);
+    if (tstamp) {
+        dev->irq_tstamp = 0;
+
+        return tstamp;
     }
 
-    return NET_RX_SUCCESS;
+    return get_clock_time_ns();
 }
 
 void netif_start_queue(struct net_device *dev)
@@ -144,6 +144,10 @@ int process_driver_selection() {
         store_driver_selection(0x0, 0x0, &vcan_driver);
     }
 
+    if (optS) {
+        store_driver_selection(0x0, 0x0, &sim_pci_driver);
+    }
+
     return 0;
 }
 
@@ -341,8 +345,11 @@ pci_err_t pci_enable_device (struct pci_dev* dev) {
                 log_info("read irq[%d]: %d\n", i, irq[i]);
             }
 
-            irq_group_add( irq, nirq, dev->hdl, dev->msi_cap,
-                    dev->is_msi, dev->is_msix );
+            if (irq_group_add( irq, nirq, dev->hdl, dev->msi_cap,
+                        dev->is_msi, dev->is_msix ))
+            {
+                return PCI_ERR_ENOMEM; // Not enough memory
+            }
         }
 
         if (dev->irq == 0) {
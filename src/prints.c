@@ -21,6 +21,8 @@
 #include <stdio.h>
 
 #include "config.h"
+#include "slab.h"
+#include "vbus.h"
 
 
 void print_version (void) {
@@ -55,6 +57,7 @@ void print_configs (void) {
             CONFIG_QNX_RESMGR_THREAD_POOL);
     printf("CONFIG_IRQ_SCHED_PRIORITY_BOOST=%d\n",
             CONFIG_IRQ_SCHED_PRIORITY_BOOST);
+    printf("CONFIG_TRACE=%d\n", CONFIG_TRACE);
 
     return;
 }
@@ -97,6 +100,9 @@ void print_help (char* program_name) {
     printf("                          specified with the -U option.\n");
     printf("                 \e[1mrx=#\e[m   - Number of RX file descriptors to create\n");
     printf("                 \e[1mtx=#\e[m   - Number of TX file descriptors to create\n");
+    printf("                 \e[1mbin\e[m    - Open the file descriptors in binary record mode;\n");
+    printf("                          read() and write() transfer whole struct can_msg\n");
+    printf("                          records instead of payload bytes only\n");
     printf("\n");
     printf("                 Examples:\n");
     printf("                     # Specify 2 RX and 0 TX file descriptors in /dev/can0/*:\n");
@@ -161,11 +167,138 @@ void print_help (char* program_name) {
     printf("                     # (Special cases only) Forced btr* baud-rate setting method:\n");
     printf("                     \e[1mdev-can-linux -b id=0,freq=125k,btr0=0x07,btr1=0x14\e[m\n");
     printf("\n");
+    printf("    \e[1m-p subopts\e[m - Enable adaptive interrupt-to-polling receive mode for a device.\n");
+    printf("\n");
+    printf("                 Once a device moves the given number of frames within the\n");
+    printf("                 window, its IRQ is left masked and the device is polled\n");
+    printf("                 periodically instead, saving a pulse and an IRQ mask/unmask\n");
+    printf("                 per frame at high bus loads. After the given number of empty\n");
+    printf("                 poll rounds the device returns to interrupt mode.\n");
+    printf("\n");
+    printf("                 Suboptions (\e[1msubopts\e[m):\n");
+    printf("\n");
+    printf("                 \e[1mid=#\e[m       - Specify ID number of the device to configure;\n");
+    printf("                              e.g. /dev/can0/ is id=0\n");
+    printf("                 \e[1mframes=#\e[m   - Frames within the window to start polling;\n");
+    printf("                              0 disables polling. Default: %d\n", DEFAULT_POLL_FRAMES);
+    printf("                 \e[1mwindow=#\e[m   - Window length (microseconds)\n");
+    printf("                              Default: %d\n", DEFAULT_POLL_WINDOW_US);
+    printf("                 \e[1mbudget=#\e[m   - Max frames handled per poll round\n");
+    printf("                              Default: %d\n", DEFAULT_POLL_BUDGET);
+    printf("                 \e[1midle=#\e[m     - Empty poll rounds before returning to\n");
+    printf("                              interrupt mode. Default: %d\n", DEFAULT_POLL_IDLE);
+    printf("                 \e[1mperiod=#\e[m   - Time between poll rounds (microseconds)\n");
+    printf("                              Default: %d\n", DEFAULT_POLL_PERIOD_US);
+    printf("\n");
+    printf("                 Examples:\n");
+    printf("                     # Poll /dev/can0 when busy, every 50us:\n");
+    printf("                     \e[1mdev-can-linux -p id=0,period=50\e[m\n");
+    printf("\n");
+    printf("    \e[1m-I subopts\e[m - Service the interrupts of a device on its own IRQ channel and\n");
+    printf("                 worker thread instead of the shared IRQ thread, optionally\n");
+    printf("                 with its own priority and restricted to a set of CPUs.\n");
+    printf("\n");
+    printf("                 Suboptions (\e[1msubopts\e[m):\n");
+    printf("\n");
+    printf("                 \e[1mid=#\e[m       - Specify ID number of the device to configure;\n");
+    printf("                              e.g. /dev/can0/ is id=0\n");
+    printf("                 \e[1mprio=#\e[m     - Worker thread priority; default is the IRQ\n");
+    printf("                              thread priority\n");
+    printf("                 \e[1mcpus=#\e[m     - CPU runmask of the worker thread, e.g. 0x2\n");
+    printf("                              for CPU 1; default is any CPU\n");
+    printf("                 \e[1mattach\e[m     - One worker per IRQ attach of the device\n");
+    printf("                              instead of one per device\n");
+    printf("\n");
+    printf("                 Examples:\n");
+    printf("                     # Service /dev/can1 interrupts on CPU 2 at priority 40:\n");
+    printf("                     \e[1mdev-can-linux -I id=1,prio=40,cpus=0x4\e[m\n");
+    printf("\n");
+    printf("    \e[1m-T subopts\e[m - Set the scheduling of the driver threads, per thread class and\n");
+    printf("                 optionally per device. Each class is given as\n");
+    printf("                 \e[1mprio[:cpus[:policy]]\e[m where cpus is a CPU runmask (e.g. 0x3 for\n");
+    printf("                 CPUs 0 and 1) and policy is one of fifo, rr or other; empty\n");
+    printf("                 fields keep the defaults. Without id the settings apply to all\n");
+    printf("                 devices; classes a device entry leaves out fall back to them.\n");
+    printf("                 An irq class given for a device also gives the device its own\n");
+    printf("                 IRQ worker thread, see -I.\n");
+    printf("\n");
+    printf("                 Suboptions (\e[1msubopts\e[m):\n");
+    printf("\n");
+    printf("                 \e[1mid=#\e[m       - Specify ID number of the device to configure;\n");
+    printf("                              e.g. /dev/can0/ is id=0\n");
+    printf("                 \e[1mirq=..\e[m     - IRQ threads servicing the device interrupts\n");
+    printf("                 \e[1mtx=..\e[m      - Transmit thread\n");
+    printf("                 \e[1mrx=..\e[m      - Receive thread resuming blocked clients\n");
+    printf("                 \e[1mresmgr=..\e[m  - Resource manager threads\n");
+    printf("                 \e[1mtimer=..\e[m   - Timer service thread; a device entry sets the\n");
+    printf("                              priority its bus-off recovery callbacks run at\n");
+    printf("                 \e[1mfile=path\e[m  - Read more -T subopts from a file, one set per\n");
+    printf("                              line; blank lines and lines starting with #\n");
+    printf("                              are ignored\n");
+    printf("\n");
+    printf("                 Examples:\n");
+    printf("                     # Keep /dev/can0 on CPU 3, IRQs at priority 50 round-robin:\n");
+    printf("                     \e[1mdev-can-linux -T id=0,irq=50:0x8:rr,tx=:0x8,rx=:0x8,resmgr=:0x8\e[m\n");
+    printf("\n");
+    printf("                     # Read the thread layout from a file:\n");
+    printf("                     \e[1mdev-can-linux -T file=/etc/dev-can-linux.threads\e[m\n");
+    printf("\n");
     printf("    \e[1m-L num\e[m       Create num virtual CAN (vcan) devices\n");
     printf("                 These devices will loop-back transmitted messages to all\n");
     printf("                 listening clients; no real CAN hardware involved.\n");
     printf("                 Max num: %d\n", MAX_NO_OF_VCAN_CHANNELS);
     printf("\n");
+    printf("    \e[1m-S num\e[m       Create num simulated SJA1000 devices\n");
+    printf("                 Unlike vcan these run the full SJA1000 driver; register\n");
+    printf("                 accesses go to a simulated controller and its interrupts\n");
+    printf("                 to the IRQ threads. All of them share one simulated bus;\n");
+    printf("                 a single device gets its frames acknowledged by the bus.\n");
+    printf("                 Max num: %d\n", MAX_NO_OF_SIM_CHANNELS);
+    printf("\n");
+    printf("    \e[1m-B subopts\e[m - Attach vcan devices to a timed virtual bus; repeat for\n");
+    printf("                 more buses (max %d). Frames take their time on the wire\n", VBUS_MAX_BUSES);
+    printf("                 at the bus bitrate, concurrent senders are arbitrated by\n");
+    printf("                 id and every device on the bus receives each frame.\n");
+    printf("\n");
+    printf("                 Suboptions (\e[1msubopts\e[m):\n");
+    printf("\n");
+    printf("                 \e[1mids=#:#...\e[m     - Device ids on the bus (required)\n");
+    printf("                 \e[1mbitrate=#\e[m      - Bus bitrate, k and M suffixes allowed\n");
+    printf("                                  Default: the first device's bitrate\n");
+    printf("                 \e[1mstuff=worst|none\e[m - Bit stuffing counted in frame time\n");
+    printf("                                  Default: worst\n");
+    printf("                 \e[1merrors=#\e[m       - Error frames per million frames\n");
+    printf("                 \e[1mbusoff=#\e[m       - Bus-off events per million frames\n");
+    printf("                 \e[1mseed=#\e[m         - Seed of the error injection sequence\n");
+    printf("\n");
+    printf("                 Example:\n");
+    printf("                     dev-can-linux -L 3 -B ids=0:1:2,bitrate=125k,errors=1000\n");
+    printf("\n");
+    printf("    \e[1m-g subopts\e[m - Add a gateway rule; frames received on device src that match\n");
+    printf("                 are queued straight to the transmit queue of device dst.\n");
+    printf("                 Repeat for more rules (max 64); see also gw_add_rule().\n");
+    printf("\n");
+    printf("                 Suboptions (\e[1msubopts\e[m):\n");
+    printf("\n");
+    printf("                 \e[1msrc=#\e[m          - Source device id, e.g. /dev/can0 is 0\n");
+    printf("                 \e[1mdst=#\e[m          - Destination device id\n");
+    printf("                 \e[1mid=#\e[m           - CAN id to match; all frames if not given\n");
+    printf("                 \e[1mmask=#\e[m         - Id bits compared; default all\n");
+    printf("                 \e[1mext=1\e[m          - Match extended 29-bit ids\n");
+    printf("                 \e[1msetid=#\e[m        - Rewrite the id\n");
+    printf("                 \e[1mand=hex\e[m        - AND, OR then XOR the 8 payload bytes,\n");
+    printf("                 \e[1mor=hex\e[m           given as 16 hex digits, byte 0 first\n");
+    printf("                 \e[1mxor=hex\e[m\n");
+    printf("                 \e[1mrate=#\e[m         - Forward at most # frames per second\n");
+    printf("\n");
+    printf("                 Example:\n");
+    printf("                     dev-can-linux -g src=0,dst=1,id=0x100,mask=0x700,rate=1000\n");
+    printf("\n");
+    printf("    \e[1m-M num\e[m       Frame buffer pool size; num objects per buffer cache\n");
+    printf("                 Buffers are reserved at startup, the receive and\n");
+    printf("                 transmit paths never allocate memory.\n");
+    printf("                 Default num: %d\n", SLAB_DEFAULT_OBJECTS);
+    printf("\n");
     printf("    \e[1m-m subopts\e[m - Kernel module parameters\n");
     printf("\n");
     printf("                 Suboptions (\e[1msubopts\e[m):\n");
@@ -1,7 +1,7 @@
 /*
  * \file    queue.c
  *
- * \details Circular queue for handling CAN messages of QNX type can_msg.
+ * \details Circular queue for handling CAN frames as internal frame records.
  *          Multi-thread safe, blocks on dequeue and implements nice shutdown on
  *          destroy_queue() call.
  *
@@ -30,6 +30,67 @@
 #include "timer.h"
 
 
+/* Whether storing another message would lose the oldest; Q->mutex held */
+static inline int queue_full (const queue_t* Q) {
+    return (Q->end == Q->attr.size && Q->begin <= 1) || Q->begin == Q->end+1;
+}
+
+/* Wake callers waiting for messages to be removed; Q->mutex held */
+static inline void space_signal (queue_t* Q) {
+    if (Q->space_waiting) {
+        pthread_cond_broadcast(&Q->space);
+    }
+}
+
+/*
+ * Store a message, losing the oldest ones if full; called with Q->mutex held,
+ * which it releases before calling the enqueued hook
+ */
+static void store (queue_t* Q, const frame_t* msg, uint64_t tstamp,
+        uint64_t queued)
+{
+    if (Q->end == Q->attr.size) {
+        Q->end = 0;
+
+        if (Q->begin == 0) {
+            Q->removed += 2;
+            Q->begin = 2; // 2 messages lost if we use the entire queue size and
+                          // wrap around. Since we don't track the wrap around
+                          // when Q->begin == Q->end (our empty queue condition)
+                          // would be the same as the wrapped around condition.
+                          // Thus we must lose 2 of the oldest messages in this
+                          // scenario.
+        }
+    }
+    else if (Q->begin == Q->end+1) {
+        ++Q->removed;
+
+        if (Q->begin+1 == Q->attr.size) {
+            Q->begin = 0;
+        }
+        else {
+            ++Q->begin; // 1 message lost if we use the entire queue size but did
+                        // not wrap around; oldest message.
+
+            if (Q->dropped_packet) {
+                Q->dropped_packet(Q->dropped_packet_arg);
+            }
+        }
+    }
+
+    Q->data[Q->end] = *msg;
+    Q->tstamp[Q->end] = tstamp;
+    Q->queued[Q->end] = queued;
+    ++Q->end;
+
+    pthread_cond_signal(&Q->cond);
+    pthread_mutex_unlock(&Q->mutex);
+
+    if (Q->enqueued) {
+        Q->enqueued(Q->enqueued_arg);
+    }
+}
+
 int create_queue (queue_t* Q, const queue_attr_t* attr) {
     int result;
 
@@ -39,8 +100,10 @@ int create_queue (queue_t* Q, const queue_attr_t* attr) {
 
     Q->session_up = 0;
     Q->dequeue_waiting = 0;
+    Q->space_waiting = 0;
     Q->stopped = 0;
     Q->wake_pending = 0;
+    Q->kicked = 0;
 
     if ((result = pthread_mutex_init(&Q->mutex, NULL)) != EOK) {
         return result;
@@ -52,13 +115,42 @@ int create_queue (queue_t* Q, const queue_attr_t* attr) {
         return result;
     }
 
+    if ((result = pthread_cond_init(&Q->space, NULL)) != EOK) {
+        pthread_cond_destroy(&Q->cond);
+        pthread_mutex_destroy(&Q->mutex);
+
+        return result;
+    }
+
     Q->attr = *attr;
     Q->begin = Q->end = 0;
+    Q->reserved = 0;
+    Q->removed = 0;
 
     if (attr->size != 0) {
-        if ((Q->data = malloc(Q->attr.size*sizeof(struct can_msg))) == NULL) {
+        if ((Q->data = malloc(Q->attr.size*sizeof(frame_t))) == NULL) {
+            pthread_mutex_destroy(&Q->mutex);
+            pthread_cond_destroy(&Q->cond);
+            pthread_cond_destroy(&Q->space);
+
+            return ENOMEM; // Not enough memory
+        }
+
+        if ((Q->tstamp = malloc(Q->attr.size*sizeof(uint64_t))) == NULL) {
+            free(Q->data);
             pthread_mutex_destroy(&Q->mutex);
             pthread_cond_destroy(&Q->cond);
+            pthread_cond_destroy(&Q->space);
+
+            return ENOMEM; // Not enough memory
+        }
+
+        if ((Q->queued = malloc(Q->attr.size*sizeof(uint64_t))) == NULL) {
+            free(Q->tstamp);
+            free(Q->data);
+            pthread_mutex_destroy(&Q->mutex);
+            pthread_cond_destroy(&Q->cond);
+            pthread_cond_destroy(&Q->space);
 
             return ENOMEM; // Not enough memory
         }
@@ -68,6 +160,12 @@ int create_queue (queue_t* Q, const queue_attr_t* attr) {
     Q->dequeue_waiting = 0;
     Q->dropped_packet_arg = NULL;
     Q->dropped_packet = NULL;
+    Q->expired_arg = NULL;
+    Q->expired = NULL;
+    Q->enqueued_arg = NULL;
+    Q->enqueued = NULL;
+    Q->dequeued_arg = NULL;
+    Q->dequeued = NULL;
 
     return EOK;
 }
@@ -80,12 +178,14 @@ void destroy_queue (queue_t* Q) {
     queue_shutdown_signal(Q);
 
     pthread_mutex_lock(&Q->mutex);
-    while (Q->dequeue_waiting) {
+    while (Q->dequeue_waiting || Q->space_waiting) {
         pthread_cond_wait(&Q->cond, &Q->mutex);
     }
 
     if (Q->attr.size != 0) {
         free(Q->data);
+        free(Q->tstamp);
+        free(Q->queued);
     }
 
     Q->attr.size = 0;
@@ -93,13 +193,24 @@ void destroy_queue (queue_t* Q) {
 
     pthread_mutex_destroy(&Q->mutex);
     pthread_cond_destroy(&Q->cond);
+    pthread_cond_destroy(&Q->space);
 
     // Notice we never unlocked the mutex, since we know the dequeue() is not
     // waiting and we are in the process of destroying the session.
     // No need: pthread_mutex_unlock(&Q->mutex);
 }
 
-int enqueue (queue_t* Q, struct can_msg* msg) {
+int enqueue (queue_t* Q, const frame_t* msg) {
+    return enqueue_tstamp(Q, msg, get_clock_time_ns());
+}
+
+int enqueue_tstamp (queue_t* Q, const frame_t* msg, uint64_t tstamp) {
+    return enqueue_at(Q, msg, tstamp, tstamp);
+}
+
+int enqueue_at (queue_t* Q, const frame_t* msg, uint64_t tstamp,
+        uint64_t queued)
+{
     if (Q == NULL || msg == NULL) {
         return EFAULT; // Bad address
     }
@@ -121,42 +232,67 @@ int enqueue (queue_t* Q, struct can_msg* msg) {
 
     // handle data insertion to queue here
 
-    if (Q->end == Q->attr.size) {
-        Q->end = 0;
+    if (Q->reserved && queue_full(Q)) {
+        // Full, and the oldest messages are being replied to in place; they
+        // can't be overwritten so lose the new message instead.
+        pthread_mutex_unlock(&Q->mutex);
 
-        if (Q->begin == 0) {
-            Q->begin = 2; // 2 messages lost if we use the entire queue size and
-                          // wrap around. Since we don't track the wrap around
-                          // when Q->begin == Q->end (our empty queue condition)
-                          // would be the same as the wrapped around condition.
-                          // Thus we must lose 2 of the oldest messages in this
-                          // scenario.
+        if (Q->dropped_packet) {
+            Q->dropped_packet(Q->dropped_packet_arg);
         }
+
+        return EOK;
     }
-    else if (Q->begin == Q->end+1) {
-        if (Q->begin+1 == Q->attr.size) {
-            Q->begin = 0;
-        }
-        else {
-            ++Q->begin; // 1 message lost if we use the entire queue size but did
-                        // not wrap around; oldest message.
 
-            if (Q->dropped_packet) {
-                Q->dropped_packet(Q->dropped_packet_arg);
-            }
+    store(Q, msg, tstamp, queued);
+
+    return EOK;
+}
+
+int enqueue_wait (queue_t* Q, const frame_t* msg, int noblock) {
+    if (Q == NULL || msg == NULL) {
+        return EFAULT; // Bad address
+    }
+
+    if (Q->session_up == 0) {
+        return EPIPE; // Broken pipe
+    }
+
+    pthread_mutex_lock(&Q->mutex);
+
+    if (Q->attr.size == 0) {
+        pthread_mutex_unlock(&Q->mutex);
+
+        return EDOM; // Domain error
+    }
+
+    while (Q->session_up == 1 && queue_full(Q)) {
+        if (noblock) {
+            pthread_mutex_unlock(&Q->mutex);
+
+            return EAGAIN; // Resource temporarily unavailable
         }
+
+        ++Q->space_waiting;
+        pthread_cond_wait(&Q->space, &Q->mutex);
+        --Q->space_waiting;
     }
 
-    Q->data[Q->end] = *msg;
-    ++Q->end;
+    if (Q->session_up == 0) {
+        pthread_cond_broadcast(&Q->cond); // destroy_queue() may be waiting
+        pthread_mutex_unlock(&Q->mutex);
 
-    pthread_cond_signal(&Q->cond);
-    pthread_mutex_unlock(&Q->mutex);
+        return EPIPE; // Broken pipe
+    }
+
+    uint64_t now = get_clock_time_ns();
+
+    store(Q, msg, now, now);
 
     return EOK;
 }
 
-struct can_msg* dequeue (queue_t* Q, uint32_t latency_limit_ms) {
+frame_t* dequeue (queue_t* Q, uint32_t latency_limit_ms) {
     if (Q == NULL) {
         return NULL;
     }
@@ -165,14 +301,14 @@ struct can_msg* dequeue (queue_t* Q, uint32_t latency_limit_ms) {
         return NULL;
     }
 
-    struct can_msg* result = NULL;
+    frame_t* result = NULL;
 
     do {
         pthread_mutex_lock(&Q->mutex);
 
         Q->dequeue_waiting = 1;
         while (Q->dequeue_waiting && Q->session_up == 1
-                && (Q->begin == Q->end || Q->stopped))
+                && ((Q->begin == Q->end && !Q->kicked) || Q->stopped))
         {
             pthread_cond_wait(&Q->cond, &Q->mutex);
         }
@@ -193,18 +329,29 @@ struct can_msg* dequeue (queue_t* Q, uint32_t latency_limit_ms) {
                          // fact.
         }
 
+        if (Q->kicked) {
+            Q->kicked = 0;
+
+            if (Q->begin == Q->end) {
+                pthread_mutex_unlock(&Q->mutex);
+
+                return NULL; // Woken by queue_kick() with nothing queued
+            }
+        }
+
         // handle data in queue here, i.e. when Q->begin != Q-end
         result = &Q->data[Q->begin];
 
         if (latency_limit_ms) {
-            uint32_t now = get_clock_time_us()/1000;
+            uint64_t now = get_clock_time_ns();
 
-            if (now - result->ext.timestamp > latency_limit_ms) {
+            if (now - Q->tstamp[Q->begin] > latency_limit_ms*1000000ULL) {
                 result = NULL;
             }
         }
 
         ++Q->begin;
+        ++Q->removed;
 
         if (Q->begin == Q->attr.size) {
             Q->begin = 0;
@@ -214,13 +361,22 @@ struct can_msg* dequeue (queue_t* Q, uint32_t latency_limit_ms) {
             }
         }
 
+        space_signal(Q);
         pthread_mutex_unlock(&Q->mutex);
+
+        if (result == NULL && Q->expired) {
+            Q->expired(Q->expired_arg);
+        }
     } while (result == NULL);
 
+    if (Q->dequeued) {
+        Q->dequeued(Q->dequeued_arg);
+    }
+
     return result;
 }
 
-struct can_msg* dequeue_noblock (queue_t* Q, uint32_t latency_limit_ms) {
+frame_t* dequeue_noblock (queue_t* Q, uint32_t latency_limit_ms) {
     if (Q == NULL) {
         return NULL;
     }
@@ -229,7 +385,7 @@ struct can_msg* dequeue_noblock (queue_t* Q, uint32_t latency_limit_ms) {
         return NULL;
     }
 
-    struct can_msg* result = NULL;
+    frame_t* result = NULL;
 
     do {
         pthread_mutex_lock(&Q->mutex);
@@ -244,14 +400,15 @@ struct can_msg* dequeue_noblock (queue_t* Q, uint32_t latency_limit_ms) {
         result = &Q->data[Q->begin];
 
         if (latency_limit_ms) {
-            uint32_t now = get_clock_time_us()/1000;
+            uint64_t now = get_clock_time_ns();
 
-            if (now - result->ext.timestamp > latency_limit_ms) {
+            if (now - Q->tstamp[Q->begin] > latency_limit_ms*1000000ULL) {
                 result = NULL;
             }
         }
 
         ++Q->begin;
+        ++Q->removed;
 
         if (Q->begin == Q->attr.size) {
             Q->begin = 0;
@@ -261,13 +418,22 @@ struct can_msg* dequeue_noblock (queue_t* Q, uint32_t latency_limit_ms) {
             }
         }
 
+        space_signal(Q);
         pthread_mutex_unlock(&Q->mutex);
+
+        if (result == NULL && Q->expired) {
+            Q->expired(Q->expired_arg);
+        }
     } while (result == NULL);
 
+    if (Q->dequeued) {
+        Q->dequeued(Q->dequeued_arg);
+    }
+
     return result;
 }
 
-struct can_msg* dequeue_peek (queue_t* Q) {
+frame_t* dequeue_peek (queue_t* Q) {
     if (Q == NULL) {
         return NULL;
     }
@@ -276,7 +442,7 @@ struct can_msg* dequeue_peek (queue_t* Q) {
         return NULL;
     }
 
-    struct can_msg* result = NULL;
+    frame_t* result = NULL;
 
     pthread_mutex_lock(&Q->mutex);
 
@@ -308,7 +474,7 @@ struct can_msg* dequeue_peek (queue_t* Q) {
     return result;
 }
 
-struct can_msg* dequeue_peek_noblock (queue_t* Q) {
+frame_t* dequeue_peek_noblock (queue_t* Q) {
     if (Q == NULL) {
         return NULL;
     }
@@ -317,7 +483,7 @@ struct can_msg* dequeue_peek_noblock (queue_t* Q) {
         return NULL;
     }
 
-    struct can_msg* result = NULL;
+    frame_t* result = NULL;
 
     pthread_mutex_lock(&Q->mutex);
 
@@ -334,3 +500,95 @@ struct can_msg* dequeue_peek_noblock (queue_t* Q) {
 
     return result;
 }
+
+int dequeue_reserve (queue_t* Q, int max,
+        frame_t* seg[2], int seg_len[2])
+{
+    seg_len[0] = seg_len[1] = 0;
+
+    if (Q == NULL || max <= 0) {
+        return 0;
+    }
+
+    if (Q->session_up == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&Q->mutex);
+
+    // One reservation at a time, else two readers would take the same messages
+    while (Q->reserved && Q->session_up == 1) {
+        ++Q->space_waiting;
+        pthread_cond_wait(&Q->space, &Q->mutex);
+        --Q->space_waiting;
+    }
+
+    if (Q->session_up == 0) {
+        pthread_cond_broadcast(&Q->cond); // destroy_queue() may be waiting
+        pthread_mutex_unlock(&Q->mutex);
+
+        return 0;
+    }
+
+    if (Q->attr.size == 0 || Q->begin == Q->end) {
+        pthread_mutex_unlock(&Q->mutex);
+
+        return 0;
+    }
+
+    if (Q->begin < Q->end) {
+        seg_len[0] = Q->end - Q->begin;
+    }
+    else { // wrapped around
+        seg_len[0] = Q->attr.size - Q->begin;
+        seg_len[1] = Q->end;
+    }
+
+    if (seg_len[0] >= max) {
+        seg_len[0] = max;
+        seg_len[1] = 0;
+    }
+    else if (seg_len[0] + seg_len[1] > max) {
+        seg_len[1] = max - seg_len[0];
+    }
+
+    seg[0] = &Q->data[Q->begin];
+    seg[1] = &Q->data[0];
+
+    Q->reserved = seg_len[0] + seg_len[1];
+
+    pthread_mutex_unlock(&Q->mutex);
+
+    return seg_len[0] + seg_len[1];
+}
+
+void dequeue_release (queue_t* Q, int count) {
+    if (Q == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&Q->mutex);
+
+    int n = (count < Q->reserved) ? count : Q->reserved;
+    Q->reserved = 0;
+
+    while (n-- > 0) {
+        ++Q->begin;
+        ++Q->removed;
+
+        if (Q->begin == Q->attr.size) {
+            Q->begin = 0;
+
+            if (Q->end == Q->attr.size) {
+                Q->end = 0;
+            }
+        }
+    }
+
+    space_signal(Q);
+    pthread_mutex_unlock(&Q->mutex);
+
+    if (count > 0 && Q->dequeued) {
+        Q->dequeued(Q->dequeued_arg);
+    }
+}
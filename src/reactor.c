@@ -0,0 +1,283 @@
+/*
+ * \file    reactor.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <resmgr.h>
+#include <threads.h>
+
+#include "reactor.h"
+
+
+static void* reactor_loop (void* arg);
+
+reactor_t* create_reactor (const struct thread_sched* sched) {
+    reactor_t* r;
+
+    if (!(r = calloc(1, sizeof(*r)))) {
+        log_err("create_reactor calloc failed\n");
+
+        return NULL;
+    }
+
+    int result;
+    if ((result = pthread_mutex_init(&r->mutex, NULL)) != EOK) {
+        log_err("create_reactor pthread_mutex_init failed: %d\n", result);
+
+        free(r);
+        return NULL;
+    }
+
+    if ((result = pthread_cond_init(&r->cond, NULL)) != EOK) {
+        log_err("create_reactor pthread_cond_init failed: %d\n", result);
+
+        pthread_mutex_destroy(&r->mutex);
+        free(r);
+        return NULL;
+    }
+
+    if ((result = pthread_cond_init(&r->idle, NULL)) != EOK) {
+        log_err("create_reactor pthread_cond_init failed: %d\n", result);
+
+        pthread_cond_destroy(&r->cond);
+        pthread_mutex_destroy(&r->mutex);
+        free(r);
+        return NULL;
+    }
+
+    r->sched = sched;
+
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    thread_sched_attr(&attr, sched, 0);
+
+    if ((result = pthread_create(&r->thread, &attr, &reactor_loop, r)) != EOK) {
+        log_err("create_reactor pthread_create failed: %d\n", result);
+
+        pthread_cond_destroy(&r->idle);
+        pthread_cond_destroy(&r->cond);
+        pthread_mutex_destroy(&r->mutex);
+        free(r);
+        return NULL;
+    }
+
+    return r;
+}
+
+void reactor_attach (reactor_t* r, struct can_resmgr* resmgr) {
+    pthread_mutex_lock(&r->mutex);
+    ++r->refs;
+    pthread_mutex_unlock(&r->mutex);
+}
+
+/* Must be called with r->mutex held */
+static void ready_remove (reactor_t* r, struct can_ocb* ocb) {
+    struct can_ocb* prev = NULL;
+    struct can_ocb* it = r->ready_head;
+
+    while (it != NULL && it != ocb) {
+        prev = it;
+        it = it->rx.ready_next;
+    }
+
+    if (it == NULL) {
+        return;
+    }
+
+    if (prev) {
+        prev->rx.ready_next = ocb->rx.ready_next;
+    }
+    else {
+        r->ready_head = ocb->rx.ready_next;
+    }
+
+    if (r->ready_tail == ocb) {
+        r->ready_tail = prev;
+    }
+
+    ocb->rx.ready_next = NULL;
+    ocb->rx.ready_queued = 0;
+}
+
+/* Must be called with r->mutex held */
+static void ready_append (reactor_t* r, struct can_ocb* ocb) {
+    if (ocb->rx.ready_queued) {
+        return;
+    }
+
+    ocb->rx.ready_next = NULL;
+    ocb->rx.ready_queued = 1;
+
+    if (r->ready_tail) {
+        r->ready_tail->rx.ready_next = ocb;
+    }
+    else {
+        r->ready_head = ocb;
+    }
+
+    r->ready_tail = ocb;
+}
+
+void reactor_detach (reactor_t* r, struct can_resmgr* resmgr) {
+    pthread_mutex_lock(&r->mutex);
+
+    // Drop any OCBs of this resmgr still waiting for a resume
+    struct can_ocb* it = r->ready_head;
+
+    while (it != NULL) {
+        struct can_ocb* next = it->rx.ready_next;
+
+        if (it->resmgr == resmgr) {
+            ready_remove(r, it);
+        }
+
+        it = next;
+    }
+
+    // The resmgr context must not be in use once we return
+    while (r->active == resmgr) {
+        pthread_cond_wait(&r->idle, &r->mutex);
+    }
+
+    if (--r->refs > 0) {
+        pthread_mutex_unlock(&r->mutex);
+
+        return;
+    }
+
+    r->shutdown = 1;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->mutex);
+
+    pthread_join(r->thread, NULL);
+
+    pthread_cond_destroy(&r->idle);
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->mutex);
+    free(r);
+}
+
+void reactor_signal (reactor_t* r, struct can_ocb* ocb) {
+    pthread_mutex_lock(&r->mutex);
+
+    if (ocb->rx.queue != NULL && !ocb->rx.ready_queued) {
+        ready_append(r, ocb);
+        pthread_cond_signal(&r->cond);
+    }
+
+    pthread_mutex_unlock(&r->mutex);
+}
+
+void reactor_cancel (reactor_t* r, struct can_ocb* ocb) {
+    pthread_mutex_lock(&r->mutex);
+    ready_remove(r, ocb);
+    ocb->rx.queue = NULL;
+
+    if (r->active_ocb == ocb) {
+        r->active_ocb = NULL;
+    }
+
+    pthread_mutex_unlock(&r->mutex);
+}
+
+/*
+ * The reactor never touches an OCB outside of r->mutex, since the OCB may be
+ * freed as soon as the mutex is released; reactor_cancel() takes the same
+ * mutex and clears active_ocb. The blocked message is replayed with only the
+ * rcvid and the resmgr context, which outlive the OCB. One blocked client is
+ * resumed per pass, rotated to the back of the list, and the OCB is queued
+ * again while more clients are waiting, so no client or session is starved.
+ */
+static void* reactor_loop (void* arg) {
+    reactor_t* r = (reactor_t*)arg;
+
+    thread_sched_apply(r->sched);
+
+    pthread_mutex_lock(&r->mutex);
+
+    while (1) {
+        while (!r->shutdown && r->ready_head == NULL) {
+            pthread_cond_wait(&r->cond, &r->mutex);
+        }
+
+        if (r->shutdown) {
+            break;
+        }
+
+        struct can_ocb* ocb = r->ready_head;
+        ready_remove(r, ocb);
+
+        if (ocb->rx.queue == NULL
+            || dequeue_peek_noblock(ocb->rx.queue) == NULL)
+        {
+            continue; // nothing to deliver; the enqueue hook will signal again
+        }
+
+        int rcvid = -1;
+
+        pthread_mutex_lock(&ocb->rx.mutex);
+
+        rcvid = waitq_first(&ocb->rx.blocked_clients);
+
+        if (rcvid != -1 && ocb->rx.blocked_clients.count > 1) {
+            waitq_rotate(&ocb->rx.blocked_clients);
+
+            ready_append(r, ocb);
+        }
+
+        pthread_mutex_unlock(&ocb->rx.mutex);
+
+        if (rcvid == -1) {
+            continue;
+        }
+
+        can_resmgr_t* resmgr = ocb->resmgr;
+        r->active = resmgr;
+        r->active_ocb = ocb;
+
+        pthread_mutex_unlock(&r->mutex);
+
+        int status = resmgr_msg_again(
+                &resmgr->reactor_context->resmgr_context, rcvid );
+
+        pthread_mutex_lock(&r->mutex);
+
+        if (status == -1) {
+            log_dbg("reactor resmgr_msg_again failed: %s\n", strerror(errno));
+
+            // The client is gone; forget it unless the OCB went with it
+            if (r->active_ocb == ocb) {
+                pthread_mutex_lock(&ocb->rx.mutex);
+                waitq_remove(&ocb->rx.blocked_clients, rcvid);
+                pthread_mutex_unlock(&ocb->rx.mutex);
+            }
+        }
+
+        r->active = NULL;
+        r->active_ocb = NULL;
+        pthread_cond_broadcast(&r->idle);
+    }
+
+    pthread_mutex_unlock(&r->mutex);
+
+    return NULL;
+}
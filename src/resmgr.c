@@ -18,14 +18,35 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
 
 #include <resmgr.h>
 #include <config.h>
 #include <pci.h>
+#include <threads.h>
+#include <slab.h>
+#include <netif.h>
+#include <vbus.h>
+#include <gateway.h>
+#include <trace.h>
 #include <dev-can-linux/commands.h>
 
+/* EXT_CAN_DEVCTL_GET_EXT_STATS replies with the summed device counters */
+static_assert( sizeof(struct can_ext_stats)
+        == DEVSTATS_COUNTERS*sizeof(uint64_t)
+        && offsetof(struct can_ext_stats, alloc_failures)
+        == offsetof(devstats_t, alloc_failures),
+        "struct can_ext_stats must match devstats_t" );
+
+/* EXT_CAN_DEVCTL_GET_LATENCY replies with latency_t as is */
+static_assert( sizeof(struct can_latency) == 2*sizeof(uint32_t)
+            + sizeof(latency_t)
+        && CAN_LATENCY_BUCKETS == LATENCY_BUCKETS
+        && (int)CAN_LATENCY_STAGES == (int)LATENCY_STAGES,
+        "struct can_latency must match latency_t" );
+
 static can_resmgr_t* root_resmgr = NULL;
 
 IOFUNC_OCB_T* can_ocb_calloc (resmgr_context_t* ctp, IOFUNC_ATTR_T* attr);
@@ -39,26 +60,16 @@ int io_read      (resmgr_context_t* ctp, io_read_t*   msg, RESMGR_OCB_T* ocb);
 int io_write     (resmgr_context_t* ctp, io_write_t*  msg, RESMGR_OCB_T* ocb);
 int io_unblock   (resmgr_context_t* ctp, io_pulse_t* msg,  RESMGR_OCB_T* ocb);
 int io_devctl    (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* ocb);
+int io_notify    (resmgr_context_t* ctp, io_notify_t* msg, RESMGR_OCB_T* ocb);
 int io_open      (resmgr_context_t* ctp, io_open_t*   msg,
                     RESMGR_HANDLE_T* handle, void* extra);
 
-void* rx_loop (void* arg);
-
-#if CONFIG_QNX_RESMGR_SINGLE_THREAD == 1
+#if CONFIG_QNX_RESMGR_THREAD_POOL == 1
+static dispatch_context_t* resmgr_context_alloc (dispatch_t* dpp);
+#elif CONFIG_QNX_RESMGR_SINGLE_THREAD == 1
 void* dispatch_receive_loop (void* arg);
 #endif
 
-/*
- * Managing blocking clients
- */
-typedef struct {
-    uint16_t id;
-    int rcvid;
-} msg_again_t;
-
-int msg_again_callback(
-        message_context_t* ctp, int type, unsigned flags, void* handle);
-
 void create_user_dev_setup ( struct can_devctl_timing* timing, u32 freq,
         struct user_dev_setup* user )
 {
@@ -189,6 +200,30 @@ int register_netdev (struct net_device* dev) {
 
     log_trace_bittiming_info(dev);
 
+    dev->poll = NULL;
+
+    if (id < num_optp_configs) {
+        if (id == optp_config[id].id) {
+            dev->poll = &optp_config[id];
+        }
+    }
+
+    dev->irq_config = NULL;
+
+    if (id < num_optI_configs) {
+        if (id == optI_config[id].id) {
+            dev->irq_config = &optI_config[id];
+        }
+    }
+
+    dev->thread_config = NULL;
+
+    if (id < num_optT_configs) {
+        if (id == optT_config[id].id) {
+            dev->thread_config = &optT_config[id];
+        }
+    }
+
     if (dev->netdev_ops->ndo_open(dev)) {
         log_err("register_netdev failed: ndo_open error\n");
 
@@ -203,6 +238,21 @@ int register_netdev (struct net_device* dev) {
 
     dev->device_session = device_session;
 
+    if (device_session != NULL) {
+        device_session->id = id;
+
+        gateway_attach(id, &device_session->tx_queue);
+    }
+
+    dev->vbus = NULL;
+
+    if (!dev->irq) { /* vcan devices can share a timed virtual bus (-B) */
+        struct can_priv* priv = netdev_priv(dev);
+
+        dev->vbus = vbus_attach(id, priv->bittiming.bitrate,
+                netif_vbus_deliver, netif_vbus_event, dev);
+    }
+
     static int io_created = 0;
 
     if (!io_created) {
@@ -223,6 +273,7 @@ int register_netdev (struct net_device* dev) {
         io_funcs.unblock = io_unblock;
         io_funcs.write = io_write;
         io_funcs.devctl = io_devctl;
+        io_funcs.notify = io_notify;
     }
 
     int num_channels[2] = {
@@ -231,6 +282,7 @@ int register_netdev (struct net_device* dev) {
     };
 
     int is_extended_mid = 0; // Default is standard MIDs
+    int record_mode = 0; // Default is payload bytes only read() and write()
 
     if (optx) {
         is_extended_mid = 1; // Change to extended if driver option is given
@@ -245,9 +297,21 @@ int register_netdev (struct net_device* dev) {
                 // Override driver option if individual device option is given
                 is_extended_mid = optu_config[id].is_extended_mid;
             }
+
+            record_mode = optu_config[id].record_mode;
         }
     }
 
+    /* One reactor per device resumes the blocked clients of all its RX
+     * channels */
+    reactor_t* reactor = NULL;
+
+    if (num_channels[0] > 0 && (reactor = create_reactor(
+                    thread_sched(dev, THREAD_RX) )) == NULL)
+    {
+        return -1;
+    }
+
     int i, j;
     for (j = 0; j < 2; ++j) { // 2 for rx & tx
         for (i = 0; i < num_channels[j]; ++i) { // number of channels
@@ -261,6 +325,7 @@ int register_netdev (struct net_device* dev) {
             // Property is_extended_mid is only applicable for read and write
             // functions not used for direct devctl send/receive functionality.
             resmgr->is_extended_mid = is_extended_mid;
+            resmgr->record_mode = record_mode;
 
 #if CONFIG_QNX_RESMGR_THREAD_POOL == 1
             /* initialize dispatch interface */
@@ -345,20 +410,30 @@ int register_netdev (struct net_device* dev) {
             resmgr->prio = 0;               /* CAN priority - not used */
             resmgr->shutdown = 0;
 
-            /* Attach a callback (handler) for two message types */
-            if (message_attach( resmgr->dispatch, NULL, _IO_MAX + 1,
-                        _IO_MAX + 1, msg_again_callback, NULL ) == -1)
-            {
-                log_err("message_attach() failed: %s\n", strerror(errno));
+            resmgr->reactor = NULL;
+            resmgr->reactor_context = NULL;
 
-                return -1;
+            if (resmgr->channel_type == RX_CHANNEL) {
+                /* Context the reactor uses to resume blocked clients */
+                resmgr->reactor_context =
+                    dispatch_context_alloc(resmgr->dispatch);
+
+                if (resmgr->reactor_context == NULL) {
+                    log_err( "dispatch_context_alloc fail: %s\n",
+                            strerror(errno) );
+
+                    return -1;
+                }
+
+                resmgr->reactor = reactor;
+                reactor_attach(reactor, resmgr);
             }
 
 #if CONFIG_QNX_RESMGR_THREAD_POOL == 1
             /* initialize thread pool attributes */
             memset(&resmgr->thread_pool_attr, 0, sizeof(thread_pool_attr_t));
             resmgr->thread_pool_attr.handle = resmgr->dispatch;
-            resmgr->thread_pool_attr.context_alloc = dispatch_context_alloc;
+            resmgr->thread_pool_attr.context_alloc = resmgr_context_alloc;
             resmgr->thread_pool_attr.block_func = dispatch_block; 
             resmgr->thread_pool_attr.unblock_func = dispatch_unblock;
             resmgr->thread_pool_attr.handler_func = dispatch_handler;
@@ -368,6 +443,12 @@ int register_netdev (struct net_device* dev) {
             resmgr->thread_pool_attr.increment = 1;
             resmgr->thread_pool_attr.maximum = 50;
 
+            pthread_attr_init(&resmgr->thread_attr);
+            thread_sched_attr(&resmgr->thread_attr,
+                    thread_sched(dev, THREAD_RESMGR), 0);
+
+            resmgr->thread_pool_attr.attr = &resmgr->thread_attr;
+
             /* allocate a thread pool handle */
             if (( resmgr->thread_pool =
                     thread_pool_create(&resmgr->thread_pool_attr, 0) ) == NULL)
@@ -396,6 +477,8 @@ int register_netdev (struct net_device* dev) {
             pthread_attr_init(&resmgr->dispatch_thread_attr);
             pthread_attr_setdetachstate(
                     &resmgr->dispatch_thread_attr, PTHREAD_CREATE_DETACHED );
+            thread_sched_attr(&resmgr->dispatch_thread_attr,
+                    thread_sched(dev, THREAD_RESMGR), 0);
 
             pthread_create( &resmgr->dispatch_thread,
                     &resmgr->dispatch_thread_attr,
@@ -475,10 +558,20 @@ void unregister_netdev(struct net_device *dev) {
         }
 #endif
 
+        if (resmgr->reactor) {
+            reactor_detach(resmgr->reactor, resmgr);
+            resmgr->reactor = NULL;
+        }
+
         if (resmgr_detach(resmgr->dispatch, resmgr->id, 0) == -1) {
             log_err("internal error; resmgr_detach failure (%s)\n", name);
         }
 
+        if (resmgr->reactor_context) {
+            dispatch_context_free(resmgr->reactor_context);
+            resmgr->reactor_context = NULL;
+        }
+
 #if CONFIG_QNX_RESMGR_SINGLE_THREAD == 1
         pthread_join(resmgr->dispatch_thread, NULL);
 #endif
@@ -500,6 +593,92 @@ void unregister_netdev(struct net_device *dev) {
 }
 
 
+static inline int notify_armed (can_ocb_t* ocb) {
+    return ocb->notify.list[IOFUNC_NOTIFY_INPUT].list != NULL
+        || ocb->notify.list[IOFUNC_NOTIFY_OUTPUT].list != NULL
+        || ocb->notify.list[IOFUNC_NOTIFY_OBAND].list != NULL;
+}
+
+/*
+ * Update the armed flag; called with the notify mutex held. TX channels also
+ * keep the device count of armed OCBs, letting the tx_queue dequeued hook
+ * skip the client session walk while nobody waits for output space.
+ */
+static void notify_set_armed (can_ocb_t* ocb, int armed) {
+    if (ocb->notify.armed == armed) {
+        return;
+    }
+
+    ocb->notify.armed = armed;
+
+    if (ocb->resmgr->channel_type != RX_CHANNEL) {
+        __atomic_fetch_add( &ocb->resmgr->device_session->tx_notify_armed,
+                armed ? 1 : -1, __ATOMIC_SEQ_CST );
+    }
+}
+
+/*
+ * Fire the armed notification entries of the given index. The armed flag is
+ * read without the lock so that the common case, nobody armed, costs nothing
+ * on the enqueue/dequeue paths; io_notify() sets the flag before checking
+ * queue readiness so an event can't fall between the two.
+ */
+static void notify_trigger (can_ocb_t* ocb, int index) {
+    if (!ocb->notify.armed) {
+        return;
+    }
+
+    pthread_mutex_lock(&ocb->notify.mutex);
+    iofunc_notify_trigger(ocb->notify.list, 1, index);
+    notify_set_armed(ocb, notify_armed(ocb));
+    pthread_mutex_unlock(&ocb->notify.mutex);
+}
+
+/* rx_queue enqueued hook */
+static void rx_queue_ready (void* arg) {
+    can_ocb_t* ocb = (can_ocb_t*)arg;
+
+    if (!waitq_empty(&ocb->rx.blocked_clients)) {
+        reactor_signal(ocb->resmgr->reactor, ocb);
+    }
+
+    notify_trigger(ocb, IOFUNC_NOTIFY_INPUT);
+}
+
+/*
+ * Record a client as blocked, replied to later by the reactor. A frame may
+ * have been enqueued after the caller found the queue empty but before the
+ * client was recorded, in which case the enqueue hook didn't see the client;
+ * so check the queue again once the client is on the list.
+ */
+static int block_client (can_ocb_t* ocb, int rcvid) {
+    pthread_mutex_lock(&ocb->rx.mutex);
+    int result = waitq_insert(&ocb->rx.blocked_clients, rcvid);
+    pthread_mutex_unlock(&ocb->rx.mutex);
+
+    if (result != EOK) {
+        log_err("block_client: too many blocked clients (%s)\n",
+                ocb->resmgr->name);
+
+        return result;
+    }
+
+    if (dequeue_peek_noblock(ocb->rx.queue) != NULL) {
+        reactor_signal(ocb->resmgr->reactor, ocb);
+    }
+
+    return EOK;
+}
+
+/* client session tx_ready hook, i.e. device tx_queue dequeued */
+static void tx_queue_ready (void* arg) {
+    can_ocb_t* ocb = (can_ocb_t*)arg;
+
+    if (queue_has_space(&ocb->resmgr->device_session->tx_queue)) {
+        notify_trigger(ocb, IOFUNC_NOTIFY_OUTPUT);
+    }
+}
+
 IOFUNC_OCB_T* can_ocb_calloc (resmgr_context_t* ctp, IOFUNC_ATTR_T* attr) {
     can_resmgr_t* resmgr = get_resmgr(&root_resmgr, ctp->id);
 
@@ -512,6 +691,7 @@ IOFUNC_OCB_T* can_ocb_calloc (resmgr_context_t* ctp, IOFUNC_ATTR_T* attr) {
     }
 
     ocb->resmgr = resmgr;
+    ocb->record_mode = resmgr->record_mode;
 
     device_session_t* ds = resmgr->device_session;
     struct net_device* device = ds->device;
@@ -531,42 +711,49 @@ IOFUNC_OCB_T* can_ocb_calloc (resmgr_context_t* ctp, IOFUNC_ATTR_T* attr) {
         log_err("create_client_session failed: %s\n", ocb->resmgr->name);
     }
 
-    ocb->rx.read_size = 0;
-    ocb->rx.read_buffer = NULL;
-    ocb->rx.nbytes = 0;
     ocb->rx.offset = 0;
+    ocb->rx.head = 0;
 
-    // Every rx session has it's own rx thread to call resmgr_msg_again()
-    if (ocb->resmgr->channel_type == RX_CHANNEL) {
-        ocb->rx.queue = &ocb->session->rx_queue;
-        ocb->rx.blocked_clients = NULL;
+    int result;
+    if ((result = pthread_mutex_init(&ocb->notify.mutex, NULL)) != EOK) {
+        log_err("can_ocb_calloc pthread_mutex_init failed: %d\n", result);
 
-        ocb->rx.read_size = 4096;
-        ocb->rx.read_buffer = malloc(ocb->rx.read_size);
+        destroy_client_session(ocb->session);
+        free(ocb);
 
-        int result;
-        if ((result = pthread_mutex_init(&ocb->rx.mutex, NULL)) != EOK) {
-            log_err("can_ocb_calloc pthread_mutex_init failed: %d\n",
-                    result);
+        return NULL;
+    }
 
-            destroy_client_session(ocb->session);
-            free(ocb);
+    ocb->notify.armed = 0;
+    IOFUNC_NOTIFY_INIT(ocb->notify.list);
 
-            return NULL;
+    if (ocb->session) {
+        if (ocb->resmgr->channel_type == RX_CHANNEL) {
+            ocb->session->rx_queue.enqueued_arg = ocb;
+            ocb->session->rx_queue.enqueued = rx_queue_ready;
+        }
+        else {
+            ocb->session->tx_ready_arg = ocb;
+            ocb->session->tx_ready = tx_queue_ready;
         }
+    }
+
+    // Blocked clients of rx sessions are resumed by the device reactor
+    if (ocb->resmgr->channel_type == RX_CHANNEL) {
+        waitq_init(&ocb->rx.blocked_clients);
 
-        if ((result = pthread_cond_init(&ocb->rx.cond, NULL)) != EOK) {
-            log_err("create_device_session pthread_cond_init failed: %d\n",
+        if ((result = pthread_mutex_init(&ocb->rx.mutex, NULL)) != EOK) {
+            log_err("can_ocb_calloc pthread_mutex_init failed: %d\n",
                     result);
 
-            pthread_mutex_destroy(&ocb->rx.mutex);
+            pthread_mutex_destroy(&ocb->notify.mutex);
             destroy_client_session(ocb->session);
             free(ocb);
 
             return NULL;
         }
 
-        pthread_create(&ocb->rx.thread, NULL, &rx_loop, ocb);
+        ocb->rx.queue = &ocb->session->rx_queue;
     }
 
     return ocb;
@@ -575,134 +762,60 @@ IOFUNC_OCB_T* can_ocb_calloc (resmgr_context_t* ctp, IOFUNC_ATTR_T* attr) {
 void can_ocb_free (IOFUNC_OCB_T* ocb) {
     log_trace("can_ocb_free -> %s\n", ocb->resmgr->name);
 
-    pthread_mutex_lock(&ocb->rx.mutex);
-    ocb->rx.queue = NULL;
-    pthread_cond_signal(&ocb->rx.cond);
-    pthread_mutex_unlock(&ocb->rx.mutex);
+    // After this the reactor neither holds nor accepts this OCB
+    if (ocb->resmgr->channel_type == RX_CHANNEL) {
+        reactor_cancel(ocb->resmgr->reactor, ocb);
+    }
 
     if (ocb->session) {
         destroy_client_session(ocb->session);
         ocb->session = NULL;
     }
 
-    // Wait for rx thread to exit
     if (ocb->resmgr->channel_type == RX_CHANNEL) {
-        pthread_join(ocb->rx.thread, NULL);
-
         pthread_mutex_lock(&ocb->rx.mutex);
 
         // Don't leave any blocking clients hanging
-        blocked_client_t *client = ocb->rx.blocked_clients;
+        int rcvid;
 
-        while (client != NULL) {
-            MsgError(client->rcvid, EBADF);
+        while ((rcvid = waitq_first(&ocb->rx.blocked_clients)) != -1) {
+            MsgError(rcvid, EBADF);
 
-            client = client->next;
+            waitq_remove(&ocb->rx.blocked_clients, rcvid);
         }
 
-        free_all_blocked_clients(&ocb->rx.blocked_clients);
         pthread_mutex_unlock(&ocb->rx.mutex);
+        pthread_mutex_destroy(&ocb->rx.mutex);
     }
 
-    pthread_mutex_lock(&ocb->rx.mutex);
-    pthread_mutex_destroy(&ocb->rx.mutex);
-    pthread_cond_destroy(&ocb->rx.cond);
-
-    ocb->rx.read_size = 0;
-    if (ocb->rx.read_buffer) {
-       free(ocb->rx.read_buffer);
-       ocb->rx.read_buffer = NULL;
-    }
+    // The session is gone so no more hooks can fire
+    pthread_mutex_destroy(&ocb->notify.mutex);
 
     free(ocb);
-
-    // Notice we never unlocked the mutex, since we know the dequeue() is not
-    // waiting and we are in the process of destroying the session.
-    // No need: pthread_mutex_unlock(&ocb->rx.mutex);
-}
-
-int msg_again_callback (message_context_t* ctp, int type, unsigned flags,
-        void* handle)
-{
-    msg_again_t* msg_again = (msg_again_t*)ctp->msg;
-
-    // function resmgr_msg_again() seems to modify the ctp->rcvid value
-    // so let's save it and restore it afer the call
-    int rcvid_save = ctp->rcvid;
-
-    if (msg_again->rcvid != -1) {
-        if (resmgr_msg_again(ctp, msg_again->rcvid) == -1) {
-        }
-    }
-
-    ctp->rcvid = rcvid_save;
-
-    MsgReply(ctp->rcvid, EOK, NULL, 0);
-    return 0;
 }
 
-void* rx_loop (void* arg) {
-    struct can_ocb* ocb = (struct can_ocb*)arg;
-
-    can_resmgr_t* resmgr = ocb->resmgr;
-
-    int coid;
-    msg_again_t msg_again = { .id = _IO_MAX + 1 };
-
-    /* Connect to our channel */
-    if ((coid = message_connect(
-                    ocb->resmgr->dispatch, MSG_FLAG_SIDE_CHANNEL )) == -1)
-    {
-        log_err("rx_loop exit: Unable to attach to channel.\n");
+#if CONFIG_QNX_RESMGR_THREAD_POOL == 1
+/*
+ * Called by each new thread of a resmgr thread pool; the pool creates threads
+ * with the policy and priority of the resmgr thread class but the runmask can
+ * only be set from the thread itself.
+ */
+static dispatch_context_t* resmgr_context_alloc (dispatch_t* dpp) {
+    can_resmgr_t* it = root_resmgr;
 
-        pthread_exit(NULL);
+    while (it != NULL && it->dispatch != dpp) {
+        it = it->next;
     }
 
-    while (1) {
-        int status = -1;
-
-        pthread_mutex_lock(&ocb->rx.mutex);
-
-        while ((!resmgr->shutdown)
-                && (ocb->rx.queue != NULL)
-                && (ocb->rx.blocked_clients == NULL))
-        {
-            pthread_cond_wait(&ocb->rx.cond, &ocb->rx.mutex);
-        }
-
-        pthread_mutex_unlock(&ocb->rx.mutex);
-
-        if (resmgr->shutdown || (ocb->rx.queue == NULL)) {
-            log_trace("rx_loop exit\n");
-
-            ConnectDetach(coid);
-            pthread_exit(NULL);
-        }
-
-        struct can_msg* canmsg = dequeue_peek(ocb->rx.queue);
-
-        if (canmsg == NULL) {
-            continue;
-        }
-
-        pthread_mutex_lock(&ocb->rx.mutex);
-        blocked_client_t* client = ocb->rx.blocked_clients;
-
-        msg_again.rcvid = client->rcvid;
-        pthread_mutex_unlock(&ocb->rx.mutex);
-
-        if ((status = MsgSend(
-                coid, &msg_again, sizeof(msg_again_t), NULL, 0 )) == -1)
-        {
-            log_err( "rx_loop MsgSend status: %d, error: %s\n",
-                    status, strerror(errno) );
-        }
+    if (it != NULL) {
+        thread_sched_apply(
+                thread_sched(it->device_session->device, THREAD_RESMGR) );
     }
 
-    return NULL;
+    return dispatch_context_alloc(dpp);
 }
 
-#if CONFIG_QNX_RESMGR_SINGLE_THREAD == 1
+#elif CONFIG_QNX_RESMGR_SINGLE_THREAD == 1
 /*
  * Resource Manager
  *
@@ -714,6 +827,9 @@ void* dispatch_receive_loop (void* arg) {
 
     dispatch_context_t* ctp = resmgr->dispatch_context;
 
+    thread_sched_apply(
+            thread_sched(resmgr->device_session->device, THREAD_RESMGR) );
+
     /* Done! We can now go into our "receive loop" and wait
      * for messages. The dispatch_block() function is calling
      * MsgReceive() under the covers, and receives for us.
@@ -770,12 +886,143 @@ int io_close_ocb (resmgr_context_t* ctp, void* reserved, RESMGR_OCB_T* _ocb) {
 
     iofunc_ocb_t* ocb = (iofunc_ocb_t*)_ocb;
 
-    _ocb->rx.nbytes = 0;
     _ocb->rx.offset = 0;
 
+    pthread_mutex_lock(&_ocb->notify.mutex);
+    iofunc_notify_remove(ctp, _ocb->notify.list);
+    notify_set_armed(_ocb, 0);
+    pthread_mutex_unlock(&_ocb->notify.mutex);
+
     return iofunc_close_ocb_default(ctp, reserved, ocb);
 }
 
+/*
+ * Frames are queued as internal frame records; the client's struct can_msg is
+ * only built from or taken apart into one here.
+ */
+static inline int enqueue_canmsg (queue_t* Q, const struct can_msg* canmsg) {
+    frame_t frame;
+
+    frame_from_canmsg(&frame, canmsg);
+
+    return enqueue(Q, &frame);
+}
+
+static inline void queued_canmsg (queue_t* Q, const frame_t* frame,
+        struct can_msg* canmsg)
+{
+    frame_to_canmsg(frame, user_timestamp_ms(queue_tstamp(Q, frame)), canmsg);
+}
+
+/* Count the wake latency of a frame taken off a client's rx_queue at now */
+static inline void latency_rx_taken (client_session_t* session,
+        const frame_t* frame, uint64_t now)
+{
+    uint64_t ns = latency_since(queue_queued(&session->rx_queue, frame), now);
+
+    latency_add(&session->latency, LATENCY_RX_WAKE, ns);
+    latency_add(&session->device_session->latency, LATENCY_RX_WAKE, ns);
+}
+
+/* Count the reply latency of a reply to a read that took its frames at taken */
+static inline void latency_rx_replied (client_session_t* session,
+        uint64_t taken)
+{
+    uint64_t ns = latency_since(taken, get_clock_time_ns());
+
+    latency_add(&session->latency, LATENCY_RX_REPLY, ns);
+    latency_add(&session->device_session->latency, LATENCY_RX_REPLY, ns);
+}
+
+/*
+ * Binary record mode read; replies with as many whole struct can_msg records as
+ * fit the client buffer. The frames are converted READ_IOV_MAX at a time
+ * straight out of the rx_queue ring; all but the last batch are written to the
+ * client buffer with MsgWrite() ahead of the reply.
+ */
+static int io_read_records (resmgr_context_t* ctp, io_read_t* msg,
+        can_ocb_t* ocb)
+{
+    queue_t* Q = &ocb->session->rx_queue;
+
+    int max = _IO_READ_GET_NBYTES(msg) / sizeof(struct can_msg);
+
+    if (max == 0) {
+        return EINVAL; // Buffer can't hold a single record
+    }
+
+    frame_t* seg[2];
+    int seg_len[2];
+
+    int n = dequeue_reserve(Q, max, seg, seg_len);
+
+    if (n == 0) {
+        int status;
+        if ((status = block_client(ocb, ctp->rcvid)) != EOK) {
+            return status;
+        }
+
+        return _RESMGR_NOREPLY;
+    }
+
+    struct can_msg record[READ_IOV_MAX];
+    size_t offset = 0;
+    int count = 0;
+    int done = 0;
+
+    uint64_t taken = get_clock_time_ns();
+
+    int s, i;
+    for (s = 0; s < 2; ++s) {
+        for (i = 0; i < seg_len[s]; ++i) {
+            latency_rx_taken(ocb->session, &seg[s][i], taken);
+            queued_canmsg(Q, &seg[s][i], &record[count++]);
+
+            if (count == READ_IOV_MAX && ++done*READ_IOV_MAX < n) {
+                if (MsgWrite(ctp->rcvid, record, sizeof(record), offset) == -1)
+                {
+                    log_dbg("io_read_records MsgWrite failed: %s\n",
+                            strerror(errno));
+                }
+
+                offset += sizeof(record);
+                count = 0;
+            }
+        }
+    }
+
+    dequeue_release(Q, n);
+
+    if (offset == 0) {
+        if (MsgReply( ctp->rcvid, n*sizeof(struct can_msg), record,
+                    count*sizeof(struct can_msg) ) == -1)
+        {
+            log_dbg("io_read_records MsgReply failed: %s\n", strerror(errno));
+        }
+    }
+    else {
+        if (MsgWrite( ctp->rcvid, record, count*sizeof(struct can_msg),
+                    offset ) == -1)
+        {
+            log_dbg("io_read_records MsgWrite failed: %s\n", strerror(errno));
+        }
+
+        if (MsgReply(ctp->rcvid, n*sizeof(struct can_msg), NULL, 0) == -1) {
+            log_dbg("io_read_records MsgReply failed: %s\n", strerror(errno));
+        }
+    }
+
+    latency_rx_replied(ocb->session, taken);
+
+    pthread_mutex_lock(&ocb->rx.mutex);
+    waitq_remove(&ocb->rx.blocked_clients, ctp->rcvid);
+    pthread_mutex_unlock(&ocb->rx.mutex);
+
+    ocb->core.attr->flags |= IOFUNC_ATTR_ATIME;
+
+    return _RESMGR_NOREPLY;
+}
+
 /*
  * io_read
  *
@@ -788,13 +1035,11 @@ int io_close_ocb (resmgr_context_t* ctp, void* reserved, RESMGR_OCB_T* _ocb) {
  * determine whom to reply to, and more.
  */
 int io_read (resmgr_context_t* ctp, io_read_t* msg, RESMGR_OCB_T* _ocb) {
-    int     nparts;
     int     status;
 
     iofunc_ocb_t* ocb = (iofunc_ocb_t*)_ocb;
 
-    log_trace( "io_read -> (id: %d, rcvid: %ld)\n",
-            ctp->id, (long int)ctp->rcvid );
+    trace(CAN_TRACE_IO_READ, ctp->id, ctp->rcvid);
 
     /* Verify the client has the access rights needed to read from our device */
     if ((status = iofunc_read_verify(ctp, msg, ocb, NULL)) != EOK) {
@@ -819,103 +1064,235 @@ int io_read (resmgr_context_t* ctp, io_read_t* msg, RESMGR_OCB_T* _ocb) {
         return (_RESMGR_NPARTS(0));
     }
 
-    if (_ocb->rx.read_buffer == NULL
-        || _ocb->rx.read_size < _IO_READ_GET_NBYTES(msg))
-    {
-        if (_ocb->rx.read_buffer) {
-            free(_ocb->rx.read_buffer);
-        }
+    if (_ocb->record_mode) {
+        return io_read_records(ctp, msg, _ocb);
+    }
 
-        _ocb->rx.read_size += _IO_READ_GET_NBYTES(msg);
-        _ocb->rx.read_buffer = malloc(_ocb->rx.read_size);
+    queue_t* Q = &_ocb->session->rx_queue;
+    size_t want = _IO_READ_GET_NBYTES(msg);
 
-        if (_ocb->rx.read_buffer == NULL) {
-            _ocb->rx.read_buffer = NULL;
-            _ocb->rx.read_size = 0;
+    /*
+     * Payload bytes are gathered straight from the frames in the rx_queue ring
+     * with one IOV per frame, once the queued frames hold the whole read; all
+     * but the last READ_IOV_MAX IOVs are written into the client buffer with
+     * MsgWritev() ahead of the MsgReplyv(). Nothing is taken off the queue for
+     * a read left blocked, so a reader that is unblocked loses no frames. A
+     * partially read frame stays queued with rx.offset marking the bytes
+     * already taken, as long as rx.head shows it hasn't been lost to a full
+     * queue since. A read larger than a full queue completes short.
+     */
+    frame_t* seg[2];
+    int seg_len[2];
+    int n = 0;
 
-            return ENOMEM; // Not enough memory
-        }
+    size_t offset = 0;
+    uint64_t head = 0;
+
+    if (want > 0) {
+        n = dequeue_reserve(Q, Q->attr.size, seg, seg_len);
     }
 
-    while (_ocb->rx.nbytes < _IO_READ_GET_NBYTES(msg)) {
-        struct can_msg* canmsg =
-            dequeue_peek_noblock(&_ocb->session->rx_queue);
+    if (n) {
+        head = queue_removed(Q);
 
-        if (canmsg == NULL) {
-            break;
+        if (head == _ocb->rx.head && _ocb->rx.offset < seg[0][0].len) {
+            offset = _ocb->rx.offset;
         }
+    }
 
-        if (_ocb->rx.nbytes + canmsg->len - _ocb->rx.offset
-                <= _IO_READ_GET_NBYTES(msg))
-        {
-            size_t nbytes = canmsg->len - _ocb->rx.offset;
-
-            memcpy( _ocb->rx.read_buffer + _ocb->rx.nbytes,
-                    canmsg->dat + _ocb->rx.offset, nbytes );
-
-            _ocb->rx.nbytes += nbytes;
-            _ocb->rx.offset = 0;
+    size_t avail = 0;
+    int s, i;
 
-            dequeue_noblock(&_ocb->session->rx_queue, 0);
+    for (s = 0; s < 2 && avail < want; ++s) {
+        for (i = 0; i < seg_len[s] && avail < want; ++i) {
+            avail += seg[s][i].len - ((s == 0 && i == 0) ? offset : 0);
         }
-        else {
-            size_t nbytes = _IO_READ_GET_NBYTES(msg) - _ocb->rx.nbytes;
+    }
 
-            memcpy( _ocb->rx.read_buffer + _ocb->rx.nbytes,
-                    canmsg->dat + _ocb->rx.offset, nbytes );
+    if (avail < want) {
+        if (n == 0 || queue_has_space(Q)) {
+            if (n) {
+                dequeue_release(Q, 0);
+            }
+
+            if ((status = block_client(_ocb, ctp->rcvid)) != EOK) {
+                return status;
+            }
 
-            _ocb->rx.nbytes = _IO_READ_GET_NBYTES(msg);
-            _ocb->rx.offset += nbytes;
+            return _RESMGR_NOREPLY;
         }
+
+        want = avail;
     }
 
-    if (_ocb->rx.nbytes < _IO_READ_GET_NBYTES(msg)) {
-        pthread_mutex_lock(&_ocb->rx.mutex);
+    uint64_t now = get_clock_time_ns();
+    size_t nbytes = 0;
+    size_t written = 0;
+    int consumed = 0;
 
-        blocked_client_t *client =
-            get_blocked_client(&_ocb->rx.blocked_clients, ctp->rcvid);
+    iov_t iov[READ_IOV_MAX];
+    int nparts = 0;
 
-        if (client == NULL) {
-            blocked_client_t* new_block = malloc(sizeof(blocked_client_t));
-            new_block->prev = new_block->next = NULL;
-            new_block->rcvid = ctp->rcvid;
+    for (s = 0; s < 2 && nbytes < want; ++s) {
+        for (i = 0; i < seg_len[s] && nbytes < want; ++i) {
+            frame_t* frame = &seg[s][i];
 
-            store_blocked_client(&_ocb->rx.blocked_clients, new_block);
-        }
+            size_t room = want - nbytes;
+            size_t len = frame->len > offset ? frame->len - offset : 0;
 
-        pthread_cond_signal(&_ocb->rx.cond);
-        pthread_mutex_unlock(&_ocb->rx.mutex);
+            if (nparts == READ_IOV_MAX) {
+                if (MsgWritev(ctp->rcvid, iov, nparts, written) == -1) {
+                    log_dbg("io_read MsgWritev failed: %s\n", strerror(errno));
 
-        return _RESMGR_NOREPLY;
-    }
-    else {
-        /* Set up the return data IOV.
-         * This is used to tell the system how large the buffer is in which we
-         * want to return the data for the read() call.
-         */
-        SETIOV(ctp->iov, _ocb->rx.read_buffer, _ocb->rx.nbytes);
+                    // The client is gone; leave the frames to the next read
+                    dequeue_release(Q, 0);
 
-        /* Set up the number of bytes (returned by client's read()) */
-        _IO_SET_READ_NBYTES(ctp, _ocb->rx.nbytes);
+                    pthread_mutex_lock(&_ocb->rx.mutex);
+                    waitq_remove(&_ocb->rx.blocked_clients, ctp->rcvid);
+                    pthread_mutex_unlock(&_ocb->rx.mutex);
 
-        nparts = 1;
+                    return _RESMGR_NOREPLY;
+                }
 
-        pthread_mutex_lock(&_ocb->rx.mutex);
-        remove_blocked_client(&_ocb->rx.blocked_clients, ctp->rcvid);
-        pthread_mutex_unlock(&_ocb->rx.mutex);
-    }
+                written = nbytes;
+                nparts = 0;
+            }
 
-    /* Mark the access time as invalid (we just accessed it) */
-    if (msg->i.nbytes > 0) {
-        ocb->attr->flags |= IOFUNC_ATTR_ATIME;
-    }
+            if (len > room) {
+                SETIOV(&iov[nparts++], frame->data + offset, room);
 
-    _ocb->rx.nbytes = 0;
+                offset += room;
+                nbytes += room;
+            }
+            else {
+                if (len) {
+                    SETIOV(&iov[nparts++], frame->data + offset, len);
+                }
 
-    return (_RESMGR_NPARTS(nparts));
-}
+                offset = 0;
+                nbytes += len;
+                ++consumed;
 
-/*
+                latency_rx_taken(_ocb->session, frame, now);
+            }
+        }
+    }
+
+    if (MsgReplyv(ctp->rcvid, want, iov, nparts) == -1) {
+        log_dbg("io_read MsgReplyv failed: %s\n", strerror(errno));
+    }
+
+    if (n) {
+        // the next reservation reads these, so they are set before release
+        _ocb->rx.offset = offset;
+        _ocb->rx.head = head + consumed;
+
+        dequeue_release(Q, consumed);
+
+        latency_rx_replied(_ocb->session, now);
+    }
+
+    pthread_mutex_lock(&_ocb->rx.mutex);
+    waitq_remove(&_ocb->rx.blocked_clients, ctp->rcvid);
+    pthread_mutex_unlock(&_ocb->rx.mutex);
+
+    /* Mark the access time as invalid (we just accessed it) */
+    if (want > 0) {
+        ocb->attr->flags |= IOFUNC_ATTR_ATIME;
+    }
+
+    return _RESMGR_NOREPLY;
+}
+
+/*
+ * Binary record mode write; the client data is an array of struct can_msg
+ * records, each queued for transmission as is. Queued frames are never lost to
+ * make room: a full tx_queue blocks the write until the device has sent some,
+ * or with O_NONBLOCK ends it short after the whole records queued so far
+ * (EAGAIN if none).
+ */
+static int io_write_records (resmgr_context_t* ctp, io_write_t* msg,
+        can_ocb_t* ocb)
+{
+    queue_t* Q = &ocb->resmgr->device_session->tx_queue;
+
+    size_t nbytes = msg->i.nbytes;
+
+    if (nbytes % sizeof(struct can_msg)) {
+        return EINVAL; // Partial records aren't accepted
+    }
+
+    int noblock = (ocb->core.ioflag & O_NONBLOCK) != 0;
+
+    size_t n = nbytes / sizeof(struct can_msg);
+    size_t i = 0;
+    int status = EOK;
+
+    frame_t frame;
+
+    if ((nbytes <= ctp->info.msglen - ctp->offset - sizeof(msg->i)) &&
+            (ctp->info.msglen < ctp->msg_max_size))
+    {
+        // The whole write is in our receive buffer already
+        struct can_msg* record = (struct can_msg*)(msg + 1);
+
+        for (i = 0; i < n; ++i) {
+            frame_from_canmsg(&frame, &record[i]);
+
+            if ((status = enqueue_wait(Q, &frame, noblock)) != EOK) {
+                break;
+            }
+        }
+    }
+    else {
+        struct can_msg chunk[16];
+
+        while (i < n && status == EOK) {
+            size_t count = n - i;
+
+            if (count > sizeof(chunk)/sizeof(chunk[0])) {
+                count = sizeof(chunk)/sizeof(chunk[0]);
+            }
+
+            if (resmgr_msgread( ctp, chunk, count*sizeof(struct can_msg),
+                        sizeof(msg->i) + i*sizeof(struct can_msg) ) == -1)
+            {
+                status = errno;
+
+                break;
+            }
+
+            size_t j;
+            for (j = 0; j < count; ++j) {
+                frame_from_canmsg(&frame, &chunk[j]);
+
+                if ((status = enqueue_wait(Q, &frame, noblock)) != EOK) {
+                    break;
+                }
+
+                ++i;
+            }
+        }
+    }
+
+    if (i == 0 && n > 0) {
+        return status;
+    }
+
+    nbytes = i*sizeof(struct can_msg);
+
+    trace(CAN_TRACE_IO_WRITE_RECORDS, ocb->resmgr->device_session->id, i);
+
+    _IO_SET_WRITE_NBYTES(ctp, nbytes);
+
+    if (nbytes > 0) {
+        ocb->core.attr->flags |= IOFUNC_ATTR_MTIME | IOFUNC_ATTR_CTIME;
+    }
+
+    return (_RESMGR_NPARTS(0));
+}
+
+/*
  *  io_write
  *
  *  At this point, the client has called the library write()
@@ -928,8 +1305,7 @@ int io_write (resmgr_context_t* ctp, io_write_t* msg, RESMGR_OCB_T* _ocb) {
 
     iofunc_ocb_t* ocb = (iofunc_ocb_t*)_ocb;
 
-    log_trace( "io_write -> (id: %d, rcvid: %ld)\n",
-            ctp->id, (long int)ctp->rcvid );
+    trace(CAN_TRACE_IO_WRITE, ctp->id, ctp->rcvid, msg->i.nbytes);
 
     /* Check the access permissions of the client */
     if ((status = iofunc_write_verify(ctp, msg, ocb, NULL)) != EOK) {
@@ -945,12 +1321,15 @@ int io_write (resmgr_context_t* ctp, io_write_t* msg, RESMGR_OCB_T* _ocb) {
         return EIO; // Input/output error
     }
 
+    if (_ocb->record_mode) {
+        return io_write_records(ctp, msg, _ocb);
+    }
+
     /* Set the number of bytes successfully written for the client. This
      * information will be passed to the client by the resource manager
      * framework upon reply.
      */
     _IO_SET_WRITE_NBYTES (ctp, msg -> i.nbytes);
-    log_trace("io_write: got write of %d bytes, data:\n", msg->i.nbytes);
 
     struct can_msg canmsg = {
         .mid = _ocb->resmgr->mid,
@@ -966,7 +1345,6 @@ int io_write (resmgr_context_t* ctp, io_write_t* msg, RESMGR_OCB_T* _ocb) {
         buf = (char *)(msg+1);
 
         buf[msg->i.nbytes] = '\0';
-        log_trace("io_write: buf: %s\n", buf);
 
         int n = msg->i.nbytes/8 + (msg->i.nbytes%8 ? 1 : 0);
 
@@ -980,23 +1358,14 @@ int io_write (resmgr_context_t* ctp, io_write_t* msg, RESMGR_OCB_T* _ocb) {
 
             memcpy(canmsg.dat, buf+8*i, canmsg.len);
 
-            log_trace("io_write; %s TS: %ums [%s] %X [%d] " \
-                      "%02X %02X %02X %02X %02X %02X %02X %02X\n",
-                    _ocb->resmgr->name,
-                    canmsg.ext.timestamp,
-                    canmsg.ext.is_extended_mid ? "EFF" : "SFF",
+            trace(CAN_TRACE_TX_WRITE,
+                    CAN_TRACE_FRAME_ARG0(
+                        _ocb->resmgr->device_session->id, canmsg.len),
                     canmsg.mid,
-                    canmsg.len,
-                    canmsg.dat[0],
-                    canmsg.dat[1],
-                    canmsg.dat[2],
-                    canmsg.dat[3],
-                    canmsg.dat[4],
-                    canmsg.dat[5],
-                    canmsg.dat[6],
-                    canmsg.dat[7]);
+                    CAN_TRACE_DATA(canmsg.dat, 0),
+                    CAN_TRACE_DATA(canmsg.dat, 4));
 
-            enqueue(&_ocb->resmgr->device_session->tx_queue, &canmsg);
+            enqueue_canmsg(&_ocb->resmgr->device_session->tx_queue, &canmsg);
         }
     }
     else {
@@ -1011,7 +1380,6 @@ int io_write (resmgr_context_t* ctp, io_write_t* msg, RESMGR_OCB_T* _ocb) {
         resmgr_msgread(ctp, buf, msg->i.nbytes, sizeof(msg->i));
 
         buf[msg->i.nbytes] = '\0';
-        log_trace("io_write: buf: %s\n", buf);
 
         int n = msg->i.nbytes/8 + (msg->i.nbytes%8 ? 1 : 0);
 
@@ -1025,23 +1393,14 @@ int io_write (resmgr_context_t* ctp, io_write_t* msg, RESMGR_OCB_T* _ocb) {
 
             memcpy(canmsg.dat, buf+8*i, canmsg.len);
 
-            log_trace("io_write; %s TS: %ums [%s] %X [%d] " \
-                      "%02X %02X %02X %02X %02X %02X %02X %02X\n",
-                    _ocb->resmgr->name,
-                    canmsg.ext.timestamp,
-                    canmsg.ext.is_extended_mid ? "EFF" : "SFF",
+            trace(CAN_TRACE_TX_WRITE,
+                    CAN_TRACE_FRAME_ARG0(
+                        _ocb->resmgr->device_session->id, canmsg.len),
                     canmsg.mid,
-                    canmsg.len,
-                    canmsg.dat[0],
-                    canmsg.dat[1],
-                    canmsg.dat[2],
-                    canmsg.dat[3],
-                    canmsg.dat[4],
-                    canmsg.dat[5],
-                    canmsg.dat[6],
-                    canmsg.dat[7]);
+                    CAN_TRACE_DATA(canmsg.dat, 0),
+                    CAN_TRACE_DATA(canmsg.dat, 4));
 
-            enqueue(&_ocb->resmgr->device_session->tx_queue, &canmsg);
+            enqueue_canmsg(&_ocb->resmgr->device_session->tx_queue, &canmsg);
         }
 
         free(buf);
@@ -1065,6 +1424,21 @@ int io_unblock (resmgr_context_t* ctp, io_pulse_t* msg, RESMGR_OCB_T* _ocb) {
 
     iofunc_ocb_t* ocb = (iofunc_ocb_t*)_ocb;
 
+    // Clients blocked waiting for frames are ours to release
+    if (_ocb->resmgr->channel_type == RX_CHANNEL) {
+        pthread_mutex_lock(&_ocb->rx.mutex);
+
+        if (waitq_remove(&_ocb->rx.blocked_clients, ctp->rcvid) == EOK) {
+            pthread_mutex_unlock(&_ocb->rx.mutex);
+
+            MsgError(ctp->rcvid, EINTR);
+
+            return _RESMGR_NOREPLY;
+        }
+
+        pthread_mutex_unlock(&_ocb->rx.mutex);
+    }
+
     int status;
     if((status = iofunc_unblock_default(ctp, msg, ocb)) != _RESMGR_DEFAULT) {
         log_dbg("iofunc_unblock_default: No client connection was found.\n");
@@ -1075,8 +1449,49 @@ int io_unblock (resmgr_context_t* ctp, io_pulse_t* msg, RESMGR_OCB_T* _ocb) {
     return 0;
 }
 
+/*
+ * io_notify
+ *
+ * RX channels report input readiness when the client session rx_queue holds
+ * frames; TX channels report output readiness when the device tx_queue has
+ * space. Out-of-band conditions are never raised.
+ */
+int io_notify (resmgr_context_t* ctp, io_notify_t* msg, RESMGR_OCB_T* _ocb) {
+    log_trace("io_notify -> id: %d\n", ctp->id);
+
+    if (_ocb->session == NULL) {
+        return EBADF;
+    }
+
+    int trig = 0;
+    int status;
+
+    pthread_mutex_lock(&_ocb->notify.mutex);
+
+    // Arm before checking readiness so a concurrent hook can't be missed
+    notify_set_armed(_ocb, 1);
+
+    if (_ocb->resmgr->channel_type == RX_CHANNEL) {
+        if (dequeue_peek_noblock(&_ocb->session->rx_queue) != NULL) {
+            trig |= _NOTIFY_COND_INPUT;
+        }
+    }
+    else if (queue_has_space(&_ocb->resmgr->device_session->tx_queue)) {
+        trig |= _NOTIFY_COND_OUTPUT;
+    }
+
+    status = iofunc_notify(ctp, msg, _ocb->notify.list, trig, NULL, NULL);
+
+    notify_set_armed(_ocb, notify_armed(_ocb));
+
+    pthread_mutex_unlock(&_ocb->notify.mutex);
+
+    return status;
+}
+
 int io_devctl (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* _ocb) {
     int nbytes, status;
+    uint64_t taken = 0; // time a read devctl took its frame (ns)
 
     iofunc_ocb_t* ocb = (iofunc_ocb_t*)_ocb;
 
@@ -1084,6 +1499,19 @@ int io_devctl (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* _ocb) {
         uint32_t        latency_limit;
         uint32_t        bitrate;
         uint32_t        info2;
+        uint64_t        timestamp_ns;
+        uint32_t        record_mode;
+        struct can_msg_ts record;
+        struct can_shm_attach shm_attach;
+        struct can_pool_stats pool_stats;
+        struct can_gw_rule gw_rule;
+        struct can_gw_stats gw_stats;
+        uint32_t        gw_first;
+        struct can_ext_stats ext_stats;
+        struct can_busload busload;
+        struct can_busload_ids busload_ids;
+        struct can_latency latency;
+        struct can_trace trace;
 
 #if _NTO_VERSION >= 800
         CAN_DCMD_DATA   dcmd;
@@ -1092,7 +1520,7 @@ int io_devctl (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* _ocb) {
 #endif
     } *data;
 
-    log_trace("io_devctl -> id: %d\n", ctp->id);
+    trace(CAN_TRACE_IO_DEVCTL, ctp->id, msg->i.dcmd);
 
     /*
      Let common code handle DCMD_ALL_* cases.
@@ -1133,6 +1561,321 @@ int io_devctl (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* _ocb) {
 
         break;
     }
+    case EXT_CAN_DEVCTL_SET_RECORD_MODE:
+    {
+        nbytes = 0;
+
+        _ocb->record_mode = data->record_mode ? 1 : 0;
+
+        // Drop any partially read payload state of the previous mode
+        _ocb->rx.offset = 0;
+
+        log_trace("EXT_CAN_DEVCTL_SET_RECORD_MODE: %d (%s)\n",
+                _ocb->record_mode,
+                _ocb->resmgr->name);
+
+        break;
+    }
+    case EXT_CAN_DEVCTL_SHM_ATTACH:
+    {
+        if (_ocb->session == NULL) {
+            return EBADF;
+        }
+
+        if (_ocb->session->shm != NULL) {
+            log_trace("EXT_CAN_DEVCTL_SHM_ATTACH: already attached (%s)\n",
+                    _ocb->resmgr->name);
+
+            return EBUSY;
+        }
+
+        if (data->shm_attach.slots != 0 &&
+            shmring_size(data->shm_attach.slots,
+                sizeof(struct can_msg_ts)) == 0)
+        {
+            return EINVAL;
+        }
+
+        shm_channel_dir_t dir =
+            (_ocb->resmgr->channel_type == RX_CHANNEL)
+                ? SHM_CHANNEL_RX : SHM_CHANNEL_TX;
+
+        shm_channel_t* ch;
+
+        if ((ch = create_shm_channel(dir, data->shm_attach.slots)) == NULL) {
+            return ENOMEM;
+        }
+
+        shm_handle_t handle;
+
+        if ((status = shm_channel_handle(ch, ctp->info.pid, &handle)) != EOK) {
+            destroy_shm_channel(ch);
+
+            return status;
+        }
+
+        ch->rcvid = ctp->rcvid;
+        ch->event = data->shm_attach.event;
+        ch->event_valid = (dir == SHM_CHANNEL_RX
+                && ch->event.sigev_notify != SIGEV_NONE);
+
+        pthread_mutex_lock(&device_session_create_mutex);
+
+        _ocb->session->shm = ch;
+
+        if (dir == SHM_CHANNEL_TX) {
+            attach_shm_tx_channel(_ocb->resmgr->device_session, ch);
+        }
+
+        pthread_mutex_unlock(&device_session_create_mutex);
+
+        data->shm_attach.size = ch->size;
+        data->shm_attach.handle = handle;
+        nbytes = sizeof(data->shm_attach);
+
+        log_trace("EXT_CAN_DEVCTL_SHM_ATTACH: %s ring of %zu bytes (%s)\n",
+                dir == SHM_CHANNEL_RX ? "rx" : "tx",
+                ch->size,
+                _ocb->resmgr->name);
+
+        break;
+    }
+    case EXT_CAN_DEVCTL_SHM_TX_KICK:
+    {
+        if (_ocb->resmgr->channel_type == RX_CHANNEL) {
+            log_trace("EXT_CAN_DEVCTL_SHM_TX_KICK: Input/output error\n");
+
+            return EIO; // Input/output error
+        }
+
+        nbytes = 0;
+
+        queue_kick(&_ocb->resmgr->device_session->tx_queue);
+
+        break;
+    }
+    case EXT_CAN_DEVCTL_GET_TIMESTAMP_NS:
+    {
+        data->timestamp_ns = get_clock_time_ns();
+        nbytes = sizeof(data->timestamp_ns);
+
+        log_trace("EXT_CAN_DEVCTL_GET_TIMESTAMP_NS: %lu\n",
+                (unsigned long)data->timestamp_ns);
+        break;
+    }
+    case EXT_CAN_DEVCTL_GET_POOL_STATS:
+    {
+        const slab_cache_t* caches[] =
+            { &skb_cache, &skb_priv_cache, &echo_cache };
+
+        memset(&data->pool_stats, 0, sizeof(data->pool_stats));
+
+        int i;
+        for (i = 0; i < sizeof(caches)/sizeof(caches[0]); ++i) {
+            slab_stats_t stats;
+
+            slab_cache_stats(caches[i], &stats);
+
+            strncpy( data->pool_stats.pool[i].name, caches[i]->name,
+                    sizeof(data->pool_stats.pool[i].name) - 1 );
+
+            data->pool_stats.pool[i].objects = stats.objects;
+            data->pool_stats.pool[i].in_use = stats.in_use;
+            data->pool_stats.pool[i].high_water = stats.high_water;
+            data->pool_stats.pool[i].failures = stats.failures;
+        }
+
+        data->pool_stats.num_pools = i;
+        nbytes = sizeof(data->pool_stats);
+
+        log_trace("EXT_CAN_DEVCTL_GET_POOL_STATS: %u pools\n",
+                data->pool_stats.num_pools);
+        break;
+    }
+    case EXT_CAN_DEVCTL_GW_ADD_RULE:
+    {
+        if ((status = gateway_add_rule(&data->gw_rule)) != EOK) {
+            log_trace("EXT_CAN_DEVCTL_GW_ADD_RULE: %s\n", strerror(status));
+
+            return status;
+        }
+
+        nbytes = sizeof(data->gw_rule);
+
+        log_trace("EXT_CAN_DEVCTL_GW_ADD_RULE: rule %u; can%u -> can%u\n",
+                data->gw_rule.index, data->gw_rule.src, data->gw_rule.dst);
+        break;
+    }
+    case EXT_CAN_DEVCTL_GW_GET_STATS:
+    {
+        if ((status = gateway_get_stats(&data->gw_stats)) != EOK) {
+            return status;
+        }
+
+        nbytes = sizeof(data->gw_stats);
+
+        log_trace("EXT_CAN_DEVCTL_GW_GET_STATS: rule %u\n",
+                data->gw_stats.index);
+        break;
+    }
+    case EXT_CAN_DEVCTL_GW_FLUSH:
+    {
+        nbytes = 0;
+
+        gateway_flush(data->gw_first);
+
+        log_trace("EXT_CAN_DEVCTL_GW_FLUSH: from rule %u\n", data->gw_first);
+        break;
+    }
+    case EXT_CAN_DEVCTL_GET_EXT_STATS:
+    {
+        devstats_t sum;
+
+        devstats_read(_ocb->resmgr->device_session->device->stats, &sum);
+
+        memcpy(&data->ext_stats, &sum, sizeof(data->ext_stats));
+        nbytes = sizeof(data->ext_stats);
+
+        log_trace("EXT_CAN_DEVCTL_GET_EXT_STATS (%s)\n", _ocb->resmgr->name);
+        break;
+    }
+    case EXT_CAN_DEVCTL_GET_BUSLOAD:
+    {
+        static const uint32_t window_ms[CAN_BUSLOAD_WINDOWS] =
+            { 100, 1000, 10000 };
+
+        struct net_device* dev = _ocb->resmgr->device_session->device;
+        busload_t* bl = &_ocb->resmgr->device_session->busload;
+        uint64_t now = get_clock_time_ns();
+
+        memset(&data->busload, 0, sizeof(data->busload));
+
+        data->busload.bitrate = dev->vbus ? dev->vbus->bus->bitrate
+            : ((struct can_priv*)netdev_priv(dev))->bittiming.bitrate;
+
+        pthread_mutex_lock(&bl->mutex);
+        data->busload.frames = bl->frames;
+        data->busload.bits = bl->bits;
+        pthread_mutex_unlock(&bl->mutex);
+
+        int i;
+        for (i = 0; i < CAN_BUSLOAD_WINDOWS; ++i) {
+            busload_window_t w;
+
+            busload_window(bl, window_ms[i]*1000000ULL, now, &w);
+
+            data->busload.window[i].window_ms = window_ms[i];
+            data->busload.window[i].frames = w.frames;
+            data->busload.window[i].bits = w.bits;
+
+            if (data->busload.bitrate) {
+                // bits*1e6 / (window_ms/1000 s * bitrate)
+                data->busload.window[i].load = (uint32_t)(
+                        w.bits * 1000000000ULL
+                        / ((uint64_t)window_ms[i] * data->busload.bitrate) );
+            }
+        }
+
+        nbytes = sizeof(data->busload);
+
+        log_trace("EXT_CAN_DEVCTL_GET_BUSLOAD (%s)\n", _ocb->resmgr->name);
+        break;
+    }
+    case EXT_CAN_DEVCTL_GET_BUSLOAD_IDS:
+    {
+        busload_t* bl = &_ocb->resmgr->device_session->busload;
+        busload_id_t ids[CAN_BUSLOAD_IDS_MAX];
+        uint64_t now = get_clock_time_ns();
+        uint32_t first = data->busload_ids.first;
+        bool reset = data->busload_ids.reset != 0;
+
+        int n = busload_ids(bl, first, ids, CAN_BUSLOAD_IDS_MAX);
+
+        memset(&data->busload_ids, 0, sizeof(data->busload_ids));
+
+        data->busload_ids.first = first;
+
+        pthread_mutex_lock(&bl->mutex);
+        data->busload_ids.num_ids = bl->num_ids;
+        data->busload_ids.other_frames = bl->other_frames;
+        pthread_mutex_unlock(&bl->mutex);
+
+        int i;
+        for (i = 0; i < n; ++i) {
+            // the key's FRAME_EFF flag is CAN_GW_EFF
+            data->busload_ids.ids[i].id = ids[i].key & ~BUSLOAD_KEY_USED;
+            data->busload_ids.ids[i].rate = ids[i].interval
+                ? (uint32_t)(1000000000000ULL / ids[i].interval) : 0;
+            data->busload_ids.ids[i].frames = ids[i].frames;
+            data->busload_ids.ids[i].interval_ns = ids[i].interval;
+            data->busload_ids.ids[i].jitter_ns = ids[i].jitter;
+            data->busload_ids.ids[i].age_ns =
+                now > ids[i].last ? now - ids[i].last : 0;
+        }
+
+        data->busload_ids.count = n;
+
+        if (reset) {
+            busload_reset_ids(bl);
+        }
+
+        nbytes = sizeof(data->busload_ids);
+
+        log_trace("EXT_CAN_DEVCTL_GET_BUSLOAD_IDS: %d of %u ids (%s)\n",
+                n, data->busload_ids.num_ids, _ocb->resmgr->name);
+        break;
+    }
+    case EXT_CAN_DEVCTL_GET_LATENCY:
+    {
+        latency_t* lat;
+        latency_t copy;
+
+        if (data->latency.scope == CAN_LATENCY_DEVICE) {
+            lat = &_ocb->resmgr->device_session->latency;
+        }
+        else if (data->latency.scope == CAN_LATENCY_SESSION
+                && _ocb->session != NULL)
+        {
+            lat = &_ocb->session->latency;
+        }
+        else {
+            log_trace("EXT_CAN_DEVCTL_GET_LATENCY: Invalid argument\n");
+
+            return EINVAL;
+        }
+
+        latency_read(lat, &copy, data->latency.reset);
+
+        memcpy(data->latency.stage, &copy, sizeof(copy));
+        nbytes = sizeof(data->latency);
+
+        log_trace("EXT_CAN_DEVCTL_GET_LATENCY: scope %u (%s)\n",
+                data->latency.scope, _ocb->resmgr->name);
+        break;
+    }
+    case EXT_CAN_DEVCTL_GET_TRACE:
+    {
+        struct can_trace* t = &data->trace;
+        int n;
+
+        if ((status = trace_read( t->ring, t->first, t->records,
+                CAN_TRACE_RECORDS_MAX, &n, &t->next, &t->head )) != EOK)
+        {
+            log_trace("EXT_CAN_DEVCTL_GET_TRACE: %s\n", strerror(status));
+
+            return status;
+        }
+
+        t->num_rings = TRACE_RINGS;
+        t->count = n;
+        t->lost = t->next - t->first - n;
+        nbytes = offsetof(struct can_trace, records)
+            + n*sizeof(struct can_trace_record);
+
+        log_trace("EXT_CAN_DEVCTL_GET_TRACE: ring %u, %d records\n",
+                t->ring, n);
+        break;
+    }
     /*
      * Standard QNX dev-can-* driver protocol commands
      */
@@ -1197,16 +1940,7 @@ int io_devctl (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* _ocb) {
         nbytes = sizeof(data->dcmd.timestamp);
 
         // set TIMESTAMP
-        if (optt) {
-            data->dcmd.timestamp = user_timestamp;
-        }
-        else if (user_timestamp_time != 0) {
-            data->dcmd.timestamp =
-                user_timestamp + get_clock_time_us()/1000 - user_timestamp_time;
-        }
-        else {
-            data->dcmd.timestamp = get_clock_time_us()/1000;
-        }
+        data->dcmd.timestamp = user_timestamp_ms(get_clock_time_ns());
 
         log_trace("CAN_DEVCTL_GET_TIMESTAMP: %x\n", data->dcmd.timestamp);
         break;
@@ -1230,46 +1964,35 @@ int io_devctl (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* _ocb) {
             return EIO; // Input/output error
         }
 
-        struct can_msg* canmsg =
+        frame_t* frame =
             dequeue_noblock( &_ocb->session->rx_queue,
                     _ocb->resmgr->latency_limit_ms );
 
-        if (canmsg != NULL) { // Could be a zero size rx queue, i.e. a tx queue
-            data->dcmd.canmsg = *canmsg;
+        if (frame != NULL) { // Could be a zero size rx queue, i.e. a tx queue
+            taken = get_clock_time_ns();
+            latency_rx_taken(_ocb->session, frame, taken);
+
+            struct can_msg* canmsg = &data->dcmd.canmsg;
+
+            queued_canmsg(&_ocb->session->rx_queue, frame, canmsg);
 
             nbytes = sizeof(data->dcmd.canmsg);
 
-            log_trace("CAN_DEVCTL_READ_CANMSG_EXT; %s TS: %ums [%s] %X [%d] " \
-                      "%02X %02X %02X %02X %02X %02X %02X %02X\n",
-                    _ocb->resmgr->name,
-                    canmsg->ext.timestamp,
-                    canmsg->ext.is_extended_mid ? "EFF" : "SFF",
+            trace(CAN_TRACE_RX_TAKEN,
+                    CAN_TRACE_FRAME_ARG0(
+                        _ocb->resmgr->device_session->id, canmsg->len),
                     canmsg->mid,
-                    canmsg->len,
-                    canmsg->dat[0],
-                    canmsg->dat[1],
-                    canmsg->dat[2],
-                    canmsg->dat[3],
-                    canmsg->dat[4],
-                    canmsg->dat[5],
-                    canmsg->dat[6],
-                    canmsg->dat[7]);
+                    CAN_TRACE_DATA(canmsg->dat, 0),
+                    CAN_TRACE_DATA(canmsg->dat, 4));
 
             pthread_mutex_lock(&_ocb->rx.mutex);
-            remove_blocked_client(&_ocb->rx.blocked_clients, ctp->rcvid);
+            waitq_remove(&_ocb->rx.blocked_clients, ctp->rcvid);
             pthread_mutex_unlock(&_ocb->rx.mutex);
         }
         else {
-            pthread_mutex_lock(&_ocb->rx.mutex);
-
-            blocked_client_t* new_block = malloc(sizeof(blocked_client_t));
-            new_block->prev = new_block->next = NULL;
-            new_block->rcvid = ctp->rcvid;
-
-            store_blocked_client(&_ocb->rx.blocked_clients, new_block);
-
-            pthread_cond_signal(&_ocb->rx.cond);
-            pthread_mutex_unlock(&_ocb->rx.mutex);
+            if ((status = block_client(_ocb, ctp->rcvid)) != EOK) {
+                return status;
+            }
 
             log_trace("CAN_DEVCTL_READ_CANMSG_EXT: _RESMGR_NOREPLY\n");
 
@@ -1289,23 +2012,14 @@ int io_devctl (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* _ocb) {
         struct can_msg canmsg = data->dcmd.canmsg;
         nbytes = 0;
 
-        enqueue(&_ocb->resmgr->device_session->tx_queue, &canmsg);
+        enqueue_canmsg(&_ocb->resmgr->device_session->tx_queue, &canmsg);
 
-        log_trace("CAN_DEVCTL_WRITE_CANMSG_EXT; %s TS: %ums [%s] %X [%d] " \
-                  "%02X %02X %02X %02X %02X %02X %02X %02X\n",
-                _ocb->resmgr->name,
-                canmsg.ext.timestamp,
-                canmsg.ext.is_extended_mid ? "EFF" : "SFF",
+        trace(CAN_TRACE_TX_DEVCTL,
+                CAN_TRACE_FRAME_ARG0(
+                    _ocb->resmgr->device_session->id, canmsg.len),
                 canmsg.mid,
-                canmsg.len,
-                canmsg.dat[0],
-                canmsg.dat[1],
-                canmsg.dat[2],
-                canmsg.dat[3],
-                canmsg.dat[4],
-                canmsg.dat[5],
-                canmsg.dat[6],
-                canmsg.dat[7]);
+                CAN_TRACE_DATA(canmsg.dat, 0),
+                CAN_TRACE_DATA(canmsg.dat, 4));
 
         break;
     }
@@ -1344,67 +2058,48 @@ int io_devctl (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* _ocb) {
         nbytes = sizeof(data->dcmd.stats);
 
         struct net_device* device = _ocb->resmgr->device_session->device;
-        struct sja1000_priv* priv = netdev_priv(device);
+        devstats_t sum;
+
+        devstats_read(device->stats, &sum);
 
-        data->dcmd.stats.transmitted_frames = device->stats.tx_packets;
-        data->dcmd.stats.received_frames = device->stats.rx_packets;
-        data->dcmd.stats.missing_ack = device->stats.tx_dropped;
+        data->dcmd.stats.transmitted_frames = sum.tx_packets;
+        data->dcmd.stats.received_frames = sum.rx_packets;
+        data->dcmd.stats.missing_ack = sum.tx_dropped;
 
         /* Bus errors */
-        data->dcmd.stats.total_frame_errors =
-            device->stats.rx_errors + device->stats.tx_errors;
+        data->dcmd.stats.total_frame_errors = sum.rx_errors + sum.tx_errors;
 
         /* Arbitration lost errors */
-        data->dcmd.stats.stuff_errors = priv->can.can_stats.arbitration_lost;
+        data->dcmd.stats.stuff_errors = sum.arbitration_lost;
 
         data->dcmd.stats.form_errors = 0;
         data->dcmd.stats.dom_bit_recess_errors = 0;
         data->dcmd.stats.recess_bit_dom_errors = 0;
         data->dcmd.stats.parity_errors = 0;
-        data->dcmd.stats.crc_errors = device->stats.rx_crc_errors;
-        data->dcmd.stats.hw_receive_overflows = device->stats.rx_over_errors;
-        data->dcmd.stats.sw_receive_q_full = device->stats.rx_dropped;
+        data->dcmd.stats.crc_errors = sum.rx_crc_errors;
+        data->dcmd.stats.hw_receive_overflows = sum.rx_over_errors;
+        data->dcmd.stats.sw_receive_q_full = sum.rx_dropped;
 
         /* Changes to error warning state */
-        data->dcmd.stats.error_warning_state_count =
-            priv->can.can_stats.error_warning;
+        data->dcmd.stats.error_warning_state_count = sum.error_warning;
 
         /* Changes to error passive state */
-        data->dcmd.stats.error_passive_state_count =
-            priv->can.can_stats.error_passive;
+        data->dcmd.stats.error_passive_state_count = sum.error_passive;
 
         /* Changes to bus off state */
-        data->dcmd.stats.bus_off_state_count = priv->can.can_stats.bus_off;
+        data->dcmd.stats.bus_off_state_count = sum.bus_off;
 
-        data->dcmd.stats.bus_idle_count = priv->can.can_stats.bus_error;
+        data->dcmd.stats.bus_idle_count = sum.bus_error;
 
         /* CAN controller re-starts */
         data->dcmd.stats.power_down_count =
-            data->dcmd.stats.wake_up_count = priv->can.can_stats.restarts;
-
-        data->dcmd.stats.rx_interrupts = device->stats.rx_errors;
-        data->dcmd.stats.tx_interrupts = device->stats.tx_errors;
-        data->dcmd.stats.total_interrupts =
-            device->stats.rx_errors + device->stats.tx_errors;
-
-        // TODO: These may need to be incremented on resmgr side:
-        // device->stats.rx_bytes;
-        // device->stats.tx_bytes;
-        // device->stats.rx_dropped;
-        // device->stats.tx_dropped;
-        // device->stats.multicast;
-        // device->stats.collisions;
-        // device->stats.rx_length_errors;
-        // device->stats.rx_frame_errors;
-        // device->stats.rx_fifo_errors;
-        // device->stats.rx_missed_errors;
-        // device->stats.tx_aborted_errors;
-        // device->stats.tx_carrier_errors;
-        // device->stats.tx_fifo_errors;
-        // device->stats.tx_heartbeat_errors;
-        // device->stats.tx_window_errors;
-        // device->stats.rx_compressed;
-        // device->stats.tx_compressed;
+            data->dcmd.stats.wake_up_count = sum.restarts;
+
+        data->dcmd.stats.rx_interrupts = sum.rx_interrupts;
+        data->dcmd.stats.tx_interrupts = sum.tx_interrupts;
+        data->dcmd.stats.total_interrupts = sum.interrupts;
+
+        // The remaining counters are reported by EXT_CAN_DEVCTL_GET_EXT_STATS
 
         log_trace("CAN_DEVCTL_GET_STATS\n");
         break;
@@ -1506,71 +2201,87 @@ int io_devctl (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* _ocb) {
 
         break;
     }
+    case EXT_CAN_DEVCTL_RX_FRAME_TS_NOBLOCK:
+    case EXT_CAN_DEVCTL_RX_FRAME_TS_BLOCK:
     case CAN_DEVCTL_RX_FRAME_RAW_NOBLOCK:
     case CAN_DEVCTL_RX_FRAME_RAW_BLOCK: // e.g. candump -u0,rx0
     {
+        const char* dcmd_name;
+        bool block = false;
+
+        switch (msg->i.dcmd) {
+        case EXT_CAN_DEVCTL_RX_FRAME_TS_BLOCK:
+            block = true;
+            dcmd_name = "EXT_CAN_DEVCTL_RX_FRAME_TS_BLOCK";
+            break;
+        case EXT_CAN_DEVCTL_RX_FRAME_TS_NOBLOCK:
+            dcmd_name = "EXT_CAN_DEVCTL_RX_FRAME_TS_NOBLOCK";
+            break;
+        case CAN_DEVCTL_RX_FRAME_RAW_BLOCK:
+            block = true;
+            dcmd_name = "CAN_DEVCTL_RX_FRAME_RAW_BLOCK";
+            break;
+        default:
+            dcmd_name = "CAN_DEVCTL_RX_FRAME_RAW_NOBLOCK";
+            break;
+        }
+
         if (_ocb->resmgr->channel_type == TX_CHANNEL) {
-            log_trace( "CAN_DEVCTL_RX_FRAME_RAW_%s: Input/output error\n",
-                    msg->i.dcmd == CAN_DEVCTL_RX_FRAME_RAW_BLOCK
-                        ? "BLOCK" : "NOBLOCK" );
+            log_trace("%s: Input/output error\n", dcmd_name);
 
             return EIO; // Input/output error
         }
 
-        struct can_msg* canmsg =
+        frame_t* frame =
             dequeue_noblock( &_ocb->session->rx_queue,
                     _ocb->resmgr->latency_limit_ms );
 
-        if (canmsg != NULL) { // Could be a zero size rx queue, i.e. a tx queue
-            data->dcmd.canmsg = *canmsg;
+        if (frame != NULL) { // Could be a zero size rx queue, i.e. a tx queue
+            taken = get_clock_time_ns();
+            latency_rx_taken(_ocb->session, frame, taken);
 
-            nbytes = sizeof(data->dcmd.canmsg);
+            struct can_msg* canmsg;
 
-            log_trace("%s; %s TS: %ums [%s] %X [%d] " \
-                      "%02X %02X %02X %02X %02X %02X %02X %02X\n",
-                    (msg->i.dcmd == CAN_DEVCTL_RX_FRAME_RAW_BLOCK
-                        ? "CAN_DEVCTL_RX_FRAME_RAW_BLOCK"
-                        : "CAN_DEVCTL_RX_FRAME_RAW_NOBLOCK"),
-                    _ocb->resmgr->name,
-                    canmsg->ext.timestamp,
-                    canmsg->ext.is_extended_mid ? "EFF" : "SFF",
-                    canmsg->mid,
-                    canmsg->len,
-                    canmsg->dat[0],
-                    canmsg->dat[1],
-                    canmsg->dat[2],
-                    canmsg->dat[3],
-                    canmsg->dat[4],
-                    canmsg->dat[5],
-                    canmsg->dat[6],
-                    canmsg->dat[7]);
+            if (msg->i.dcmd == EXT_CAN_DEVCTL_RX_FRAME_TS_BLOCK ||
+                msg->i.dcmd == EXT_CAN_DEVCTL_RX_FRAME_TS_NOBLOCK)
+            {
+                canmsg = &data->record.canmsg;
 
-            pthread_mutex_lock(&_ocb->rx.mutex);
-            remove_blocked_client(&_ocb->rx.blocked_clients, ctp->rcvid);
-            pthread_mutex_unlock(&_ocb->rx.mutex);
-        }
-        else if (msg->i.dcmd == CAN_DEVCTL_RX_FRAME_RAW_BLOCK) {
-            pthread_mutex_lock(&_ocb->rx.mutex);
+                data->record.timestamp_ns =
+                    queue_tstamp(&_ocb->session->rx_queue, frame);
 
-            blocked_client_t* new_block = malloc(sizeof(blocked_client_t));
-            new_block->prev = new_block->next = NULL;
-            new_block->rcvid = ctp->rcvid;
+                nbytes = sizeof(data->record);
+            }
+            else {
+                canmsg = &data->dcmd.canmsg;
 
-            store_blocked_client(&_ocb->rx.blocked_clients, new_block);
+                nbytes = sizeof(data->dcmd.canmsg);
+            }
+
+            queued_canmsg(&_ocb->session->rx_queue, frame, canmsg);
+
+            trace(CAN_TRACE_RX_TAKEN,
+                    CAN_TRACE_FRAME_ARG0(
+                        _ocb->resmgr->device_session->id, canmsg->len),
+                    canmsg->mid,
+                    CAN_TRACE_DATA(canmsg->dat, 0),
+                    CAN_TRACE_DATA(canmsg->dat, 4));
 
-            pthread_cond_signal(&_ocb->rx.cond);
+            pthread_mutex_lock(&_ocb->rx.mutex);
+            waitq_remove(&_ocb->rx.blocked_clients, ctp->rcvid);
             pthread_mutex_unlock(&_ocb->rx.mutex);
+        }
+        else if (block) {
+            if ((status = block_client(_ocb, ctp->rcvid)) != EOK) {
+                return status;
+            }
 
-            log_trace( "CAN_DEVCTL_RX_FRAME_RAW_%s: _RESMGR_NOREPLY\n",
-                    msg->i.dcmd == CAN_DEVCTL_RX_FRAME_RAW_BLOCK
-                        ? "BLOCK" : "NOBLOCK" );
+            log_trace("%s: _RESMGR_NOREPLY\n", dcmd_name);
 
             return _RESMGR_NOREPLY; /* put the client in block state */
         }
-        else { // CAN_DEVCTL_RX_FRAME_RAW_NOBLOCK
-            log_trace( "CAN_DEVCTL_RX_FRAME_RAW_%s: EAGAIN\n",
-                    msg->i.dcmd == CAN_DEVCTL_RX_FRAME_RAW_BLOCK
-                        ? "BLOCK" : "NOBLOCK" );
+        else {
+            log_trace("%s: EAGAIN\n", dcmd_name);
 
             return EAGAIN; /* There are no messages in the queue. */
         }
@@ -1588,23 +2299,14 @@ int io_devctl (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* _ocb) {
         struct can_msg canmsg = data->dcmd.canmsg;
         nbytes = 0;
 
-        enqueue(&_ocb->resmgr->device_session->tx_queue, &canmsg);
+        enqueue_canmsg(&_ocb->resmgr->device_session->tx_queue, &canmsg);
 
-        log_trace("CAN_DEVCTL_TX_FRAME_RAW; %s TS: %ums [%s] %X [%d] " \
-                  "%02X %02X %02X %02X %02X %02X %02X %02X\n",
-                _ocb->resmgr->name,
-                canmsg.ext.timestamp,
-                canmsg.ext.is_extended_mid ? "EFF" : "SFF",
+        trace(CAN_TRACE_TX_DEVCTL,
+                CAN_TRACE_FRAME_ARG0(
+                    _ocb->resmgr->device_session->id, canmsg.len),
                 canmsg.mid,
-                canmsg.len,
-                canmsg.dat[0],
-                canmsg.dat[1],
-                canmsg.dat[2],
-                canmsg.dat[3],
-                canmsg.dat[4],
-                canmsg.dat[5],
-                canmsg.dat[6],
-                canmsg.dat[7]);
+                CAN_TRACE_DATA(canmsg.dat, 0),
+                CAN_TRACE_DATA(canmsg.dat, 4));
 
         break;
     }
@@ -1627,6 +2329,11 @@ int io_devctl (resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* _ocb) {
 
     /* Indicate the number of bytes and return the message */
     msg->o.nbytes = nbytes;
+
+    if (taken) { // replied to as we return
+        latency_rx_replied(_ocb->session, taken);
+    }
+
     return(_RESMGR_PTR(ctp, &msg->o, sizeof(msg->o) + nbytes));
 }
 
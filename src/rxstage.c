@@ -0,0 +1,174 @@
+/*
+ * \file    rxstage.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/netmgr.h>
+
+#include <config.h>
+#include <threads.h>
+
+#include "rxstage.h"
+
+
+/* Delivery thread pulse codes */
+#define _PULSE_CODE_RX_STAGE_DOORBELL   (_PULSE_CODE_MINAVAIL+0)
+#define _PULSE_CODE_RX_STAGE_SHUTDOWN   (_PULSE_CODE_MINAVAIL+1)
+
+static void* rx_stage_loop (void* arg);
+
+int create_rx_stage (rx_stage_t* stage, struct device_session* ds,
+        void (*deliver)(struct device_session*, const rx_stage_frame_t*, int),
+        const struct thread_sched* sched, int default_priority)
+{
+    size_t size = shmring_size(RX_STAGE_SLOTS, sizeof(rx_stage_frame_t));
+
+    memset(stage, 0, sizeof(*stage));
+    stage->chid = stage->coid = -1;
+
+    if ((stage->mem = malloc(size)) == NULL) {
+        log_err("create_rx_stage malloc failed\n");
+
+        return ENOMEM;
+    }
+
+    shmring_init(stage->mem, size, RX_STAGE_SLOTS, sizeof(rx_stage_frame_t));
+    shmring_attach( &stage->producer, stage->mem, size,
+            sizeof(rx_stage_frame_t) );
+    shmring_attach( &stage->consumer, stage->mem, size,
+            sizeof(rx_stage_frame_t) );
+
+    stage->device_session = ds;
+    stage->deliver = deliver;
+    stage->sched = sched;
+    stage->priority = thread_sched_priority(sched, default_priority);
+
+    if ((stage->chid = ChannelCreate(_NTO_CHF_PRIVATE)) == -1) {
+        log_err("create_rx_stage ChannelCreate error; %s\n", strerror(errno));
+
+        destroy_rx_stage(stage);
+        return errno;
+    }
+
+    stage->coid =
+        ConnectAttach(ND_LOCAL_NODE, 0, stage->chid, _NTO_SIDE_CHANNEL, 0);
+
+    if (stage->coid == -1) {
+        log_err("create_rx_stage ConnectAttach error; %s\n", strerror(errno));
+
+        destroy_rx_stage(stage);
+        return errno;
+    }
+
+    pthread_attr_init(&stage->thread_attr);
+    thread_sched_attr(&stage->thread_attr, sched, stage->priority);
+
+    int err;
+    if ((err = pthread_create( &stage->thread, &stage->thread_attr,
+                    &rx_stage_loop, stage )) != EOK)
+    {
+        log_err("create_rx_stage pthread_create failed: %d\n", err);
+
+        destroy_rx_stage(stage);
+        return err;
+    }
+
+    stage->running = 1;
+
+    return EOK;
+}
+
+void destroy_rx_stage (rx_stage_t* stage) {
+    if (stage->running) {
+        MsgSendPulse(stage->coid, stage->priority,
+                _PULSE_CODE_RX_STAGE_SHUTDOWN, 0);
+
+        pthread_join(stage->thread, NULL);
+        stage->running = 0;
+    }
+
+    if (stage->coid != -1) {
+        ConnectDetach(stage->coid);
+        stage->coid = -1;
+    }
+
+    if (stage->chid != -1) {
+        ChannelDestroy(stage->chid);
+        stage->chid = -1;
+    }
+
+    free(stage->mem);
+    stage->mem = NULL;
+}
+
+int rx_stage_push (rx_stage_t* stage, const rx_stage_frame_t* frame) {
+    if (shmring_push(&stage->producer, frame) != EOK) {
+        return EAGAIN;
+    }
+
+    if (shmring_need_wakeup(&stage->producer)) {
+        MsgSendPulse(stage->coid, stage->priority,
+                _PULSE_CODE_RX_STAGE_DOORBELL, 0);
+    }
+
+    return EOK;
+}
+
+static void* rx_stage_loop (void* arg) {
+    rx_stage_t* stage = (rx_stage_t*)arg;
+    rx_stage_frame_t batch[RX_STAGE_BATCH];
+
+    thread_sched_apply(stage->sched);
+
+    for (;;) {
+        int n = 0;
+
+        while (n < RX_STAGE_BATCH
+                && shmring_pop(&stage->consumer, &batch[n]) == EOK)
+        {
+            ++n;
+        }
+
+        if (n) {
+            stage->deliver(stage->device_session, batch, n);
+
+            continue;
+        }
+
+        if (!shmring_prepare_wait(&stage->consumer)) {
+            continue;
+        }
+
+        struct _pulse pulse;
+
+        if (MsgReceivePulse(stage->chid, &pulse, sizeof(pulse), NULL) == -1) {
+            log_err("rx_stage_loop MsgReceivePulse error; %s\n",
+                    strerror(errno));
+
+            continue;
+        }
+
+        if (pulse.code == _PULSE_CODE_RX_STAGE_SHUTDOWN) {
+            break;
+        }
+    }
+
+    return NULL;
+}
@@ -23,6 +23,8 @@
 #include "session.h"
 #include "netif.h"
 #include "interrupt.h"
+#include "threads.h"
+#include "gateway.h"
 
 device_session_t* root_device_session = NULL;
 
@@ -30,14 +32,49 @@ device_session_t* root_device_session = NULL;
 pthread_mutex_t device_session_create_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 
-void increment_dropped_packet (void* arg) {
-    if (arg == NULL) {
+static void tx_queue_dropped (void* arg) {
+    struct net_device* dev = (struct net_device*)arg;
+
+    DEV_STATS_INC(dev, tx_dropped);
+    DEV_STATS_INC(dev, tx_queue_drops);
+}
+
+static void rx_queue_dropped (void* arg) {
+    struct net_device* dev = (struct net_device*)arg;
+
+    DEV_STATS_INC(dev, rx_dropped);
+    DEV_STATS_INC(dev, rx_queue_drops);
+}
+
+/* a frame went past the client latency limit before it was read */
+static void rx_queue_expired (void* arg) {
+    struct net_device* dev = (struct net_device*)arg;
+
+    DEV_STATS_INC(dev, rx_dropped);
+    DEV_STATS_INC(dev, rx_latency_drops);
+}
+
+/* let the clients know the device tx_queue has space again */
+static void tx_queue_dequeued (void* arg) {
+    device_session_t* ds = (device_session_t*)arg;
+
+    // Nobody is waiting for output space; skip the client session walk
+    if (__atomic_load_n(&ds->tx_notify_armed, __ATOMIC_SEQ_CST) == 0) {
         return;
     }
 
-    unsigned long* count = (unsigned long*)arg;
+    pthread_mutex_lock(&device_session_create_mutex);
+
+    client_session_t* it = ds->root_client_session;
+    while (it != NULL) {
+        if (it->tx_ready) {
+            it->tx_ready(it->tx_ready_arg);
+        }
+
+        it = it->next;
+    }
 
-    ++(*count);
+    pthread_mutex_unlock(&device_session_create_mutex);
 }
 
 device_session_t*
@@ -59,8 +96,19 @@ create_device_session (struct net_device* dev, const queue_attr_t* tx_attr) {
     }
 
     new_device->device = dev;
+    new_device->id = -1;
     new_device->root_client_session = NULL;
     new_device->queue_stopped = 0;
+    pthread_mutex_init(&new_device->shm_tx_mutex, NULL);
+    new_device->shm_tx_list = NULL;
+    new_device->shm_tx_channels = 0;
+    new_device->shm_tx_turn = 0;
+    new_device->tx_notify_armed = 0;
+    new_device->rx_stage.mem = NULL;
+    new_device->rx_stage.running = 0;
+
+    busload_init(&new_device->busload);
+    latency_init(&new_device->latency);
 
     int err;
     if ((err = create_queue(&new_device->tx_queue, tx_attr)) != EOK) {
@@ -71,8 +119,10 @@ create_device_session (struct net_device* dev, const queue_attr_t* tx_attr) {
         return NULL;
     }
 
-    new_device->tx_queue.dropped_packet_arg = &dev->stats.tx_dropped;
-    new_device->tx_queue.dropped_packet = increment_dropped_packet;
+    new_device->tx_queue.dropped_packet_arg = dev;
+    new_device->tx_queue.dropped_packet = tx_queue_dropped;
+    new_device->tx_queue.dequeued_arg = new_device;
+    new_device->tx_queue.dequeued = tx_queue_dequeued;
 
     int policy;
     struct sched_param param;
@@ -89,15 +139,22 @@ create_device_session (struct net_device* dev, const queue_attr_t* tx_attr) {
     pthread_attr_setdetachstate(
             &new_device->tx_thread_attr, PTHREAD_CREATE_DETACHED );
 
-    pthread_attr_setinheritsched( &new_device->tx_thread_attr,
-            PTHREAD_EXPLICIT_SCHED );
-
-    param.sched_priority += CONFIG_IRQ_SCHED_PRIORITY_BOOST;
-    pthread_attr_setschedparam(&new_device->tx_thread_attr, &param);
+    thread_sched_attr( &new_device->tx_thread_attr,
+            thread_sched(dev, THREAD_TX),
+            param.sched_priority + CONFIG_IRQ_SCHED_PRIORITY_BOOST );
 
     pthread_create( &new_device->tx_thread, &new_device->tx_thread_attr,
             &netif_tx, new_device );
 
+    if ((err = create_rx_stage( &new_device->rx_stage, new_device,
+                    netif_rx_deliver, thread_sched(dev, THREAD_RX),
+                    param.sched_priority + CONFIG_IRQ_SCHED_PRIORITY_BOOST ))
+            != EOK)
+    {
+        // netif_rx() falls back to delivering from the IRQ path
+        log_err("create_device_session: create_rx_stage err: %d\n", err);
+    }
+
     pthread_mutex_unlock(&device_session_create_mutex);
     return new_device;
 }
@@ -107,6 +164,11 @@ void destroy_device_session (device_session_t* D) {
         return;
     }
 
+    // Stop the delivery thread first; it takes the lock below
+    if (D->rx_stage.mem != NULL) {
+        destroy_rx_stage(&D->rx_stage);
+    }
+
     pthread_mutex_lock(&device_session_create_mutex);
 
     if (D->prev && D->next) {
@@ -132,9 +194,14 @@ void destroy_device_session (device_session_t* D) {
         root_device_session = NULL;
     }
 
+    gateway_attach(D->id, NULL);
+
     destroy_queue(&D->tx_queue);
     D->queue_stopped = 0;
 
+    busload_destroy(&D->busload);
+    pthread_mutex_destroy(&D->shm_tx_mutex);
+
     free(D);
 }
 
@@ -171,6 +238,11 @@ create_client_session (struct net_device* dev, const queue_attr_t* rx_attr,
     new_client->mid = mid;          /* CAN message identifier */
     new_client->mfilter = mfilter;  /* CAN message filter */
     new_client->prio = prio;        /* CAN priority - not used */
+    new_client->tx_ready_arg = NULL;
+    new_client->tx_ready = NULL;
+    new_client->shm = NULL;
+
+    latency_init(&new_client->latency);
 
     int err;
     if ((err = create_queue(&new_client->rx_queue, rx_attr)) != EOK) {
@@ -181,8 +253,10 @@ create_client_session (struct net_device* dev, const queue_attr_t* rx_attr,
         return NULL;
     }
 
-    new_client->rx_queue.dropped_packet_arg = &dev->stats.rx_dropped;
-    new_client->rx_queue.dropped_packet = increment_dropped_packet;
+    new_client->rx_queue.dropped_packet_arg = dev;
+    new_client->rx_queue.dropped_packet = rx_queue_dropped;
+    new_client->rx_queue.expired_arg = dev;
+    new_client->rx_queue.expired = rx_queue_expired;
 
     pthread_mutex_unlock(&device_session_create_mutex);
     return new_client;
@@ -225,7 +299,35 @@ void destroy_client_session (client_session_t* S) {
     }
 
     destroy_queue(&S->rx_queue);
+
+    if (S->shm && S->shm->dir == SHM_CHANNEL_TX) {
+        pthread_mutex_lock(&ds->shm_tx_mutex);
+
+        shm_channel_t** link = &ds->shm_tx_list;
+        while (*link != NULL && *link != S->shm) {
+            link = &(*link)->next;
+        }
+
+        if (*link != NULL) {
+            *link = S->shm->next;
+            --ds->shm_tx_channels;
+        }
+
+        pthread_mutex_unlock(&ds->shm_tx_mutex);
+    }
+
+    destroy_shm_channel(S->shm);
     free(S);
 
     pthread_mutex_unlock(&device_session_create_mutex);
 }
+
+void attach_shm_tx_channel (device_session_t* D, shm_channel_t* ch) {
+    pthread_mutex_lock(&D->shm_tx_mutex);
+
+    ch->next = D->shm_tx_list;
+    D->shm_tx_list = ch;
+    ++D->shm_tx_channels;
+
+    pthread_mutex_unlock(&D->shm_tx_mutex);
+}
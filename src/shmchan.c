@@ -0,0 +1,152 @@
+/*
+ * \file    shmchan.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <config.h>
+#include <dev-can-linux/commands.h>
+
+#include "shmchan.h"
+#include "timer.h"
+
+
+shm_channel_t* create_shm_channel (shm_channel_dir_t dir, uint32_t slots) {
+    shm_channel_t* ch;
+
+    if (slots == 0) {
+        slots = SHM_CHANNEL_DEFAULT_SLOTS;
+    }
+
+    size_t size = shmring_size(slots, sizeof(struct can_msg_ts));
+
+    if (size == 0) {
+        log_err("create_shm_channel invalid slots: %u\n", slots);
+
+        return NULL;
+    }
+
+    if ((ch = calloc(1, sizeof(*ch))) == NULL) {
+        log_err("create_shm_channel calloc failed\n");
+
+        return NULL;
+    }
+
+    ch->dir = dir;
+    ch->size = size;
+    ch->rcvid = -1;
+
+    if ((ch->fd = shm_open(SHM_ANON, O_RDWR | O_CREAT, 0600)) == -1) {
+        log_err("create_shm_channel shm_open failed: %s\n", strerror(errno));
+
+        free(ch);
+        return NULL;
+    }
+
+    if (ftruncate(ch->fd, size) == -1) {
+        log_err("create_shm_channel ftruncate failed: %s\n", strerror(errno));
+
+        close(ch->fd);
+        free(ch);
+        return NULL;
+    }
+
+    ch->mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ch->fd, 0);
+
+    if (ch->mem == MAP_FAILED) {
+        log_err("create_shm_channel mmap failed: %s\n", strerror(errno));
+
+        close(ch->fd);
+        free(ch);
+        return NULL;
+    }
+
+    int result;
+
+    if ((result = shmring_init(ch->mem, size,
+                    slots, sizeof(struct can_msg_ts))) != EOK
+        || (result = shmring_attach(&ch->port, ch->mem, size,
+                    sizeof(struct can_msg_ts))) != EOK)
+    {
+        log_err("create_shm_channel ring init failed: %d\n", result);
+
+        destroy_shm_channel(ch);
+        return NULL;
+    }
+
+    return ch;
+}
+
+void destroy_shm_channel (shm_channel_t* ch) {
+    if (ch == NULL) {
+        return;
+    }
+
+    // The client keeps its own mapping; the object goes with the last unmap
+    munmap(ch->mem, ch->size);
+    close(ch->fd);
+
+    free(ch);
+}
+
+int shm_channel_handle (shm_channel_t* ch, pid_t pid, shm_handle_t* handle) {
+    if (shm_create_handle(ch->fd, pid, O_RDWR, handle, 0) == -1) {
+        log_err("shm_create_handle failed: %s\n", strerror(errno));
+
+        return errno;
+    }
+
+    return EOK;
+}
+
+int shm_channel_rx (shm_channel_t* ch,
+        const frame_t* frame, uint64_t tstamp)
+{
+    struct can_msg_ts record;
+
+    frame_to_canmsg(frame, user_timestamp_ms(tstamp), &record.canmsg);
+    record.timestamp_ns = tstamp;
+
+    if (shmring_push(&ch->port, &record) != EOK) {
+        return EAGAIN;
+    }
+
+    if (ch->event_valid && shmring_need_wakeup(&ch->port)) {
+        MsgDeliverEvent(ch->rcvid, &ch->event);
+    }
+
+    return EOK;
+}
+
+int shm_channel_tx (shm_channel_t* ch, frame_t* frame) {
+    struct can_msg_ts* record = shmring_peek(&ch->port);
+
+    if (record == NULL) {
+        return EAGAIN;
+    }
+
+    // The record was written by the client; the conversion limits its length
+    frame_from_canmsg(frame, &record->canmsg);
+    shmring_consume(&ch->port);
+
+    return EOK;
+}
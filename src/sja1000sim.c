@@ -0,0 +1,765 @@
+/*
+ * \file    sja1000sim.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "sja1000sim.h"
+
+#ifndef EOK
+#define EOK 0 // only QNX defines EOK
+#endif
+
+/*
+ * PeliCAN register map and bits; the same as in the kernel driver's
+ * sja1000.h, repeated here so that the simulator builds without the kernel
+ * headers.
+ */
+#define REG_MOD         0x00
+#define REG_CMR         0x01
+#define REG_SR          0x02
+#define REG_IR          0x03
+#define REG_IER         0x04
+#define REG_BTR0        0x06
+#define REG_BTR1        0x07
+#define REG_OCR         0x08
+#define REG_ALC         0x0B
+#define REG_ECC         0x0C
+#define REG_EWL         0x0D
+#define REG_RXERR       0x0E
+#define REG_TXERR       0x0F
+#define REG_FI          0x10    /* receive window / transmit buffer */
+#define REG_ACR0        0x10    /* acceptance code, reset mode */
+#define REG_AMR0        0x14    /* acceptance mask, reset mode */
+#define REG_FRAME_END   0x1C
+#define REG_RMC         0x1D
+#define REG_RBSA        0x1E
+#define REG_CDR         0x1F
+#define REG_RX_RAM      0x20
+#define REG_TX_RAM      (REG_RX_RAM + SJA1000_SIM_RX_FIFO)
+
+#define MOD_RM          0x01
+#define MOD_LOM         0x02
+#define MOD_STM         0x04
+#define MOD_AFM         0x08
+#define MOD_SM          0x10
+
+#define CMD_SRR         0x10
+#define CMD_CDO         0x08
+#define CMD_RRB         0x04
+#define CMD_AT          0x02
+#define CMD_TR          0x01
+
+#define IRQ_BEI         0x80
+#define IRQ_EPI         0x20
+#define IRQ_DOI         0x08
+#define IRQ_EI          0x04
+#define IRQ_TI          0x02
+#define IRQ_RI          0x01
+
+#define SR_BS           0x80
+#define SR_ES           0x40
+#define SR_TS           0x20
+#define SR_TCS          0x08
+#define SR_TBS          0x04
+#define SR_DOS          0x02
+#define SR_RBS          0x01
+
+#define FI_FF           0x80
+#define FI_RTR          0x40
+#define FI_DLC          0x0F
+
+/* ECC of an acknowledgement error; other error type, ACK slot, during TX */
+#define ECC_ACK_ERROR   (0xC0 | 0x19)
+
+/* ECC of an injected error; bit error in the data field */
+#define ECC_BIT_ERROR   (0x00 | 0x0A)
+#define ECC_DIR_RX      0x20
+
+#define EWL_DEFAULT     96
+#define ERROR_PASSIVE   128
+#define BUS_OFF         256
+
+
+static inline bool sim_reset_mode (const sja1000_sim_t* sim) {
+    return (sim->mod & MOD_RM);
+}
+
+static inline bool sim_error_passive (const sja1000_sim_t* sim) {
+    return (sim->txerr >= ERROR_PASSIVE || sim->rxerr >= ERROR_PASSIVE);
+}
+
+/* Size in the receive FIFO of the message with frame information fi */
+static inline uint8_t sim_message_size (uint8_t fi) {
+    uint8_t len = fi & FI_DLC;
+
+    if (len > 8 || (fi & FI_RTR)) {
+        len = (fi & FI_RTR) ? 0 : 8;
+    }
+
+    return 1 + ((fi & FI_FF) ? 4 : 2) + len;
+}
+
+/* Frame and identifier bytes as laid out in the TX buffer and RX FIFO */
+static uint8_t sim_frame_encode (const sja1000_sim_frame_t* frame,
+        uint8_t* buf)
+{
+    uint8_t fi = (frame->len & FI_DLC);
+    uint8_t n;
+
+    if (frame->rtr) {
+        fi |= FI_RTR;
+    }
+
+    if (frame->eff) {
+        buf[0] = fi | FI_FF;
+        buf[1] = (frame->id >> 21) & 0xFF;
+        buf[2] = (frame->id >> 13) & 0xFF;
+        buf[3] = (frame->id >> 5) & 0xFF;
+        buf[4] = ((frame->id & 0x1F) << 3) | (frame->rtr ? 0x04 : 0);
+        n = 5;
+    }
+    else {
+        buf[0] = fi;
+        buf[1] = (frame->id >> 3) & 0xFF;
+        buf[2] = ((frame->id & 0x07) << 5) | (frame->rtr ? 0x10 : 0);
+        n = 3;
+    }
+
+    uint8_t size = sim_message_size(buf[0]);
+
+    memcpy(&buf[n], frame->data, size - n);
+
+    return size;
+}
+
+static void sim_frame_decode (const uint8_t* buf, sja1000_sim_frame_t* frame) {
+    uint8_t fi = buf[0];
+    uint8_t n;
+
+    memset(frame, 0, sizeof(*frame));
+
+    frame->eff = (fi & FI_FF) ? true : false;
+    frame->rtr = (fi & FI_RTR) ? true : false;
+    frame->len = fi & FI_DLC;
+
+    if (frame->eff) {
+        frame->id = (buf[1] << 21) | (buf[2] << 13) | (buf[3] << 5)
+                  | (buf[4] >> 3);
+        n = 5;
+    }
+    else {
+        frame->id = (buf[1] << 3) | (buf[2] >> 5);
+        n = 3;
+    }
+
+    memcpy(frame->data, &buf[n], sim_message_size(fi) - n);
+}
+
+static inline bool sim_match (uint8_t byte, uint8_t acr, uint8_t amr,
+        uint8_t bits)
+{
+    return (((byte ^ acr) & ~amr & bits) == 0);
+}
+
+/*
+ * Acceptance filter; single filter mode (MOD_AFM) compares one 32-bit filter,
+ * dual filter mode passes frames matching either of two shorter filters.
+ */
+static bool sim_accept (const sja1000_sim_t* sim,
+        const sja1000_sim_frame_t* frame)
+{
+    uint8_t buf[SJA1000_SIM_TX_BUF];
+    const uint8_t* acr = sim->acr;
+    const uint8_t* amr = sim->amr;
+
+    uint8_t size = sim_frame_encode(frame, buf);
+    uint8_t* id = &buf[1];
+
+    if (frame->eff) {
+        if (sim->mod & MOD_AFM) {
+            return sim_match(id[0], acr[0], amr[0], 0xFF)
+                && sim_match(id[1], acr[1], amr[1], 0xFF)
+                && sim_match(id[2], acr[2], amr[2], 0xFF)
+                && sim_match(id[3], acr[3], amr[3], 0xFC);
+        }
+
+        return (sim_match(id[0], acr[0], amr[0], 0xFF)
+                && sim_match(id[1], acr[1], amr[1], 0xFF))
+            || (sim_match(id[0], acr[2], amr[2], 0xFF)
+                && sim_match(id[1], acr[3], amr[3], 0xFF));
+    }
+
+    bool data0 = (size > 3);
+    bool data1 = (size > 4);
+
+    if (sim->mod & MOD_AFM) {
+        return sim_match(id[0], acr[0], amr[0], 0xFF)
+            && sim_match(id[1], acr[1], amr[1], 0xF0)
+            && (!data0 || sim_match(id[2], acr[2], amr[2], 0xFF))
+            && (!data1 || sim_match(id[3], acr[3], amr[3], 0xFF));
+    }
+
+    /* filter 1 also compares the first data byte, split over ACR1 and ACR3 */
+    uint8_t d = data0 ? id[2] : 0;
+
+    bool filter1 = sim_match(id[0], acr[0], amr[0], 0xFF)
+        && sim_match(id[1], acr[1], amr[1], 0xF0)
+        && (!data0 || (sim_match(d >> 4, acr[1], amr[1], 0x0F)
+                && sim_match(d & 0x0F, acr[3], amr[3], 0x0F)));
+
+    bool filter2 = sim_match(id[0], acr[2], amr[2], 0xFF)
+        && sim_match(id[1], acr[3], amr[3], 0xF0);
+
+    return filter1 || filter2;
+}
+
+/* Latch interrupt sources bits, as far as they are enabled */
+static inline void sim_set_ir (sja1000_sim_t* sim, uint8_t bits) {
+    sim->ir |= (bits & sim->ier & ~IRQ_RI);
+}
+
+/* Update the interrupt output; RI is not latched but follows RBS */
+static void sim_update_line (sja1000_sim_t* sim) {
+    bool active = (sim->ir != 0)
+        || ((sim->ier & IRQ_RI) && (sim->sr & SR_RBS));
+
+    if (active && !sim->irq_line) {
+        sim->irq_raise = true;
+    }
+
+    sim->irq_line = active;
+}
+
+static void sim_fifo_clear (sja1000_sim_t* sim) {
+    sim->rbsa = 0;
+    sim->fifo_used = 0;
+    sim->rmc = 0;
+    sim->sr &= ~(SR_RBS | SR_DOS);
+}
+
+static void sim_enter_reset (sja1000_sim_t* sim) {
+    sim->mod |= MOD_RM;
+    sim->ir = 0;
+    sim->tx_pending = false;
+    sim->sr |= (SR_TBS | SR_TCS);
+    sim->sr &= ~SR_TS;
+
+    sim_fifo_clear(sim);
+}
+
+/*
+ * Error status after the error counters changed; raises the error warning
+ * (EI) and error passive (EPI) interrupts and goes bus-off.
+ */
+static void sim_update_errors (sja1000_sim_t* sim, bool was_passive) {
+    uint8_t sr = sim->sr;
+
+    if (sim->txerr >= BUS_OFF) {
+        sim_enter_reset(sim);
+
+        /* counts the bus-free occurrences of the recovery sequence */
+        sim->txerr = 127;
+        sim->rxerr = 0;
+        sim->sr |= (SR_BS | SR_ES);
+    }
+    else if (sim->txerr >= sim->ewl || sim->rxerr >= sim->ewl) {
+        sim->sr |= SR_ES;
+    }
+    else {
+        sim->sr &= ~SR_ES;
+    }
+
+    if ((sr ^ sim->sr) & (SR_BS | SR_ES)) {
+        sim_set_ir(sim, IRQ_EI);
+    }
+
+    if (!(sim->sr & SR_BS) && was_passive != sim_error_passive(sim)) {
+        sim_set_ir(sim, IRQ_EPI);
+    }
+}
+
+static void sim_receive (sja1000_sim_t* sim, const sja1000_sim_frame_t* frame)
+{
+    if (sim_reset_mode(sim) || !sim_accept(sim, frame)) {
+        return;
+    }
+
+    uint8_t buf[SJA1000_SIM_TX_BUF];
+    uint8_t size = sim_frame_encode(frame, buf);
+
+    if (sim->fifo_used + size > SJA1000_SIM_RX_FIFO) {
+        sim->sr |= SR_DOS;
+        sim_set_ir(sim, IRQ_DOI);
+        sim->rx_overruns++;
+
+        return;
+    }
+
+    uint8_t i;
+    for (i = 0; i < size; ++i) {
+        sim->fifo[(sim->rbsa + sim->fifo_used + i) % SJA1000_SIM_RX_FIFO] =
+            buf[i];
+    }
+
+    sim->fifo_used += size;
+    sim->rmc++;
+    sim->sr |= SR_RBS;
+
+    bool was_passive = sim_error_passive(sim);
+
+    if (sim->rxerr >= ERROR_PASSIVE) {
+        sim->rxerr = 119;
+    }
+    else if (sim->rxerr) {
+        sim->rxerr--;
+    }
+
+    sim_update_errors(sim, was_passive);
+}
+
+static void sim_release (sja1000_sim_t* sim) {
+    if (sim->rmc == 0) {
+        return;
+    }
+
+    uint8_t size = sim_message_size(sim->fifo[sim->rbsa]);
+
+    sim->rbsa = (sim->rbsa + size) % SJA1000_SIM_RX_FIFO;
+    sim->fifo_used -= size;
+
+    if (--sim->rmc == 0) {
+        sim->sr &= ~SR_RBS;
+    }
+}
+
+static inline bool sim_node_acks (const sja1000_sim_t* node) {
+    return (!sim_reset_mode(node) && !(node->mod & MOD_LOM));
+}
+
+/* Put the frame on the bus to every operating node other than sender */
+static void sim_bus_put (sja1000_sim_bus_t* bus, sja1000_sim_t* sender,
+        const sja1000_sim_frame_t* frame)
+{
+    int i;
+    for (i = 0; i < bus->num_nodes; ++i) {
+        if (bus->node[i] != sender) {
+            sim_receive(bus->node[i], frame);
+        }
+    }
+
+    bus->frames++;
+
+    if (bus->tx) {
+        bus->tx(bus->tx_arg, frame);
+    }
+}
+
+static void sim_tx_done (sja1000_sim_t* sim, bool complete) {
+    sim->tx_pending = false;
+    sim->sr |= SR_TBS;
+    sim->sr &= ~SR_TS;
+
+    if (complete) {
+        sim->sr |= SR_TCS;
+    }
+
+    sim_set_ir(sim, IRQ_TI);
+}
+
+/* Attempt the pending transmission of sim */
+static void sim_tx_attempt (sja1000_sim_t* sim) {
+    sja1000_sim_bus_t* bus = sim->bus;
+    bool acked = bus->ack || (sim->mod & MOD_STM);
+    int i;
+
+    for (i = 0; i < bus->num_nodes && !acked; ++i) {
+        acked = (bus->node[i] != sim && sim_node_acks(bus->node[i]));
+    }
+
+    bool was_passive = sim_error_passive(sim);
+
+    if (acked) {
+        sja1000_sim_frame_t frame;
+        sim_frame_decode(sim->tx_buf, &frame);
+
+        sim_bus_put(bus, sim, &frame);
+
+        if (sim->tx_self) {
+            sim_receive(sim, &frame);
+        }
+
+        if (sim->txerr) {
+            sim->txerr--;
+        }
+
+        sim_tx_done(sim, true);
+        sim_update_errors(sim, was_passive);
+
+        return;
+    }
+
+    bus->ack_errors++;
+
+    sim->ecc = ECC_ACK_ERROR;
+    sim_set_ir(sim, IRQ_BEI);
+
+    /*
+     * Retransmissions go on until error passive; an error passive
+     * transmitter does not count further ACK errors.
+     */
+    do {
+        if (sim->txerr < ERROR_PASSIVE) {
+            sim->txerr += 8;
+        }
+    } while (!sim->tx_single_shot && sim->txerr < ERROR_PASSIVE);
+
+    if (sim->tx_single_shot) {
+        sim_tx_done(sim, false);
+    }
+
+    sim_update_errors(sim, was_passive);
+}
+
+/* Retry the transmissions waiting for an acknowledgement */
+static void sim_bus_retry (sja1000_sim_bus_t* bus) {
+    int i;
+    for (i = 0; i < bus->num_nodes; ++i) {
+        sja1000_sim_t* node = bus->node[i];
+
+        if (node->tx_pending && !sim_reset_mode(node)) {
+            sim_tx_attempt(node);
+        }
+    }
+}
+
+static void sim_command (sja1000_sim_t* sim, uint8_t cmd) {
+    if (sim_reset_mode(sim)) {
+        return;
+    }
+
+    if (cmd & (CMD_TR | CMD_SRR)) {
+        if ((sim->sr & SR_TBS) && !(sim->mod & MOD_LOM)) {
+            sim->tx_pending = true;
+            sim->tx_single_shot = (cmd & CMD_AT) ? true : false;
+            sim->tx_self = (cmd & CMD_SRR) ? true : false;
+            sim->sr &= ~(SR_TBS | SR_TCS);
+            sim->sr |= SR_TS;
+
+            sim_tx_attempt(sim);
+        }
+    }
+    else if ((cmd & CMD_AT) && sim->tx_pending) {
+        sim_tx_done(sim, false);
+    }
+
+    if (cmd & CMD_RRB) {
+        sim_release(sim);
+    }
+
+    if (cmd & CMD_CDO) {
+        sim->sr &= ~SR_DOS;
+    }
+}
+
+static void sim_write_mod (sja1000_sim_t* sim, uint8_t val) {
+    const uint8_t mode_bits = MOD_LOM | MOD_STM | MOD_AFM;
+
+    if (sim_reset_mode(sim)) {
+        sim->mod = val & (MOD_RM | MOD_SM | mode_bits);
+
+        if (!sim_reset_mode(sim)) {
+            if (sim->sr & SR_BS) {
+                /* bus-off recovery completes at once */
+                bool was_passive = sim_error_passive(sim);
+
+                sim->txerr = 0;
+                sim->rxerr = 0;
+                sim->sr &= ~SR_BS;
+
+                sim_update_errors(sim, was_passive);
+            }
+
+            sim_bus_retry(sim->bus);
+        }
+
+        return;
+    }
+
+    sim->mod = (sim->mod & mode_bits) | (val & (MOD_RM | MOD_SM));
+
+    if (sim_reset_mode(sim)) {
+        sim_enter_reset(sim);
+    }
+}
+
+/* Unlock the bus and raise the interrupts that became active meanwhile */
+static void sim_bus_unlock (sja1000_sim_bus_t* bus) {
+    sja1000_sim_t* raise[SJA1000_SIM_MAX_NODES];
+    int n = 0;
+    int i;
+
+    for (i = 0; i < bus->num_nodes; ++i) {
+        sja1000_sim_t* node = bus->node[i];
+
+        sim_update_line(node);
+
+        if (node->irq_raise) {
+            node->irq_raise = false;
+            raise[n++] = node;
+        }
+    }
+
+    pthread_mutex_unlock(&bus->mutex);
+
+    for (i = 0; i < n; ++i) {
+        if (raise[i]->irq) {
+            raise[i]->irq(raise[i]->irq_arg);
+        }
+    }
+}
+
+int sja1000_sim_bus_init (sja1000_sim_bus_t* bus) {
+    memset(bus, 0, sizeof(*bus));
+
+    return pthread_mutex_init(&bus->mutex, NULL);
+}
+
+void sja1000_sim_bus_destroy (sja1000_sim_bus_t* bus) {
+    pthread_mutex_destroy(&bus->mutex);
+}
+
+int sja1000_sim_init (sja1000_sim_t* sim, sja1000_sim_bus_t* bus,
+        void (*irq)(void* arg), void* irq_arg)
+{
+    memset(sim, 0, sizeof(*sim));
+
+    sim->bus = bus;
+    sim->irq = irq;
+    sim->irq_arg = irq_arg;
+
+    sim->mod = MOD_RM;
+    sim->sr = SR_TBS | SR_TCS;
+    sim->ewl = EWL_DEFAULT;
+    memset(sim->amr, 0xFF, sizeof(sim->amr));
+
+    pthread_mutex_lock(&bus->mutex);
+
+    if (bus->num_nodes == SJA1000_SIM_MAX_NODES) {
+        pthread_mutex_unlock(&bus->mutex);
+
+        return ENOSPC;
+    }
+
+    bus->node[bus->num_nodes++] = sim;
+
+    pthread_mutex_unlock(&bus->mutex);
+
+    return EOK;
+}
+
+void sja1000_sim_destroy (sja1000_sim_t* sim) {
+    sja1000_sim_bus_t* bus = sim->bus;
+    int i;
+
+    pthread_mutex_lock(&bus->mutex);
+
+    for (i = 0; i < bus->num_nodes; ++i) {
+        if (bus->node[i] == sim) {
+            bus->node[i] = bus->node[--bus->num_nodes];
+            bus->node[bus->num_nodes] = NULL;
+
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&bus->mutex);
+}
+
+uint8_t sja1000_sim_read (sja1000_sim_t* sim, int reg) {
+    uint8_t val = 0;
+
+    if (reg < 0 || reg >= SJA1000_SIM_REGS) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&sim->bus->mutex);
+
+    if (reg >= REG_FI && reg < REG_FRAME_END) {
+        if (!sim_reset_mode(sim)) {
+            val = sim->fifo[(sim->rbsa + reg - REG_FI) % SJA1000_SIM_RX_FIFO];
+        }
+        else if (reg < REG_AMR0) {
+            val = sim->acr[reg - REG_ACR0];
+        }
+        else if (reg < REG_AMR0 + 4) {
+            val = sim->amr[reg - REG_AMR0];
+        }
+    }
+    else if (reg >= REG_RX_RAM && reg < REG_TX_RAM) {
+        val = sim->fifo[reg - REG_RX_RAM];
+    }
+    else if (reg >= REG_TX_RAM && reg < REG_TX_RAM + SJA1000_SIM_TX_BUF) {
+        val = sim->tx_buf[reg - REG_TX_RAM];
+    }
+    else {
+        switch (reg) {
+        case REG_MOD:   val = sim->mod; break;
+        case REG_CMR:   val = 0xFF; break; // write only
+        case REG_SR:    val = sim->sr; break;
+        case REG_IR:
+            val = sim->ir;
+
+            if ((sim->ier & IRQ_RI) && (sim->sr & SR_RBS)) {
+                val |= IRQ_RI;
+            }
+
+            sim->ir = 0; // reading clears all but RI
+            break;
+        case REG_IER:   val = sim->ier; break;
+        case REG_BTR0:  val = sim->btr0; break;
+        case REG_BTR1:  val = sim->btr1; break;
+        case REG_OCR:   val = sim->ocr; break;
+        case REG_ALC:   val = sim->alc; break;
+        case REG_ECC:   val = sim->ecc; break;
+        case REG_EWL:   val = sim->ewl; break;
+        case REG_RXERR: val = (sim->rxerr > 0xFF) ? 0xFF : sim->rxerr; break;
+        case REG_TXERR: val = (sim->txerr > 0xFF) ? 0xFF : sim->txerr; break;
+        case REG_RMC:   val = sim->rmc; break;
+        case REG_RBSA:  val = sim->rbsa; break;
+        case REG_CDR:   val = sim->cdr; break;
+        default:
+            break;
+        }
+    }
+
+    sim_bus_unlock(sim->bus);
+
+    return val;
+}
+
+void sja1000_sim_write (sja1000_sim_t* sim, int reg, uint8_t val) {
+    if (reg < 0 || reg >= SJA1000_SIM_REGS) {
+        return;
+    }
+
+    pthread_mutex_lock(&sim->bus->mutex);
+
+    bool reset_mode = sim_reset_mode(sim);
+
+    if (reg >= REG_FI && reg < REG_FRAME_END) {
+        if (!reset_mode) {
+            if (sim->sr & SR_TBS) {
+                sim->tx_buf[reg - REG_FI] = val;
+            }
+        }
+        else if (reg < REG_AMR0) {
+            sim->acr[reg - REG_ACR0] = val;
+        }
+        else if (reg < REG_AMR0 + 4) {
+            sim->amr[reg - REG_AMR0] = val;
+        }
+    }
+    else if (reg >= REG_RX_RAM && reg < REG_TX_RAM) {
+        sim->fifo[reg - REG_RX_RAM] = val;
+    }
+    else if (reg >= REG_TX_RAM && reg < REG_TX_RAM + SJA1000_SIM_TX_BUF) {
+        sim->tx_buf[reg - REG_TX_RAM] = val;
+    }
+    else {
+        switch (reg) {
+        case REG_MOD:   sim_write_mod(sim, val); break;
+        case REG_CMR:   sim_command(sim, val); break;
+        case REG_IER:   sim->ier = val; break;
+        case REG_CDR:   sim->cdr = val; break;
+        default:
+            if (!reset_mode) {
+                break; // the rest can only be written in reset mode
+            }
+
+            switch (reg) {
+            case REG_BTR0:  sim->btr0 = val; break;
+            case REG_BTR1:  sim->btr1 = val; break;
+            case REG_OCR:   sim->ocr = val; break;
+            case REG_EWL:   sim->ewl = val; break;
+            case REG_RXERR: sim->rxerr = val; break;
+            case REG_TXERR: sim->txerr = val; break;
+            case REG_RBSA:  sim->rbsa = val % SJA1000_SIM_RX_FIFO; break;
+            default:
+                break;
+            }
+            break;
+        }
+    }
+
+    sim_bus_unlock(sim->bus);
+}
+
+bool sja1000_sim_irq_active (sja1000_sim_t* sim) {
+    pthread_mutex_lock(&sim->bus->mutex);
+
+    sim_update_line(sim);
+    bool active = sim->irq_line;
+
+    sim_bus_unlock(sim->bus);
+
+    return active;
+}
+
+int sja1000_sim_bus_inject (sja1000_sim_bus_t* bus,
+        const sja1000_sim_frame_t* frame)
+{
+    if (frame->len > FI_DLC) {
+        return EINVAL;
+    }
+
+    pthread_mutex_lock(&bus->mutex);
+
+    sim_bus_put(bus, NULL, frame);
+
+    sim_bus_unlock(bus);
+
+    return EOK;
+}
+
+void sja1000_sim_inject_error (sja1000_sim_t* sim, bool tx) {
+    pthread_mutex_lock(&sim->bus->mutex);
+
+    if (!sim_reset_mode(sim)) {
+        bool was_passive = sim_error_passive(sim);
+
+        if (tx) {
+            sim->txerr += 8;
+            sim->ecc = ECC_BIT_ERROR;
+        }
+        else {
+            if (sim->rxerr < ERROR_PASSIVE) {
+                sim->rxerr++;
+            }
+
+            sim->ecc = ECC_BIT_ERROR | ECC_DIR_RX;
+        }
+
+        sim_set_ir(sim, IRQ_BEI);
+        sim_update_errors(sim, was_passive);
+    }
+
+    sim_bus_unlock(sim->bus);
+}
@@ -0,0 +1,328 @@
+/*
+ * \file    slab.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <logs.h>
+#include <linux/skbuff.h>
+#include <linux/can/skb.h>
+
+#include "slab.h"
+
+
+/* Registered caches; slab_free() finds the owner of an object here */
+static slab_cache_t* volatile slab_registry[SLAB_MAX_CACHES];
+static uint32_t slab_generation = 0;
+
+/* Per-thread magazine of one cache */
+typedef struct slab_magazine {
+    uint32_t generation;
+    uint32_t count;
+    void* objects[SLAB_MAGAZINE_SIZE];
+} slab_magazine_t;
+
+static __thread slab_magazine_t slab_magazines[SLAB_MAX_CACHES];
+
+/* Flushes the magazines of exiting threads, e.g. resmgr pool threads */
+static pthread_key_t slab_magazines_key;
+static pthread_once_t slab_magazines_once = PTHREAD_ONCE_INIT;
+
+slab_cache_t skb_cache;
+slab_cache_t skb_priv_cache;
+slab_cache_t echo_cache;
+
+#define SLAB_TAG_INC    ((uint64_t)1 << 32)
+
+static inline uint32_t slab_index (const slab_cache_t* cache, void* ptr) {
+    return (uint32_t)(((uint8_t*)ptr - cache->mem)/cache->object_size);
+}
+
+static inline void* slab_object (const slab_cache_t* cache, uint32_t i) {
+    return cache->mem + (size_t)i*cache->object_size;
+}
+
+/*
+ * Depot; a Treiber stack of object indices. The head carries a tag that is
+ * bumped on every pop so that a stale compare-and-swap can't succeed after the
+ * same top index was popped and pushed back in between.
+ */
+
+static void depot_push (slab_cache_t* cache, uint32_t i) {
+    uint64_t head = __atomic_load_n(&cache->depot, __ATOMIC_RELAXED);
+    uint64_t update;
+
+    do {
+        __atomic_store_n(&cache->next[i], (uint32_t)head, __ATOMIC_RELAXED);
+        update = (head & ~(uint64_t)UINT32_MAX) | i;
+    } while (!__atomic_compare_exchange_n( &cache->depot, &head, update,
+                1, __ATOMIC_RELEASE, __ATOMIC_RELAXED ));
+}
+
+static uint32_t depot_pop (slab_cache_t* cache) {
+    uint64_t head = __atomic_load_n(&cache->depot, __ATOMIC_ACQUIRE);
+    uint64_t update;
+    uint32_t i;
+
+    do {
+        i = (uint32_t)head;
+
+        if (i == SLAB_NIL) {
+            return SLAB_NIL;
+        }
+
+        update = ((head & ~(uint64_t)UINT32_MAX) + SLAB_TAG_INC)
+            | __atomic_load_n(&cache->next[i], __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n( &cache->depot, &head, update,
+                1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE ));
+
+    return i;
+}
+
+static void slab_magazines_flush (void* arg) {
+    slab_magazine_t* mags = (slab_magazine_t*)arg;
+
+    int slot;
+    for (slot = 0; slot < SLAB_MAX_CACHES; ++slot) {
+        slab_cache_t* cache =
+            __atomic_load_n(&slab_registry[slot], __ATOMIC_ACQUIRE);
+
+        if (cache == NULL || mags[slot].generation != cache->generation) {
+            continue;
+        }
+
+        while (mags[slot].count) {
+            depot_push( cache,
+                    slab_index(cache, mags[slot].objects[--mags[slot].count]) );
+        }
+    }
+}
+
+static void slab_magazines_key_create (void) {
+    pthread_key_create(&slab_magazines_key, slab_magazines_flush);
+}
+
+static inline slab_magazine_t* slab_magazine (slab_cache_t* cache) {
+    slab_magazine_t* mag = &slab_magazines[cache->slot];
+
+    /* Objects of a destroyed cache must not be handed out again */
+    if (mag->generation != cache->generation) {
+        mag->generation = cache->generation;
+        mag->count = 0;
+
+        pthread_once(&slab_magazines_once, slab_magazines_key_create);
+        pthread_setspecific(slab_magazines_key, slab_magazines);
+    }
+
+    return mag;
+}
+
+static inline void slab_count_alloc (slab_cache_t* cache) {
+    uint32_t in_use =
+        __atomic_add_fetch(&cache->in_use, 1, __ATOMIC_RELAXED);
+    uint32_t high_water =
+        __atomic_load_n(&cache->high_water, __ATOMIC_RELAXED);
+
+    while (in_use > high_water
+            && !__atomic_compare_exchange_n( &cache->high_water, &high_water,
+                in_use, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ))
+    {
+    }
+}
+
+int slab_cache_init (slab_cache_t* cache, const char* name,
+        size_t object_size, uint32_t objects)
+{
+    if (object_size == 0 || objects == 0 || objects >= SLAB_NIL) {
+        return EINVAL;
+    }
+
+    memset(cache, 0, sizeof(*cache));
+
+    cache->name = name;
+    cache->object_size = (object_size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+    cache->objects = objects;
+    cache->slot = -1;
+
+    if (posix_memalign( (void**)&cache->mem, SLAB_ALIGN,
+                (size_t)objects*cache->object_size ) != EOK)
+    {
+        cache->mem = NULL;
+
+        return ENOMEM;
+    }
+
+    if ((cache->next = malloc(objects*sizeof(uint32_t))) == NULL) {
+        free(cache->mem);
+        cache->mem = NULL;
+
+        return ENOMEM;
+    }
+
+    uint32_t i;
+    for (i = 0; i < objects; ++i) {
+        cache->next[i] = (i + 1 < objects) ? i + 1 : SLAB_NIL;
+    }
+
+    cache->depot = 0; // tag 0, top index 0
+
+    int slot;
+    for (slot = 0; slot < SLAB_MAX_CACHES; ++slot) {
+        slab_cache_t* expected = NULL;
+
+        if (__atomic_compare_exchange_n( &slab_registry[slot], &expected,
+                    cache, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ))
+        {
+            cache->slot = slot;
+            break;
+        }
+    }
+
+    if (cache->slot == -1) {
+        free(cache->next);
+        free(cache->mem);
+        cache->next = NULL;
+        cache->mem = NULL;
+
+        return ENOMEM;
+    }
+
+    cache->generation =
+        __atomic_add_fetch(&slab_generation, 1, __ATOMIC_RELAXED);
+
+    return EOK;
+}
+
+void slab_cache_destroy (slab_cache_t* cache) {
+    if (cache->slot != -1) {
+        __atomic_store_n(&slab_registry[cache->slot], NULL, __ATOMIC_RELEASE);
+        cache->slot = -1;
+    }
+
+    free(cache->next);
+    free(cache->mem);
+    cache->next = NULL;
+    cache->mem = NULL;
+}
+
+void* slab_alloc (slab_cache_t* cache) {
+    slab_magazine_t* mag = slab_magazine(cache);
+
+    if (mag->count == 0) {
+        /* Refill half the magazine from the depot */
+        while (mag->count < SLAB_MAGAZINE_SIZE/2) {
+            uint32_t i = depot_pop(cache);
+
+            if (i == SLAB_NIL) {
+                break;
+            }
+
+            mag->objects[mag->count++] = slab_object(cache, i);
+        }
+
+        if (mag->count == 0) {
+            __atomic_add_fetch(&cache->failures, 1, __ATOMIC_RELAXED);
+
+            return NULL;
+        }
+    }
+
+    slab_count_alloc(cache);
+
+    return mag->objects[--mag->count];
+}
+
+void slab_free (void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    slab_cache_t* cache = NULL;
+
+    int slot;
+    for (slot = 0; slot < SLAB_MAX_CACHES; ++slot) {
+        slab_cache_t* c =
+            __atomic_load_n(&slab_registry[slot], __ATOMIC_ACQUIRE);
+
+        if (c != NULL && (uint8_t*)ptr >= c->mem
+            && (uint8_t*)ptr < c->mem + (size_t)c->objects*c->object_size)
+        {
+            cache = c;
+            break;
+        }
+    }
+
+    if (cache == NULL) {
+        log_err("slab_free: BUG! %p not from any cache\n", ptr);
+
+        return;
+    }
+
+    __atomic_sub_fetch(&cache->in_use, 1, __ATOMIC_RELAXED);
+
+    slab_magazine_t* mag = slab_magazine(cache);
+
+    if (mag->count == SLAB_MAGAZINE_SIZE) {
+        /* Flush half the magazine to the depot */
+        while (mag->count > SLAB_MAGAZINE_SIZE/2) {
+            depot_push(cache, slab_index(cache, mag->objects[--mag->count]));
+        }
+    }
+
+    mag->objects[mag->count++] = ptr;
+}
+
+void slab_cache_stats (const slab_cache_t* cache, slab_stats_t* stats) {
+    stats->objects = cache->objects;
+    stats->in_use = __atomic_load_n(&cache->in_use, __ATOMIC_RELAXED);
+    stats->high_water = __atomic_load_n(&cache->high_water, __ATOMIC_RELAXED);
+    stats->failures = __atomic_load_n(&cache->failures, __ATOMIC_RELAXED);
+}
+
+int slab_memory_init (uint32_t objects) {
+    int err;
+
+    if ((err = slab_cache_init( &skb_cache, "skb",
+                    sizeof(struct sk_buff), objects )) != EOK)
+    {
+        return err;
+    }
+
+    if ((err = slab_cache_init( &skb_priv_cache, "skb_priv",
+                    sizeof(struct can_skb_priv), objects )) != EOK)
+    {
+        slab_cache_destroy(&skb_cache);
+
+        return err;
+    }
+
+    if ((err = slab_cache_init( &echo_cache, "echo",
+                    sizeof(struct can_skb_priv), objects )) != EOK)
+    {
+        slab_cache_destroy(&skb_priv_cache);
+        slab_cache_destroy(&skb_cache);
+
+        return err;
+    }
+
+    return EOK;
+}
@@ -0,0 +1,397 @@
+/*
+ * \file    threads.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sched.h>
+
+#include <linux/netdevice.h>
+
+#include "threads.h"
+
+
+static char* const thread_sub_opts[] = {
+    [THREAD_IRQ]        = "irq",
+    [THREAD_TX]         = "tx",
+    [THREAD_RX]         = "rx",
+    [THREAD_RESMGR]     = "resmgr",
+    [THREAD_TIMER]      = "timer",
+#define THREAD_OPT_ID       (NUM_THREAD_CLASSES + 0)
+    [THREAD_OPT_ID]     = "id",
+#define THREAD_OPT_FILE     (NUM_THREAD_CLASSES + 1)
+    [THREAD_OPT_FILE]   = "file",
+    NULL
+};
+
+#define THREAD_CONFIG_LINE_MAX  256
+
+/* Parse "prio[:cpus[:policy]]"; empty fields keep the defaults */
+static int parse_thread_sched (const char* value, thread_sched_t* sched) {
+    char buf[THREAD_CONFIG_LINE_MAX];
+    char* fields[3] = { NULL, NULL, NULL };
+    char* end;
+    int n = 0;
+
+    if (strlen(value) >= sizeof(buf)) {
+        return EINVAL;
+    }
+
+    strcpy(buf, value);
+    fields[n++] = buf;
+
+    for (end = buf; *end != '\0'; ++end) {
+        if (*end == ':') {
+            if (n == 3) {
+                return EINVAL;
+            }
+
+            *end = '\0';
+            fields[n++] = end + 1;
+        }
+    }
+
+    sched->policy = -1;
+    sched->priority = 0;
+    sched->runmask = 0;
+
+    if (*fields[0] != '\0') {
+        long prio = strtol(fields[0], &end, 10);
+
+        if (*end != '\0' || prio < 0
+            || prio > sched_get_priority_max(SCHED_FIFO))
+        {
+            return EINVAL;
+        }
+
+        sched->priority = prio;
+    }
+
+    if (fields[1] && *fields[1] != '\0') {
+        unsigned long mask = strtoul(fields[1], &end, 0);
+
+        if (*end != '\0' || mask > UINT32_MAX) {
+            return EINVAL;
+        }
+
+        sched->runmask = (uint32_t)mask;
+    }
+
+    if (fields[2] && *fields[2] != '\0') {
+        if (!strcmp(fields[2], "fifo")) {
+            sched->policy = SCHED_FIFO;
+        }
+        else if (!strcmp(fields[2], "rr")) {
+            sched->policy = SCHED_RR;
+        }
+        else if (!strcmp(fields[2], "other")) {
+            sched->policy = SCHED_OTHER;
+        }
+        else {
+            return EINVAL;
+        }
+    }
+
+    return EOK;
+}
+
+static thread_config_t* get_thread_config (int id) {
+    if (id < 0) {
+        return &optT_default;
+    }
+
+    if (num_optT_configs < id + 1) {
+        thread_config_t* new_optT_config;
+
+        int new_num_optT_configs = id + 1;
+        new_optT_config =
+            malloc(new_num_optT_configs*sizeof(thread_config_t));
+
+        if (new_optT_config == NULL) {
+            return NULL;
+        }
+
+        /* Fill all newly created configs with default settings */
+        int i;
+        for (i = num_optT_configs; i < new_num_optT_configs; ++i) {
+            int c;
+
+            new_optT_config[i].id = -1;
+            new_optT_config[i].classes = 0;
+
+            for (c = 0; c < NUM_THREAD_CLASSES; ++c) {
+                new_optT_config[i].sched[c] =
+                    (thread_sched_t){ .policy = -1 };
+            }
+        }
+
+        /* Copy previous configs to the new configs */
+        if (optT_config != NULL) {
+            memcpy( new_optT_config, optT_config,
+                    num_optT_configs*sizeof(thread_config_t) );
+
+            free(optT_config);
+        }
+
+        /* Set the configs to the new configs */
+        num_optT_configs = new_num_optT_configs;
+        optT_config = new_optT_config;
+    }
+
+    optT_config[id].id = id;
+
+    return &optT_config[id];
+}
+
+static int thread_config_file (const char* path) {
+    FILE* file;
+    char line[THREAD_CONFIG_LINE_MAX];
+    int lineno = 0;
+    int result = EOK;
+
+    if ((file = fopen(path, "r")) == NULL) {
+        printf("error: -T cannot open file %s: %s\n", path, strerror(errno));
+
+        return EINVAL;
+    }
+
+    while (result == EOK && fgets(line, sizeof(line), file) != NULL) {
+        char* begin = line;
+        char* end = line + strlen(line);
+
+        ++lineno;
+
+        while (isspace((unsigned char)*begin)) {
+            ++begin;
+        }
+
+        while (end > begin && isspace((unsigned char)end[-1])) {
+            *--end = '\0';
+        }
+
+        if (*begin == '\0' || *begin == '#') {
+            continue;
+        }
+
+        if (strstr(begin, "file=") != NULL) {
+            printf("error: -T file %s:%d cannot include files\n",
+                    path, lineno);
+
+            result = EINVAL;
+            break;
+        }
+
+        if ((result = thread_config_option(begin)) != EOK) {
+            printf("error: -T file %s:%d invalid\n", path, lineno);
+        }
+    }
+
+    fclose(file);
+
+    return result;
+}
+
+int thread_config_option (const char* option) {
+    char *copy, *options, *value;
+    thread_sched_t sched[NUM_THREAD_CLASSES];
+    unsigned classes = 0;
+    int id = -1;
+    int result = EOK;
+
+    if ((copy = strdup(option)) == NULL) {
+        printf("strdup failure\n");
+
+        return EINVAL;
+    }
+
+    options = copy;
+    while (result == EOK && *options != '\0') {
+        int subopt = getsubopt(&options, thread_sub_opts, &value);
+
+        if (subopt == -1) {
+            /* process unknown token */
+            printf("error: Unknown suboption for -T\n");
+            continue;
+        }
+
+        if (value == NULL) {
+            printf("error with %s sub-option\n", thread_sub_opts[subopt]);
+
+            result = EINVAL;
+            break;
+        }
+
+        switch (subopt) {
+        case THREAD_OPT_ID:     /* process id option */
+            id = atoi(value);
+
+            if (id < 0) {
+                printf("channel id (%d) invalid\n", id);
+
+                result = EINVAL;
+            }
+            break;
+
+        case THREAD_OPT_FILE:   /* process file option */
+            result = thread_config_file(value);
+            break;
+
+        default:                /* process thread class options */
+            if (parse_thread_sched(value, &sched[subopt]) != EOK) {
+                printf("invalid -T %s value: %s\n",
+                        thread_sub_opts[subopt], value);
+
+                result = EINVAL;
+            }
+
+            classes |= 1u << subopt;
+            break;
+        }
+    }
+
+    free(copy);
+
+    if (result != EOK || classes == 0) {
+        return result;
+    }
+
+    thread_config_t* config = get_thread_config(id);
+
+    if (config == NULL) {
+        printf("malloc failure\n");
+
+        return EINVAL;
+    }
+
+    int c;
+    for (c = 0; c < NUM_THREAD_CLASSES; ++c) {
+        if (classes & (1u << c)) {
+            config->sched[c] = sched[c];
+        }
+    }
+
+    config->classes |= classes;
+
+    return EOK;
+}
+
+void thread_config_finalize (void) {
+    int i, c;
+
+    for (i = 0; i < num_optT_configs; ++i) {
+        for (c = 0; c < NUM_THREAD_CLASSES; ++c) {
+            if (!(optT_config[i].classes & (1u << c))) {
+                optT_config[i].sched[c] = optT_default.sched[c];
+            }
+        }
+    }
+}
+
+const thread_sched_t* thread_sched (
+        const struct net_device* dev, thread_class_t cls )
+{
+    if (dev != NULL && dev->thread_config != NULL) {
+        return &dev->thread_config->sched[cls];
+    }
+
+    return &optT_default.sched[cls];
+}
+
+int thread_sched_priority (const thread_sched_t* sched, int default_priority) {
+    if (sched != NULL && sched->priority != 0) {
+        return sched->priority;
+    }
+
+    return default_priority;
+}
+
+void thread_sched_attr (pthread_attr_t* attr,
+        const thread_sched_t* sched, int default_priority)
+{
+    int priority = thread_sched_priority(sched, default_priority);
+    int policy = (sched != NULL) ? sched->policy : -1;
+
+    if (priority == 0 && policy == -1) {
+        return; // inherit
+    }
+
+    struct sched_param param;
+    int self_policy;
+    int err;
+
+    if ((err = pthread_getschedparam(pthread_self(), &self_policy, &param))
+            != EOK)
+    {
+        log_err("error pthread_getschedparam: %s\n", strerror(err));
+
+        return;
+    }
+
+    if (priority != 0) {
+        param.sched_priority = priority;
+    }
+
+    pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(attr, policy == -1 ? self_policy : policy);
+    pthread_attr_setschedparam(attr, &param);
+}
+
+void thread_sched_apply (const thread_sched_t* sched) {
+    if (sched == NULL) {
+        return;
+    }
+
+    if (sched->runmask) {
+        if (ThreadCtl( _NTO_TCTL_RUNMASK,
+                    (void*)(uintptr_t)sched->runmask ) == -1)
+        {
+            log_err("thread runmask 0x%x error; %s\n",
+                    sched->runmask, strerror(errno));
+        }
+    }
+
+    if (sched->priority == 0 && sched->policy == -1) {
+        return;
+    }
+
+    struct sched_param param;
+    int policy;
+    int err;
+
+    if ((err = pthread_getschedparam(pthread_self(), &policy, &param))
+            != EOK)
+    {
+        log_err("error pthread_getschedparam: %s\n", strerror(err));
+
+        return;
+    }
+
+    if (sched->priority != 0) {
+        param.sched_priority = sched->priority;
+    }
+
+    if (sched->policy != -1) {
+        policy = sched->policy;
+    }
+
+    if ((err = pthread_setschedparam(pthread_self(), policy, &param)) != EOK) {
+        log_err("error pthread_setschedparam: %s\n", strerror(err));
+    }
+}
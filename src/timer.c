@@ -18,51 +18,69 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <string.h>
+#include <unistd.h>
 #include <pthread.h>
 #include <sys/netmgr.h>
 
 #include "timer.h"
+#include "threads.h"
 
-/* check custom timer pulse codes are within safe range */
-#if _PULSE_CODE_SHUTDOWN_TIMER < _PULSE_CODE_MINAVAIL || \
-    _PULSE_CODE_SHUTDOWN_TIMER >= _PULSE_CODE_MAXAVAIL
-#error Invalid (_PULSE_CODE_SHUTDOWN_TIMER) safe range of pulse values is \
-    _PULSE_CODE_MINAVAIL through _PULSE_CODE_MAXAVAIL
-#endif
-
+/* check custom timer pulse code is within safe range */
 #if _PULSE_CODE_TIMER_TRIGGER < _PULSE_CODE_MINAVAIL || \
     _PULSE_CODE_TIMER_TRIGGER >= _PULSE_CODE_MAXAVAIL
 #error Invalid (_PULSE_CODE_TIMER_TRIGGER) safe range of pulse values is \
     _PULSE_CODE_MINAVAIL through _PULSE_CODE_MAXAVAIL
 #endif
 
-/* check custom timer pulse codes are unique */
-#if _PULSE_CODE_TIMER_TRIGGER == _PULSE_CODE_SHUTDOWN_TIMER
-#error _PULSE_CODE_SHUTDOWN_TIMER and _PULSE_CODE_TIMER_TRIGGER must have \
-    unique values
-#endif
-
 uint32_t user_timestamp = 0;
 uint32_t user_timestamp_time = 0;
 
+/* The timer service shared by all timers */
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t done;            /* signalled as each callback returns */
+
+    timer_wheel_t wheel;
+    uint64_t armed;                 /* tick the OS timer is set for */
+    timer_record_t* running;        /* callback in progress */
+
+    int chid;
+    struct sigevent event;
+    timer_t id;
+    pthread_t thread;
+} service = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER
+};
+
+static pthread_once_t service_once = PTHREAD_ONCE_INIT;
+
 static void* timer_loop (void* arg);
 
 
-static void create (timer_record_t* timer) {
-    if (timer == NULL) {
-        return;
-    }
+/* Current tick on the clock the OS timer runs on */
+static uint64_t current_tick (void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec*1000000000ULL + now.tv_nsec)
+        / (uint64_t)TIMER_INTERVAL_NS;
+}
 
+static void service_start (void) {
+    const thread_sched_t* sched = thread_sched(NULL, THREAD_TIMER);
     struct sched_param scheduling_params;
+    pthread_attr_t attr;
     int prio;
 
-    if (timer->created) {
-        return;
-    }
+    timer_wheel_init(&service.wheel, current_tick());
+    service.armed = TIMER_WHEEL_NEVER;
 
-    timer->chid = ChannelCreate(0);
+    service.chid = ChannelCreate(0);
 
-    if (timer->chid == -1) {
+    if (service.chid == -1) {
         log_err( "timer ChannelCreate error; %s\n",
                 strerror(errno) );
     }
@@ -75,70 +93,117 @@ static void create (timer_record_t* timer) {
         prio = 10;
     }
 
-    timer->event.sigev_notify = SIGEV_PULSE;
-    timer->event.sigev_coid =
-        ConnectAttach(ND_LOCAL_NODE, 0, timer->chid, _NTO_SIDE_CHANNEL, 0);
+    prio = thread_sched_priority(sched, prio);
 
-    if (timer->event.sigev_coid == -1) {
+    service.event.sigev_notify = SIGEV_PULSE;
+    service.event.sigev_coid =
+        ConnectAttach(ND_LOCAL_NODE, 0, service.chid, _NTO_SIDE_CHANNEL, 0);
+
+    if (service.event.sigev_coid == -1) {
         log_err( "timer ConnectAttach error; %s\n",
                 strerror(errno) );
     }
 
-    timer->event.sigev_priority = prio;
-    timer->event.sigev_code = _PULSE_CODE_TIMER_TRIGGER;
+    service.event.sigev_priority = prio;
+    service.event.sigev_code = _PULSE_CODE_TIMER_TRIGGER;
 
-    if (timer_create(CLOCK_MONOTONIC, &timer->event, &timer->id) == -1) {
+    if (timer_create(CLOCK_MONOTONIC, &service.event, &service.id) == -1) {
         log_err( "timer timer_create error; %s\n",
                 strerror(errno) );
     }
 
-    timer->started = 0;
+    /* Start the timer thread; pulses queue on the channel until it runs */
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    thread_sched_attr(&attr, sched, 0);
+    pthread_create(&service.thread, &attr, &timer_loop, NULL);
+    pthread_attr_destroy(&attr);
+}
 
-    /* Start the timer thread */
-    pthread_attr_init(&timer->attr);
-    pthread_attr_setdetachstate(&timer->attr, PTHREAD_CREATE_DETACHED);
-    pthread_create(NULL, &timer->attr, &timer_loop, timer);
+/* Set the OS timer for the wheel's next expiry if it is due earlier */
+static void arm_locked (void) {
+    uint64_t next = timer_wheel_next(&service.wheel);
 
-    while (timer->started == 0) {
-        usleep(1000);
+    if (next >= service.armed) {
+        return;
     }
 
-    timer->created = 1;
-}
+    uint64_t ns = next*(uint64_t)TIMER_INTERVAL_NS;
+    struct itimerspec itime = {
+        .it_value = {
+            .tv_sec = ns / 1000000000ULL,
+            .tv_nsec = ns % 1000000000ULL
+        }
+    };
 
-void destroy (timer_record_t* timer) {
-    if (timer == NULL) {
-        return;
-    }
+    if (timer_settime(service.id, TIMER_ABSTIME, &itime, NULL) == -1) {
+        log_err( "timer timer_settime error; %s\n",
+                strerror(errno) );
 
-    if (!timer->created) {
         return;
     }
 
-    if (MsgSendPulse(
-        timer->event.sigev_coid,
-        -1, _PULSE_CODE_SHUTDOWN_TIMER, 0 ) == -1)
+    service.armed = next;
+}
+
+static void run_callback (timer_record_t* timer) {
+    int prio = thread_sched_priority(timer->sched, 0);
+    struct sched_param param;
+    int policy;
+
+    if (prio == 0
+            || pthread_getschedparam(pthread_self(), &policy, &param) != EOK
+            || param.sched_priority == prio)
     {
-        log_err( "destroy timer MsgSendPulse error; %s\n",
-                strerror(errno) );
-    }
+        timer->callback(timer->data);
 
-    if (timer_delete(timer->id) == -1) {
-        log_err( "destroy timer timer_delete error; %s\n",
-                strerror(errno) );
+        return;
     }
 
-    if (ConnectDetach(timer->event.sigev_coid) == -1) {
-        log_err( "destroy timer ConnectDetach error; %s\n",
-                strerror(errno) );
-    }
+    pthread_setschedprio(pthread_self(), prio);
+    timer->callback(timer->data);
+    pthread_setschedprio(pthread_self(), param.sched_priority);
+}
 
-    if (ChannelDestroy(timer->chid) == -1) {
-        log_err( "destroy timer ChannelDestroy error; %s\n",
-                strerror(errno) );
+static void* timer_loop (void* arg) {
+    int             rcvid;
+    struct _pulse   pulse;
+
+    thread_sched_apply(thread_sched(NULL, THREAD_TIMER));
+
+    for (;;) {
+        rcvid = MsgReceive(service.chid, &pulse, sizeof(struct _pulse), NULL);
+
+        if (rcvid != 0 || pulse.code != _PULSE_CODE_TIMER_TRIGGER) {
+            continue; /* other messages and pulses ... */
+        }
+
+        uint64_t now = current_tick();
+        timer_entry_t* e;
+
+        pthread_mutex_lock(&service.mutex);
+
+        service.armed = TIMER_WHEEL_NEVER;
+
+        while ((e = timer_wheel_expire(&service.wheel, now)) != NULL) {
+            timer_record_t* timer = (timer_record_t*)e;
+
+            service.running = timer;
+            pthread_mutex_unlock(&service.mutex);
+
+            run_callback(timer);
+
+            pthread_mutex_lock(&service.mutex);
+            service.running = NULL;
+            pthread_cond_broadcast(&service.done);
+        }
+
+        arm_locked();
+
+        pthread_mutex_unlock(&service.mutex);
     }
 
-    timer->created = 0;
+    return NULL;
 }
 
 void setup_timer (timer_record_t* timer, void (*callback)(void*), void *data) {
@@ -150,36 +215,21 @@ void setup_timer (timer_record_t* timer, void (*callback)(void*), void *data) {
 
     log_trace( "setup_timer (%p)\n", timer);
 
-    timer->created = 0;
+    pthread_once(&service_once, service_start);
+
+    timer_entry_init(&timer->entry);
     timer->callback = callback;
     timer->data = data;
-
-    create(timer);
 }
 
-static void* timer_loop (void* arg) {
-    timer_record_t* timer = (timer_record_t*)arg;
-
-    int             rcvid;
-    struct _pulse   pulse;
-
-    timer->started = 1;
-
-    for (;;) {
-        rcvid = MsgReceive(timer->chid, &pulse, sizeof(struct _pulse), NULL);
-        if (rcvid == 0) { /* we got a pulse */
-            if (pulse.code == _PULSE_CODE_TIMER_TRIGGER) {
-                timer->callback(timer->data);
-            }
-	        else if (pulse.code == _PULSE_CODE_SHUTDOWN_TIMER) {
-	            log_trace("timer_loop shutdown\n");
-
-	            pthread_exit(NULL);
-            } /* else other pulses ... */
-        } /* else other messages ... */
+void set_timer_sched (timer_record_t* timer,
+        const struct thread_sched* sched)
+{
+    if (timer == NULL) {
+        return;
     }
 
-    return NULL;
+    timer->sched = sched;
 }
 
 void cancel_delayed_work_sync (timer_record_t* timer) {
@@ -191,7 +241,18 @@ void cancel_delayed_work_sync (timer_record_t* timer) {
 
     log_trace( "cancel_delayed_work_sync (%p)\n", timer);
 
-    destroy(timer);
+    pthread_mutex_lock(&service.mutex);
+
+    timer_wheel_del(&service.wheel, &timer->entry);
+
+    /* a callback cancelling its own timer can't wait for itself */
+    while (service.running == timer
+            && !pthread_equal(pthread_self(), service.thread))
+    {
+        pthread_cond_wait(&service.done, &service.mutex);
+    }
+
+    pthread_mutex_unlock(&service.mutex);
 }
 
 void schedule_delayed_work (timer_record_t* timer, int ticks) {
@@ -203,26 +264,17 @@ void schedule_delayed_work (timer_record_t* timer, int ticks) {
 
     log_trace( "schedule_delayed_work (%p)\n", timer);
 
-    create(timer);
-
-    struct itimerspec itime;
+    /* the next tick boundary on is the earliest the timer may fire at, so it
+     * never fires before the full delay has passed */
+    uint64_t expires = current_tick() + 1 + (ticks > 0 ? ticks : 0);
 
-    // first trigger, seconds:
-    itime.it_value.tv_sec = 0;
-    // first trigger, 0.1s in nanoseconds:
-    itime.it_value.tv_nsec = TIMER_INTERVAL_NS * ticks;
+    pthread_mutex_lock(&service.mutex);
 
-    // interval between triggers, seconds:
-    itime.it_interval.tv_sec = 0;
-    // interval between triggers, nanoseconds:
-    itime.it_interval.tv_nsec = 0;
+    timer_wheel_sync(&service.wheel, current_tick());
+    timer_wheel_add(&service.wheel, &timer->entry, expires);
+    arm_locked();
 
-    if (timer_settime(timer->id, 0, &itime, NULL) == -1) {
-        log_err( "schedule_delayed_work timer_settime error; %s\n",
-                strerror(errno) );
-    }
-
-    timer->created = 1;
+    pthread_mutex_unlock(&service.mutex);
 }
 
 uint64_t get_clock_time_us() {
@@ -234,3 +286,29 @@ uint64_t get_clock_time_us() {
 
     return ClockCycles() / cycles_per_us;
 }
+
+uint32_t user_timestamp_ms (uint64_t tstamp) {
+    if (optt) {
+        return user_timestamp;
+    }
+
+    if (user_timestamp_time != 0) {
+        return user_timestamp + tstamp/1000000 - user_timestamp_time;
+    }
+
+    return tstamp/1000000;
+}
+
+uint64_t get_clock_time_ns() {
+    static uint64_t cycles_per_sec = 0;
+
+    if (cycles_per_sec == 0) {
+        cycles_per_sec = SYSPAGE_ENTRY(qtime)->cycles_per_sec;
+    }
+
+    uint64_t cycles = ClockCycles();
+
+    /* split to avoid overflowing the 64-bit intermediate product */
+    return (cycles / cycles_per_sec) * 1000000000ULL
+        + ((cycles % cycles_per_sec) * 1000000000ULL) / cycles_per_sec;
+}
@@ -0,0 +1,222 @@
+/*
+ * \file    timerwheel.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "timerwheel.h"
+
+#define SLOT_MASK   (TIMER_WHEEL_SLOTS - 1)
+
+/* Slot of level holding tick */
+#define SLOT(tick, level) \
+    ((unsigned)((tick) >> (TIMER_WHEEL_BITS*(level))) & SLOT_MASK)
+
+
+void timer_wheel_init (timer_wheel_t* w, uint64_t now) {
+    int level, slot;
+
+    w->now = now;
+    w->pending = 0;
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        w->occupied[level] = 0;
+
+        for (slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot) {
+            timer_entry_t* head = &w->slot[level][slot];
+
+            head->prev = head->next = head;
+        }
+    }
+}
+
+void timer_wheel_sync (timer_wheel_t* w, uint64_t now) {
+    if (w->pending == 0 && now > w->now) {
+        w->now = now;
+    }
+}
+
+static void link_entry (timer_wheel_t* w, timer_entry_t* e) {
+    uint64_t delta = e->expires - w->now;
+    int level = 0;
+
+    while (level < TIMER_WHEEL_LEVELS - 1
+            && delta >> (TIMER_WHEEL_BITS*(level + 1)))
+    {
+        ++level;
+    }
+
+    timer_entry_t* head = &w->slot[level][SLOT(e->expires, level)];
+
+    e->level = level;
+    e->slot = SLOT(e->expires, level);
+    e->prev = head->prev;
+    e->next = head;
+    head->prev->next = e;
+    head->prev = e;
+
+    w->occupied[level] |= 1ULL << e->slot;
+}
+
+static void unlink_entry (timer_wheel_t* w, timer_entry_t* e) {
+    timer_entry_t* head = &w->slot[e->level][e->slot];
+
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+    e->prev = e->next = NULL;
+
+    if (head->next == head) {
+        w->occupied[e->level] &= ~(1ULL << e->slot);
+    }
+}
+
+void timer_wheel_add (timer_wheel_t* w, timer_entry_t* e, uint64_t expires) {
+    if (timer_entry_pending(e)) {
+        timer_wheel_del(w, e);
+    }
+
+    if (expires < w->now) {
+        expires = w->now;
+    }
+    else if (expires - w->now > TIMER_WHEEL_MAX_TICKS) {
+        expires = w->now + TIMER_WHEEL_MAX_TICKS;
+    }
+
+    e->expires = expires;
+    link_entry(w, e);
+
+    ++w->pending;
+}
+
+void timer_wheel_del (timer_wheel_t* w, timer_entry_t* e) {
+    if (!timer_entry_pending(e)) {
+        return;
+    }
+
+    unlink_entry(w, e);
+
+    --w->pending;
+}
+
+/* Move the timers of the higher level slots starting at w->now down */
+static void cascade (timer_wheel_t* w) {
+    int level;
+
+    for (level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+        unsigned slot = SLOT(w->now, level);
+        timer_entry_t* head = &w->slot[level][slot];
+
+        while (head->next != head) {
+            timer_entry_t* e = head->next;
+
+            unlink_entry(w, e);
+            link_entry(w, e);
+        }
+
+        if (slot != 0) {
+            break;
+        }
+    }
+}
+
+timer_entry_t* timer_wheel_expire (timer_wheel_t* w, uint64_t now) {
+    while (w->now <= now) {
+        if (w->pending == 0) {
+            w->now = now + 1;
+
+            break;
+        }
+
+        unsigned slot = SLOT(w->now, 0);
+        uint64_t ahead = w->occupied[0] >> slot;
+
+        if (ahead & 1) {
+            timer_entry_t* e = w->slot[0][slot].next;
+
+            timer_wheel_del(w, e);
+
+            return e;
+        }
+
+        if (ahead) {
+            /* next timer within this round of level 0 */
+            uint64_t tick = w->now + __builtin_ctzll(ahead);
+
+            if (tick <= now) {
+                w->now = tick;
+
+                continue;
+            }
+        }
+
+        /* up to now, or on to the next round; cascading as it starts */
+        uint64_t next = (w->now | SLOT_MASK) + 1;
+
+        if (next > now + 1) {
+            w->now = now + 1;
+
+            break;
+        }
+
+        w->now = next;
+        cascade(w);
+    }
+
+    return NULL;
+}
+
+uint64_t timer_wheel_next (const timer_wheel_t* w) {
+    if (w->pending == 0) {
+        return TIMER_WHEEL_NEVER;
+    }
+
+    uint64_t next = TIMER_WHEEL_NEVER;
+    int level;
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        uint64_t occupied = w->occupied[level];
+
+        if (occupied == 0) {
+            continue;
+        }
+
+        /* level 0 slots are due at their tick, higher level slots at their
+         * cascade; the cascade at w->now has already been done */
+        unsigned shift = TIMER_WHEEL_BITS*level;
+        uint64_t round = (uint64_t)TIMER_WHEEL_SLOTS << shift;
+        uint64_t base = w->now & ~(round - 1);
+        uint64_t from = level == 0 ? w->now : w->now + 1;
+        uint64_t first = (from - base + (1ULL << shift) - 1) >> shift;
+        uint64_t ahead = first < TIMER_WHEEL_SLOTS ?
+                occupied & (~0ULL << first) : 0;
+        uint64_t tick;
+
+        if (ahead) {
+            tick = base + ((uint64_t)__builtin_ctzll(ahead) << shift);
+        }
+        else {
+            tick = base + round
+                + ((uint64_t)__builtin_ctzll(occupied) << shift);
+        }
+
+        if (tick < next) {
+            next = tick;
+        }
+    }
+
+    return next;
+}
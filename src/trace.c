@@ -0,0 +1,103 @@
+/*
+ * \file    trace.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "trace.h"
+
+
+#if CONFIG_TRACE == 1
+
+trace_ring_t trace_rings[TRACE_RINGS];
+
+__thread int trace_ring = -1;
+__thread uint16_t trace_thread;
+
+static unsigned trace_next_ring = 0;
+
+int trace_ring_take (void) {
+    trace_thread = (uint16_t)pthread_self();
+    trace_ring = (int)(__atomic_fetch_add(
+            &trace_next_ring, 1, __ATOMIC_RELAXED) % TRACE_RINGS);
+
+    return trace_ring;
+}
+
+int trace_read (int r, uint64_t first, struct can_trace_record* out,
+        int max, int* count, uint64_t* next, uint64_t* head)
+{
+    if (r < 0 || r >= TRACE_RINGS || max < 0) {
+        return EINVAL;
+    }
+
+    trace_ring_t* ring = &trace_rings[r];
+    uint64_t end = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t pos = first;
+    int n = 0;
+
+    if (end > TRACE_RING_RECORDS && pos < end - TRACE_RING_RECORDS) {
+        pos = end - TRACE_RING_RECORDS;
+    }
+
+    for (; pos < end && n < max; ++pos) {
+        struct can_trace_record* rec =
+            &ring->record[pos & (TRACE_RING_RECORDS-1)];
+
+        uint32_t seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+
+        if (seq == (uint32_t)(pos + 1)) {
+            memcpy(&out[n], rec, sizeof(struct can_trace_record));
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) == seq) {
+                ++n;
+
+                continue;
+            }
+        }
+
+        /* Still being written by a thread sharing the ring; stop here and
+         * let the next read pick it up, unless it is being overwritten */
+        if (__atomic_load_n(&ring->head, __ATOMIC_RELAXED)
+                <= pos + TRACE_RING_RECORDS)
+        {
+            break;
+        }
+    }
+
+    *count = n;
+    *next = pos;
+    *head = end;
+
+    return EOK;
+}
+
+#else
+
+int trace_read (int r, uint64_t first, struct can_trace_record* out,
+        int max, int* count, uint64_t* next, uint64_t* head)
+{
+    return ENOSYS;
+}
+
+#endif
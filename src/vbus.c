@@ -0,0 +1,714 @@
+/*
+ * \file    vbus.c
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/can/dev.h>
+
+#include "vbus.h"
+
+#ifndef EOK
+#define EOK 0 // only QNX defines EOK
+#endif
+
+/* Default bus bitrate when neither -B nor the device sets one */
+#define VBUS_DEFAULT_BITRATE    250000
+
+/* Error flag (6) and error delimiter (8) bits */
+#define VBUS_ERROR_FRAME_BITS   (6 + 8)
+
+/* Bus-off recovery; 128 occurrences of 11 consecutive recessive bits */
+#define VBUS_BUS_OFF_BITS       (128 * 11)
+
+vbus_t vbus[VBUS_MAX_BUSES];
+int num_vbus = 0;
+
+enum {
+    VBUS_OPT_IDS = 0,
+    VBUS_OPT_BITRATE,
+    VBUS_OPT_STUFF,
+    VBUS_OPT_ERRORS,
+    VBUS_OPT_BUS_OFF,
+    VBUS_OPT_SEED
+};
+
+static char* const vbus_sub_opts[] = {
+    [VBUS_OPT_IDS]      = "ids",
+    [VBUS_OPT_BITRATE]  = "bitrate",
+    [VBUS_OPT_STUFF]    = "stuff",
+    [VBUS_OPT_ERRORS]   = "errors",
+    [VBUS_OPT_BUS_OFF]  = "busoff",
+    [VBUS_OPT_SEED]     = "seed",
+    NULL
+};
+
+static uint64_t vbus_now (void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void vbus_sleep_until (uint64_t ns) {
+    struct timespec ts = {
+        .tv_sec = ns / 1000000000ULL,
+        .tv_nsec = ns % 1000000000ULL
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+            == EINTR)
+    {
+    }
+}
+
+static uint64_t vbus_bits_ns (uint64_t bits, uint32_t bitrate) {
+    return bits * 1000000000ULL / bitrate;
+}
+
+uint64_t vbus_frame_ns (const frame_t* frame, uint32_t bitrate,
+        bool stuffing)
+{
+    unsigned bits = can_frame_bits(false, (frame->id & FRAME_EFF) != 0,
+            stuffing, true, frame->len);
+
+    return vbus_bits_ns(bits, bitrate);
+}
+
+/* xorshift64; good enough to space out injected events */
+static uint32_t vbus_rand (vbus_t* bus) {
+    uint64_t x = bus->rng;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+
+    bus->rng = x;
+
+    return (uint32_t)(x >> 32);
+}
+
+/* Whether an event at ppm per million frames occurs on this frame */
+static bool vbus_roll (vbus_t* bus, uint32_t ppm) {
+    if (ppm == 0) {
+        return false;
+    }
+
+    return (vbus_rand(bus) % 1000000) < ppm;
+}
+
+/*
+ * Arbitration field as it goes on the wire, most significant bit first; the
+ * lowest key wins. Standard frames have the dominant IDE bit where extended
+ * frames have theirs, so a standard frame beats an extended one with the
+ * same base id. frame_t carries no RTR flag, all frames are data frames.
+ */
+static uint32_t vbus_arbitration_key (const frame_t* frame) {
+    uint32_t id = frame->id & FRAME_ID_MASK;
+
+    if (frame->id & FRAME_EFF) {
+        /* base id, SRR (recessive), IDE (recessive), extended id */
+        return ((id >> 18) << 20) | (1u << 19) | (1u << 18) | (id & 0x3FFFF);
+    }
+
+    /* base id, RTR (dominant), IDE (dominant) */
+    return (id & 0x7FF) << 20;
+}
+
+static int vbus_parse_ids (vbus_t* bus, const char* value) {
+    const char* p = value;
+
+    while (*p != '\0') {
+        char* end;
+        long id = strtol(p, &end, 0);
+
+        if (end == p || id < 0 || (*end != ':' && *end != '\0')) {
+            return EINVAL;
+        }
+
+        if (bus->num_ids == VBUS_MAX_NODES) {
+            return EINVAL;
+        }
+
+        bus->ids[bus->num_ids++] = (int)id;
+
+        p = (*end == ':') ? end + 1 : end;
+    }
+
+    return (bus->num_ids > 0) ? EOK : EINVAL;
+}
+
+static int vbus_parse_bitrate (const char* value, uint32_t* bitrate) {
+    char* end;
+    double rate = strtod(value, &end);
+
+    if (end == value) {
+        return EINVAL;
+    }
+
+    if (*end == 'k' || *end == 'K') {
+        rate *= 1000;
+        ++end;
+    }
+    else if (*end == 'M' || *end == 'm') {
+        rate *= 1000000;
+        ++end;
+    }
+
+    if (*end != '\0' || rate < 1 || rate > 1000000) {
+        return EINVAL;
+    }
+
+    *bitrate = (uint32_t)rate;
+
+    return EOK;
+}
+
+static int vbus_parse_ppm (const char* value, uint32_t* ppm) {
+    char* end;
+    unsigned long n = strtoul(value, &end, 0);
+
+    if (end == value || *end != '\0' || n > 1000000) {
+        return EINVAL;
+    }
+
+    *ppm = (uint32_t)n;
+
+    return EOK;
+}
+
+int vbus_option (const char* option) {
+    char *copy, *options, *value;
+    int result = EOK;
+
+    if (num_vbus == VBUS_MAX_BUSES) {
+        printf("error: too many -B buses; max %d\n", VBUS_MAX_BUSES);
+
+        return EINVAL;
+    }
+
+    vbus_t* bus = &vbus[num_vbus];
+
+    memset(bus, 0, sizeof(vbus_t));
+    bus->index = num_vbus;
+    bus->stuffing = true;
+    bus->seed = 1;
+
+    if ((copy = strdup(option)) == NULL) {
+        printf("strdup failure\n");
+
+        return EINVAL;
+    }
+
+    options = copy;
+    while (result == EOK && *options != '\0') {
+        int subopt = getsubopt(&options, vbus_sub_opts, &value);
+
+        if (subopt == -1) {
+            printf("error: Unknown suboption for -B\n");
+
+            result = EINVAL;
+            break;
+        }
+
+        if (value == NULL) {
+            printf("error with %s sub-option\n", vbus_sub_opts[subopt]);
+
+            result = EINVAL;
+            break;
+        }
+
+        switch (subopt) {
+        case VBUS_OPT_IDS:
+            result = vbus_parse_ids(bus, value);
+            break;
+
+        case VBUS_OPT_BITRATE:
+            result = vbus_parse_bitrate(value, &bus->bitrate);
+            break;
+
+        case VBUS_OPT_STUFF:
+            if (strcmp(value, "worst") == 0) {
+                bus->stuffing = true;
+            }
+            else if (strcmp(value, "none") == 0) {
+                bus->stuffing = false;
+            }
+            else {
+                result = EINVAL;
+            }
+            break;
+
+        case VBUS_OPT_ERRORS:
+            result = vbus_parse_ppm(value, &bus->error_ppm);
+            break;
+
+        case VBUS_OPT_BUS_OFF:
+            result = vbus_parse_ppm(value, &bus->bus_off_ppm);
+            break;
+
+        case VBUS_OPT_SEED:
+            bus->seed = strtoull(value, NULL, 0);
+            break;
+        }
+
+        if (result != EOK) {
+            printf("invalid -B %s value: %s\n", vbus_sub_opts[subopt], value);
+        }
+    }
+
+    free(copy);
+
+    if (result != EOK) {
+        return result;
+    }
+
+    if (bus->num_ids == 0) {
+        printf("error: -B requires ids\n");
+
+        return EINVAL;
+    }
+
+    int i, j, k;
+    for (i = 0; i < bus->num_ids; ++i) {
+        for (j = 0; j <= num_vbus; ++j) {
+            for (k = 0; k < vbus[j].num_ids; ++k) {
+                if ((j != num_vbus || k != i)
+                        && vbus[j].ids[k] == bus->ids[i])
+                {
+                    printf("error: -B device id %d on more than one bus\n",
+                            bus->ids[i]);
+
+                    return EINVAL;
+                }
+            }
+        }
+    }
+
+    /* xorshift must not start from zero */
+    bus->rng = bus->seed ? bus->seed : 1;
+
+    ++num_vbus;
+
+    return EOK;
+}
+
+/* Error counters changed; let the node's device know */
+static void vbus_event (vbus_node_t* node, vbus_event_t event) {
+    if (node->event) {
+        node->event(node->arg, event, node->tec, node->rec);
+    }
+}
+
+static void vbus_go_bus_off (vbus_t* bus, vbus_node_t* node, uint64_t at) {
+    node->bus_off = true;
+    node->bus_off_until = at + vbus_bits_ns(VBUS_BUS_OFF_BITS, bus->bitrate);
+    node->pending = false;
+    node->bus_offs++;
+    bus->bus_offs++;
+
+    vbus_event(node, VBUS_EVENT_BUS_OFF);
+}
+
+/* Severity of a node's error state; changes are reported as events */
+static int vbus_error_state (const vbus_node_t* node) {
+    unsigned c = (node->tec > node->rec) ? node->tec : node->rec;
+
+    return (c >= VBUS_ERROR_PASSIVE) ? 2 : (c >= VBUS_ERROR_WARNING) ? 1 : 0;
+}
+
+/*
+ * Recover the nodes whose bus-off time is over; returns the end of the
+ * earliest recovery still to come, or 0 if no node is bus-off.
+ */
+static uint64_t vbus_recover (vbus_t* bus, uint64_t now) {
+    uint64_t next = 0;
+    int i;
+
+    for (i = 0; i < bus->num_nodes; ++i) {
+        vbus_node_t* node = bus->node[i];
+
+        if (!node->bus_off) {
+            continue;
+        }
+
+        if (now >= node->bus_off_until) {
+            node->bus_off = false;
+            node->tec = node->rec = 0;
+
+            vbus_event(node, VBUS_EVENT_BUS_ON);
+
+            pthread_cond_broadcast(&bus->done);
+        }
+        else if (next == 0 || node->bus_off_until < next) {
+            next = node->bus_off_until;
+        }
+    }
+
+    return next;
+}
+
+/*
+ * An error frame aborts the winner's frame; the sender counts a transmit
+ * error and the receivers a receive error each.
+ */
+static void vbus_error_frame (vbus_t* bus, vbus_node_t* sender,
+        uint64_t start)
+{
+    int i;
+
+    sender->error_frames++;
+    bus->error_frames++;
+
+    for (i = 0; i < bus->num_nodes; ++i) {
+        vbus_node_t* node = bus->node[i];
+
+        if (node == sender || node->bus_off) {
+            continue;
+        }
+
+        if (node->rec < 255) {
+            node->rec++;
+        }
+
+        vbus_event(node, VBUS_EVENT_RX_ERROR);
+    }
+
+    sender->tec += 8;
+
+    if (sender->tec >= VBUS_BUS_OFF) {
+        vbus_go_bus_off(bus, sender, start);
+    }
+    else {
+        vbus_event(sender, VBUS_EVENT_TX_ERROR);
+    }
+}
+
+/* A frame made it; error counters count back down */
+static void vbus_success (vbus_t* bus, vbus_node_t* sender) {
+    int i;
+
+    for (i = 0; i < bus->num_nodes; ++i) {
+        vbus_node_t* node = bus->node[i];
+        int state = vbus_error_state(node);
+
+        if (node->bus_off) {
+            continue;
+        }
+
+        if (node == sender) {
+            if (node->tec > 0) {
+                node->tec--;
+            }
+        }
+        else if (node->rec > 0) {
+            node->rec--;
+        }
+
+        if (vbus_error_state(node) != state) {
+            vbus_event(node, VBUS_EVENT_STATE);
+        }
+    }
+}
+
+static void* vbus_thread (void* arg) {
+    vbus_t* bus = (vbus_t*)arg;
+    vbus_node_t* receivers[VBUS_MAX_NODES];
+    frame_t frame;
+
+    pthread_mutex_lock(&bus->mutex);
+
+    while (!bus->stop) {
+        uint64_t now = vbus_now();
+        uint64_t next_recovery = vbus_recover(bus, now);
+
+        vbus_node_t* winner = NULL;
+        uint32_t winner_key = 0;
+        int contenders = 0;
+        int i;
+
+        for (i = 0; i < bus->num_nodes; ++i) {
+            vbus_node_t* node = bus->node[i];
+
+            if (!node->pending || node->bus_off) {
+                continue;
+            }
+
+            uint32_t key = vbus_arbitration_key(&node->frame);
+
+            if (winner == NULL || key < winner_key) {
+                winner = node;
+                winner_key = key;
+            }
+
+            ++contenders;
+        }
+
+        if (winner == NULL) {
+            if (next_recovery) {
+                struct timespec ts = {
+                    .tv_sec = next_recovery / 1000000000ULL,
+                    .tv_nsec = next_recovery % 1000000000ULL
+                };
+
+                pthread_cond_timedwait(&bus->cond, &bus->mutex, &ts);
+            }
+            else {
+                pthread_cond_wait(&bus->cond, &bus->mutex);
+            }
+
+            continue;
+        }
+
+        for (i = 0; i < bus->num_nodes; ++i) {
+            vbus_node_t* node = bus->node[i];
+
+            if (node != winner && node->pending && !node->bus_off) {
+                node->arbitration_lost++;
+            }
+        }
+
+        uint64_t start = (bus->idle_at > now) ? bus->idle_at : now;
+        unsigned bits = can_frame_bits(false,
+                (winner->frame.id & FRAME_EFF) != 0,
+                bus->stuffing, true, winner->frame.len);
+
+        if (vbus_roll(bus, bus->bus_off_ppm)) {
+            vbus_go_bus_off(bus, winner, start);
+            pthread_cond_broadcast(&bus->done);
+
+            continue;
+        }
+
+        if (vbus_roll(bus, bus->error_ppm)) {
+            /* abort at a bit of the frame proper, then error frame and
+             * intermission; the frame stays pending for retransmission */
+            unsigned at = 1 + vbus_rand(bus) %
+                    (bits - CAN_INTERMISSION_BITS);
+
+            bits = at + VBUS_ERROR_FRAME_BITS + CAN_INTERMISSION_BITS;
+
+            bus->bits += bits;
+            bus->idle_at = start + vbus_bits_ns(bits, bus->bitrate);
+
+            vbus_error_frame(bus, winner, start);
+
+            if (!winner->pending) {
+                pthread_cond_broadcast(&bus->done);
+            }
+
+            uint64_t idle_at = bus->idle_at;
+
+            pthread_mutex_unlock(&bus->mutex);
+            vbus_sleep_until(idle_at);
+            pthread_mutex_lock(&bus->mutex);
+
+            continue;
+        }
+
+        bus->frames++;
+        bus->bits += bits;
+        bus->idle_at = start + vbus_bits_ns(bits, bus->bitrate);
+        winner->tx_frames++;
+
+        vbus_success(bus, winner);
+
+        frame = winner->frame;
+
+        int num_receivers = 0;
+        for (i = 0; i < bus->num_nodes; ++i) {
+            if (!bus->node[i]->bus_off) {
+                receivers[num_receivers++] = bus->node[i];
+            }
+        }
+
+        uint64_t idle_at = bus->idle_at;
+
+        pthread_mutex_unlock(&bus->mutex);
+
+        vbus_sleep_until(idle_at);
+
+        frame_t echo = frame;
+        echo.id |= FRAME_ECHO;
+
+        for (i = 0; i < num_receivers; ++i) {
+            receivers[i]->deliver( receivers[i]->arg,
+                    (receivers[i] == winner) ? &echo : &frame, idle_at );
+        }
+
+        pthread_mutex_lock(&bus->mutex);
+
+        winner->pending = false;
+        pthread_cond_broadcast(&bus->done);
+    }
+
+    pthread_mutex_unlock(&bus->mutex);
+
+    return NULL;
+}
+
+static int vbus_start (vbus_t* bus) {
+    pthread_condattr_t attr;
+    int err;
+
+    if ((err = pthread_mutex_init(&bus->mutex, NULL)) != EOK) {
+        return err;
+    }
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+    pthread_cond_init(&bus->cond, &attr);
+    pthread_cond_init(&bus->done, NULL);
+
+    pthread_condattr_destroy(&attr);
+
+    bus->stop = false;
+    bus->idle_at = 0;
+
+    if ((err = pthread_create(&bus->thread, NULL, vbus_thread, bus)) != EOK) {
+        pthread_cond_destroy(&bus->done);
+        pthread_cond_destroy(&bus->cond);
+        pthread_mutex_destroy(&bus->mutex);
+
+        return err;
+    }
+
+    bus->running = true;
+
+    return EOK;
+}
+
+vbus_node_t* vbus_attach (int id, uint32_t bitrate,
+        void (*deliver)(void* arg, const frame_t* frame, uint64_t tstamp),
+        void (*event)(void* arg, vbus_event_t event,
+                unsigned tec, unsigned rec),
+        void* arg)
+{
+    vbus_t* bus = NULL;
+    int b, i;
+
+    for (b = 0; b < num_vbus && bus == NULL; ++b) {
+        for (i = 0; i < vbus[b].num_ids; ++i) {
+            if (vbus[b].ids[i] == id) {
+                bus = &vbus[b];
+                break;
+            }
+        }
+    }
+
+    if (bus == NULL) {
+        return NULL;
+    }
+
+    vbus_node_t* node = calloc(1, sizeof(vbus_node_t));
+
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->bus = bus;
+    node->id = id;
+    node->deliver = deliver;
+    node->event = event;
+    node->arg = arg;
+
+    if (!bus->running) {
+        if (bus->bitrate == 0) {
+            bus->bitrate = bitrate ? bitrate : VBUS_DEFAULT_BITRATE;
+        }
+
+        if (vbus_start(bus) != EOK) {
+            free(node);
+
+            return NULL;
+        }
+    }
+
+    pthread_mutex_lock(&bus->mutex);
+    bus->node[bus->num_nodes++] = node;
+    pthread_mutex_unlock(&bus->mutex);
+
+    return node;
+}
+
+int vbus_xmit (vbus_node_t* node, const frame_t* frame) {
+    vbus_t* bus = node->bus;
+
+    pthread_mutex_lock(&bus->mutex);
+
+    /* a bus-off device holds its frames until it is back on the bus */
+    while ((node->pending || node->bus_off) && !bus->stop) {
+        pthread_cond_wait(&bus->done, &bus->mutex);
+    }
+
+    if (!bus->stop) {
+        node->frame = *frame;
+        node->pending = true;
+
+        pthread_cond_signal(&bus->cond);
+
+        while (node->pending && !bus->stop) {
+            pthread_cond_wait(&bus->done, &bus->mutex);
+        }
+    }
+
+    pthread_mutex_unlock(&bus->mutex);
+
+    return EOK;
+}
+
+void vbus_cleanup (void) {
+    int b, i;
+
+    for (b = 0; b < num_vbus; ++b) {
+        vbus_t* bus = &vbus[b];
+
+        if (!bus->running) {
+            continue;
+        }
+
+        pthread_mutex_lock(&bus->mutex);
+        bus->stop = true;
+        pthread_cond_broadcast(&bus->cond);
+        pthread_cond_broadcast(&bus->done);
+        pthread_mutex_unlock(&bus->mutex);
+
+        pthread_join(bus->thread, NULL);
+
+        for (i = 0; i < bus->num_nodes; ++i) {
+            free(bus->node[i]);
+            bus->node[i] = NULL;
+        }
+
+        bus->num_nodes = 0;
+        bus->running = false;
+
+        pthread_cond_destroy(&bus->done);
+        pthread_cond_destroy(&bus->cond);
+        pthread_mutex_destroy(&bus->mutex);
+    }
+
+    num_vbus = 0;
+}
@@ -0,0 +1,213 @@
+/**
+ * \file    busload-tests.cpp
+ * \brief   Bus load measurement test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+
+extern "C" {
+    #include <frame.h>
+    #include <busload.h>
+}
+
+/* Unstuffed Classical CAN frame bits, intermission included */
+#define SFF_BITS(len)   (19 + 8*(len) + 16 + 2 + 7 + 3)
+#define EFF_BITS(len)   (39 + 8*(len) + 16 + 2 + 7 + 3)
+
+#define MS              1000000ULL
+
+class BusLoad : public ::testing::Test {
+protected:
+    busload_t bl;
+
+    void SetUp() override {
+        busload_init(&bl);
+    }
+
+    void TearDown() override {
+        busload_destroy(&bl);
+    }
+
+    const busload_id_t* find (uint32_t id) {
+        static busload_id_t ids[BUSLOAD_MAX_IDS];
+        int n = busload_ids(&bl, 0, ids, BUSLOAD_MAX_IDS);
+
+        for (int i = 0; i < n; ++i) {
+            if ((ids[i].key & ~BUSLOAD_KEY_USED) == id) {
+                return &ids[i];
+            }
+        }
+
+        return nullptr;
+    }
+};
+
+TEST_F( BusLoad, Bits ) {
+    busload_frame(&bl, 0x123, 8, false, 1*MS);
+    busload_frame(&bl, 0x123 | FRAME_EFF, 8, false, 2*MS);
+    busload_frame(&bl, 0x123, 8, true, 3*MS); // RTR carries no data
+
+    EXPECT_EQ(bl.frames, 3u);
+    EXPECT_EQ(bl.bits, SFF_BITS(8) + EFF_BITS(8) + SFF_BITS(0));
+
+    // standard and extended 0x123 are different ids
+    EXPECT_EQ(bl.num_ids, 2);
+}
+
+TEST_F( BusLoad, Windows ) {
+    const uint64_t start = 1000*MS;
+
+    // one 8 byte frame per ms for 2 s
+    for (uint64_t t = 0; t < 2000; ++t) {
+        busload_frame(&bl, 0x100, 8, false, start + t*MS);
+    }
+
+    uint64_t now = start + 2000*MS;
+    busload_window_t w;
+
+    busload_window(&bl, 100*MS, now, &w);
+    EXPECT_EQ(w.frames, 100u);
+    EXPECT_EQ(w.bits, 100u*SFF_BITS(8));
+
+    busload_window(&bl, 1000*MS, now, &w);
+    EXPECT_EQ(w.frames, 1000u);
+
+    // only 2 s of frames in the 10 s window
+    busload_window(&bl, 10000*MS, now, &w);
+    EXPECT_EQ(w.frames, 2000u);
+
+    // the bucket still filling is left out
+    busload_window(&bl, 100*MS, now + 5*MS, &w);
+    EXPECT_EQ(w.frames, 100u);
+
+    // frames age out of the window
+    busload_window(&bl, 100*MS, now + 50*MS, &w);
+    EXPECT_EQ(w.frames, 50u);
+
+    busload_window(&bl, 1000*MS, now + 20000*MS, &w);
+    EXPECT_EQ(w.frames, 0u);
+    EXPECT_EQ(w.bits, 0u);
+}
+
+TEST_F( BusLoad, FullWindow ) {
+    // one frame per 10 ms bucket for 12 s; the 10 s window spans 1000
+    for (uint64_t t = 0; t < 1200; ++t) {
+        busload_frame(&bl, 0x100, 8, false, 1000*MS + t*10*MS);
+    }
+
+    busload_window_t w;
+    busload_window(&bl, 10000*MS, 13000*MS, &w);
+
+    EXPECT_EQ(w.frames, 1000u);
+}
+
+TEST_F( BusLoad, RingWrap ) {
+    // buckets from one ring turn ago must not count
+    busload_frame(&bl, 0x100, 8, false, 5*MS);
+    busload_frame(&bl, 0x100, 8, false,
+            5*MS + BUSLOAD_BUCKETS*BUSLOAD_BUCKET_NS);
+
+    busload_window_t w;
+    busload_window(&bl, 10000*MS,
+            20*MS + BUSLOAD_BUCKETS*BUSLOAD_BUCKET_NS, &w);
+
+    EXPECT_EQ(w.frames, 1u);
+    EXPECT_EQ(bl.frames, 2u);
+}
+
+TEST_F( BusLoad, IntervalJitter ) {
+    // 0x200 every 10 ms exactly, 0x300 alternating 8 and 12 ms
+    uint64_t t300 = 0;
+
+    for (int i = 0; i < 400; ++i) {
+        busload_frame(&bl, 0x200, 1, false, i*10*MS);
+
+        busload_frame(&bl, 0x300, 1, false, t300);
+        t300 += (i % 2) ? 12*MS : 8*MS;
+    }
+
+    const busload_id_t* a = find(0x200);
+    ASSERT_NE(a, nullptr);
+    EXPECT_EQ(a->frames, 400u);
+    EXPECT_EQ(a->interval, 10*MS);
+    EXPECT_EQ(a->jitter, 0u);
+    EXPECT_EQ(a->last, 399*10*MS);
+
+    const busload_id_t* b = find(0x300);
+    ASSERT_NE(b, nullptr);
+    EXPECT_NEAR((double)b->interval, 10.0*MS, 0.3*MS);
+    EXPECT_NEAR((double)b->jitter, 2.0*MS, 0.3*MS);
+}
+
+TEST_F( BusLoad, TableFull ) {
+    for (uint32_t id = 0; id < BUSLOAD_MAX_IDS + 10; ++id) {
+        busload_frame(&bl, id, 0, false, id*MS);
+    }
+
+    EXPECT_EQ(bl.num_ids, BUSLOAD_MAX_IDS);
+    EXPECT_EQ(bl.other_frames, 10u);
+
+    // paged copies cover the table once
+    busload_id_t ids[32];
+    int total = 0, n;
+
+    while ((n = busload_ids(&bl, total, ids, 32)) > 0) {
+        total += n;
+    }
+
+    EXPECT_EQ(total, BUSLOAD_MAX_IDS);
+
+    // frames of known ids are still counted per id
+    busload_frame(&bl, 5, 0, false, 1000*MS);
+    ASSERT_NE(find(5), nullptr);
+    EXPECT_EQ(find(5)->frames, 2u);
+    EXPECT_EQ(bl.other_frames, 10u);
+}
+
+TEST_F( BusLoad, ProbeLimit ) {
+    // ids a multiple of BUSLOAD_MAX_IDS apart share their first slot
+    for (uint32_t k = 0; k < BUSLOAD_MAX_PROBES + 3; ++k) {
+        busload_frame(&bl, k*BUSLOAD_MAX_IDS, 0, false, k*MS);
+    }
+
+    EXPECT_EQ(bl.num_ids, BUSLOAD_MAX_PROBES);
+    EXPECT_EQ(bl.other_frames, 3u);
+    EXPECT_EQ(bl.frames, BUSLOAD_MAX_PROBES + 3u);
+
+    ASSERT_NE(find(0), nullptr);
+    EXPECT_EQ(find(BUSLOAD_MAX_PROBES*BUSLOAD_MAX_IDS), nullptr);
+}
+
+TEST_F( BusLoad, ResetIds ) {
+    busload_frame(&bl, 0x10, 0, false, 1*MS);
+    busload_frame(&bl, 0x20, 0, false, 2*MS);
+
+    busload_reset_ids(&bl);
+
+    EXPECT_EQ(bl.num_ids, 0);
+    EXPECT_EQ(find(0x10), nullptr);
+
+    // the load totals are kept
+    EXPECT_EQ(bl.frames, 2u);
+
+    busload_frame(&bl, 0x10, 0, false, 3*MS);
+    ASSERT_NE(find(0x10), nullptr);
+    EXPECT_EQ(find(0x10)->frames, 1u);
+}
@@ -0,0 +1,104 @@
+/**
+ * \file    config-tests.cpp
+ * \brief   Program option parsing test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+
+extern "C" {
+    #include <config.h>
+    #include <threads.h>
+}
+
+/* Options growing each table past the others, interleaved */
+TEST( Config, RepeatedOptions ) {
+    EXPECT_EQ(thread_config_option("id=1,rx=20"), EOK);
+    EXPECT_EQ(poll_config_option("id=0"), EOK);
+    EXPECT_EQ(irq_config_option("id=0,prio=25"), EOK);
+    EXPECT_EQ(poll_config_option("id=3,frames=8,window=500"), EOK);
+    EXPECT_EQ(thread_config_option("id=4,tx=40:0x3:fifo"), EOK);
+    EXPECT_EQ(irq_config_option("id=2,prio=30,cpus=0x4"), EOK);
+    EXPECT_EQ(poll_config_option("id=6,budget=4"), EOK);
+    EXPECT_EQ(irq_config_option("id=5,attach"), EOK);
+    EXPECT_EQ(thread_config_option("timer=12"), EOK);
+    EXPECT_EQ(thread_config_option("id=1,irq=50"), EOK);
+
+    thread_config_finalize();
+
+    // -T
+    ASSERT_EQ(num_optT_configs, 5u);
+
+    EXPECT_EQ(optT_config[1].id, 1);
+    EXPECT_EQ(optT_config[1].sched[THREAD_RX].priority, 20);
+    EXPECT_EQ(optT_config[1].sched[THREAD_IRQ].priority, 50);
+    EXPECT_EQ(optT_config[1].sched[THREAD_TIMER].priority, 12); // default
+
+    EXPECT_EQ(optT_config[4].id, 4);
+    EXPECT_EQ(optT_config[4].sched[THREAD_TX].priority, 40);
+    EXPECT_EQ(optT_config[4].sched[THREAD_TX].runmask, 0x3u);
+    EXPECT_EQ(optT_config[4].sched[THREAD_TX].policy, SCHED_FIFO);
+    EXPECT_EQ(optT_config[4].sched[THREAD_RX].priority, 0);
+
+    EXPECT_EQ(optT_config[0].id, -1);
+    EXPECT_EQ(optT_config[2].id, -1);
+    EXPECT_EQ(optT_config[3].classes, 0u);
+
+    EXPECT_EQ(optT_default.sched[THREAD_TIMER].priority, 12);
+
+    // -p
+    ASSERT_EQ(num_optp_configs, 7u);
+
+    EXPECT_EQ(optp_config[0].id, 0);
+    EXPECT_EQ(optp_config[0].frames, DEFAULT_POLL_FRAMES);
+    EXPECT_EQ(optp_config[3].id, 3);
+    EXPECT_EQ(optp_config[3].frames, 8);
+    EXPECT_EQ(optp_config[3].window_us, 500);
+    EXPECT_EQ(optp_config[6].budget, 4);
+    EXPECT_EQ(optp_config[6].period_us, DEFAULT_POLL_PERIOD_US);
+    EXPECT_EQ(optp_config[1].id, -1);
+    EXPECT_EQ(optp_config[5].id, -1);
+
+    // -I
+    ASSERT_EQ(num_optI_configs, 6u);
+
+    EXPECT_EQ(optI_config[0].priority, 25);
+    EXPECT_EQ(optI_config[2].id, 2);
+    EXPECT_EQ(optI_config[2].priority, 30);
+    EXPECT_EQ(optI_config[2].runmask, 0x4u);
+    EXPECT_EQ(optI_config[5].per_attach, 1);
+    EXPECT_EQ(optI_config[5].priority, 0);
+    EXPECT_EQ(optI_config[1].id, -1);
+    EXPECT_EQ(optI_config[4].id, -1);
+}
+
+TEST( Config, InvalidOptions ) {
+    size_t p = num_optp_configs;
+    size_t I = num_optI_configs;
+
+    EXPECT_EQ(poll_config_option("frames=8"), EINVAL);      // no id
+    EXPECT_EQ(poll_config_option("id=9,budget=0"), EINVAL);
+    EXPECT_EQ(poll_config_option("id=9,idle"), EINVAL);
+    EXPECT_EQ(irq_config_option("prio=10"), EINVAL);        // no id
+    EXPECT_EQ(irq_config_option("id=9,cpus=0x1z"), EINVAL);
+    EXPECT_EQ(thread_config_option("id=9,rx=abc"), EINVAL);
+
+    EXPECT_EQ(num_optp_configs, p);
+    EXPECT_EQ(num_optI_configs, I);
+}
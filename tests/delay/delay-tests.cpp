@@ -0,0 +1,100 @@
+/**
+ * \file    delay-tests.cpp
+ * \brief   Short delay test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+
+extern "C" {
+    #include <timer.h>
+    #include <delay.h>
+}
+
+/* Microseconds taken by delay_ns(ns) */
+static double time_delay_us (uint64_t ns) {
+    uint64_t start = get_clock_time_ns();
+
+    delay_ns(ns);
+
+    return (get_clock_time_ns() - start) / 1000.0;
+}
+
+TEST( Delay, Short ) {
+    for (uint64_t us : { 1, 10, 100, 300 }) {
+        double t = time_delay_us(us*1000);
+
+        // must not return earlier than requested
+        EXPECT_GE(t, (double)us) << us << " us";
+
+#ifdef TESTING_REAL_HARDWARE
+        // spun, not slept to the next tick
+        EXPECT_LT(t, us + 50.0) << us << " us";
+#else
+        // leave room for a slow or virtualized test machine
+        EXPECT_LT(t, us + 5000.0) << us << " us";
+#endif
+    }
+}
+
+TEST( Delay, Long ) {
+    double t = time_delay_us(10000000); // 10 ms
+
+    EXPECT_GE(t, 10000.0);
+
+#ifdef TESTING_REAL_HARDWARE
+    EXPECT_LT(t, 10100.0);
+#else
+    EXPECT_LT(t, 40000.0);
+#endif
+}
+
+TEST( Delay, Range ) {
+    uint64_t start = get_clock_time_ns();
+
+    delay_range_us(300, 400);
+
+    double t = (get_clock_time_ns() - start) / 1000.0;
+
+    EXPECT_GE(t, 300.0);
+
+#ifdef TESTING_REAL_HARDWARE
+    EXPECT_LT(t, 400.0);
+#else
+    EXPECT_LT(t, 5300.0);
+#endif
+
+    start = get_clock_time_ns();
+
+    delay_range_us(5000, 6000);
+
+    t = (get_clock_time_ns() - start) / 1000.0;
+
+    EXPECT_GE(t, 5000.0);
+
+#ifdef TESTING_REAL_HARDWARE
+    EXPECT_LT(t, 7500.0);
+#else
+    EXPECT_LT(t, 40000.0);
+#endif
+}
+
+TEST( Delay, Zero ) {
+    EXPECT_LT(time_delay_us(0), 1000.0);
+}
@@ -0,0 +1,124 @@
+/**
+ * \file    devstats-tests.cpp
+ * \brief   Device statistics test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+
+extern "C" {
+    #include <devstats.h>
+}
+
+class DevStats : public ::testing::Test {
+protected:
+    devstats_t slots[DEVSTATS_SLOTS];
+
+    void SetUp() override {
+        memset(slots, 0, sizeof(slots));
+    }
+
+    int slots_used (size_t offset) {
+        int n = 0;
+
+        for (int i = 0; i < DEVSTATS_SLOTS; ++i) {
+            if (*(uint64_t*)((uint8_t*)&slots[i] + offset)) {
+                ++n;
+            }
+        }
+
+        return n;
+    }
+};
+
+TEST_F( DevStats, Layout ) {
+    EXPECT_EQ(sizeof(devstats_t) % DEVSTATS_ALIGN, 0u);
+    EXPECT_EQ((uintptr_t)&slots[1] % DEVSTATS_ALIGN, 0u);
+    EXPECT_EQ(DEVSTATS_COUNTERS*sizeof(uint64_t),
+            offsetof(devstats_t, alloc_failures) + sizeof(uint64_t));
+}
+
+TEST_F( DevStats, ThreadSlots ) {
+    // each new thread counts into a slot of its own, until they run out
+    for (int i = 0; i < DEVSTATS_SLOTS; ++i) {
+        std::thread t([&] {
+            DEVSTATS_INC(slots, rx_packets);
+            DEVSTATS_ADD(slots, rx_bytes, 8);
+        });
+
+        t.join();
+    }
+
+    EXPECT_EQ(slots_used(offsetof(devstats_t, rx_packets)), DEVSTATS_SLOTS);
+    EXPECT_EQ(DEVSTATS_READ(slots, rx_packets), (uint64_t)DEVSTATS_SLOTS);
+    EXPECT_EQ(DEVSTATS_READ(slots, rx_bytes), 8u*DEVSTATS_SLOTS);
+
+    // the calling thread keeps its slot
+    DEVSTATS_INC(slots, tx_packets);
+    DEVSTATS_INC(slots, tx_packets);
+    EXPECT_EQ(slots_used(offsetof(devstats_t, tx_packets)), 1);
+    EXPECT_EQ(slots[devstats_slot].tx_packets, 2u);
+}
+
+TEST_F( DevStats, Concurrent ) {
+    // more threads than slots, so some of them share one
+    const int n = 2*DEVSTATS_SLOTS + 3;
+    const int count = 20000;
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < n; ++i) {
+        threads.emplace_back([&] {
+            for (int j = 0; j < count; ++j) {
+                DEVSTATS_INC(slots, tx_packets);
+                DEVSTATS_INC(slots, interrupts);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(DEVSTATS_READ(slots, tx_packets), (uint64_t)n*count);
+    EXPECT_EQ(DEVSTATS_READ(slots, interrupts), (uint64_t)n*count);
+}
+
+TEST_F( DevStats, Read ) {
+    std::thread t([&] {
+        DEVSTATS_INC(slots, rx_packets);
+        DEVSTATS_INC(slots, alloc_failures);
+        DEVSTATS_ADD(slots, bus_off, 3);
+    });
+    t.join();
+
+    DEVSTATS_INC(slots, rx_packets);
+    DEVSTATS_INC(slots, alloc_failures);
+
+    devstats_t sum;
+    devstats_read(slots, &sum);
+
+    EXPECT_EQ(sum.rx_packets, 2u);
+    EXPECT_EQ(sum.alloc_failures, 2u);
+    EXPECT_EQ(sum.bus_off, 3u);
+    EXPECT_EQ(sum.tx_packets, 0u);
+    EXPECT_EQ(sum.rx_latency_drops, 0u);
+}
@@ -64,4 +64,15 @@ static inline std::string get_device1_tx0 (void) {
     return std::string("");
 }
 
+/* Driver binary the tests start instances of their own with */
+static inline std::string get_driver_binary (void) {
+    char* bin = getenv("DRIVER_TEST_BINARY");
+
+    if (bin != NULL) {
+        return std::string(bin);
+    }
+
+    return std::string("dev-can-linux");
+}
+
 #endif /* TESTS_DRIVER_COMMON_H_ */
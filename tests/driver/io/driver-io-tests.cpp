@@ -20,12 +20,18 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <fcntl.h>
 #include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/select.h>
+#include <vector>
 #include <gtest/gtest.h>
 #include <tests/driver/common/test_devices.h>
 
 extern "C" {
     #include <timer.h>
+    #include <waitq.h>
     #include <dev-can-linux/commands.h>
 }
 
@@ -339,6 +345,24 @@ TEST( IO, SingleSendMultiReceive ) {
     uint32_t initial_tx_interrupts = stats.tx_interrupts;
     uint32_t initial_total_interrupts = stats.total_interrupts;
 
+    struct can_ext_stats ext_stats;
+
+    EXPECT_EQ(get_ext_stats(fd, &ext_stats), EOK);
+
+    uint64_t initial_ext_tx_packets = ext_stats.tx_packets;
+    uint64_t initial_ext_rx_dropped = ext_stats.rx_dropped;
+
+    struct can_latency latency = { .scope = CAN_LATENCY_DEVICE, .reset = 0 };
+
+    EXPECT_EQ(get_latency(fd, &latency), EOK);
+
+    uint64_t initial_tx_queue_samples = 0;
+
+    for (int b = 0; b < CAN_LATENCY_BUCKETS; ++b) {
+        initial_tx_queue_samples +=
+            latency.stage[CAN_LATENCY_TX_QUEUE].count[b];
+    }
+
     int set_mid_ret = set_mid(fd, wrong_mid);
 
     EXPECT_EQ(set_mid_ret, EOK);
@@ -396,5 +420,507 @@ TEST( IO, SingleSendMultiReceive ) {
     EXPECT_EQ(stats.power_down_count, 0);
     EXPECT_EQ(stats.wake_up_count, 0);
 
+    EXPECT_EQ(get_ext_stats(fd, &ext_stats), EOK);
+
+    EXPECT_EQ(ext_stats.tx_packets - initial_ext_tx_packets, 4);
+    EXPECT_EQ(ext_stats.rx_dropped - initial_ext_rx_dropped, 0);
+    EXPECT_EQ(ext_stats.interrupts, 0);
+
+    EXPECT_EQ(get_latency(fd, &latency), EOK);
+
+    uint64_t tx_queue_samples = 0;
+
+    for (int b = 0; b < CAN_LATENCY_BUCKETS; ++b) {
+        tx_queue_samples += latency.stage[CAN_LATENCY_TX_QUEUE].count[b];
+    }
+
+    EXPECT_EQ(tx_queue_samples - initial_tx_queue_samples, 4);
+
+    // the TX channel's own session takes no frames
+    latency.scope = CAN_LATENCY_SESSION;
+    EXPECT_EQ(get_latency(fd, &latency), EOK);
+    EXPECT_EQ(latency.stage[CAN_LATENCY_RX_WAKE].max_ns, 0);
+
     close(fd);
 }
+
+TEST( IO, RecordModeWrite ) {
+    const int n = 5;
+
+    int fd_tx = open(get_device0_tx0().c_str(), O_RDWR);
+    int fd_rx = open(get_device0_rx0().c_str(), O_RDWR);
+
+    EXPECT_NE(fd_tx, -1);
+    EXPECT_NE(fd_rx, -1);
+
+    EXPECT_EQ(set_record_mode(fd_tx, 1), EOK);
+    EXPECT_EQ(set_record_mode(fd_rx, 1), EOK);
+
+    struct can_msg out[n], in[n];
+
+    memset(out, 0, sizeof(out));
+    memset(in, 0, sizeof(in));
+
+    for (int i = 0; i < n; ++i) {
+        out[i].mid = 0x120 + i;
+        out[i].len = 8;
+
+        for (int j = 0; j < 8; ++j) {
+            out[i].dat[j] = 8*i + j;
+        }
+    }
+
+    // all the records in one write
+    EXPECT_EQ(write(fd_tx, out, sizeof(out)), (ssize_t)sizeof(out));
+
+    // a partial record isn't accepted
+    EXPECT_EQ(write(fd_tx, out, sizeof(struct can_msg) + 1), -1);
+    EXPECT_EQ(errno, EINVAL);
+
+    int received = 0;
+
+    while (received < n) {
+        ssize_t r = read( fd_rx, &in[received],
+                (n - received)*sizeof(struct can_msg) );
+
+        ASSERT_GT(r, 0);
+        EXPECT_EQ(r % sizeof(struct can_msg), 0);
+
+        received += r/sizeof(struct can_msg);
+    }
+
+    EXPECT_EQ(received, n);
+
+    for (int i = 0; i < n; ++i) {
+        EXPECT_EQ(in[i].mid, out[i].mid);
+        EXPECT_EQ(in[i].len, out[i].len);
+        EXPECT_EQ(memcmp(in[i].dat, out[i].dat, 8), 0);
+    }
+
+    set_record_mode(fd_tx, 0);
+    set_record_mode(fd_rx, 0);
+
+    close(fd_rx);
+    close(fd_tx);
+}
+
+/* Read n records from fd_rx and compare them with out */
+static void io_expect_records (int fd_rx, const struct can_msg* out, int n) {
+    std::vector<struct can_msg> in(n);
+    int received = 0;
+
+    while (received < n) {
+        ssize_t r = read( fd_rx, &in[received],
+                (n - received)*sizeof(struct can_msg) );
+
+        ASSERT_GT(r, 0);
+        EXPECT_EQ(r % sizeof(struct can_msg), 0);
+
+        received += r/sizeof(struct can_msg);
+    }
+
+    for (int i = 0; i < n; ++i) {
+        EXPECT_EQ(in[i].mid, out[i].mid) << "record " << i;
+        EXPECT_EQ(memcmp(in[i].dat, out[i].dat, 8), 0) << "record " << i;
+    }
+}
+
+TEST( IO, RecordModeBulkWrite ) {
+    const int n = 200; // well over the device transmit queue
+
+    int fd_tx = open(get_device0_tx0().c_str(), O_RDWR);
+    int fd_rx = open(get_device0_rx0().c_str(), O_RDWR);
+
+    EXPECT_NE(fd_tx, -1);
+    EXPECT_NE(fd_rx, -1);
+
+    EXPECT_EQ(set_record_mode(fd_tx, 1), EOK);
+    EXPECT_EQ(set_record_mode(fd_rx, 1), EOK);
+
+    std::vector<struct can_msg> out(n);
+
+    for (int i = 0; i < n; ++i) {
+        memset(&out[i], 0, sizeof(out[i]));
+
+        out[i].mid = 0x200 + i;
+        out[i].len = 8;
+
+        for (int j = 0; j < 8; ++j) {
+            out[i].dat[j] = i + j;
+        }
+    }
+
+    // a blocking write takes all the records, waiting for queue space
+    EXPECT_EQ( write(fd_tx, out.data(), n*sizeof(struct can_msg)),
+            (ssize_t)(n*sizeof(struct can_msg)) );
+
+    io_expect_records(fd_rx, out.data(), n);
+
+    // a non-blocking write ends short at whole records instead
+    int flags = fcntl(fd_tx, F_GETFL);
+    EXPECT_EQ(fcntl(fd_tx, F_SETFL, flags | O_NONBLOCK), 0);
+
+    int sent = 0;
+    bool short_write = false;
+
+    while (sent < n) {
+        ssize_t r = write( fd_tx, &out[sent],
+                (n - sent)*sizeof(struct can_msg) );
+
+        if (r == -1) {
+            ASSERT_EQ(errno, EAGAIN);
+
+            short_write = true;
+            usleep(1000);
+
+            continue;
+        }
+
+        EXPECT_EQ(r % sizeof(struct can_msg), 0);
+
+        if (r < (ssize_t)((n - sent)*sizeof(struct can_msg))) {
+            short_write = true;
+        }
+
+        sent += r/sizeof(struct can_msg);
+    }
+
+    EXPECT_TRUE(short_write);
+
+    io_expect_records(fd_rx, out.data(), n);
+
+    fcntl(fd_tx, F_SETFL, flags);
+
+    set_record_mode(fd_tx, 0);
+    set_record_mode(fd_rx, 0);
+
+    close(fd_rx);
+    close(fd_tx);
+}
+
+TEST( IO, ReadPartialBuffer ) {
+    int fd_tx = open(get_device0_tx0().c_str(), O_RDWR);
+    int fd_rx = open(get_device0_rx0().c_str(), O_RDWR);
+
+    EXPECT_NE(fd_tx, -1);
+    EXPECT_NE(fd_rx, -1);
+
+    // Record mode; only whole records are returned
+    EXPECT_EQ(set_record_mode(fd_tx, 1), EOK);
+    EXPECT_EQ(set_record_mode(fd_rx, 1), EOK);
+
+    struct can_msg out[3], in[3];
+
+    memset(out, 0, sizeof(out));
+    memset(in, 0, sizeof(in));
+
+    for (int i = 0; i < 3; ++i) {
+        out[i].mid = 0x130 + i;
+        out[i].len = 4;
+        out[i].dat[0] = i;
+    }
+
+    EXPECT_EQ(write(fd_tx, out, sizeof(out)), (ssize_t)sizeof(out));
+
+    // a buffer too small for a single record
+    char small[sizeof(struct can_msg) - 1];
+
+    EXPECT_EQ(read(fd_rx, small, sizeof(small)), -1);
+    EXPECT_EQ(errno, EINVAL);
+
+    // room for two and a half records
+    char buf[2*sizeof(struct can_msg) + sizeof(struct can_msg)/2];
+    int received = 0;
+
+    while (received < 3) {
+        ssize_t r = read(fd_rx, buf, sizeof(buf));
+
+        ASSERT_GT(r, 0);
+        EXPECT_EQ(r % sizeof(struct can_msg), 0);
+        EXPECT_LE(r, (ssize_t)(2*sizeof(struct can_msg)));
+
+        int k = r/sizeof(struct can_msg);
+
+        ASSERT_LE(received + k, 3);
+        memcpy(&in[received], buf, r);
+
+        received += k;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(in[i].mid, out[i].mid);
+        EXPECT_EQ(in[i].len, out[i].len);
+        EXPECT_EQ(in[i].dat[0], out[i].dat[0]);
+    }
+
+    // Payload mode; a frame only partly read is finished by the next read
+    EXPECT_EQ(set_record_mode(fd_tx, 0), EOK);
+    EXPECT_EQ(set_record_mode(fd_rx, 0), EOK);
+
+    EXPECT_EQ(set_mid(fd_tx, 0x140), EOK);
+
+    char msg[] = "0123456789abcdef"; // two frames
+
+    EXPECT_EQ(write(fd_tx, msg, 16), 16);
+
+    char payload[17];
+
+    memset(payload, 0, sizeof(payload));
+
+    EXPECT_EQ(read(fd_rx, payload, 12), 12);
+    EXPECT_EQ(std::string(payload), std::string("0123456789ab"));
+
+    EXPECT_EQ(read(fd_rx, payload + 12, 4), 4);
+    EXPECT_EQ(std::string(payload), std::string(msg));
+
+    close(fd_rx);
+    close(fd_tx);
+}
+
+static volatile bool io_select_sender_started = false;
+
+void* io_select_sender (void* arg) {
+    int fd = *(int*)arg;
+    char msg[] = "select";
+
+    io_select_sender_started = true;
+
+    usleep(20000);
+
+    write(fd, msg, 6);
+
+    pthread_exit(NULL);
+}
+
+TEST( IO, SelectNotify ) {
+    int fd_tx = open(get_device0_tx0().c_str(), O_RDWR);
+    int fd_rx = open(get_device0_rx0().c_str(), O_RDWR);
+
+    EXPECT_NE(fd_tx, -1);
+    EXPECT_NE(fd_rx, -1);
+
+    EXPECT_EQ(set_mid(fd_tx, 0x150), EOK);
+
+    fd_set rfds, wfds;
+    struct timeval tv;
+
+    // Nothing queued yet; input notify is armed and times out
+    FD_ZERO(&rfds);
+    FD_SET(fd_rx, &rfds);
+    tv.tv_sec = 0;
+    tv.tv_usec = 10000;
+
+    EXPECT_EQ(select(fd_rx + 1, &rfds, NULL, NULL, &tv), 0);
+
+    // The TX channel has space in the device tx_queue
+    FD_ZERO(&wfds);
+    FD_SET(fd_tx, &wfds);
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+
+    EXPECT_EQ(select(fd_tx + 1, NULL, &wfds, NULL, &tv), 1);
+    EXPECT_TRUE(FD_ISSET(fd_tx, &wfds));
+
+    // A frame sent while the reader waits in select() wakes it
+    io_select_sender_started = false;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, &io_select_sender, &fd_tx);
+
+    while (!io_select_sender_started) {
+        usleep(1000);
+    }
+
+    FD_ZERO(&rfds);
+    FD_SET(fd_rx, &rfds);
+    tv.tv_sec = 2;
+    tv.tv_usec = 0;
+
+    EXPECT_EQ(select(fd_rx + 1, &rfds, NULL, NULL, &tv), 1);
+    EXPECT_TRUE(FD_ISSET(fd_rx, &rfds));
+
+    pthread_join(thread, NULL);
+
+    char msg[7];
+
+    memset(msg, 0, sizeof(msg));
+
+    EXPECT_EQ(read(fd_rx, msg, 6), 6);
+    EXPECT_EQ(std::string(msg), std::string("select"));
+
+    // Close a reader with its input notify still armed; frames that follow
+    // must not go near it, and other readers still get them
+    int fd_closed = open(get_device0_rx0().c_str(), O_RDWR);
+
+    EXPECT_NE(fd_closed, -1);
+
+    FD_ZERO(&rfds);
+    FD_SET(fd_closed, &rfds);
+    tv.tv_sec = 0;
+    tv.tv_usec = 10000;
+
+    EXPECT_EQ(select(fd_closed + 1, &rfds, NULL, NULL, &tv), 0);
+
+    close(fd_closed);
+
+    EXPECT_EQ(write(fd_tx, "closed", 6), 6);
+
+    memset(msg, 0, sizeof(msg));
+
+    EXPECT_EQ(read(fd_rx, msg, 6), 6);
+    EXPECT_EQ(std::string(msg), std::string("closed"));
+
+    struct can_devctl_stats stats;
+
+    EXPECT_EQ(get_stats(fd_tx, &stats), EOK);
+
+    close(fd_rx);
+    close(fd_tx);
+}
+
+static void io_signal_handler (int signo) {
+}
+
+struct io_blocked_read {
+    int fd;
+    size_t nbytes;
+    volatile bool started;
+    ssize_t result;
+    int error;
+    char buf[16];
+};
+
+void* io_blocked_read_loop (void* arg) {
+    struct io_blocked_read* r = (struct io_blocked_read*)arg;
+
+    r->started = true;
+    r->result = read(r->fd, r->buf, r->nbytes);
+    r->error = errno;
+
+    pthread_exit(NULL);
+}
+
+TEST( IO, ReadInterrupted ) {
+    int fd_tx = open(get_device0_tx0().c_str(), O_RDWR);
+    int fd_rx = open(get_device0_rx0().c_str(), O_RDWR);
+
+    EXPECT_NE(fd_tx, -1);
+    EXPECT_NE(fd_rx, -1);
+
+    EXPECT_EQ(set_mid(fd_tx, 0x160), EOK);
+
+    struct sigaction sa, old_sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = io_signal_handler; // no SA_RESTART
+    sigemptyset(&sa.sa_mask);
+
+    EXPECT_EQ(sigaction(SIGUSR1, &sa, &old_sa), 0);
+
+    // A 16 byte read stays blocked on a single 8 byte frame
+    struct io_blocked_read r = { .fd = fd_rx, .nbytes = 16 };
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, &io_blocked_read_loop, &r);
+
+    while (!r.started) {
+        usleep(1000);
+    }
+
+    usleep(20000);
+
+    EXPECT_EQ(write(fd_tx, "12345678", 8), 8);
+
+    usleep(20000);
+
+    pthread_kill(thread, SIGUSR1);
+    pthread_join(thread, NULL);
+
+    EXPECT_EQ(r.result, -1);
+    EXPECT_EQ(r.error, EINTR);
+
+    // The frame the interrupted read was waiting on is still there
+    char msg[9];
+
+    memset(msg, 0, sizeof(msg));
+
+    EXPECT_EQ(read(fd_rx, msg, 8), 8);
+    EXPECT_EQ(std::string(msg), std::string("12345678"));
+
+    // and the next read isn't handed anything stale
+    EXPECT_EQ(write(fd_tx, "abcdefgh", 8), 8);
+
+    memset(msg, 0, sizeof(msg));
+
+    EXPECT_EQ(read(fd_rx, msg, 8), 8);
+    EXPECT_EQ(std::string(msg), std::string("abcdefgh"));
+
+    sigaction(SIGUSR1, &old_sa, NULL);
+
+    close(fd_rx);
+    close(fd_tx);
+}
+
+TEST( IO, TooManyBlockedReaders ) {
+    const int extra = 6;
+    const int n = WAITQ_MAX_CLIENTS + extra;
+
+    int fd_tx = open(get_device0_tx0().c_str(), O_RDWR);
+    int fd_rx = open(get_device0_rx0().c_str(), O_RDWR);
+
+    EXPECT_NE(fd_tx, -1);
+    EXPECT_NE(fd_rx, -1);
+
+    EXPECT_EQ(set_mid(fd_tx, 0x170), EOK);
+
+    static struct io_blocked_read r[n];
+    pthread_t thread[n];
+
+    for (int i = 0; i < n; ++i) {
+        r[i] = { .fd = fd_rx, .nbytes = 8 };
+
+        pthread_create(&thread[i], NULL, &io_blocked_read_loop, &r[i]);
+    }
+
+    for (int i = 0; i < n; ++i) {
+        while (!r[i].started) {
+            usleep(1000);
+        }
+    }
+
+    // Readers beyond WAITQ_MAX_CLIENTS are turned away with EAGAIN at once
+    usleep(100000);
+
+    int frames = 0;
+
+    for (int i = 0; i < WAITQ_MAX_CLIENTS; ++i) {
+        char msg[9];
+
+        snprintf(msg, sizeof(msg), "msg%05d", i);
+
+        if (write(fd_tx, msg, 8) == 8) {
+            ++frames;
+        }
+    }
+
+    EXPECT_EQ(frames, WAITQ_MAX_CLIENTS);
+
+    int completed = 0, rejected = 0;
+
+    for (int i = 0; i < n; ++i) {
+        pthread_join(thread[i], NULL);
+
+        if (r[i].result == 8) {
+            ++completed;
+        }
+        else if (r[i].result == -1 && r[i].error == EAGAIN) {
+            ++rejected;
+        }
+    }
+
+    EXPECT_EQ(completed, WAITQ_MAX_CLIENTS);
+    EXPECT_EQ(rejected, extra);
+
+    close(fd_rx);
+    close(fd_tx);
+}
@@ -0,0 +1,147 @@
+/**
+ * \file    driver-poll-tests.cpp
+ * \brief   Driver adaptive polling (-p) integration tests; starts a driver
+ *          instance of its own with two simulated SJA1000 devices in polling
+ *          mode and checks that frames still flow both ways.
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <spawn.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <gtest/gtest.h>
+#include <tests/driver/common/test_devices.h>
+
+extern "C" {
+    #include <dev-can-linux/commands.h>
+}
+
+/* Device ids clear of those of the driver under test */
+#define POLL_DEVICE0_RX0    "/dev/can10/rx0"
+#define POLL_DEVICE0_TX0    "/dev/can10/tx0"
+#define POLL_DEVICE1_RX0    "/dev/can11/rx0"
+#define POLL_DEVICE1_TX0    "/dev/can11/tx0"
+
+#define POLL_TEST_SIZE      (200)
+#define POLL_TEST_SLEEP_US  (1000)
+
+extern char** environ;
+
+class Poll : public ::testing::Test {
+protected:
+    pid_t pid = -1;
+
+    void SetUp() override {
+        std::string bin = get_driver_binary();
+
+        // Two simulated devices polled once two frames arrive within 10ms
+        const char* argv[] = {
+            bin.c_str(),
+            "-S", "2",
+            "-U", "10",
+            "-p", "id=10,frames=2,window=10000,period=100",
+            "-p", "id=11,frames=2,window=10000,period=100",
+            NULL
+        };
+
+        ASSERT_EQ(posix_spawnp( &pid, bin.c_str(), NULL, NULL,
+                    (char* const*)argv, environ ), 0);
+
+        // Wait for the resource managers to come up
+        for (int i = 0; i < 500; ++i) {
+            if (access(POLL_DEVICE1_TX0, F_OK) == 0) {
+                break;
+            }
+
+            usleep(10000);
+        }
+
+        ASSERT_EQ(access(POLL_DEVICE0_RX0, F_OK), 0);
+        ASSERT_EQ(access(POLL_DEVICE1_TX0, F_OK), 0);
+    }
+
+    void TearDown() override {
+        if (pid != -1) {
+            kill(pid, SIGTERM);
+            waitpid(pid, NULL, 0);
+        }
+    }
+
+    /* Send POLL_TEST_SIZE frames from tx and check rx receives them all */
+    void transfer (const char* tx, const char* rx, uint32_t mid) {
+        int fd_tx = open(tx, O_RDWR);
+        int fd_rx = open(rx, O_RDWR);
+
+        ASSERT_NE(fd_tx, -1);
+        ASSERT_NE(fd_rx, -1);
+
+        set_latency_limit_ms(fd_rx, 0);
+
+        struct can_ext_stats stats;
+
+        EXPECT_EQ(get_ext_stats(fd_rx, &stats), EOK);
+
+        uint64_t initial_rx_packets = stats.rx_packets;
+        uint64_t initial_rx_dropped = stats.rx_dropped;
+
+        struct can_msg canmsg = {
+            .len = 8,
+            .mid = mid
+        };
+
+        for (int i = 0; i < POLL_TEST_SIZE; ++i) {
+            canmsg.dat[0] = (uint8_t)i;
+
+            EXPECT_EQ(write_frame_raw(fd_tx, &canmsg), EOK);
+
+            // The device tx_queue is short; keep within what the polled
+            // device drains
+            usleep(POLL_TEST_SLEEP_US);
+        }
+
+        for (int i = 0; i < POLL_TEST_SIZE; ++i) {
+            struct can_msg received;
+
+            ASSERT_EQ(read_frame_raw_block(fd_rx, &received), EOK);
+
+            EXPECT_EQ(received.mid, mid);
+            EXPECT_EQ(received.len, 8);
+            EXPECT_EQ(received.dat[0], (uint8_t)i);
+        }
+
+        EXPECT_EQ(get_ext_stats(fd_rx, &stats), EOK);
+
+        EXPECT_EQ(stats.rx_packets - initial_rx_packets, POLL_TEST_SIZE);
+        EXPECT_EQ(stats.rx_dropped - initial_rx_dropped, 0);
+
+        close(fd_rx);
+        close(fd_tx);
+    }
+};
+
+TEST_F( Poll, SendReceive ) {
+    transfer(POLL_DEVICE0_TX0, POLL_DEVICE1_RX0, 0x180);
+    transfer(POLL_DEVICE1_TX0, POLL_DEVICE0_RX0, 0x190);
+
+    // After the idle rounds the devices are back in interrupt mode and go
+    // over to polling again
+    usleep(100000);
+
+    transfer(POLL_DEVICE0_TX0, POLL_DEVICE1_RX0, 0x1A0);
+}
@@ -0,0 +1,267 @@
+/**
+ * \file    gateway-tests.cpp
+ * \brief   In-driver gateway test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+
+extern "C" {
+    #include <dev-can-linux/commands.h>
+    #include <gateway.h>
+}
+
+static frame_t make_frame (uint32_t id, uint8_t fill = 0x11) {
+    frame_t frame = {};
+
+    frame.id = id;
+    frame.len = 8;
+    memset(frame.data, fill, sizeof(frame.data));
+
+    return frame;
+}
+
+static struct can_gw_rule make_rule (uint32_t src, uint32_t dst,
+        uint32_t id, uint32_t mask)
+{
+    struct can_gw_rule rule = {};
+
+    rule.src = src;
+    rule.dst = dst;
+    rule.id = id;
+    rule.mask = mask;
+
+    return rule;
+}
+
+class Gateway : public ::testing::Test {
+protected:
+    queue_t tx[2];
+
+    void SetUp() override {
+        queue_attr_t attr = { .size = 8 };
+
+        for (int i = 0; i < 2; ++i) {
+            memset(&tx[i], 0, sizeof(queue_t));
+            ASSERT_EQ(create_queue(&tx[i], &attr), EOK);
+
+            gateway_attach(i, &tx[i]);
+        }
+    }
+
+    void TearDown() override {
+        gateway_flush(0);
+
+        for (int i = 0; i < 2; ++i) {
+            gateway_attach(i, NULL);
+            destroy_queue(&tx[i]);
+        }
+    }
+
+    struct can_gw_stats stats (uint32_t index) {
+        struct can_gw_stats result = {};
+
+        result.index = index;
+        EXPECT_EQ(gateway_get_stats(&result), EOK);
+
+        return result;
+    }
+};
+
+TEST_F( Gateway, Forward ) {
+    struct can_gw_rule rule = make_rule(0, 1, 0x120, 0x7F0);
+
+    ASSERT_EQ(gateway_add_rule(&rule), EOK);
+    EXPECT_EQ(rule.index, 0u);
+    EXPECT_EQ(gateway_num_rules, 1);
+
+    frame_t match = make_frame(0x123);
+    frame_t other = make_frame(0x223);
+    frame_t eff = make_frame(0x123 | FRAME_EFF);
+
+    gateway_route(0, &match, 1000);
+    gateway_route(0, &other, 1001);
+    gateway_route(0, &eff, 1002);   // id type differs
+    gateway_route(1, &match, 1003); // not the source device
+
+    frame_t* out = dequeue_noblock(&tx[1], 0);
+
+    ASSERT_NE(out, nullptr);
+    EXPECT_EQ(out->id, 0x123u);
+    EXPECT_EQ(out->hops, 1);
+    EXPECT_EQ(queue_tstamp(&tx[1], out), 1000u);
+    EXPECT_EQ(dequeue_noblock(&tx[1], 0), nullptr);
+    EXPECT_EQ(dequeue_noblock(&tx[0], 0), nullptr);
+
+    struct can_gw_stats s = stats(0);
+    EXPECT_EQ(s.hits, 1u);
+    EXPECT_EQ(s.drops, 0u);
+}
+
+TEST_F( Gateway, NoLoops ) {
+    struct can_gw_rule to1 = make_rule(0, 1, 0, 0);
+    struct can_gw_rule to0 = make_rule(1, 0, 0, 0);
+
+    ASSERT_EQ(gateway_add_rule(&to1), EOK);
+    ASSERT_EQ(gateway_add_rule(&to0), EOK);
+
+    frame_t echo = make_frame(0x10 | FRAME_ECHO);
+    gateway_route(0, &echo, 0);
+    EXPECT_EQ(dequeue_noblock(&tx[1], 0), nullptr);
+
+    frame_t frame = make_frame(0x10);
+    gateway_route(0, &frame, 0);
+
+    // the forwarded frame, received back on device 1, stays there
+    frame_t* out = dequeue_noblock(&tx[1], 0);
+    ASSERT_NE(out, nullptr);
+
+    frame_t forwarded = *out;
+    gateway_route(1, &forwarded, 0);
+    EXPECT_EQ(dequeue_noblock(&tx[0], 0), nullptr);
+}
+
+TEST_F( Gateway, Modify ) {
+    struct can_gw_rule rule = make_rule(0, 1, 0x1ABCDE | CAN_GW_EFF, ~0U);
+
+    rule.flags = CAN_GW_SET_ID | CAN_GW_MOD_DATA;
+    rule.new_id = 0x456;
+    memset(rule.and_data, 0xFF, sizeof(rule.and_data));
+    rule.and_data[0] = 0x0F;
+    rule.or_data[1] = 0x80;
+    rule.xor_data[7] = 0xFF;
+
+    ASSERT_EQ(gateway_add_rule(&rule), EOK);
+
+    frame_t frame = make_frame(0x1ABCDE | FRAME_EFF);
+    gateway_route(0, &frame, 0);
+
+    frame_t* out = dequeue_noblock(&tx[1], 0);
+    ASSERT_NE(out, nullptr);
+    EXPECT_EQ(out->id, 0x456u);
+    EXPECT_EQ(out->data[0], 0x01);
+    EXPECT_EQ(out->data[1], 0x91);
+    EXPECT_EQ(out->data[2], 0x11);
+    EXPECT_EQ(out->data[7], 0xEE);
+}
+
+TEST_F( Gateway, RateLimit ) {
+    struct can_gw_rule rule = make_rule(0, 1, 0, 0);
+
+    rule.rate = 20;     // one frame per 50ms, bursts of 3
+    ASSERT_EQ(gateway_add_rule(&rule), EOK);
+
+    frame_t frame = make_frame(0x1);
+    const uint64_t ms = 1000000;
+
+    gateway_route(0, &frame, 1000 * ms);
+    gateway_route(0, &frame, 1001 * ms);
+    gateway_route(0, &frame, 1002 * ms);
+    gateway_route(0, &frame, 1003 * ms);    // over the burst
+    gateway_route(0, &frame, 1200 * ms);
+
+    struct can_gw_stats s = stats(0);
+    EXPECT_EQ(s.hits, 5u);
+    EXPECT_EQ(s.rate_drops, 1u);
+    EXPECT_EQ(s.drops, 1u);
+
+    int n = 0;
+    while (dequeue_noblock(&tx[1], 0) != nullptr) {
+        ++n;
+    }
+    EXPECT_EQ(n, 4);
+}
+
+TEST_F( Gateway, Drops ) {
+    struct can_gw_rule full = make_rule(0, 1, 0x1, ~0U);
+    struct can_gw_rule absent = make_rule(0, 5, 0x2, ~0U);
+
+    ASSERT_EQ(gateway_add_rule(&full), EOK);
+    ASSERT_EQ(gateway_add_rule(&absent), EOK);
+
+    frame_t frame = make_frame(0x1);
+    for (int i = 0; i < 10; ++i) {
+        gateway_route(0, &frame, i);
+    }
+
+    // a full destination queue loses the new frames, not the queued ones
+    struct can_gw_stats s = stats(0);
+    EXPECT_EQ(s.hits, 10u);
+    EXPECT_EQ(s.drops, 3u);
+    EXPECT_EQ(s.rate_drops, 0u);
+
+    frame_t* out = dequeue_noblock(&tx[1], 0);
+    ASSERT_NE(out, nullptr);
+    EXPECT_EQ(queue_tstamp(&tx[1], out), 0u);
+
+    frame = make_frame(0x2);
+    gateway_route(0, &frame, 0);
+    EXPECT_EQ(stats(1).drops, 1u);
+}
+
+TEST_F( Gateway, Rules ) {
+    struct can_gw_rule rule = make_rule(0, 1, 0x800, ~0U);
+    EXPECT_EQ(gateway_add_rule(&rule), EINVAL);   // not a standard id
+
+    rule = make_rule(0, 1, 0x1, ~0U);
+    rule.flags = 0x100;
+    EXPECT_EQ(gateway_add_rule(&rule), EINVAL);
+
+    for (int i = 0; i < CAN_GW_MAX_RULES; ++i) {
+        rule = make_rule(0, 1, i, ~0U);
+        ASSERT_EQ(gateway_add_rule(&rule), EOK);
+    }
+
+    EXPECT_EQ(gateway_add_rule(&rule), ENOSPC);
+
+    gateway_flush(2);
+    EXPECT_EQ(gateway_num_rules, 2);
+
+    struct can_gw_stats s = {};
+    s.index = 2;
+    EXPECT_EQ(gateway_get_stats(&s), EINVAL);
+}
+
+TEST_F( Gateway, Options ) {
+    EXPECT_EQ(gateway_option("src=0,dst=1,id=0x1ABCDE,ext=1,setid=0x100,"
+                "and=FFFFFFFFFFFFFF00,rate=100"), EOK);
+    EXPECT_EQ(gateway_num_rules, 1);
+
+    frame_t frame = make_frame(0x1ABCDE | FRAME_EFF);
+    gateway_route(0, &frame, 0);
+
+    frame_t* out = dequeue_noblock(&tx[1], 0);
+    ASSERT_NE(out, nullptr);
+    EXPECT_EQ(out->id, 0x100u | FRAME_EFF);
+    EXPECT_EQ(out->data[6], 0x11);
+    EXPECT_EQ(out->data[7], 0x00);
+
+    // without id every frame of the source matches
+    EXPECT_EQ(gateway_option("src=1,dst=0"), EOK);
+
+    frame = make_frame(0x7FF);
+    gateway_route(1, &frame, 0);
+    EXPECT_NE(dequeue_noblock(&tx[0], 0), nullptr);
+
+    EXPECT_EQ(gateway_option("src=0"), EINVAL);
+    EXPECT_EQ(gateway_option("src=0,dst=1,and=FF"), EINVAL);
+    EXPECT_EQ(gateway_option("src=0,dst=1,id=0x800"), EINVAL);
+    EXPECT_EQ(gateway_option("src=0,dst=1,via=2"), EINVAL);
+    EXPECT_EQ(gateway_num_rules, 2);
+}
@@ -0,0 +1,127 @@
+/**
+ * \file    latency-tests.cpp
+ * \brief   Latency histogram test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+
+extern "C" {
+    #include <latency.h>
+}
+
+static uint64_t samples (const latency_hist_t* hist) {
+    uint64_t n = 0;
+
+    for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+        n += hist->count[b];
+    }
+
+    return n;
+}
+
+TEST( Latency, Buckets ) {
+    EXPECT_EQ(latency_bucket(0), 0);
+    EXPECT_EQ(latency_bucket(1), 0);
+    EXPECT_EQ(latency_bucket(2), 1);
+    EXPECT_EQ(latency_bucket(3), 1);
+    EXPECT_EQ(latency_bucket(1000), 9);     // 512..1023
+    EXPECT_EQ(latency_bucket(1024), 10);
+    EXPECT_EQ(latency_bucket(1000000), 19); // 1 ms
+
+    // everything from 2^31 ns on lands in the last bucket
+    EXPECT_EQ(latency_bucket(1ULL << 31), LATENCY_BUCKETS - 1);
+    EXPECT_EQ(latency_bucket(UINT64_MAX), LATENCY_BUCKETS - 1);
+}
+
+TEST( Latency, Since ) {
+    EXPECT_EQ(latency_since(100, 250), 150u);
+    EXPECT_EQ(latency_since(250, 100), 0u);
+}
+
+TEST( Latency, Add ) {
+    latency_t lat;
+    latency_init(&lat);
+
+    latency_add(&lat, LATENCY_RX_IRQ, 1500);
+    latency_add(&lat, LATENCY_RX_IRQ, 1600);
+    latency_add(&lat, LATENCY_RX_IRQ, 40000);
+    latency_add(&lat, LATENCY_TX_DONE, 300000);
+
+    const latency_hist_t* irq = &lat.stage[LATENCY_RX_IRQ];
+
+    EXPECT_EQ(irq->count[10], 2u);
+    EXPECT_EQ(irq->count[15], 1u);
+    EXPECT_EQ(samples(irq), 3u);
+    EXPECT_EQ(irq->sum, 43100u);
+    EXPECT_EQ(irq->max, 40000u);
+
+    EXPECT_EQ(samples(&lat.stage[LATENCY_TX_DONE]), 1u);
+    EXPECT_EQ(lat.stage[LATENCY_TX_DONE].max, 300000u);
+    EXPECT_EQ(samples(&lat.stage[LATENCY_RX_QUEUE]), 0u);
+}
+
+TEST( Latency, Concurrent ) {
+    latency_t lat;
+    latency_init(&lat);
+
+    const int n = 8;
+    const int count = 20000;
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < n; ++i) {
+        threads.emplace_back([&lat, i] {
+            for (int j = 0; j < count; ++j) {
+                latency_add(&lat, LATENCY_RX_WAKE, 1000*i + j % 100);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    const latency_hist_t* wake = &lat.stage[LATENCY_RX_WAKE];
+
+    EXPECT_EQ(samples(wake), (uint64_t)n*count);
+    EXPECT_EQ(wake->max, 1000u*(n - 1) + 99);
+}
+
+TEST( Latency, ReadReset ) {
+    latency_t lat, copy;
+    latency_init(&lat);
+
+    latency_add(&lat, LATENCY_TX_QUEUE, 5000);
+
+    latency_read(&lat, &copy, 0);
+    EXPECT_EQ(samples(&copy.stage[LATENCY_TX_QUEUE]), 1u);
+    EXPECT_EQ(samples(&lat.stage[LATENCY_TX_QUEUE]), 1u);
+
+    latency_read(&lat, &copy, 1);
+    EXPECT_EQ(samples(&copy.stage[LATENCY_TX_QUEUE]), 1u);
+    EXPECT_EQ(copy.stage[LATENCY_TX_QUEUE].sum, 5000u);
+
+    // cleared, max included
+    EXPECT_EQ(samples(&lat.stage[LATENCY_TX_QUEUE]), 0u);
+    EXPECT_EQ(lat.stage[LATENCY_TX_QUEUE].max, 0u);
+    EXPECT_EQ(lat.stage[LATENCY_TX_QUEUE].sum, 0u);
+}
@@ -29,17 +29,37 @@ extern "C" {
 void* receive_loop (void* arg) {
     queue_t* queue = (queue_t*)arg;
 
-    struct can_msg* dequeue_can_msg = dequeue(queue, 0);
+    frame_t* dequeue_frame = dequeue(queue, 0);
 
-    pthread_exit(dequeue_can_msg);
+    pthread_exit(dequeue_frame);
+}
+
+void* enqueue_wait_loop (void* arg) {
+    queue_t* queue = (queue_t*)arg;
+    frame_t msg = { .id = 0x55 };
+
+    return (void*)(intptr_t)enqueue_wait(queue, &msg, 0);
+}
+
+void* reserve_loop (void* arg) {
+    queue_t* queue = (queue_t*)arg;
+    frame_t* seg[2];
+    int seg_len[2];
+
+    int n = dequeue_reserve(queue, 2, seg, seg_len);
+    void* first = n ? (void*)(uintptr_t)seg[0][0].id : nullptr;
+
+    dequeue_release(queue, n);
+
+    return first;
 }
 
 void* peek_receive_loop (void* arg) {
     queue_t* queue = (queue_t*)arg;
 
-    struct can_msg* dequeue_can_msg = dequeue_peek(queue);
+    frame_t* dequeue_frame = dequeue_peek(queue);
 
-    pthread_exit(dequeue_can_msg);
+    pthread_exit(dequeue_frame);
 }
 
 TEST( Queue, ZeroQueueSize ) {
@@ -63,7 +83,7 @@ TEST( Queue, ZeroQueueSize ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    can_msg msg;
+    frame_t msg;
     int enqueue_code = enqueue(&queue, &msg);
 
     EXPECT_EQ(enqueue_code, EDOM /* Domain error */);
@@ -83,7 +103,7 @@ TEST( Queue, ZeroQueueSize ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 1);
 
-    msg.mid = 0x112233;
+    msg.id = 0x112233;
     msg.len = 0;
 
     enqueue_code = enqueue(&queue, &msg);
@@ -98,9 +118,9 @@ TEST( Queue, ZeroQueueSize ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    struct can_msg* dequeue_can_msg = (struct can_msg*)value_ptr;
+    frame_t* dequeue_frame = (frame_t*)value_ptr;
 
-    EXPECT_EQ(dequeue_can_msg, nullptr);
+    EXPECT_EQ(dequeue_frame, nullptr);
 
     destroy_queue(&queue);
 
@@ -132,7 +152,7 @@ TEST( Queue, PeekZeroQueueSize ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    can_msg msg;
+    frame_t msg;
     int enqueue_code = enqueue(&queue, &msg);
 
     EXPECT_EQ(enqueue_code, EDOM /* Domain error */);
@@ -152,7 +172,7 @@ TEST( Queue, PeekZeroQueueSize ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 1);
 
-    msg.mid = 0x112233;
+    msg.id = 0x112233;
     msg.len = 0;
 
     enqueue_code = enqueue(&queue, &msg);
@@ -167,9 +187,9 @@ TEST( Queue, PeekZeroQueueSize ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    struct can_msg* dequeue_can_msg = (struct can_msg*)value_ptr;
+    frame_t* dequeue_frame = (frame_t*)value_ptr;
 
-    EXPECT_EQ(dequeue_can_msg, nullptr);
+    EXPECT_EQ(dequeue_frame, nullptr);
 
     destroy_queue(&queue);
 
@@ -201,7 +221,7 @@ TEST( Queue, NonBlockZeroQueueSize ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    can_msg msg;
+    frame_t msg;
     int enqueue_code = enqueue(&queue, &msg);
 
     EXPECT_EQ(enqueue_code, EDOM /* Domain error */);
@@ -211,9 +231,9 @@ TEST( Queue, NonBlockZeroQueueSize ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    struct can_msg* dequeue_can_msg = dequeue_noblock(&queue, 0);
+    frame_t* dequeue_frame = dequeue_noblock(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg, nullptr);
+    EXPECT_EQ(dequeue_frame, nullptr);
     EXPECT_EQ(queue.begin, 0);
     EXPECT_EQ(queue.end, 0);
     EXPECT_EQ(queue.attr.size, 0);
@@ -242,7 +262,7 @@ TEST( Queue, NullInput ) {
 
     EXPECT_EQ(create_queue_code, EFAULT /* Bad address */);
 
-    can_msg msg;
+    frame_t msg;
     int enqueue_code = enqueue(NULL, &msg);
     EXPECT_EQ(enqueue_code, EFAULT /* Bad address */);
 
@@ -252,7 +272,7 @@ TEST( Queue, NullInput ) {
     enqueue_code = enqueue(NULL, NULL);
     EXPECT_EQ(create_queue_code, EFAULT /* Bad address */);
 
-    can_msg* dequeue_ret = dequeue(NULL, 0);
+    frame_t* dequeue_ret = dequeue(NULL, 0);
     EXPECT_EQ(dequeue_ret, nullptr);
 
     dequeue_ret = dequeue_noblock(NULL, 0);
@@ -283,13 +303,13 @@ TEST( Queue, SimpleUse ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    can_msg msg;
-    msg.mid = 0x112233;
+    frame_t msg;
+    msg.id = 0x112233;
     msg.len = 0;
 
-    struct can_msg* dequeue_can_msg = dequeue_noblock(&queue, 0);
+    frame_t* dequeue_frame = dequeue_noblock(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg, nullptr);
+    EXPECT_EQ(dequeue_frame, nullptr);
     EXPECT_EQ(queue.begin, 0);
     EXPECT_EQ(queue.end, 0);
     EXPECT_EQ(queue.attr.size, 10);
@@ -305,10 +325,10 @@ TEST( Queue, SimpleUse ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    msg.mid = 0x445566;
+    msg.id = 0x445566;
     msg.len = 2;
-    msg.dat[0] = 0x77;
-    msg.dat[1] = 0x88;
+    msg.data[0] = 0x77;
+    msg.data[1] = 0x88;
 
     enqueue_code = enqueue(&queue, &msg);
 
@@ -320,45 +340,45 @@ TEST( Queue, SimpleUse ) {
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
     enqueue_code = enqueue(&queue, &msg);
-    dequeue_can_msg = dequeue_noblock(&queue, 0);
+    dequeue_frame = dequeue_noblock(&queue, 0);
 
     EXPECT_EQ(enqueue_code, EOK /* No error */);
-    EXPECT_EQ(dequeue_can_msg->mid, 0x112233);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 0x112233);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 1);
     EXPECT_EQ(queue.end, 3);
     EXPECT_EQ(queue.attr.size, 10);
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    dequeue_can_msg = dequeue(&queue, 0);
+    dequeue_frame = dequeue(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 0x445566);
-    EXPECT_EQ(dequeue_can_msg->len, 2);
+    EXPECT_EQ(dequeue_frame->id, 0x445566);
+    EXPECT_EQ(dequeue_frame->len, 2);
     EXPECT_EQ(queue.begin, 2);
     EXPECT_EQ(queue.end, 3);
     EXPECT_EQ(queue.attr.size, 10);
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    dequeue_can_msg = dequeue_peek(&queue);
+    dequeue_frame = dequeue_peek(&queue);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 0x445566);
-    EXPECT_EQ(dequeue_can_msg->len, 2);
-    EXPECT_EQ(dequeue_can_msg->dat[0], 0x77);
-    EXPECT_EQ(dequeue_can_msg->dat[1], 0x88);
+    EXPECT_EQ(dequeue_frame->id, 0x445566);
+    EXPECT_EQ(dequeue_frame->len, 2);
+    EXPECT_EQ(dequeue_frame->data[0], 0x77);
+    EXPECT_EQ(dequeue_frame->data[1], 0x88);
     EXPECT_EQ(queue.begin, 2);
     EXPECT_EQ(queue.end, 3);
     EXPECT_EQ(queue.attr.size, 10);
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    dequeue_can_msg = dequeue(&queue, 0);
+    dequeue_frame = dequeue(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 0x445566);
-    EXPECT_EQ(dequeue_can_msg->len, 2);
-    EXPECT_EQ(dequeue_can_msg->dat[0], 0x77);
-    EXPECT_EQ(dequeue_can_msg->dat[1], 0x88);
+    EXPECT_EQ(dequeue_frame->id, 0x445566);
+    EXPECT_EQ(dequeue_frame->len, 2);
+    EXPECT_EQ(dequeue_frame->data[0], 0x77);
+    EXPECT_EQ(dequeue_frame->data[1], 0x88);
     EXPECT_EQ(queue.begin, 3);
     EXPECT_EQ(queue.end, 3);
     EXPECT_EQ(queue.attr.size, 10);
@@ -380,7 +400,7 @@ TEST( Queue, WrapBeforeAnyDequeue ) {
         .size = 10
     };
 
-    struct can_msg msg;
+    frame_t msg;
 
     int create_queue_code = create_queue(&queue, &attr);
 
@@ -392,7 +412,7 @@ TEST( Queue, WrapBeforeAnyDequeue ) {
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
     for (int i = 0; i < 10; ++i) {
-        msg.mid = 100 + i;
+        msg.id = 100 + i;
         msg.len = 0;
 
         int enqueue_code = enqueue(&queue, &msg);
@@ -423,20 +443,20 @@ TEST( Queue, WrapBeforeAnyDequeue ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    struct can_msg* dequeue_can_msg = dequeue(&queue, 0);
+    frame_t* dequeue_frame = dequeue(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 103);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 103);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 4);
     EXPECT_EQ(queue.end, 2);
     EXPECT_EQ(queue.attr.size, 10);
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    dequeue_can_msg = dequeue(&queue, 0);
+    dequeue_frame = dequeue(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 104);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 104);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 5);
     EXPECT_EQ(queue.end, 2);
     EXPECT_EQ(queue.attr.size, 10);
@@ -458,7 +478,7 @@ TEST( Queue, PushBeginToWrap ) {
         .size = 5
     };
 
-    struct can_msg msg;
+    frame_t msg;
 
     int create_queue_code = create_queue(&queue, &attr);
 
@@ -475,7 +495,7 @@ TEST( Queue, PushBeginToWrap ) {
         2 };
 
     for (int i = 0; i < 11; ++i) {
-        msg.mid = 100 + i;
+        msg.id = 100 + i;
         msg.len = 0;
 
         int enqueue_code = enqueue(&queue, &msg);
@@ -488,10 +508,10 @@ TEST( Queue, PushBeginToWrap ) {
         EXPECT_EQ(queue.dequeue_waiting, 0);
     }
 
-    struct can_msg* dequeue_can_msg = dequeue(&queue, 0);
+    frame_t* dequeue_frame = dequeue(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 107);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 107);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 3);
     EXPECT_EQ(queue.end, 1);
     EXPECT_EQ(queue.attr.size, 5);
@@ -513,7 +533,7 @@ TEST( Queue, WrapAfterSomeDequeue ) {
         .size = 10
     };
 
-    struct can_msg msg;
+    frame_t msg;
 
     int create_queue_code = create_queue(&queue, &attr);
 
@@ -536,7 +556,7 @@ TEST( Queue, WrapAfterSomeDequeue ) {
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
     for (int i = 0; i < 8; ++i) {
-        msg.mid = 100 + i;
+        msg.id = 100 + i;
         msg.len = 0;
 
         int enqueue_code = enqueue(&queue, &msg);
@@ -567,20 +587,20 @@ TEST( Queue, WrapAfterSomeDequeue ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    struct can_msg* dequeue_can_msg = dequeue(&queue, 0);
+    frame_t* dequeue_frame = dequeue(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 101);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 101);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 4);
     EXPECT_EQ(queue.end, 2);
     EXPECT_EQ(queue.attr.size, 10);
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    dequeue_can_msg = dequeue(&queue, 0);
+    dequeue_frame = dequeue(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 102);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 102);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 5);
     EXPECT_EQ(queue.end, 2);
     EXPECT_EQ(queue.attr.size, 10);
@@ -602,7 +622,7 @@ TEST( Queue, WrapEnqueueThenWrapDequeue ) {
         .size = 10
     };
 
-    struct can_msg msg;
+    frame_t msg;
 
     int create_queue_code = create_queue(&queue, &attr);
 
@@ -614,7 +634,7 @@ TEST( Queue, WrapEnqueueThenWrapDequeue ) {
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
     for (int i = 0; i < 10; ++i) {
-        msg.mid = 100 + i;
+        msg.id = 100 + i;
         msg.len = 0;
 
         int enqueue_code = enqueue(&queue, &msg);
@@ -627,7 +647,7 @@ TEST( Queue, WrapEnqueueThenWrapDequeue ) {
         EXPECT_EQ(queue.dequeue_waiting, 0);
     }
 
-    msg.mid = 1000;
+    msg.id = 1000;
     int enqueue_code = enqueue(&queue, &msg);
 
     EXPECT_EQ(enqueue_code, EOK /* No error */);
@@ -637,13 +657,13 @@ TEST( Queue, WrapEnqueueThenWrapDequeue ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    struct can_msg* dequeue_can_msg;
+    frame_t* dequeue_frame;
 
     for (int i = 0; i < 7; ++i) {
-        dequeue_can_msg = dequeue(&queue, 0);
+        dequeue_frame = dequeue(&queue, 0);
 
-        EXPECT_EQ(dequeue_can_msg->mid, 102+i);
-        EXPECT_EQ(dequeue_can_msg->len, 0);
+        EXPECT_EQ(dequeue_frame->id, 102+i);
+        EXPECT_EQ(dequeue_frame->len, 0);
         EXPECT_EQ(queue.begin, 3+i);
         EXPECT_EQ(queue.end, 1);
         EXPECT_EQ(queue.attr.size, 10);
@@ -651,20 +671,20 @@ TEST( Queue, WrapEnqueueThenWrapDequeue ) {
         EXPECT_EQ(queue.dequeue_waiting, 0);
     }
 
-    dequeue_can_msg = dequeue(&queue, 0);
+    dequeue_frame = dequeue(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 109);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 109);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 0);
     EXPECT_EQ(queue.end, 1);
     EXPECT_EQ(queue.attr.size, 10);
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    dequeue_can_msg = dequeue(&queue, 0);
+    dequeue_frame = dequeue(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 1000);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 1000);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 1);
     EXPECT_EQ(queue.end, 1);
     EXPECT_EQ(queue.attr.size, 10);
@@ -686,7 +706,7 @@ TEST( Queue, WrapEnqueueThenWrapDequeueNonBlock ) {
         .size = 10
     };
 
-    struct can_msg msg;
+    frame_t msg;
 
     int create_queue_code = create_queue(&queue, &attr);
 
@@ -698,7 +718,7 @@ TEST( Queue, WrapEnqueueThenWrapDequeueNonBlock ) {
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
     for (int i = 0; i < 10; ++i) {
-        msg.mid = 100 + i;
+        msg.id = 100 + i;
         msg.len = 0;
 
         int enqueue_code = enqueue(&queue, &msg);
@@ -711,7 +731,7 @@ TEST( Queue, WrapEnqueueThenWrapDequeueNonBlock ) {
         EXPECT_EQ(queue.dequeue_waiting, 0);
     }
 
-    msg.mid = 1000;
+    msg.id = 1000;
     int enqueue_code = enqueue(&queue, &msg);
 
     EXPECT_EQ(enqueue_code, EOK /* No error */);
@@ -721,13 +741,13 @@ TEST( Queue, WrapEnqueueThenWrapDequeueNonBlock ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    struct can_msg* dequeue_can_msg;
+    frame_t* dequeue_frame;
 
     for (int i = 0; i < 7; ++i) {
-        dequeue_can_msg = dequeue_noblock(&queue, 0);
+        dequeue_frame = dequeue_noblock(&queue, 0);
 
-        EXPECT_EQ(dequeue_can_msg->mid, 102+i);
-        EXPECT_EQ(dequeue_can_msg->len, 0);
+        EXPECT_EQ(dequeue_frame->id, 102+i);
+        EXPECT_EQ(dequeue_frame->len, 0);
         EXPECT_EQ(queue.begin, 3+i);
         EXPECT_EQ(queue.end, 1);
         EXPECT_EQ(queue.attr.size, 10);
@@ -735,20 +755,20 @@ TEST( Queue, WrapEnqueueThenWrapDequeueNonBlock ) {
         EXPECT_EQ(queue.dequeue_waiting, 0);
     }
 
-    dequeue_can_msg = dequeue_noblock(&queue, 0);
+    dequeue_frame = dequeue_noblock(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 109);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 109);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 0);
     EXPECT_EQ(queue.end, 1);
     EXPECT_EQ(queue.attr.size, 10);
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    dequeue_can_msg = dequeue_noblock(&queue, 0);
+    dequeue_frame = dequeue_noblock(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 1000);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 1000);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 1);
     EXPECT_EQ(queue.end, 1);
     EXPECT_EQ(queue.attr.size, 10);
@@ -770,7 +790,7 @@ TEST( Queue, DequeueAllFromFullQueue ) {
         .size = 10
     };
 
-    struct can_msg msg;
+    frame_t msg;
 
     int create_queue_code = create_queue(&queue, &attr);
 
@@ -782,7 +802,7 @@ TEST( Queue, DequeueAllFromFullQueue ) {
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
     for (int i = 0; i < 10; ++i) {
-        msg.mid = 100 + i;
+        msg.id = 100 + i;
         msg.len = 0;
 
         int enqueue_code = enqueue(&queue, &msg);
@@ -796,10 +816,10 @@ TEST( Queue, DequeueAllFromFullQueue ) {
     }
 
     for (int i = 0; i < 9; ++i) {
-        struct can_msg* dequeue_can_msg = dequeue(&queue, 0);
+        frame_t* dequeue_frame = dequeue(&queue, 0);
 
-        EXPECT_EQ(dequeue_can_msg->mid, 100+i);
-        EXPECT_EQ(dequeue_can_msg->len, 0);
+        EXPECT_EQ(dequeue_frame->id, 100+i);
+        EXPECT_EQ(dequeue_frame->len, 0);
         EXPECT_EQ(queue.begin, i+1);
         EXPECT_EQ(queue.end, 10);
         EXPECT_EQ(queue.attr.size, 10);
@@ -807,10 +827,10 @@ TEST( Queue, DequeueAllFromFullQueue ) {
         EXPECT_EQ(queue.dequeue_waiting, 0);
     }
 
-    struct can_msg* dequeue_can_msg = dequeue(&queue, 0);
+    frame_t* dequeue_frame = dequeue(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 109);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 109);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 0);
     EXPECT_EQ(queue.end, 0);
     EXPECT_EQ(queue.attr.size, 10);
@@ -832,7 +852,7 @@ TEST( Queue, DequeueNonBlockAllFromFullQueue ) {
         .size = 10
     };
 
-    struct can_msg msg;
+    frame_t msg;
 
     int create_queue_code = create_queue(&queue, &attr);
 
@@ -844,7 +864,7 @@ TEST( Queue, DequeueNonBlockAllFromFullQueue ) {
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
     for (int i = 0; i < 10; ++i) {
-        msg.mid = 100 + i;
+        msg.id = 100 + i;
         msg.len = 0;
 
         int enqueue_code = enqueue(&queue, &msg);
@@ -858,10 +878,10 @@ TEST( Queue, DequeueNonBlockAllFromFullQueue ) {
     }
 
     for (int i = 0; i < 9; ++i) {
-        struct can_msg* dequeue_can_msg = dequeue_noblock(&queue, 0);
+        frame_t* dequeue_frame = dequeue_noblock(&queue, 0);
 
-        EXPECT_EQ(dequeue_can_msg->mid, 100+i);
-        EXPECT_EQ(dequeue_can_msg->len, 0);
+        EXPECT_EQ(dequeue_frame->id, 100+i);
+        EXPECT_EQ(dequeue_frame->len, 0);
         EXPECT_EQ(queue.begin, i+1);
         EXPECT_EQ(queue.end, 10);
         EXPECT_EQ(queue.attr.size, 10);
@@ -869,10 +889,10 @@ TEST( Queue, DequeueNonBlockAllFromFullQueue ) {
         EXPECT_EQ(queue.dequeue_waiting, 0);
     }
 
-    struct can_msg* dequeue_can_msg = dequeue_noblock(&queue, 0);
+    frame_t* dequeue_frame = dequeue_noblock(&queue, 0);
 
-    EXPECT_EQ(dequeue_can_msg->mid, 109);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 109);
+    EXPECT_EQ(dequeue_frame->len, 0);
     EXPECT_EQ(queue.begin, 0);
     EXPECT_EQ(queue.end, 0);
     EXPECT_EQ(queue.attr.size, 10);
@@ -913,8 +933,8 @@ TEST( Queue, BlockingDequeue ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 1);
 
-    can_msg msg;
-    msg.mid = 0x112233;
+    frame_t msg;
+    msg.id = 0x112233;
     msg.len = 0;
 
     int enqueue_code = enqueue(&queue, &msg);
@@ -929,10 +949,10 @@ TEST( Queue, BlockingDequeue ) {
     EXPECT_EQ(queue.session_up, 1);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 
-    struct can_msg* dequeue_can_msg = (struct can_msg*)value_ptr;
+    frame_t* dequeue_frame = (frame_t*)value_ptr;
 
-    EXPECT_EQ(dequeue_can_msg->mid, 0x112233);
-    EXPECT_EQ(dequeue_can_msg->len, 0);
+    EXPECT_EQ(dequeue_frame->id, 0x112233);
+    EXPECT_EQ(dequeue_frame->len, 0);
 
     destroy_queue(&queue);
 }
@@ -1024,3 +1044,292 @@ TEST( Queue, DestroyWhilePeekDequeueBlocks ) {
     EXPECT_EQ(queue.session_up, 0);
     EXPECT_EQ(queue.dequeue_waiting, 0);
 }
+
+TEST( Queue, ReserveRelease ) {
+    queue_t queue = {
+        .begin = -1,
+        .end = -1,
+        .session_up = -1,
+        .dequeue_waiting = -1
+    };
+
+    queue_attr_t attr = {
+        .size = 10
+    };
+
+    int create_queue_code = create_queue(&queue, &attr);
+
+    EXPECT_EQ(create_queue_code, EOK /* No error */);
+    EXPECT_EQ(queue.reserved, 0);
+
+    frame_t* seg[2];
+    int seg_len[2];
+
+    EXPECT_EQ(dequeue_reserve(&queue, 10, seg, seg_len), 0 /* empty */);
+
+    frame_t msg = {};
+    uint32_t mid;
+
+    for (mid = 0; mid < 5; ++mid) {
+        msg.id = mid;
+        EXPECT_EQ(enqueue(&queue, &msg), EOK);
+    }
+
+    EXPECT_EQ(dequeue_reserve(&queue, 3, seg, seg_len), 3);
+    EXPECT_EQ(queue.reserved, 3);
+    EXPECT_EQ(seg_len[0], 3);
+    EXPECT_EQ(seg_len[1], 0);
+    EXPECT_EQ(seg[0][0].id, 0);
+    EXPECT_EQ(seg[0][2].id, 2);
+
+    dequeue_release(&queue, queue.reserved);
+    EXPECT_EQ(queue.reserved, 0);
+    EXPECT_EQ(queue.begin, 3);
+    EXPECT_EQ(queue.end, 5);
+
+    // Wrap around the end of the ring: messages 3..10
+    for (mid = 5; mid < 11; ++mid) {
+        msg.id = mid;
+        EXPECT_EQ(enqueue(&queue, &msg), EOK);
+    }
+
+    EXPECT_EQ(queue.begin, 3);
+    EXPECT_EQ(queue.end, 1);
+
+    EXPECT_EQ(dequeue_reserve(&queue, 100, seg, seg_len), 8);
+    EXPECT_EQ(seg_len[0], 7);
+    EXPECT_EQ(seg_len[1], 1);
+    EXPECT_EQ(seg[0][0].id, 3);
+    EXPECT_EQ(seg[0][6].id, 9);
+    EXPECT_EQ(seg[1][0].id, 10);
+
+    // Fill up while reserved; the new message is lost, not the reserved ones
+    msg.id = 11;
+    EXPECT_EQ(enqueue(&queue, &msg), EOK);
+    msg.id = 12;
+    EXPECT_EQ(enqueue(&queue, &msg), EOK);
+
+    EXPECT_EQ(queue.begin, 3);
+    EXPECT_EQ(queue.end, 2);
+    EXPECT_EQ(seg[0][0].id, 3);
+    EXPECT_EQ(seg[1][0].id, 10);
+
+    dequeue_release(&queue, queue.reserved);
+    EXPECT_EQ(queue.begin, 1);
+    EXPECT_EQ(queue.end, 2);
+
+    frame_t* dequeue_frame = dequeue_noblock(&queue, 0);
+
+    EXPECT_NE(dequeue_frame, nullptr);
+    EXPECT_EQ(dequeue_frame->id, 11);
+    EXPECT_EQ(dequeue_noblock(&queue, 0), nullptr);
+
+    destroy_queue(&queue);
+}
+
+TEST( Queue, FrameRecord ) {
+    EXPECT_EQ(sizeof(frame_t), 16);
+    EXPECT_EQ(64 / sizeof(frame_t), 4); // frames per cache line
+
+    struct can_msg canmsg;
+    frame_t frame;
+
+    // Standard MIDs are in bits 18-28
+    memset(&canmsg, 0, sizeof(canmsg));
+    canmsg.mid = 0x123 << 18;
+    canmsg.len = 3;
+    canmsg.dat[0] = 0x11;
+    canmsg.dat[1] = 0x22;
+    canmsg.dat[2] = 0x33;
+
+    frame_from_canmsg(&frame, &canmsg);
+
+    EXPECT_EQ(frame.id, 0x123);
+    EXPECT_EQ(frame.len, 3);
+    EXPECT_EQ(frame.data[2], 0x33);
+    EXPECT_EQ(frame_mid(&frame), 0x123 << 18);
+
+    struct can_msg out;
+    frame_to_canmsg(&frame, 1234, &out);
+
+    EXPECT_EQ(out.mid, 0x123 << 18);
+    EXPECT_EQ(out.len, 3);
+    EXPECT_EQ(out.dat[0], 0x11);
+    EXPECT_EQ(out.dat[2], 0x33);
+    EXPECT_EQ(out.ext.timestamp, 1234);
+    EXPECT_EQ(out.ext.is_extended_mid, 0);
+    EXPECT_EQ(out.ext.is_remote_frame, 1);
+
+    // Extended MIDs are in bits 0-28
+    canmsg.mid = 0x1F334455;
+    canmsg.ext.is_extended_mid = 1;
+    canmsg.len = 12; // client supplied; limited to CAN_MSG_DATA_MAX
+
+    frame_from_canmsg(&frame, &canmsg);
+
+    EXPECT_EQ(frame.id, 0x1F334455 | FRAME_EFF);
+    EXPECT_EQ(frame.len, CAN_MSG_DATA_MAX);
+    EXPECT_EQ(frame_mid(&frame), 0x1F334455);
+
+    frame.id |= FRAME_ECHO;
+    frame_to_canmsg(&frame, 0, &out);
+
+    EXPECT_EQ(out.mid, 0x1F334455);
+    EXPECT_EQ(out.ext.is_extended_mid, 1);
+    EXPECT_EQ(out.ext.is_remote_frame, 0);
+}
+
+TEST( Queue, StoredTime ) {
+    queue_t queue;
+    queue_attr_t attr = { .size = 4 };
+    frame_t frame = { .id = 0x123, .len = 1 };
+
+    EXPECT_EQ(create_queue(&queue, &attr), EOK);
+
+    // the receive time and the time stored travel in separate lanes
+    EXPECT_EQ(enqueue_at(&queue, &frame, 1000, 1500), EOK);
+    EXPECT_EQ(enqueue_tstamp(&queue, &frame, 2000), EOK);
+
+    frame_t* out = dequeue_noblock(&queue, 0);
+    ASSERT_NE(out, nullptr);
+    EXPECT_EQ(queue_tstamp(&queue, out), 1000);
+    EXPECT_EQ(queue_queued(&queue, out), 1500);
+
+    out = dequeue_noblock(&queue, 0);
+    ASSERT_NE(out, nullptr);
+    EXPECT_EQ(queue_tstamp(&queue, out), 2000);
+    EXPECT_EQ(queue_queued(&queue, out), 2000);
+
+    destroy_queue(&queue);
+}
+
+TEST( Queue, EnqueueWait ) {
+    queue_t queue;
+    queue_attr_t attr = { .size = 4 };
+    frame_t msg = {};
+
+    EXPECT_EQ(create_queue(&queue, &attr), EOK);
+
+    // fills up without losing anything, then refuses
+    for (msg.id = 0; msg.id < 4; ++msg.id) {
+        EXPECT_EQ(enqueue_wait(&queue, &msg, 1), EOK);
+    }
+
+    EXPECT_EQ(enqueue_wait(&queue, &msg, 1), EAGAIN);
+
+    // a blocked caller stores once a message is removed
+    pthread_t thread;
+    pthread_create(&thread, NULL, &enqueue_wait_loop, &queue);
+
+    usleep(5000);
+    EXPECT_EQ(queue.space_waiting, 1);
+
+    // with the ring at its end, storing again needs two free slots
+    frame_t* out = dequeue_noblock(&queue, 0);
+    ASSERT_NE(out, nullptr);
+    EXPECT_EQ(out->id, 0);
+
+    usleep(5000);
+    EXPECT_EQ(queue.space_waiting, 1);
+
+    out = dequeue_noblock(&queue, 0);
+    ASSERT_NE(out, nullptr);
+    EXPECT_EQ(out->id, 1);
+
+    void* value_ptr;
+    pthread_join(thread, &value_ptr);
+    EXPECT_EQ((intptr_t)value_ptr, EOK);
+    EXPECT_EQ(queue.space_waiting, 0);
+
+    for (uint32_t id : { 2, 3, 0x55 }) {
+        out = dequeue_noblock(&queue, 0);
+        ASSERT_NE(out, nullptr);
+        EXPECT_EQ(out->id, id);
+    }
+
+    EXPECT_EQ(dequeue_noblock(&queue, 0), nullptr);
+
+    // and is released by a shut down
+    while (enqueue_wait(&queue, &msg, 1) == EOK) {
+    }
+
+    pthread_create(&thread, NULL, &enqueue_wait_loop, &queue);
+
+    usleep(5000);
+    EXPECT_EQ(queue.space_waiting, 1);
+
+    destroy_queue(&queue);
+
+    pthread_join(thread, &value_ptr);
+    EXPECT_EQ((intptr_t)value_ptr, EPIPE);
+}
+
+TEST( Queue, ConcurrentReserve ) {
+    queue_t queue;
+    queue_attr_t attr = { .size = 10 };
+    frame_t msg = {};
+
+    EXPECT_EQ(create_queue(&queue, &attr), EOK);
+
+    for (msg.id = 1; msg.id <= 4; ++msg.id) {
+        EXPECT_EQ(enqueue(&queue, &msg), EOK);
+    }
+
+    frame_t* seg[2];
+    int seg_len[2];
+
+    EXPECT_EQ(dequeue_reserve(&queue, 2, seg, seg_len), 2);
+    EXPECT_EQ(seg[0][0].id, 1);
+
+    // a second reader waits for the first reservation to end
+    pthread_t thread;
+    pthread_create(&thread, NULL, &reserve_loop, &queue);
+
+    usleep(5000);
+    EXPECT_EQ(queue.space_waiting, 1);
+
+    dequeue_release(&queue, 2);
+
+    void* value_ptr;
+    pthread_join(thread, &value_ptr);
+    EXPECT_EQ((uintptr_t)value_ptr, 3);
+
+    EXPECT_EQ(dequeue_noblock(&queue, 0), nullptr);
+
+    destroy_queue(&queue);
+}
+
+TEST( Queue, RemovedCount ) {
+    queue_t queue;
+    queue_attr_t attr = { .size = 4 };
+    frame_t msg = {};
+    frame_t* seg[2];
+    int seg_len[2];
+
+    EXPECT_EQ(create_queue(&queue, &attr), EOK);
+    EXPECT_EQ(queue_removed(&queue), 0);
+
+    for (msg.id = 0; msg.id < 3; ++msg.id) {
+        EXPECT_EQ(enqueue(&queue, &msg), EOK);
+    }
+
+    EXPECT_NE(dequeue_noblock(&queue, 0), nullptr);
+    EXPECT_EQ(queue_removed(&queue), 1);
+
+    EXPECT_EQ(dequeue_reserve(&queue, 4, seg, seg_len), 2);
+    dequeue_release(&queue, 1);
+    EXPECT_EQ(queue_removed(&queue), 2);
+
+    // messages lost to a full queue count as well; the ids count up from 0,
+    // so the oldest one left is the number removed
+    for (msg.id = 3; msg.id < 7; ++msg.id) {
+        EXPECT_EQ(enqueue(&queue, &msg), EOK);
+    }
+
+    frame_t* out = dequeue_peek_noblock(&queue);
+    ASSERT_NE(out, nullptr);
+    EXPECT_GT(out->id, 2);
+    EXPECT_EQ(queue_removed(&queue), out->id);
+
+    destroy_queue(&queue);
+}
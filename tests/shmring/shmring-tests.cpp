@@ -0,0 +1,254 @@
+/**
+ * \file    shmring-tests.cpp
+ * \brief   Shared memory ring test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <vector>
+
+
+extern "C" {
+    #include <dev-can-linux/shmring.h>
+}
+
+struct record_t {
+    uint32_t seq;
+    uint8_t payload[20];
+};
+
+TEST( SharedMemoryRing, Geometry ) {
+    EXPECT_EQ(shmring_size(0, sizeof(record_t)), 0);
+    EXPECT_EQ(shmring_size(3, sizeof(record_t)), 0);
+    EXPECT_EQ(shmring_size(8, 0), 0);
+    EXPECT_EQ(shmring_size(SHMRING_MAX_SLOTS*2, sizeof(record_t)), 0);
+    EXPECT_EQ(shmring_size(8, sizeof(record_t)),
+            sizeof(shmring_t) + 8*sizeof(record_t));
+
+    std::vector<uint8_t> mem(shmring_size(8, sizeof(record_t)));
+    shmring_port_t port;
+
+    // Not formatted yet
+    EXPECT_EQ(shmring_attach(&port, mem.data(), mem.size(), 0), EINVAL);
+
+    EXPECT_EQ(shmring_init(mem.data(), mem.size() - 1, 8, sizeof(record_t)),
+            EINVAL);
+    EXPECT_EQ(shmring_init(mem.data(), mem.size(), 8, sizeof(record_t)), EOK);
+
+    EXPECT_EQ(shmring_attach(&port, mem.data(), mem.size() - 1, 0), EINVAL);
+    EXPECT_EQ(shmring_attach(&port, mem.data(), mem.size(), 4), EINVAL);
+    EXPECT_EQ(shmring_attach(&port, mem.data(), mem.size(), 0), EOK);
+    EXPECT_EQ(port.record_size, sizeof(record_t));
+    EXPECT_EQ(port.mask, 7);
+}
+
+TEST( SharedMemoryRing, FillAndDrain ) {
+    std::vector<uint8_t> mem(shmring_size(8, sizeof(record_t)));
+    shmring_port_t producer, consumer;
+
+    EXPECT_EQ(shmring_init(mem.data(), mem.size(), 8, sizeof(record_t)), EOK);
+    EXPECT_EQ(shmring_attach(&producer, mem.data(), mem.size(), 0), EOK);
+    EXPECT_EQ(shmring_attach(&consumer, mem.data(), mem.size(), 0), EOK);
+
+    record_t record = {};
+
+    EXPECT_EQ(shmring_pop(&consumer, &record), EAGAIN);
+    EXPECT_EQ(shmring_peek(&consumer), nullptr);
+
+    // Several rounds so that the counters wrap the slots a few times
+    uint32_t next = 0, expect = 0;
+
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < 8; ++i) {
+            record.seq = next++;
+            EXPECT_EQ(shmring_push(&producer, &record), EOK);
+        }
+
+        record.seq = 0xffff;
+        EXPECT_EQ(shmring_push(&producer, &record), EAGAIN);
+        EXPECT_EQ(shmring_count(&consumer), 8);
+
+        // Drain half by copy and half in place
+        for (int i = 0; i < 4; ++i) {
+            EXPECT_EQ(shmring_pop(&consumer, &record), EOK);
+            EXPECT_EQ(record.seq, expect++);
+        }
+
+        for (int i = 0; i < 4; ++i) {
+            record_t* slot = (record_t*)shmring_peek(&consumer);
+
+            ASSERT_NE(slot, nullptr);
+            EXPECT_EQ(slot->seq, expect++);
+
+            shmring_consume(&consumer);
+        }
+
+        EXPECT_EQ(shmring_pop(&consumer, &record), EAGAIN);
+        EXPECT_EQ(shmring_count(&consumer), 0);
+    }
+}
+
+TEST( SharedMemoryRing, Doorbell ) {
+    std::vector<uint8_t> mem(shmring_size(4, sizeof(record_t)));
+    shmring_port_t producer, consumer;
+
+    EXPECT_EQ(shmring_init(mem.data(), mem.size(), 4, sizeof(record_t)), EOK);
+    EXPECT_EQ(shmring_attach(&producer, mem.data(), mem.size(), 0), EOK);
+    EXPECT_EQ(shmring_attach(&consumer, mem.data(), mem.size(), 0), EOK);
+
+    record_t record = {};
+
+    // Nobody is waiting yet
+    EXPECT_EQ(shmring_push(&producer, &record), EOK);
+    EXPECT_EQ(shmring_need_wakeup(&producer), 0);
+
+    // A consumer must not sleep on a non-empty ring
+    EXPECT_EQ(shmring_prepare_wait(&consumer), 0);
+    EXPECT_EQ(shmring_need_wakeup(&producer), 0);
+
+    EXPECT_EQ(shmring_pop(&consumer, &record), EOK);
+    EXPECT_EQ(shmring_prepare_wait(&consumer), 1);
+
+    // Only the push that ends the empty period rings the doorbell
+    EXPECT_EQ(shmring_push(&producer, &record), EOK);
+    EXPECT_EQ(shmring_need_wakeup(&producer), 1);
+    EXPECT_EQ(shmring_push(&producer, &record), EOK);
+    EXPECT_EQ(shmring_need_wakeup(&producer), 0);
+}
+
+struct stream_t {
+    shmring_port_t producer, consumer;
+    uint32_t count;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int doorbell;
+    int wakeups;
+};
+
+static void* stream_producer (void* arg) {
+    stream_t* s = (stream_t*)arg;
+    record_t record = {};
+
+    for (uint32_t i = 0; i < s->count; ) {
+        record.seq = i;
+        record.payload[0] = (uint8_t)i;
+
+        if (shmring_push(&s->producer, &record) != EOK) {
+            sched_yield();
+            continue;
+        }
+
+        ++i;
+
+        if (shmring_need_wakeup(&s->producer)) {
+            pthread_mutex_lock(&s->mutex);
+            s->doorbell = 1;
+            ++s->wakeups;
+            pthread_cond_signal(&s->cond);
+            pthread_mutex_unlock(&s->mutex);
+        }
+    }
+
+    return NULL;
+}
+
+TEST( SharedMemoryRing, PosixShmStream ) {
+    const uint32_t slots = 64;
+    size_t size = shmring_size(slots, sizeof(record_t));
+
+    // Two mappings of the same object, as between the driver and a client
+    char name[64];
+    snprintf(name, sizeof(name), "/shmring-tests-%d", getpid());
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    ASSERT_NE(fd, -1);
+    shm_unlink(name);
+
+    ASSERT_EQ(ftruncate(fd, size), 0);
+
+    void* driver_mem =
+        mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void* client_mem =
+        mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    ASSERT_NE(driver_mem, MAP_FAILED);
+    ASSERT_NE(client_mem, MAP_FAILED);
+
+    stream_t s;
+    s.count = 200000;
+    s.doorbell = 0;
+    s.wakeups = 0;
+    pthread_mutex_init(&s.mutex, NULL);
+    pthread_cond_init(&s.cond, NULL);
+
+    EXPECT_EQ(shmring_init(driver_mem, size, slots, sizeof(record_t)), EOK);
+    EXPECT_EQ(shmring_attach(&s.producer, driver_mem, size,
+                sizeof(record_t)), EOK);
+    EXPECT_EQ(shmring_attach(&s.consumer, client_mem, size, 0), EOK);
+
+    pthread_t thread;
+    ASSERT_EQ(pthread_create(&thread, NULL, stream_producer, &s), 0);
+
+    record_t record;
+    uint32_t expect = 0;
+    int sleeps = 0;
+
+    while (expect < s.count) {
+        if (shmring_pop(&s.consumer, &record) == EOK) {
+            EXPECT_EQ(record.seq, expect);
+            EXPECT_EQ(record.payload[0], (uint8_t)expect);
+
+            ++expect;
+            continue;
+        }
+
+        if (!shmring_prepare_wait(&s.consumer)) {
+            continue;
+        }
+
+        // A lost wake up would hang here
+        pthread_mutex_lock(&s.mutex);
+        while (!s.doorbell) {
+            pthread_cond_wait(&s.cond, &s.mutex);
+        }
+        s.doorbell = 0;
+        pthread_mutex_unlock(&s.mutex);
+
+        ++sleeps;
+    }
+
+    pthread_join(thread, NULL);
+
+    EXPECT_EQ(shmring_pop(&s.consumer, &record), EAGAIN);
+
+    // The consumer never slept without being rung for
+    EXPECT_LE(sleeps, s.wakeups);
+
+    munmap(driver_mem, size);
+    munmap(client_mem, size);
+
+    pthread_cond_destroy(&s.cond);
+    pthread_mutex_destroy(&s.mutex);
+}
@@ -0,0 +1,332 @@
+/**
+ * \file    sja1000sim-tests.cpp
+ * \brief   SJA1000 simulator test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+
+extern "C" {
+    #include <sja1000sim.h>
+}
+
+// PeliCAN registers and bits used by the tests
+enum {
+    MOD = 0x00, CMR = 0x01, SR = 0x02, IR = 0x03, IER = 0x04,
+    ECC = 0x0C, RXERR = 0x0E, TXERR = 0x0F, FI = 0x10, ID1 = 0x11,
+    ID2 = 0x12, SFF_BUF = 0x13, ACR0 = 0x10, AMR0 = 0x14, RMC = 0x1D,
+    RBSA = 0x1E
+};
+
+enum { MOD_RM = 0x01, MOD_LOM = 0x02, MOD_STM = 0x04 };
+enum { CMD_SRR = 0x10, CMD_CDO = 0x08, CMD_RRB = 0x04, CMD_AT = 0x02,
+       CMD_TR = 0x01 };
+enum { IRQ_BEI = 0x80, IRQ_EPI = 0x20, IRQ_DOI = 0x08, IRQ_EI = 0x04,
+       IRQ_TI = 0x02, IRQ_RI = 0x01, IRQ_ALL = 0xFF };
+enum { SR_BS = 0x80, SR_ES = 0x40, SR_TCS = 0x08, SR_TBS = 0x04,
+       SR_DOS = 0x02, SR_RBS = 0x01 };
+
+static void count_irq (void* arg) {
+    ++*(int*)arg;
+}
+
+static void start (sja1000_sim_t* sim) {
+    sja1000_sim_write(sim, IER, IRQ_ALL);
+    sja1000_sim_write(sim, MOD, 0x00);
+}
+
+// Load the transmit buffer with a standard frame, as sja1000_start_xmit() does
+static void load_sff (sja1000_sim_t* sim, uint32_t id,
+        const std::vector<uint8_t>& data)
+{
+    sja1000_sim_write(sim, FI, data.size());
+    sja1000_sim_write(sim, ID1, (id & 0x000007f8) >> 3);
+    sja1000_sim_write(sim, ID2, (id & 0x00000007) << 5);
+
+    for (size_t i = 0; i < data.size(); ++i) {
+        sja1000_sim_write(sim, SFF_BUF + i, data[i]);
+    }
+}
+
+// Read the current message from the receive window, as sja1000_rx() does
+static uint32_t read_sff (sja1000_sim_t* sim, std::vector<uint8_t>& data) {
+    uint8_t fi = sja1000_sim_read(sim, FI);
+    uint32_t id = (sja1000_sim_read(sim, ID1) << 3)
+                | (sja1000_sim_read(sim, ID2) >> 5);
+
+    data.clear();
+
+    for (int i = 0; i < (fi & 0x0F); ++i) {
+        data.push_back(sja1000_sim_read(sim, SFF_BUF + i));
+    }
+
+    sja1000_sim_write(sim, CMR, CMD_RRB);
+
+    return id;
+}
+
+class SJA1000Sim : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_EQ(sja1000_sim_bus_init(&bus), EOK);
+        ASSERT_EQ(sja1000_sim_init(&a, &bus, count_irq, &irq_a), EOK);
+        ASSERT_EQ(sja1000_sim_init(&b, &bus, count_irq, &irq_b), EOK);
+    }
+
+    void TearDown() override {
+        sja1000_sim_destroy(&b);
+        sja1000_sim_destroy(&a);
+        sja1000_sim_bus_destroy(&bus);
+    }
+
+    sja1000_sim_bus_t bus;
+    sja1000_sim_t a, b;
+    int irq_a = 0, irq_b = 0;
+};
+
+TEST_F( SJA1000Sim, ResetState ) {
+    EXPECT_EQ(sja1000_sim_read(&a, MOD) & MOD_RM, MOD_RM);
+    EXPECT_EQ(sja1000_sim_read(&a, SR), SR_TBS | SR_TCS);
+    EXPECT_EQ(sja1000_sim_read(&a, IR), 0);
+    EXPECT_EQ(sja1000_sim_read(&a, RMC), 0);
+
+    // Acceptance filter registers are only visible in reset mode
+    sja1000_sim_write(&a, ACR0, 0x5A);
+    EXPECT_EQ(sja1000_sim_read(&a, ACR0), 0x5A);
+    EXPECT_EQ(sja1000_sim_read(&a, AMR0), 0xFF);
+
+    start(&a);
+
+    EXPECT_EQ(sja1000_sim_read(&a, MOD) & MOD_RM, 0);
+    EXPECT_FALSE(sja1000_sim_irq_active(&a));
+}
+
+TEST_F( SJA1000Sim, Transfer ) {
+    start(&a);
+    start(&b);
+
+    load_sff(&a, 0x123, { 0x11, 0x22, 0x33, 0x44 });
+    sja1000_sim_write(&a, CMR, CMD_TR);
+
+    // Transmitter completes and raises TI; reading IR clears it
+    EXPECT_EQ(irq_a, 1);
+    EXPECT_EQ(sja1000_sim_read(&a, SR) & (SR_TBS | SR_TCS), SR_TBS | SR_TCS);
+    EXPECT_EQ(sja1000_sim_read(&a, IR), IRQ_TI);
+    EXPECT_EQ(sja1000_sim_read(&a, IR), 0);
+    EXPECT_FALSE(sja1000_sim_irq_active(&a));
+
+    // Receiver holds the frame; RI stays set until the buffer is released
+    EXPECT_EQ(irq_b, 1);
+    EXPECT_EQ(sja1000_sim_read(&b, SR) & SR_RBS, SR_RBS);
+    EXPECT_EQ(sja1000_sim_read(&b, IR), IRQ_RI);
+    EXPECT_EQ(sja1000_sim_read(&b, IR), IRQ_RI);
+    EXPECT_EQ(sja1000_sim_read(&b, RMC), 1);
+
+    std::vector<uint8_t> data;
+    EXPECT_EQ(read_sff(&b, data), 0x123);
+    EXPECT_EQ(data, std::vector<uint8_t>({ 0x11, 0x22, 0x33, 0x44 }));
+
+    EXPECT_EQ(sja1000_sim_read(&b, SR) & SR_RBS, 0);
+    EXPECT_EQ(sja1000_sim_read(&b, RMC), 0);
+    EXPECT_FALSE(sja1000_sim_irq_active(&b));
+
+    EXPECT_EQ(bus.frames, 1);
+}
+
+TEST_F( SJA1000Sim, Fifo ) {
+    start(&a);
+    start(&b);
+
+    // 8 data byte standard frames take 11 bytes; 5 fit in the 64 byte FIFO
+    for (int i = 0; i < 6; ++i) {
+        load_sff(&a, 0x100 + i, { (uint8_t)i, 1, 2, 3, 4, 5, 6, 7 });
+        sja1000_sim_write(&a, CMR, CMD_TR);
+    }
+
+    EXPECT_EQ(sja1000_sim_read(&b, RMC), 5);
+    EXPECT_EQ(sja1000_sim_read(&b, SR) & SR_DOS, SR_DOS);
+    EXPECT_EQ(sja1000_sim_read(&b, IR), IRQ_DOI | IRQ_RI);
+    EXPECT_EQ(b.rx_overruns, 1);
+
+    sja1000_sim_write(&b, CMR, CMD_CDO);
+    EXPECT_EQ(sja1000_sim_read(&b, SR) & SR_DOS, 0);
+
+    std::vector<uint8_t> data;
+
+    // Messages wrap around the end of the FIFO
+    for (int round = 0; round < 3; ++round) {
+        uint32_t id = read_sff(&b, data);
+
+        load_sff(&a, id + 0x10, { (uint8_t)round, 1, 2, 3, 4, 5, 6, 7 });
+        sja1000_sim_write(&a, CMR, CMD_TR);
+    }
+
+    uint32_t expect[] = { 0x103, 0x104, 0x110, 0x111, 0x112 };
+
+    for (uint32_t id : expect) {
+        ASSERT_EQ(sja1000_sim_read(&b, SR) & SR_RBS, SR_RBS);
+        EXPECT_EQ(read_sff(&b, data), id);
+        EXPECT_EQ(data.size(), 8);
+        EXPECT_EQ(data[7], 7);
+    }
+
+    EXPECT_EQ(sja1000_sim_read(&b, RMC), 0);
+    EXPECT_EQ(sja1000_sim_read(&b, RBSA), (8*11) % 64);
+}
+
+TEST_F( SJA1000Sim, AcceptanceFilter ) {
+    // Dual filter mode; filter 1 matches id 0x120-0x12F, filter 2 nothing
+    sja1000_sim_write(&b, ACR0, 0x24);
+    sja1000_sim_write(&b, AMR0, 0x01);
+    sja1000_sim_write(&b, AMR0 + 1, 0xFF);
+    sja1000_sim_write(&b, ACR0 + 2, 0xFF);
+    sja1000_sim_write(&b, AMR0 + 2, 0x00);
+    sja1000_sim_write(&b, AMR0 + 3, 0x0F);
+
+    start(&a);
+    start(&b);
+
+    load_sff(&a, 0x125, { 1 });
+    sja1000_sim_write(&a, CMR, CMD_TR);
+
+    load_sff(&a, 0x225, { 2 });
+    sja1000_sim_write(&a, CMR, CMD_TR);
+
+    // Frames filtered out are still acknowledged
+    EXPECT_EQ(sja1000_sim_read(&a, TXERR), 0);
+    EXPECT_EQ(sja1000_sim_read(&b, RMC), 1);
+
+    std::vector<uint8_t> data;
+    EXPECT_EQ(read_sff(&b, data), 0x125);
+}
+
+TEST_F( SJA1000Sim, AckError ) {
+    start(&a);
+
+    // b is in reset mode, so nobody acknowledges
+    load_sff(&a, 0x7FF, { 0xAA });
+    sja1000_sim_write(&a, CMR, CMD_TR);
+
+    EXPECT_EQ(sja1000_sim_read(&a, TXERR), 128);
+    EXPECT_EQ(sja1000_sim_read(&a, SR) & (SR_TBS | SR_ES), SR_ES);
+    EXPECT_EQ(sja1000_sim_read(&a, ECC), 0xC0 | 0x19);
+    EXPECT_EQ(sja1000_sim_read(&a, IR), IRQ_BEI | IRQ_EPI | IRQ_EI);
+    EXPECT_EQ(bus.ack_errors, 1);
+
+    // The request completes once a receiver joins
+    start(&b);
+
+    EXPECT_EQ(sja1000_sim_read(&a, SR) & (SR_TBS | SR_TCS), SR_TBS | SR_TCS);
+    EXPECT_EQ(sja1000_sim_read(&a, TXERR), 127);
+    EXPECT_EQ(sja1000_sim_read(&a, IR), IRQ_TI | IRQ_EPI);
+    EXPECT_EQ(sja1000_sim_read(&b, RMC), 1);
+}
+
+TEST_F( SJA1000Sim, SingleShot ) {
+    start(&a);
+
+    load_sff(&a, 0x100, { 0x01 });
+    sja1000_sim_write(&a, CMR, CMD_TR | CMD_AT);
+
+    // Released without completion after a single attempt
+    EXPECT_EQ(sja1000_sim_read(&a, SR) & (SR_TBS | SR_TCS), SR_TBS);
+    EXPECT_EQ(sja1000_sim_read(&a, TXERR), 8);
+    EXPECT_EQ(sja1000_sim_read(&a, IR), IRQ_BEI | IRQ_TI);
+}
+
+TEST_F( SJA1000Sim, SelfReception ) {
+    sja1000_sim_write(&a, MOD, MOD_RM | MOD_STM);
+    sja1000_sim_write(&a, IER, IRQ_ALL);
+    sja1000_sim_write(&a, MOD, MOD_STM);
+
+    load_sff(&a, 0x42, { 0x01, 0x02 });
+    sja1000_sim_write(&a, CMR, CMD_SRR);
+
+    EXPECT_EQ(sja1000_sim_read(&a, IR), IRQ_TI | IRQ_RI);
+
+    std::vector<uint8_t> data;
+    EXPECT_EQ(read_sff(&a, data), 0x42);
+    EXPECT_EQ(data, std::vector<uint8_t>({ 0x01, 0x02 }));
+
+    // Listen only controllers cannot transmit nor acknowledge
+    sja1000_sim_write(&b, MOD, MOD_RM | MOD_LOM);
+    sja1000_sim_write(&b, MOD, MOD_LOM);
+
+    load_sff(&b, 0x43, {});
+    sja1000_sim_write(&b, CMR, CMD_TR);
+
+    EXPECT_EQ(bus.frames, 1);
+}
+
+TEST_F( SJA1000Sim, BusOff ) {
+    start(&a);
+    start(&b);
+
+    for (int i = 0; i < 12; ++i) {
+        sja1000_sim_inject_error(&a, true);
+    }
+
+    EXPECT_EQ(sja1000_sim_read(&a, SR) & (SR_BS | SR_ES), SR_ES);
+    EXPECT_EQ(sja1000_sim_read(&a, IR), IRQ_BEI | IRQ_EI);
+
+    for (int i = 0; i < 20; ++i) {
+        sja1000_sim_inject_error(&a, true);
+    }
+
+    // Bus-off puts the controller into reset mode
+    EXPECT_EQ(sja1000_sim_read(&a, SR) & (SR_BS | SR_ES), SR_BS | SR_ES);
+    EXPECT_EQ(sja1000_sim_read(&a, MOD) & MOD_RM, MOD_RM);
+    EXPECT_EQ(sja1000_sim_read(&a, IR) & IRQ_EI, IRQ_EI);
+
+    // Leaving reset mode recovers
+    sja1000_sim_write(&a, MOD, 0x00);
+
+    EXPECT_EQ(sja1000_sim_read(&a, SR) & (SR_BS | SR_ES), 0);
+    EXPECT_EQ(sja1000_sim_read(&a, TXERR), 0);
+
+    sja1000_sim_inject_error(&b, false);
+    EXPECT_EQ(sja1000_sim_read(&b, RXERR), 1);
+    EXPECT_EQ(sja1000_sim_read(&b, ECC) & 0x20, 0x20);
+}
+
+TEST_F( SJA1000Sim, Inject ) {
+    start(&a);
+    start(&b);
+
+    sja1000_sim_frame_t frame = {};
+    frame.id = 0x1FFFFFFF;
+    frame.eff = true;
+    frame.len = 3;
+    frame.data[0] = 0xDE;
+
+    EXPECT_EQ(sja1000_sim_bus_inject(&bus, &frame), EOK);
+
+    EXPECT_EQ(sja1000_sim_read(&a, RMC), 1);
+    EXPECT_EQ(sja1000_sim_read(&b, RMC), 1);
+
+    // Extended frame information and identifier
+    EXPECT_EQ(sja1000_sim_read(&a, FI), 0x80 | 3);
+    EXPECT_EQ(sja1000_sim_read(&a, ID1), 0xFF);
+    EXPECT_EQ(sja1000_sim_read(&a, 0x15), 0xDE);
+
+    frame.len = 16;
+    EXPECT_EQ(sja1000_sim_bus_inject(&bus, &frame), EINVAL);
+}
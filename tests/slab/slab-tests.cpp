@@ -0,0 +1,263 @@
+/**
+ * \file    slab-tests.cpp
+ * \brief   Slab object cache test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include <set>
+#include <vector>
+
+
+extern "C" {
+    #include <slab.h>
+}
+
+struct object_t {
+    uint32_t seq;
+    uint8_t payload[20];
+};
+
+TEST( SlabCache, Init ) {
+    slab_cache_t cache;
+
+    EXPECT_EQ(slab_cache_init(&cache, "test", 0, 8), EINVAL);
+    EXPECT_EQ(slab_cache_init(&cache, "test", sizeof(object_t), 0), EINVAL);
+
+    EXPECT_EQ(slab_cache_init(&cache, "test", sizeof(object_t), 8), EOK);
+    EXPECT_EQ(cache.object_size % SLAB_ALIGN, 0);
+    EXPECT_GE(cache.object_size, sizeof(object_t));
+
+    slab_stats_t stats;
+    slab_cache_stats(&cache, &stats);
+
+    EXPECT_EQ(stats.objects, 8);
+    EXPECT_EQ(stats.in_use, 0);
+    EXPECT_EQ(stats.high_water, 0);
+    EXPECT_EQ(stats.failures, 0);
+
+    slab_cache_destroy(&cache);
+}
+
+TEST( SlabCache, Exhaustion ) {
+    slab_cache_t cache;
+    const uint32_t n = 40;
+
+    ASSERT_EQ(slab_cache_init(&cache, "test", sizeof(object_t), n), EOK);
+
+    std::set<void*> objects;
+
+    for (uint32_t i = 0; i < n; ++i) {
+        object_t* obj = (object_t*)slab_alloc(&cache);
+
+        ASSERT_NE(obj, nullptr);
+        EXPECT_EQ((uintptr_t)obj % SLAB_ALIGN, 0);
+
+        obj->seq = i;
+        objects.insert(obj);
+    }
+
+    // All distinct
+    EXPECT_EQ(objects.size(), n);
+
+    EXPECT_EQ(slab_alloc(&cache), nullptr);
+
+    slab_stats_t stats;
+    slab_cache_stats(&cache, &stats);
+
+    EXPECT_EQ(stats.in_use, n);
+    EXPECT_EQ(stats.high_water, n);
+    EXPECT_EQ(stats.failures, 1);
+
+    for (void* obj : objects) {
+        slab_free(obj);
+    }
+
+    slab_cache_stats(&cache, &stats);
+
+    EXPECT_EQ(stats.in_use, 0);
+    EXPECT_EQ(stats.high_water, n);
+
+    // Everything can be allocated again
+    objects.clear();
+
+    for (uint32_t i = 0; i < n; ++i) {
+        void* obj = slab_alloc(&cache);
+
+        ASSERT_NE(obj, nullptr);
+        objects.insert(obj);
+    }
+
+    EXPECT_EQ(objects.size(), n);
+
+    for (void* obj : objects) {
+        slab_free(obj);
+    }
+
+    slab_cache_destroy(&cache);
+}
+
+TEST( SlabCache, FreeFindsOwner ) {
+    slab_cache_t a, b;
+
+    ASSERT_EQ(slab_cache_init(&a, "a", 24, 16), EOK);
+    ASSERT_EQ(slab_cache_init(&b, "b", 64, 16), EOK);
+
+    void* obj_a = slab_alloc(&a);
+    void* obj_b = slab_alloc(&b);
+
+    ASSERT_NE(obj_a, nullptr);
+    ASSERT_NE(obj_b, nullptr);
+
+    slab_free(obj_b);
+    slab_free(obj_a);
+    slab_free(nullptr);
+
+    slab_stats_t stats;
+
+    slab_cache_stats(&a, &stats);
+    EXPECT_EQ(stats.in_use, 0);
+    EXPECT_EQ(stats.high_water, 1);
+
+    slab_cache_stats(&b, &stats);
+    EXPECT_EQ(stats.in_use, 0);
+    EXPECT_EQ(stats.high_water, 1);
+
+    slab_cache_destroy(&b);
+    slab_cache_destroy(&a);
+}
+
+TEST( SlabCache, Reinit ) {
+    slab_cache_t cache;
+
+    // A destroyed cache's objects must not linger in this thread's magazine
+    for (int round = 0; round < 3; ++round) {
+        ASSERT_EQ(slab_cache_init(&cache, "test", sizeof(object_t), 4), EOK);
+
+        std::vector<void*> objects;
+
+        for (int i = 0; i < 4; ++i) {
+            void* obj = slab_alloc(&cache);
+
+            ASSERT_NE(obj, nullptr);
+            EXPECT_GE((uint8_t*)obj, cache.mem);
+            EXPECT_LT((uint8_t*)obj, cache.mem + 4*cache.object_size);
+
+            objects.push_back(obj);
+        }
+
+        for (void* obj : objects) {
+            slab_free(obj);
+        }
+
+        slab_cache_destroy(&cache);
+    }
+}
+
+struct worker_args_t {
+    slab_cache_t* cache;
+    int iterations;
+    int failures;
+};
+
+static void* worker (void* arg) {
+    worker_args_t* args = (worker_args_t*)arg;
+    std::vector<object_t*> held;
+
+    for (int i = 0; i < args->iterations; ++i) {
+        object_t* obj = (object_t*)slab_alloc(args->cache);
+
+        if (obj == nullptr) {
+            args->failures++;
+        }
+        else {
+            obj->seq = i;
+            held.push_back(obj);
+        }
+
+        // Free in bursts so that objects travel through the depot
+        if (held.size() == 24 || (obj == nullptr && !held.empty())) {
+            for (object_t* o : held) {
+                slab_free(o);
+            }
+
+            held.clear();
+        }
+    }
+
+    for (object_t* o : held) {
+        slab_free(o);
+    }
+
+    return NULL;
+}
+
+TEST( SlabCache, Threads ) {
+    const int num_threads = 4;
+    const uint32_t n = num_threads*(24 + SLAB_MAGAZINE_SIZE);
+    slab_cache_t cache;
+
+    ASSERT_EQ(slab_cache_init(&cache, "test", sizeof(object_t), n), EOK);
+
+    for (int round = 0; round < 4; ++round) {
+        pthread_t threads[num_threads];
+        worker_args_t args[num_threads];
+
+        for (int i = 0; i < num_threads; ++i) {
+            args[i] = { &cache, 20000, 0 };
+
+            ASSERT_EQ(pthread_create(&threads[i], NULL, &worker, &args[i]),
+                    EOK);
+        }
+
+        for (int i = 0; i < num_threads; ++i) {
+            pthread_join(threads[i], NULL);
+
+            // Enough objects for every thread's burst and magazine
+            EXPECT_EQ(args[i].failures, 0);
+        }
+
+        slab_stats_t stats;
+        slab_cache_stats(&cache, &stats);
+
+        EXPECT_EQ(stats.in_use, 0);
+        EXPECT_LE(stats.high_water, n);
+    }
+
+    // The exited threads' magazines went back to the depot
+    std::set<void*> objects;
+
+    for (uint32_t i = 0; i < n; ++i) {
+        void* obj = slab_alloc(&cache);
+
+        ASSERT_NE(obj, nullptr);
+        objects.insert(obj);
+    }
+
+    EXPECT_EQ(objects.size(), n);
+    EXPECT_EQ(slab_alloc(&cache), nullptr);
+
+    for (void* obj : objects) {
+        slab_free(obj);
+    }
+
+    slab_cache_destroy(&cache);
+}
@@ -0,0 +1,191 @@
+/**
+ * \file    timerwheel-tests.cpp
+ * \brief   Timer wheel test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+
+extern "C" {
+    #include <timerwheel.h>
+}
+
+static timer_wheel_t wheel;
+
+/* Tick at which e fires when the wheel is driven by timer_wheel_next() */
+static uint64_t run_until_fired (timer_entry_t* e) {
+    for (;;) {
+        uint64_t t = timer_wheel_next(&wheel);
+
+        if (t == TIMER_WHEEL_NEVER) {
+            return TIMER_WHEEL_NEVER;
+        }
+
+        timer_entry_t* x;
+
+        while ((x = timer_wheel_expire(&wheel, t)) != NULL) {
+            if (x == e) {
+                return t;
+            }
+        }
+    }
+}
+
+TEST( TimerWheel, Empty ) {
+    timer_wheel_init(&wheel, 1000);
+
+    EXPECT_EQ(timer_wheel_next(&wheel), TIMER_WHEEL_NEVER);
+    EXPECT_EQ(timer_wheel_expire(&wheel, 5000), nullptr);
+    EXPECT_EQ(wheel.now, 5001u);
+
+    timer_wheel_sync(&wheel, 9000);
+    EXPECT_EQ(wheel.now, 9000u);
+}
+
+TEST( TimerWheel, FiresOnTime ) {
+    const uint64_t delays[] = { 0, 1, 2, 63, 64, 65, 100, 4095, 4096, 4097,
+            70000, 262143, 262144, 1000000, TIMER_WHEEL_MAX_TICKS };
+
+    for (uint64_t start : { 0ULL, 1ULL, 63ULL, 64ULL, 12345ULL, 262143ULL }) {
+        for (uint64_t delay : delays) {
+            timer_entry_t e;
+            timer_entry_init(&e);
+            timer_wheel_init(&wheel, start);
+
+            timer_wheel_add(&wheel, &e, start + delay);
+            EXPECT_TRUE(timer_entry_pending(&e));
+
+            EXPECT_EQ(run_until_fired(&e), start + delay)
+                << "start " << start << " delay " << delay;
+
+            EXPECT_FALSE(timer_entry_pending(&e));
+            EXPECT_EQ(wheel.pending, 0u);
+        }
+    }
+}
+
+TEST( TimerWheel, Clamped ) {
+    timer_entry_t late, early;
+    timer_entry_init(&late);
+    timer_entry_init(&early);
+    timer_wheel_init(&wheel, 100);
+
+    timer_wheel_add(&wheel, &late, 100 + TIMER_WHEEL_MAX_TICKS + 50);
+    EXPECT_EQ(late.expires, 100 + TIMER_WHEEL_MAX_TICKS);
+
+    timer_wheel_add(&wheel, &early, 20);
+    EXPECT_EQ(early.expires, 100u);
+    EXPECT_EQ(timer_wheel_expire(&wheel, 100), &early);
+}
+
+TEST( TimerWheel, DeleteAndReAdd ) {
+    timer_entry_t a, b;
+    timer_entry_init(&a);
+    timer_entry_init(&b);
+    timer_wheel_init(&wheel, 0);
+
+    timer_wheel_add(&wheel, &a, 10);
+    timer_wheel_add(&wheel, &b, 5000);
+    EXPECT_EQ(wheel.pending, 2u);
+
+    timer_wheel_del(&wheel, &a);
+    timer_wheel_del(&wheel, &a); // no-op
+    EXPECT_FALSE(timer_entry_pending(&a));
+    EXPECT_EQ(wheel.pending, 1u);
+
+    // adding a pending timer moves it
+    timer_wheel_add(&wheel, &b, 30);
+    EXPECT_EQ(wheel.pending, 1u);
+
+    EXPECT_EQ(timer_wheel_expire(&wheel, 29), nullptr);
+    EXPECT_EQ(timer_wheel_expire(&wheel, 10000), &b);
+    EXPECT_EQ(timer_wheel_expire(&wheel, 10000), nullptr);
+}
+
+/* A far timer wakes the wheel only for its cascades, not every round */
+TEST( TimerWheel, FarTimerWakeups ) {
+    timer_entry_t e;
+    timer_entry_init(&e);
+    timer_wheel_init(&wheel, 10);
+
+    // level 2 slot 1, cascaded at 4096, then level 1 slot 14 at 4992
+    timer_wheel_add(&wheel, &e, 5000);
+    EXPECT_EQ(timer_wheel_next(&wheel), 4096u);
+
+    EXPECT_EQ(timer_wheel_expire(&wheel, 4096), nullptr);
+    EXPECT_EQ(timer_wheel_next(&wheel), 4992u);
+
+    EXPECT_EQ(timer_wheel_expire(&wheel, 4992), nullptr);
+    EXPECT_EQ(timer_wheel_next(&wheel), 5000u);
+
+    EXPECT_EQ(timer_wheel_expire(&wheel, 5000), &e);
+    EXPECT_EQ(timer_wheel_next(&wheel), TIMER_WHEEL_NEVER);
+}
+
+/* Random timers, cancels and clock steps against a plain list */
+TEST( TimerWheel, Random ) {
+    const int n = 2000;
+    std::mt19937_64 rng(12345);
+    std::vector<timer_entry_t> e(n);
+    std::vector<uint64_t> fired(n, TIMER_WHEEL_NEVER);
+    std::vector<bool> cancelled(n, false);
+    uint64_t now = 5;
+
+    timer_wheel_init(&wheel, now);
+
+    for (int i = 0; i < n; ++i) {
+        timer_entry_init(&e[i]);
+        timer_wheel_add(&wheel, &e[i], now + rng() % 300000);
+    }
+
+    while (wheel.pending) {
+        now += 1 + rng() % 200;
+
+        timer_entry_t* x;
+
+        while ((x = timer_wheel_expire(&wheel, now)) != NULL) {
+            int i = x - &e[0];
+
+            EXPECT_EQ(fired[i], TIMER_WHEEL_NEVER);
+            fired[i] = now;
+
+            // cancel another timer now and then
+            int j = rng() % n;
+
+            if (timer_entry_pending(&e[j])) {
+                timer_wheel_del(&wheel, &e[j]);
+                cancelled[j] = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        if (cancelled[i]) {
+            EXPECT_EQ(fired[i], TIMER_WHEEL_NEVER);
+            continue;
+        }
+
+        // fired by the first step at or past its expiry
+        EXPECT_GE(fired[i], e[i].expires);
+        EXPECT_LT(fired[i], e[i].expires + 200);
+    }
+}
@@ -0,0 +1,192 @@
+/**
+ * \file    trace-tests.cpp
+ * \brief   Trace point ring test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+extern "C" {
+    #include <trace.h>
+}
+
+#if CONFIG_TRACE == 1
+
+#define READ_MAX    32
+
+/* Read all of ring r from first on */
+static std::vector<can_trace_record> read_ring (int r, uint64_t first,
+        uint64_t* next = nullptr)
+{
+    std::vector<can_trace_record> all;
+    can_trace_record rec[READ_MAX];
+    uint64_t head;
+    int n;
+
+    do {
+        EXPECT_EQ(trace_read(r, first, rec, READ_MAX,
+                    &n, &first, &head), EOK);
+
+        all.insert(all.end(), rec, rec + n);
+    } while (n == READ_MAX);
+
+    if (next != nullptr) {
+        *next = first;
+    }
+
+    return all;
+}
+
+TEST( Trace, RecordSize ) {
+    EXPECT_EQ(sizeof(struct can_trace_record), 32u);
+}
+
+TEST( Trace, WriteRead ) {
+    std::thread([] {
+        trace(CAN_TRACE_IO_DEVCTL, 7, 0x1234);
+
+        uint8_t dat[8] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 };
+
+        trace(CAN_TRACE_RX_FRAME, CAN_TRACE_FRAME_ARG0(3, 8), 0x123,
+                CAN_TRACE_DATA(dat, 0), CAN_TRACE_DATA(dat, 4));
+
+        int r = trace_ring;
+        uint64_t head = __atomic_load_n(&trace_rings[r].head,
+                __ATOMIC_RELAXED);
+
+        auto rec = read_ring(r, head - 2);
+        ASSERT_EQ(rec.size(), 2u);
+
+        EXPECT_EQ(rec[0].event, CAN_TRACE_IO_DEVCTL);
+        EXPECT_EQ(rec[0].arg[0], 7u);
+        EXPECT_EQ(rec[0].arg[1], 0x1234u);
+        EXPECT_EQ(rec[0].arg[2], 0u); // missing arguments are 0
+        EXPECT_EQ(rec[0].arg[3], 0u);
+        EXPECT_EQ(rec[0].seq, (uint32_t)(head - 1));
+        EXPECT_EQ(rec[0].thread, trace_thread);
+
+        EXPECT_EQ(rec[1].event, CAN_TRACE_RX_FRAME);
+        EXPECT_EQ(CAN_TRACE_UNIT(rec[1].arg[0]), 3u);
+        EXPECT_EQ(CAN_TRACE_LEN(rec[1].arg[0]), 8u);
+        EXPECT_EQ(rec[1].arg[1], 0x123u);
+        EXPECT_EQ(rec[1].arg[2], 0x11223344u);
+        EXPECT_EQ(rec[1].arg[3], 0x55667788u);
+    }).join();
+}
+
+TEST( Trace, Overwritten ) {
+    std::thread([] {
+        trace(CAN_TRACE_NONE);
+
+        int r = trace_ring;
+        uint64_t first = __atomic_load_n(&trace_rings[r].head,
+                __ATOMIC_RELAXED);
+
+        for (uint32_t i = 0; i < TRACE_RING_RECORDS + 100; ++i) {
+            trace(CAN_TRACE_IO_READ, i);
+        }
+
+        uint64_t next;
+        auto rec = read_ring(r, first, &next);
+
+        // only the latest ring full is left, oldest first
+        ASSERT_EQ(rec.size(), (size_t)TRACE_RING_RECORDS);
+        EXPECT_EQ(rec.front().arg[0], 100u);
+        EXPECT_EQ(rec.back().arg[0], TRACE_RING_RECORDS + 99u);
+        EXPECT_EQ(next, first + TRACE_RING_RECORDS + 100);
+
+        // nothing new
+        EXPECT_EQ(read_ring(r, next).size(), 0u);
+    }).join();
+}
+
+TEST( Trace, InvalidRing ) {
+    can_trace_record rec[1];
+    uint64_t next, head;
+    int n;
+
+    EXPECT_EQ(trace_read(-1, 0, rec, 1, &n, &next, &head), EINVAL);
+    EXPECT_EQ(trace_read(TRACE_RINGS, 0, rec, 1, &n, &next, &head), EINVAL);
+}
+
+/* More writers than rings, so some share one, with a reader running along */
+TEST( Trace, Concurrent ) {
+    const int n = 2*TRACE_RINGS;
+    const uint32_t count = 20000;
+    std::atomic<bool> done(false);
+    std::vector<std::thread> threads;
+    uint64_t torn = 0, seen = 0;
+
+    std::thread reader([&] {
+        uint64_t first[TRACE_RINGS] = {};
+        bool last;
+
+        do { // once more after the writers are done
+            last = done.load();
+
+            for (int r = 0; r < TRACE_RINGS; ++r) {
+                for (auto& rec : read_ring(r, first[r], &first[r])) {
+                    if (rec.event == CAN_TRACE_IO_WRITE) {
+                        ++seen;
+                        torn += (rec.arg[1] != rec.arg[0]*3
+                                || rec.arg[2] != ~rec.arg[0]);
+                    }
+                }
+            }
+        } while (!last);
+    });
+
+    for (int i = 0; i < n; ++i) {
+        threads.emplace_back([i, count] {
+            for (uint32_t j = 0; j < count; ++j) {
+                uint32_t v = (uint32_t)i << 20 | j;
+
+                trace(CAN_TRACE_IO_WRITE, v, v*3, ~v);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(torn, 0u);
+    EXPECT_GT(seen, 0u);
+}
+
+#else
+
+TEST( Trace, Disabled ) {
+    can_trace_record rec[1];
+    uint64_t next, head;
+    int n;
+
+    trace(CAN_TRACE_IO_READ, 1, 2);
+
+    EXPECT_EQ(trace_read(0, 0, rec, 1, &n, &next, &head), ENOSYS);
+}
+
+#endif
@@ -0,0 +1,259 @@
+/**
+ * \file    vbus-tests.cpp
+ * \brief   Timed virtual bus test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+extern "C" {
+    #include <vbus.h>
+}
+
+// What one device attached to the bus saw
+struct device {
+    std::mutex mutex;
+    std::vector<uint32_t> rx;       // ids received, own frames included
+    std::vector<vbus_event_t> events;
+    unsigned tec = 0, rec = 0;
+    vbus_node_t* node = nullptr;
+};
+
+static void deliver (void* arg, const frame_t* frame, uint64_t tstamp) {
+    device* dev = (device*)arg;
+    std::lock_guard<std::mutex> lock(dev->mutex);
+
+    dev->rx.push_back(frame->id);
+}
+
+static void event (void* arg, vbus_event_t event,
+        unsigned tec, unsigned rec)
+{
+    device* dev = (device*)arg;
+    std::lock_guard<std::mutex> lock(dev->mutex);
+
+    dev->events.push_back(event);
+    dev->tec = tec;
+    dev->rec = rec;
+}
+
+static frame_t make_frame (uint32_t id, uint8_t len = 8) {
+    frame_t frame = {};
+
+    frame.id = id;
+    frame.len = len;
+
+    return frame;
+}
+
+static int64_t elapsed_ns (std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - since).count();
+}
+
+class VBus : public ::testing::Test {
+protected:
+    device dev[4];
+
+    void TearDown() override {
+        vbus_cleanup();
+    }
+
+    void attach (int n, uint32_t bitrate = 500000) {
+        for (int i = 0; i < n; ++i) {
+            dev[i].node = vbus_attach(i, bitrate, deliver, event, &dev[i]);
+
+            ASSERT_NE(dev[i].node, nullptr);
+        }
+    }
+};
+
+TEST_F( VBus, Options ) {
+    EXPECT_EQ(vbus_option("ids=0:1,bitrate=125k,stuff=none,errors=10"), EOK);
+    EXPECT_EQ(num_vbus, 1);
+    EXPECT_EQ(vbus[0].num_ids, 2);
+    EXPECT_EQ(vbus[0].bitrate, 125000u);
+    EXPECT_FALSE(vbus[0].stuffing);
+    EXPECT_EQ(vbus[0].error_ppm, 10u);
+
+    EXPECT_EQ(vbus_option("ids=2,bitrate=1M"), EOK);
+    EXPECT_EQ(vbus[1].bitrate, 1000000u);
+    EXPECT_TRUE(vbus[1].stuffing);
+
+    EXPECT_EQ(vbus_option("bitrate=500k"), EINVAL);     // no ids
+    EXPECT_EQ(vbus_option("ids=1:3"), EINVAL);          // 1 already on a bus
+    EXPECT_EQ(vbus_option("ids=3,bitrate=2M"), EINVAL);
+    EXPECT_EQ(vbus_option("ids=3,stuff=best"), EINVAL);
+    EXPECT_EQ(vbus_option("ids=3,errors=2000000"), EINVAL);
+    EXPECT_EQ(vbus_option("ids=3,speed=1"), EINVAL);
+    EXPECT_EQ(vbus_option("ids=a"), EINVAL);
+    EXPECT_EQ(num_vbus, 2);
+
+    // devices not on a bus keep the plain vcan loop-back
+    EXPECT_EQ(vbus_attach(3, 500000, deliver, event, &dev[3]), nullptr);
+}
+
+TEST_F( VBus, FrameTime ) {
+    frame_t sff = make_frame(0x123);
+    frame_t eff = make_frame(0x123 | FRAME_EFF);
+
+    // can_frame_bits() with intermission; 111 bits unstuffed, 135 worst case
+    EXPECT_EQ(vbus_frame_ns(&sff, 500000, false), 111u * 2000);
+    EXPECT_EQ(vbus_frame_ns(&sff, 500000, true), 135u * 2000);
+    EXPECT_GT(vbus_frame_ns(&eff, 500000, true),
+            vbus_frame_ns(&sff, 500000, true));
+
+    frame_t empty = make_frame(0x123, 0);
+    EXPECT_LT(vbus_frame_ns(&empty, 500000, true),
+            vbus_frame_ns(&sff, 500000, true));
+}
+
+TEST_F( VBus, Delivery ) {
+    ASSERT_EQ(vbus_option("ids=0:1:2"), EOK);
+    attach(3);
+
+    frame_t frame = make_frame(0x42);
+    EXPECT_EQ(vbus_xmit(dev[1].node, &frame), EOK);
+
+    // every device receives it, the sender as its echo, before xmit returns
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(dev[i].rx.size(), 1u);
+        EXPECT_EQ(dev[i].rx[0], (i == 1) ? (0x42u | FRAME_ECHO) : 0x42u);
+    }
+
+    EXPECT_EQ(dev[1].node->tx_frames, 1u);
+    EXPECT_EQ(vbus[0].frames, 1u);
+}
+
+TEST_F( VBus, Pacing ) {
+    ASSERT_EQ(vbus_option("ids=0:1,bitrate=100k"), EOK);
+    attach(2);
+
+    const int n = 20;
+    frame_t frame = make_frame(0x100);
+    uint64_t frame_ns = vbus_frame_ns(&frame, 100000, true);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < n; ++i) {
+        EXPECT_EQ(vbus_xmit(dev[0].node, &frame), EOK);
+    }
+
+    EXPECT_GE(elapsed_ns(start), (int64_t)(n * frame_ns));
+    EXPECT_EQ(dev[1].rx.size(), (size_t)n);
+    EXPECT_EQ(vbus[0].bits, n * (frame_ns * 100000 / 1000000000));
+}
+
+TEST_F( VBus, Arbitration ) {
+    ASSERT_EQ(vbus_option("ids=0:1:2:3,bitrate=10k"), EOK);
+    attach(4);
+
+    // keep the bus busy with a first frame while the others queue up behind
+    // it; they then go out in id order, standard before extended
+    frame_t busy = make_frame(0x7FF);
+    frame_t frames[] = {
+        make_frame(0x300),
+        make_frame((0x100 << 18) | FRAME_EFF),
+        make_frame(0x100)
+    };
+
+    std::thread first([&] { vbus_xmit(dev[0].node, &busy); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(3));
+
+    std::vector<std::thread> senders;
+    for (int i = 0; i < 3; ++i) {
+        senders.emplace_back([&, i] { vbus_xmit(dev[i + 1].node, &frames[i]); });
+    }
+
+    first.join();
+    for (auto& t : senders) {
+        t.join();
+    }
+
+    std::vector<uint32_t> expect = {
+        0x7FF | FRAME_ECHO, 0x100, (0x100 << 18) | FRAME_EFF, 0x300
+    };
+
+    EXPECT_EQ(dev[0].rx, expect);
+    EXPECT_EQ(dev[3].node->arbitration_lost, 0u);
+    EXPECT_EQ(dev[2].node->arbitration_lost, 1u);
+    EXPECT_EQ(dev[1].node->arbitration_lost, 2u);
+}
+
+TEST_F( VBus, ErrorFrames ) {
+    ASSERT_EQ(vbus_option("ids=0:1,bitrate=1M,errors=1000000"), EOK);
+    attach(2);
+
+    // every attempt fails; the sender counts up to bus-off and drops the frame
+    frame_t frame = make_frame(0x55);
+    EXPECT_EQ(vbus_xmit(dev[0].node, &frame), EOK);
+
+    EXPECT_TRUE(dev[1].rx.empty());
+    EXPECT_EQ(dev[0].node->error_frames, 32u);
+    EXPECT_EQ(dev[0].node->bus_offs, 1u);
+    EXPECT_EQ(vbus[0].error_frames, 32u);
+
+    {
+        std::lock_guard<std::mutex> lock(dev[1].mutex);
+        EXPECT_EQ(dev[1].rec, 32u);
+        EXPECT_EQ(dev[1].events.back(), VBUS_EVENT_RX_ERROR);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(dev[0].mutex);
+        EXPECT_EQ(dev[0].events.back(), VBUS_EVENT_BUS_OFF);
+    }
+
+    // recovery after 128 x 11 bit times
+    for (int i = 0; i < 100; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        std::lock_guard<std::mutex> lock(dev[0].mutex);
+        if (dev[0].events.back() == VBUS_EVENT_BUS_ON) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(dev[0].mutex);
+    EXPECT_EQ(dev[0].events.back(), VBUS_EVENT_BUS_ON);
+    EXPECT_EQ(dev[0].tec, 0u);
+}
+
+TEST_F( VBus, BusOff ) {
+    ASSERT_EQ(vbus_option("ids=0:1,bitrate=1M,busoff=1000000"), EOK);
+    attach(2);
+
+    frame_t frame = make_frame(0x55);
+    auto start = std::chrono::steady_clock::now();
+
+    EXPECT_EQ(vbus_xmit(dev[0].node, &frame), EOK);
+    EXPECT_EQ(dev[0].node->bus_offs, 1u);
+    EXPECT_TRUE(dev[1].rx.empty());
+
+    // the next frame waits out the recovery, then goes bus-off again
+    EXPECT_EQ(vbus_xmit(dev[0].node, &frame), EOK);
+    EXPECT_GE(elapsed_ns(start), 128 * 11 * 1000);
+    EXPECT_EQ(dev[0].node->bus_offs, 2u);
+    EXPECT_EQ(vbus[0].bus_offs, 2u);
+}
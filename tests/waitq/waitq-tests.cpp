@@ -0,0 +1,195 @@
+/**
+ * \file    waitq-tests.cpp
+ * \brief   Blocked client wait queue test definition file
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <gtest/gtest.h>
+
+
+extern "C" {
+    #include <waitq.h>
+}
+
+TEST( WaitQueue, Empty ) {
+    waitq_t waitq;
+    waitq_init(&waitq);
+
+    EXPECT_TRUE(waitq_empty(&waitq));
+    EXPECT_EQ(waitq.count, 0);
+    EXPECT_EQ(waitq_first(&waitq), -1);
+    EXPECT_FALSE(waitq_contains(&waitq, 1234));
+    EXPECT_EQ(waitq_remove(&waitq, 1234), ENOENT);
+
+    waitq_rotate(&waitq); // must be harmless
+
+    EXPECT_TRUE(waitq_empty(&waitq));
+}
+
+TEST( WaitQueue, FifoOrder ) {
+    waitq_t waitq;
+    waitq_init(&waitq);
+
+    EXPECT_EQ(waitq_insert(&waitq, 30), EOK);
+    EXPECT_EQ(waitq_insert(&waitq, 10), EOK);
+    EXPECT_EQ(waitq_insert(&waitq, 20), EOK);
+    EXPECT_EQ(waitq.count, 3);
+
+    EXPECT_EQ(waitq_first(&waitq), 30);
+    EXPECT_EQ(waitq_remove(&waitq, 30), EOK);
+    EXPECT_EQ(waitq_first(&waitq), 10);
+    EXPECT_EQ(waitq_remove(&waitq, 10), EOK);
+    EXPECT_EQ(waitq_first(&waitq), 20);
+    EXPECT_EQ(waitq_remove(&waitq, 20), EOK);
+
+    EXPECT_TRUE(waitq_empty(&waitq));
+    EXPECT_EQ(waitq_first(&waitq), -1);
+}
+
+TEST( WaitQueue, DuplicateInsert ) {
+    waitq_t waitq;
+    waitq_init(&waitq);
+
+    EXPECT_EQ(waitq_insert(&waitq, 7), EOK);
+    EXPECT_EQ(waitq_insert(&waitq, 8), EOK);
+    EXPECT_EQ(waitq_insert(&waitq, 7), EOK); // already queued; keeps position
+
+    EXPECT_EQ(waitq.count, 2);
+    EXPECT_EQ(waitq_first(&waitq), 7);
+
+    EXPECT_EQ(waitq_remove(&waitq, 7), EOK);
+    EXPECT_EQ(waitq_remove(&waitq, 7), ENOENT);
+    EXPECT_EQ(waitq.count, 1);
+}
+
+TEST( WaitQueue, RemoveMiddle ) {
+    waitq_t waitq;
+    waitq_init(&waitq);
+
+    for (int i = 1; i <= 5; ++i) {
+        EXPECT_EQ(waitq_insert(&waitq, i), EOK);
+    }
+
+    EXPECT_EQ(waitq_remove(&waitq, 3), EOK);
+    EXPECT_EQ(waitq_remove(&waitq, 5), EOK); // tail
+
+    EXPECT_FALSE(waitq_contains(&waitq, 3));
+    EXPECT_TRUE(waitq_contains(&waitq, 4));
+
+    EXPECT_EQ(waitq_insert(&waitq, 6), EOK);
+
+    int expected[] = { 1, 2, 4, 6 };
+
+    for (int rcvid : expected) {
+        EXPECT_EQ(waitq_first(&waitq), rcvid);
+        EXPECT_EQ(waitq_remove(&waitq, rcvid), EOK);
+    }
+
+    EXPECT_TRUE(waitq_empty(&waitq));
+}
+
+TEST( WaitQueue, Rotate ) {
+    waitq_t waitq;
+    waitq_init(&waitq);
+
+    EXPECT_EQ(waitq_insert(&waitq, 1), EOK);
+
+    waitq_rotate(&waitq); // single entry stays put
+    EXPECT_EQ(waitq_first(&waitq), 1);
+
+    EXPECT_EQ(waitq_insert(&waitq, 2), EOK);
+    EXPECT_EQ(waitq_insert(&waitq, 3), EOK);
+
+    waitq_rotate(&waitq);
+    EXPECT_EQ(waitq_first(&waitq), 2);
+
+    waitq_rotate(&waitq);
+    EXPECT_EQ(waitq_first(&waitq), 3);
+
+    waitq_rotate(&waitq);
+    EXPECT_EQ(waitq_first(&waitq), 1);
+
+    // Rotated entries must still be found and unlinked correctly
+    EXPECT_EQ(waitq_remove(&waitq, 3), EOK);
+    EXPECT_EQ(waitq_first(&waitq), 1);
+    EXPECT_EQ(waitq_remove(&waitq, 1), EOK);
+    EXPECT_EQ(waitq_first(&waitq), 2);
+    EXPECT_EQ(waitq_remove(&waitq, 2), EOK);
+
+    EXPECT_TRUE(waitq_empty(&waitq));
+}
+
+TEST( WaitQueue, Full ) {
+    waitq_t waitq;
+    waitq_init(&waitq);
+
+    for (int i = 0; i < WAITQ_MAX_CLIENTS; ++i) {
+        EXPECT_EQ(waitq_insert(&waitq, 0x1000 + i), EOK);
+    }
+
+    EXPECT_EQ(waitq.count, WAITQ_MAX_CLIENTS);
+    EXPECT_EQ(waitq_insert(&waitq, 0x2000), EAGAIN);
+    EXPECT_EQ(waitq_insert(&waitq, 0x1000), EOK); // already queued
+
+    EXPECT_EQ(waitq_remove(&waitq, 0x1005), EOK);
+    EXPECT_EQ(waitq_insert(&waitq, 0x2000), EOK);
+    EXPECT_EQ(waitq.count, WAITQ_MAX_CLIENTS);
+
+    for (int i = 0; i < WAITQ_MAX_CLIENTS; ++i) {
+        if (i == 5) {
+            continue;
+        }
+
+        EXPECT_EQ(waitq_first(&waitq), 0x1000 + i);
+        EXPECT_EQ(waitq_remove(&waitq, 0x1000 + i), EOK);
+    }
+
+    EXPECT_EQ(waitq_first(&waitq), 0x2000);
+}
+
+TEST( WaitQueue, TombstoneChurn ) {
+    waitq_t waitq;
+    waitq_init(&waitq);
+
+    // Long running blocked clients stay while many others come and go, which
+    // leaves tombstones behind and forces the table to be rehashed
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_EQ(waitq_insert(&waitq, 100 + i), EOK);
+    }
+
+    for (int round = 0; round < 1000; ++round) {
+        int rcvid = round * 65537;
+
+        EXPECT_EQ(waitq_insert(&waitq, rcvid), EOK);
+        EXPECT_TRUE(waitq_contains(&waitq, rcvid));
+        EXPECT_EQ(waitq_remove(&waitq, rcvid), EOK);
+        EXPECT_FALSE(waitq_contains(&waitq, rcvid));
+
+        EXPECT_LT(waitq.count + waitq.tombstones, WAITQ_BUCKETS);
+    }
+
+    EXPECT_EQ(waitq.count, 8);
+
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_TRUE(waitq_contains(&waitq, 100 + i));
+        EXPECT_EQ(waitq_first(&waitq), 100 + i);
+        EXPECT_EQ(waitq_remove(&waitq, 100 + i), EOK);
+    }
+
+    EXPECT_TRUE(waitq_empty(&waitq));
+}
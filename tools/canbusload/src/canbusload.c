@@ -0,0 +1,265 @@
+/*
+ * \file    canbusload.c
+ * \brief   This program shows the bus load and the per CAN id frame rates of
+ *          dev-can-linux driver devices.
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <signal.h>
+
+#include <prints.h>
+#include <dev-can-linux/commands.h>
+
+
+#define MAX_IDS     4096
+
+static int fd = -1;
+
+static struct can_busload_ids page;
+static typeof(page.ids[0]) ids[MAX_IDS];
+
+static void sigint_signal_handler (int sig_no) {
+    close(fd);
+
+    exit(0);
+}
+
+void help (char* program_name) {
+    print_notice();
+
+    printf("\n");
+    printf("\e[1mSYNOPSIS\e[m\n");
+    printf("    \e[1m%s\e[m [options]\n", program_name);
+    printf("\n");
+    printf("\e[1mDESCRIPTION\e[m\n");
+    printf("    \e[1mDEV-CAN-LINUX\e[m is a QNX CAN-bus driver project that aims at porting drivers\n");
+    printf("    from the open-source Linux Kernel project to QNX RTOS.\n");
+    printf("\n");
+    printf("    \e[1mCANBUSLOAD\e[m is an accompanying tool used to show the bus load measured\n");
+    printf("    by the driver over the last 100ms, 1s and 10s, and the CAN ids with the\n");
+    printf("    highest frame rates together with their period and jitter.\n");
+    printf("\n");
+    printf("\e[1mOPTIONS\e[m\n");
+    printf("    \e[1m-u #\e[m       - Specify ID number of the device; e.g. /dev/can0/ is -u0\n");
+    printf("    \e[1m-i ms\e[m      - Refresh interval in milliseconds; default 1000.\n");
+    printf("    \e[1m-n ids\e[m     - Number of CAN ids to list, highest rate first; default 10,\n");
+    printf("                 0 lists none.\n");
+    printf("    \e[1m-o\e[m         - Print once and exit.\n");
+    printf("    \e[1m-r\e[m         - Reset the CAN id table after each print.\n");
+    printf("    \e[1m-w\e[m         - Print warranty message and exit.\n");
+    printf("    \e[1m-c\e[m         - Print license details and exit.\n");
+    printf("    \e[1m-?/h\e[m       - Print help menu and exit.\n");
+    printf("\n");
+    printf("\e[1mEXAMPLES\e[m\n");
+    printf("    Show the load of /dev/can0 every second:\n");
+    printf("\n");
+    printf("        \e[1mcanbusload -u0\e[m\n");
+    printf("\n");
+    printf("    List the 20 busiest ids of /dev/can1 once:\n");
+    printf("\n");
+    printf("        \e[1mcanbusload -u1 -n20 -o\e[m\n");
+    printf("\n");
+    printf("\e[1mBUGS\e[m\n");
+    printf("    If you find a bug, please report it.\n");
+}
+
+static int compare_rate (const void* a, const void* b) {
+    const typeof(ids[0])* x = a;
+    const typeof(ids[0])* y = b;
+
+    if (x->rate != y->rate) {
+        return x->rate < y->rate ? 1 : -1;
+    }
+
+    return x->frames < y->frames ? 1 : (x->frames > y->frames ? -1 : 0);
+}
+
+static void print_load (const struct can_busload* load) {
+    int i;
+
+    printf("bitrate: %u bit/s, frames: %llu\n",
+            load->bitrate, (unsigned long long)load->frames);
+
+    for (i = 0; i < CAN_BUSLOAD_WINDOWS; ++i) {
+        uint32_t ms = load->window[i].window_ms;
+
+        printf("  %6ums: %3u.%02u%% %10llu frames/s\n", ms,
+                load->window[i].load / 10000,
+                (load->window[i].load / 100) % 100,
+                (unsigned long long)(load->window[i].frames * 1000 / ms));
+    }
+}
+
+static int print_ids (int max, int reset) {
+    int num_ids = 0, i;
+    int ret;
+
+    page.first = 0;
+
+    do {
+        page.reset = 0;
+
+        if ((ret = get_busload_ids(fd, &page)) != EOK) {
+            return ret;
+        }
+
+        for (i = 0; i < page.count && num_ids < MAX_IDS; ++i) {
+            ids[num_ids++] = page.ids[i];
+        }
+
+        page.first += page.count;
+    } while (page.count == CAN_BUSLOAD_IDS_MAX && num_ids < MAX_IDS);
+
+    if (reset) {
+        page.first = page.num_ids; // copies nothing
+        page.reset = 1;
+
+        if ((ret = get_busload_ids(fd, &page)) != EOK) {
+            return ret;
+        }
+    }
+
+    qsort(ids, num_ids, sizeof(ids[0]), compare_rate);
+
+    printf("  %10s %10s %12s %12s %12s %10s\n",
+            "id", "frames/s", "frames", "period us", "jitter us", "age ms");
+
+    for (i = 0; i < num_ids && i < max; ++i) {
+        char id[16];
+
+        if (ids[i].id & CAN_GW_EFF) {
+            snprintf(id, sizeof(id), "%08X", ids[i].id & ~CAN_GW_EFF);
+        }
+        else {
+            snprintf(id, sizeof(id), "%03X", ids[i].id);
+        }
+
+        printf("  %10s %6u.%03u %12llu %12llu %12llu %10llu\n", id,
+                ids[i].rate / 1000, ids[i].rate % 1000,
+                (unsigned long long)ids[i].frames,
+                (unsigned long long)(ids[i].interval_ns / 1000),
+                (unsigned long long)(ids[i].jitter_ns / 1000),
+                (unsigned long long)(ids[i].age_ns / 1000000));
+    }
+
+    if (page.other_frames) {
+        printf("  %llu frames of ids beyond the driver's table\n",
+                (unsigned long long)page.other_frames);
+    }
+
+    return EOK;
+}
+
+int main (int argc, char* argv[]) {
+    int opt;
+
+    int optu_unit = 0;
+    int opti = 1000;
+    int optn = 10;
+    int opto = 0;
+    int optr = 0;
+
+    while ((opt = getopt(argc, argv, "u:i:n:orwc?h")) != -1) {
+        switch (opt) {
+        case 'u':
+            optu_unit = atoi(optarg);
+            break;
+
+        case 'i':
+            opti = atoi(optarg);
+
+            if (opti <= 0) {
+                printf("invalid interval %s\n", optarg);
+
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'n':
+            optn = atoi(optarg);
+            break;
+
+        case 'o':
+            opto = 1;
+            break;
+
+        case 'r':
+            optr = 1;
+            break;
+
+        case 'w':
+            print_warranty();
+            return EXIT_SUCCESS;
+
+        case 'c':
+            print_license();
+            return EXIT_SUCCESS;
+
+        case '?':
+        case 'h':
+            help(argv[0]);
+            return EXIT_SUCCESS;
+
+        default:
+            printf("invalid option %c\n", opt);
+            break;
+        }
+    }
+
+    signal(SIGINT, sigint_signal_handler);
+
+    int     ret = EOK;
+
+    char OPEN_FILE[32];
+
+    /* TX channels serve devctls without a client session of their own */
+    snprintf(OPEN_FILE, sizeof(OPEN_FILE), "/dev/can%d/tx0", optu_unit);
+
+    if ((fd = open(OPEN_FILE, O_RDWR)) == -1) {
+        printf("canbusload error: %s\n", strerror(errno));
+
+        exit(EXIT_FAILURE);
+    }
+
+    while (ret == EOK) {
+        struct can_busload load;
+
+        if ((ret = get_busload(fd, &load)) != EOK) {
+            break;
+        }
+
+        printf("/dev/can%d ", optu_unit);
+        print_load(&load);
+
+        if (optn > 0 && (ret = print_ids(optn, optr)) != EOK) {
+            break;
+        }
+
+        fflush(stdout);
+
+        if (opto) {
+            break;
+        }
+
+        usleep(opti*1000);
+        printf("\n");
+    }
+
+    close(fd);
+    return ret == EOK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
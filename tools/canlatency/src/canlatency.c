@@ -0,0 +1,242 @@
+/*
+ * \file    canlatency.c
+ * \brief   This program shows the latency histograms of the frame pipeline
+ *          stages of dev-can-linux driver devices.
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <signal.h>
+
+#include <prints.h>
+#include <dev-can-linux/commands.h>
+
+
+static int fd = -1;
+
+static const char* stage_name[CAN_LATENCY_STAGES] = {
+    [CAN_LATENCY_RX_IRQ]    = "rx irq",
+    [CAN_LATENCY_RX_QUEUE]  = "rx queue",
+    [CAN_LATENCY_RX_WAKE]   = "rx wake",
+    [CAN_LATENCY_RX_REPLY]  = "rx reply",
+    [CAN_LATENCY_TX_QUEUE]  = "tx queue",
+    [CAN_LATENCY_TX_XMIT]   = "tx xmit",
+    [CAN_LATENCY_TX_DONE]   = "tx done"
+};
+
+static void sigint_signal_handler (int sig_no) {
+    close(fd);
+
+    exit(0);
+}
+
+void help (char* program_name) {
+    print_notice();
+
+    printf("\n");
+    printf("\e[1mSYNOPSIS\e[m\n");
+    printf("    \e[1m%s\e[m [options]\n", program_name);
+    printf("\n");
+    printf("\e[1mDESCRIPTION\e[m\n");
+    printf("    \e[1mDEV-CAN-LINUX\e[m is a QNX CAN-bus driver project that aims at porting drivers\n");
+    printf("    from the open-source Linux Kernel project to QNX RTOS.\n");
+    printf("\n");
+    printf("    \e[1mCANLATENCY\e[m is an accompanying tool used to show how long frames spend\n");
+    printf("    in each stage of the driver; from the IRQ to the client reply when\n");
+    printf("    receiving, and from the client write to the TX complete IRQ when\n");
+    printf("    transmitting.\n");
+    printf("\n");
+    printf("\e[1mOPTIONS\e[m\n");
+    printf("    \e[1m-u #\e[m       - Specify ID number of the device; e.g. /dev/can0/ is -u0\n");
+    printf("    \e[1m-i ms\e[m      - Refresh interval in milliseconds; default 1000.\n");
+    printf("    \e[1m-H\e[m         - Print the histogram buckets of each stage.\n");
+    printf("    \e[1m-o\e[m         - Print once and exit.\n");
+    printf("    \e[1m-r\e[m         - Reset the histograms after each print, i.e. show each\n");
+    printf("                 interval on its own.\n");
+    printf("    \e[1m-w\e[m         - Print warranty message and exit.\n");
+    printf("    \e[1m-c\e[m         - Print license details and exit.\n");
+    printf("    \e[1m-?/h\e[m       - Print help menu and exit.\n");
+    printf("\n");
+    printf("\e[1mEXAMPLES\e[m\n");
+    printf("    Show the stage latencies of /dev/can0 every second:\n");
+    printf("\n");
+    printf("        \e[1mcanlatency -u0 -r\e[m\n");
+    printf("\n");
+    printf("    Print the histograms of /dev/can1 since driver start once:\n");
+    printf("\n");
+    printf("        \e[1mcanlatency -u1 -H -o\e[m\n");
+    printf("\n");
+    printf("\e[1mBUGS\e[m\n");
+    printf("    If you find a bug, please report it.\n");
+}
+
+/* Upper bound (ns) of the bucket holding the given fraction of samples */
+static uint64_t percentile (const uint64_t* count, uint64_t samples,
+        double fraction)
+{
+    uint64_t want = (uint64_t)(samples*fraction);
+    uint64_t seen = 0;
+    int b;
+
+    for (b = 0; b < CAN_LATENCY_BUCKETS; ++b) {
+        seen += count[b];
+
+        if (seen > want) {
+            break;
+        }
+    }
+
+    return 2ULL << b;
+}
+
+static void print_latency (const struct can_latency* latency, int buckets) {
+    int s, b;
+
+    printf("  %-9s %12s %10s %10s %10s %10s\n",
+            "stage", "samples", "mean us", "p50 <us", "p99 <us", "max us");
+
+    for (s = 0; s < CAN_LATENCY_STAGES; ++s) {
+        const uint64_t* count = latency->stage[s].count;
+        uint64_t samples = 0;
+
+        for (b = 0; b < CAN_LATENCY_BUCKETS; ++b) {
+            samples += count[b];
+        }
+
+        if (samples == 0) {
+            printf("  %-9s %12d\n", stage_name[s], 0);
+
+            continue;
+        }
+
+        printf("  %-9s %12llu %10.1f %10.1f %10.1f %10.1f\n", stage_name[s],
+                (unsigned long long)samples,
+                latency->stage[s].sum_ns / 1000.0 / samples,
+                percentile(count, samples, 0.5) / 1000.0,
+                percentile(count, samples, 0.99) / 1000.0,
+                latency->stage[s].max_ns / 1000.0);
+
+        if (!buckets) {
+            continue;
+        }
+
+        for (b = 0; b < CAN_LATENCY_BUCKETS; ++b) {
+            if (count[b]) {
+                printf("  %9s %12llu < %.3f us\n", "",
+                        (unsigned long long)count[b],
+                        (2ULL << b) / 1000.0);
+            }
+        }
+    }
+}
+
+int main (int argc, char* argv[]) {
+    int opt;
+
+    int optu_unit = 0;
+    int opti = 1000;
+    int optH = 0;
+    int opto = 0;
+    int optr = 0;
+
+    while ((opt = getopt(argc, argv, "u:i:Horwc?h")) != -1) {
+        switch (opt) {
+        case 'u':
+            optu_unit = atoi(optarg);
+            break;
+
+        case 'i':
+            opti = atoi(optarg);
+
+            if (opti <= 0) {
+                printf("invalid interval %s\n", optarg);
+
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'H':
+            optH = 1;
+            break;
+
+        case 'o':
+            opto = 1;
+            break;
+
+        case 'r':
+            optr = 1;
+            break;
+
+        case 'w':
+            print_warranty();
+            return EXIT_SUCCESS;
+
+        case 'c':
+            print_license();
+            return EXIT_SUCCESS;
+
+        case '?':
+        case 'h':
+            help(argv[0]);
+            return EXIT_SUCCESS;
+
+        default:
+            printf("invalid option %c\n", opt);
+            break;
+        }
+    }
+
+    signal(SIGINT, sigint_signal_handler);
+
+    int     ret = EOK;
+
+    char OPEN_FILE[32];
+
+    /* a TX channel queues no received frames, so none pile up unread */
+    snprintf(OPEN_FILE, sizeof(OPEN_FILE), "/dev/can%d/tx0", optu_unit);
+
+    if ((fd = open(OPEN_FILE, O_RDWR)) == -1) {
+        printf("canlatency error: %s\n", strerror(errno));
+
+        exit(EXIT_FAILURE);
+    }
+
+    while (ret == EOK) {
+        struct can_latency latency = {
+            .scope = CAN_LATENCY_DEVICE,
+            .reset = optr
+        };
+
+        if ((ret = get_latency(fd, &latency)) != EOK) {
+            break;
+        }
+
+        printf("/dev/can%d\n", optu_unit);
+        print_latency(&latency, optH);
+        fflush(stdout);
+
+        if (opto) {
+            break;
+        }
+
+        usleep(opti*1000);
+        printf("\n");
+    }
+
+    close(fd);
+    return ret == EOK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,403 @@
+/*
+ * \file    cantrace.c
+ * \brief   This program reads the trace records of the dev-can-linux driver
+ *          and formats them, live or offline from a record file.
+ *
+ * Copyright (C) 2022 Deniz Eren <deniz.eren@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <signal.h>
+
+#include <prints.h>
+#include <dev-can-linux/commands.h>
+
+
+#define MAX_RINGS   256
+
+static int fd = -1;
+
+static struct can_trace page;
+static uint64_t next[MAX_RINGS];
+
+static struct can_trace_record* records = NULL;
+static size_t num_records = 0;
+static size_t max_records = 0;
+static uint64_t lost = 0;
+
+#define CAN_TRACE_EVENT_INFO(event, kind, name, format) \
+    [event] = { kind, name, format },
+
+static const struct {
+    int kind;
+    const char* name;
+    const char* format;
+} events[CAN_TRACE_NUM_EVENTS] = {
+    CAN_TRACE_EVENTS(CAN_TRACE_EVENT_INFO)
+};
+
+static void sigint_signal_handler (int sig_no) {
+    close(fd);
+
+    exit(0);
+}
+
+void help (char* program_name) {
+    print_notice();
+
+    printf("\n");
+    printf("\e[1mSYNOPSIS\e[m\n");
+    printf("    \e[1m%s\e[m [options]\n", program_name);
+    printf("\n");
+    printf("\e[1mDESCRIPTION\e[m\n");
+    printf("    \e[1mDEV-CAN-LINUX\e[m is a QNX CAN-bus driver project that aims at porting drivers\n");
+    printf("    from the open-source Linux Kernel project to QNX RTOS.\n");
+    printf("\n");
+    printf("    \e[1mCANTRACE\e[m is an accompanying tool used to read the binary records of\n");
+    printf("    the driver's trace points and print them in time order, or to save\n");
+    printf("    them to a record file to be printed later.\n");
+    printf("\n");
+    printf("\e[1mOPTIONS\e[m\n");
+    printf("    \e[1m-u #\e[m       - Specify ID number of a device to read through; the\n");
+    printf("                 records of all devices are returned. Default 0.\n");
+    printf("    \e[1m-F\e[m         - Follow; keep printing new records.\n");
+    printf("    \e[1m-i ms\e[m      - Follow interval in milliseconds; default 100.\n");
+    printf("    \e[1m-f file\e[m    - Save the records to a record file instead of\n");
+    printf("                 printing them.\n");
+    printf("    \e[1m-d file\e[m    - Print the records of a record file and exit.\n");
+    printf("    \e[1m-w\e[m         - Print warranty message and exit.\n");
+    printf("    \e[1m-c\e[m         - Print license details and exit.\n");
+    printf("    \e[1m-?/h\e[m       - Print help menu and exit.\n");
+    printf("\n");
+    printf("\e[1mEXAMPLES\e[m\n");
+    printf("    Print the records currently held by the driver:\n");
+    printf("\n");
+    printf("        \e[1mcantrace\e[m\n");
+    printf("\n");
+    printf("    Save them and print them later, e.g. on another machine:\n");
+    printf("\n");
+    printf("        \e[1mcantrace -f trace.bin\e[m\n");
+    printf("        \e[1mcantrace -d trace.bin\e[m\n");
+    printf("\n");
+    printf("\e[1mBUGS\e[m\n");
+    printf("    If you find a bug, please report it.\n");
+}
+
+static int compare_time (const void* a, const void* b) {
+    const struct can_trace_record* x = a;
+    const struct can_trace_record* y = b;
+
+    if (x->tstamp != y->tstamp) {
+        return x->tstamp < y->tstamp ? -1 : 1;
+    }
+
+    return x->seq < y->seq ? -1 : (x->seq > y->seq ? 1 : 0);
+}
+
+static int add_records (const struct can_trace_record* recs, size_t n) {
+    if (num_records + n > max_records) {
+        size_t max = max_records ? 2*max_records : 4096;
+
+        while (max < num_records + n) {
+            max *= 2;
+        }
+
+        struct can_trace_record* r =
+            realloc(records, max*sizeof(struct can_trace_record));
+
+        if (r == NULL) {
+            return ENOMEM;
+        }
+
+        records = r;
+        max_records = max;
+    }
+
+    memcpy(&records[num_records], recs, n*sizeof(struct can_trace_record));
+    num_records += n;
+
+    return EOK;
+}
+
+/* Read the records of all rings written since the previous call */
+static int read_records (void) {
+    uint32_t num_rings = 1;
+    uint32_t r;
+    int ret;
+
+    for (r = 0; r < num_rings && r < MAX_RINGS; ++r) {
+        do {
+            page.ring = r;
+            page.first = next[r];
+
+            if ((ret = get_trace(fd, &page)) != EOK) {
+                return ret;
+            }
+
+            if ((ret = add_records(page.records, page.count)) != EOK) {
+                return ret;
+            }
+
+            num_rings = page.num_rings;
+            next[r] = page.next;
+            lost += page.lost;
+        } while (page.count == CAN_TRACE_RECORDS_MAX);
+    }
+
+    qsort(records, num_records, sizeof(records[0]), compare_time);
+
+    return EOK;
+}
+
+static uint8_t record_byte (const struct can_trace_record* rec, int i) {
+    uint32_t word = (i < 4) ? rec->arg[2] : rec->arg[3];
+
+    return (uint8_t)(word >> (24 - 8*(i % 4)));
+}
+
+static void print_record (const struct can_trace_record* rec) {
+    printf("%llu.%09llu %5u ",
+            (unsigned long long)(rec->tstamp / 1000000000),
+            (unsigned long long)(rec->tstamp % 1000000000),
+            rec->thread);
+
+    if (rec->event >= CAN_TRACE_NUM_EVENTS) {
+        printf("%-10s %u: %08X %08X %08X %08X\n", "unknown", rec->event,
+                rec->arg[0], rec->arg[1], rec->arg[2], rec->arg[3]);
+
+        return;
+    }
+
+    printf("%-10s ", events[rec->event].name);
+
+    if (events[rec->event].kind == CAN_TRACE_KIND_FRAME) {
+        uint32_t len = CAN_TRACE_LEN(rec->arg[0]);
+        int i;
+
+        printf("can%u %s %X [%u]", CAN_TRACE_UNIT(rec->arg[0]),
+                events[rec->event].format, rec->arg[1], len);
+
+        for (i = 0; i < len && i < 8; ++i) {
+            printf(" %02X", record_byte(rec, i));
+        }
+    }
+    else {
+        printf(events[rec->event].format,
+                rec->arg[0], rec->arg[1], rec->arg[2], rec->arg[3]);
+    }
+
+    printf("\n");
+}
+
+static void print_records (void) {
+    size_t i;
+
+    for (i = 0; i < num_records; ++i) {
+        print_record(&records[i]);
+    }
+
+    if (lost) {
+        printf("%llu records overwritten before they were read\n",
+                (unsigned long long)lost);
+    }
+
+    num_records = 0;
+    lost = 0;
+}
+
+static int save_records (const char* path) {
+    struct can_trace_file header = {
+        .magic = CAN_TRACE_FILE_MAGIC,
+        .version = CAN_TRACE_FILE_VERSION,
+        .record_size = sizeof(struct can_trace_record),
+        .count = num_records
+    };
+
+    FILE* file = fopen(path, "wb");
+
+    if (file == NULL) {
+        printf("cantrace error: %s: %s\n", path, strerror(errno));
+
+        return errno;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(records, sizeof(records[0]), num_records, file) != num_records)
+    {
+        printf("cantrace error: %s: %s\n", path, strerror(errno));
+        fclose(file);
+
+        return EIO;
+    }
+
+    fclose(file);
+
+    printf("%zu records saved to %s\n", num_records, path);
+
+    return EOK;
+}
+
+static int load_records (const char* path) {
+    struct can_trace_file header;
+    struct can_trace_record rec;
+    uint32_t i;
+    int ret = EOK;
+
+    FILE* file = fopen(path, "rb");
+
+    if (file == NULL) {
+        printf("cantrace error: %s: %s\n", path, strerror(errno));
+
+        return errno;
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1
+            || header.magic != CAN_TRACE_FILE_MAGIC
+            || header.version != CAN_TRACE_FILE_VERSION
+            || header.record_size != sizeof(struct can_trace_record))
+    {
+        printf("cantrace error: %s: not a record file\n", path);
+        fclose(file);
+
+        return EINVAL;
+    }
+
+    for (i = 0; i < header.count && ret == EOK; ++i) {
+        if (fread(&rec, sizeof(rec), 1, file) != 1) {
+            printf("cantrace error: %s: truncated at record %u\n", path, i);
+
+            ret = EIO;
+            break;
+        }
+
+        ret = add_records(&rec, 1);
+    }
+
+    fclose(file);
+
+    return ret;
+}
+
+int main (int argc, char* argv[]) {
+    int opt;
+
+    int optu_unit = 0;
+    int optF = 0;
+    int opti = 100;
+    char* optf = NULL;
+    char* optd = NULL;
+
+    while ((opt = getopt(argc, argv, "u:Fi:f:d:wc?h")) != -1) {
+        switch (opt) {
+        case 'u':
+            optu_unit = atoi(optarg);
+            break;
+
+        case 'F':
+            optF = 1;
+            break;
+
+        case 'i':
+            opti = atoi(optarg);
+
+            if (opti <= 0) {
+                printf("invalid interval %s\n", optarg);
+
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'f':
+            optf = optarg;
+            break;
+
+        case 'd':
+            optd = optarg;
+            break;
+
+        case 'w':
+            print_warranty();
+            return EXIT_SUCCESS;
+
+        case 'c':
+            print_license();
+            return EXIT_SUCCESS;
+
+        case '?':
+        case 'h':
+            help(argv[0]);
+            return EXIT_SUCCESS;
+
+        default:
+            printf("invalid option %c\n", opt);
+            break;
+        }
+    }
+
+    if (optF && optf != NULL) {
+        printf("cantrace error: -f saves a single read; it cannot follow\n");
+
+        exit(EXIT_FAILURE);
+    }
+
+    if (optd != NULL) {
+        if (load_records(optd) != EOK) {
+            exit(EXIT_FAILURE);
+        }
+
+        print_records();
+
+        return EXIT_SUCCESS;
+    }
+
+    signal(SIGINT, sigint_signal_handler);
+
+    int     ret = EOK;
+
+    char OPEN_FILE[32];
+
+    /* a TX channel queues no received frames, so none pile up unread */
+    snprintf(OPEN_FILE, sizeof(OPEN_FILE), "/dev/can%d/tx0", optu_unit);
+
+    if ((fd = open(OPEN_FILE, O_RDWR)) == -1) {
+        printf("cantrace error: %s\n", strerror(errno));
+
+        exit(EXIT_FAILURE);
+    }
+
+    while ((ret = read_records()) == EOK) {
+        if (optf != NULL) {
+            ret = save_records(optf);
+            break;
+        }
+
+        print_records();
+        fflush(stdout);
+
+        if (!optF) {
+            break;
+        }
+
+        usleep(opti*1000);
+    }
+
+    if (ret == ENOSYS) {
+        printf("cantrace error: driver built without trace points\n");
+    }
+
+    close(fd);
+    return ret == EOK ? EXIT_SUCCESS : EXIT_FAILURE;
+}